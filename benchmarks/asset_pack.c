@@ -0,0 +1,238 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Startup cost of loading many small assets, from loose files and from
+ * an asset pack (see src/helpers/asset_pack.h).
+ *
+ * Usage : asset_pack_bench [n_assets]
+ *
+ * Generates n_assets files (4096 by default) in a temporary directory,
+ * packs them, then maps and reads every one of them through
+ * fh_MapFileToMemory, first from the filesystem, then from the pack.
+ *
+ * System calls performed by the file helpers are counted through the
+ * linker (-Wl,--wrap=...). Page faults are read from getrusage. */
+
+#include <helpers/file.h>
+#include <helpers/asset_pack.h>
+#include <pack/pack_writer.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define N_DIRECTORIES 32
+
+static unsigned long n_syscalls;
+
+int __real_open(char const * pathname, int flags, ...);
+int __wrap_open(char const * pathname, int flags, ...)
+{
+	mode_t mode = 0;
+	if (flags & O_CREAT) {
+		va_list args;
+		va_start(args, flags);
+		mode = va_arg(args, mode_t);
+		va_end(args);
+	}
+	n_syscalls++;
+	return __real_open(pathname, flags, mode);
+}
+
+#define COUNTED(ret, name, params, args) \
+	ret __real_##name params; \
+	ret __wrap_##name params { n_syscalls++; return __real_##name args; }
+
+COUNTED(int, close, (int fd), (fd))
+COUNTED(int, fstat, (int fd, struct stat * stats), (fd, stats))
+COUNTED(ssize_t, read, (int fd, void * buffer, size_t count),
+        (fd, buffer, count))
+COUNTED(off_t, lseek, (int fd, off_t offset, int whence),
+        (fd, offset, whence))
+COUNTED(void *, mmap,
+        (void * address, size_t length, int prot, int flags, int fd,
+         off_t offset),
+        (address, length, prot, flags, fd, offset))
+COUNTED(int, munmap, (void * address, size_t length), (address, length))
+
+struct measure {
+	double seconds;
+	unsigned long syscalls;
+	long minor_faults, major_faults;
+	uint64_t checksum;
+};
+
+static double now_seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void measure_start(struct measure * __restrict const measure)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	measure->minor_faults = -usage.ru_minflt;
+	measure->major_faults = -usage.ru_majflt;
+	measure->syscalls = n_syscalls;
+	measure->checksum = 0;
+	measure->seconds = -now_seconds();
+}
+
+static void measure_stop(struct measure * __restrict const measure)
+{
+	struct rusage usage;
+	measure->seconds += now_seconds();
+	getrusage(RUSAGE_SELF, &usage);
+	measure->minor_faults += usage.ru_minflt;
+	measure->major_faults += usage.ru_majflt;
+	measure->syscalls = n_syscalls - measure->syscalls;
+}
+
+/* Read every asset byte, like an upload would */
+static void load_assets
+(char * const * __restrict const names,
+ unsigned int const n,
+ struct measure * __restrict const measure)
+{
+	for (unsigned int a = 0; a < n; a++) {
+		struct myy_fh_map_handle const handle = fh_MapFileToMemory(names[a]);
+		if (handle.ok) {
+			uint8_t const * __restrict const data = handle.address;
+			for (int b = 0; b < handle.length; b++)
+				measure->checksum += data[b];
+		}
+		fh_UnmapFileFromMemory(handle);
+	}
+}
+
+static void print_measure
+(char const * __restrict const mode,
+ unsigned int const n,
+ struct measure const * __restrict const measure)
+{
+	printf("{\"benchmark\": \"asset_pack\", \"mode\": \"%s\", "
+	       "\"assets\": %u, \"seconds\": %.6f, \"syscalls\": %lu, "
+	       "\"minor_faults\": %ld, \"major_faults\": %ld}\n",
+	       mode, n, measure->seconds, measure->syscalls,
+	       measure->minor_faults, measure->major_faults);
+}
+
+static uint32_t xorshift32(uint32_t * __restrict const state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int const n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4096;
+	char directory[] = "/tmp/myy-asset-pack-XXXXXX";
+	char ** __restrict const names = calloc(n ? n : 1, sizeof(char *));
+	uint8_t * __restrict const content = malloc(16384);
+	uint32_t random_state = 0x4d797921;
+	int ret = 1;
+
+	if (n == 0 || names == NULL || content == NULL ||
+	    mkdtemp(directory) == NULL || chdir(directory) != 0) {
+		fprintf(stderr, "Could not prepare the benchmark\n");
+		return 1;
+	}
+
+	for (unsigned int d = 0; d < N_DIRECTORIES; d++) {
+		char dir_name[32];
+		snprintf(dir_name, sizeof(dir_name), "assets_%02u", d);
+		mkdir(dir_name, 0700);
+	}
+
+	/* Shader and texture sized assets */
+	for (unsigned int a = 0; a < n; a++) {
+		size_t const size = 512 + xorshift32(&random_state) % (16384 - 512);
+		for (size_t b = 0; b < size; b++)
+			content[b] = xorshift32(&random_state);
+
+		names[a] = malloc(48);
+		snprintf(names[a], 48, "assets_%02u/asset_%06u.raw",
+		         a % N_DIRECTORIES, a);
+		FILE * __restrict const file = fopen(names[a], "wb");
+		if (file == NULL || fwrite(content, size, 1, file) != 1) {
+			fprintf(stderr, "Could not write %s/%s\n", directory, names[a]);
+			if (file) fclose(file);
+			goto cleanup;
+		}
+		fclose(file);
+	}
+
+	char const * const * const const_names = (char const * const *) names;
+	if (pw_WriteAssetPack("assets.pack", const_names, const_names, n))
+		goto cleanup;
+
+	struct measure loose, packed;
+
+	measure_start(&loose);
+	load_assets(names, n, &loose);
+	measure_stop(&loose);
+
+	measure_start(&packed);
+	if (fh_OpenAssetPack("assets.pack")) {
+		load_assets(names, n, &packed);
+		fh_CloseAssetPack();
+	}
+	measure_stop(&packed);
+
+	print_measure("loose", n, &loose);
+	print_measure("packed", n, &packed);
+
+	if (loose.checksum != packed.checksum)
+		fprintf(stderr, "The pack contents differ from the files !\n");
+	else ret = 0;
+
+cleanup:
+	for (unsigned int a = 0; a < n; a++) {
+		if (names[a]) unlink(names[a]);
+		free(names[a]);
+	}
+	for (unsigned int d = 0; d < N_DIRECTORIES; d++) {
+		char dir_name[32];
+		snprintf(dir_name, sizeof(dir_name), "assets_%02u", d);
+		rmdir(dir_name);
+	}
+	unlink("assets.pack");
+	if (chdir("/") == 0) rmdir(directory);
+	free(content);
+	free(names);
+	return ret;
+}
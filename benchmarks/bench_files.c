@@ -0,0 +1,156 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* File helpers throughput, on files kept in the page cache.
+ * Cold loads are measured by file_batch_bench. */
+
+#include <helpers/file.h>
+
+#include "harness.h"
+#include "suites.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BIG_FILE_SIZE (1024*1024)
+#define N_SMALL_FILES 64
+#define SMALL_FILE_SIZE (16*1024)
+
+static struct {
+	char directory[256];
+	char big_file[320];
+	char small_files[N_SMALL_FILES][320];
+	struct fh_load_request requests[N_SMALL_FILES];
+	uint8_t * buffer;
+} files;
+
+static int write_file
+(char const * __restrict const pathname,
+ uint8_t const * __restrict const content,
+ size_t const size)
+{
+	int const fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) return -1;
+	ssize_t const written = write(fd, content, size);
+	close(fd);
+	return (written == (ssize_t) size) ? 0 : -1;
+}
+
+static void read_to_buffer(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		bh_Use(fh_ReadFileToBuffer(files.big_file, files.buffer, BIG_FILE_SIZE));
+}
+
+static void whole_file_to_buffer(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		bh_Use(fh_WholeFileToBuffer(files.big_file, files.buffer));
+}
+
+/* Map, then read one byte per page, like an upload would */
+static void map_file(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		struct myy_fh_map_handle const handle =
+			fh_MapFileToMemory(files.big_file);
+		uint64_t sum = 0;
+		if (handle.ok) {
+			uint8_t const * __restrict const bytes = handle.address;
+			for (int b = 0; b < handle.length; b += 4096) sum += bytes[b];
+		}
+		fh_UnmapFileFromMemory(handle);
+		bh_Use(sum);
+	}
+}
+
+static void load_files(void * __restrict data, uint64_t iterations)
+{
+	enum fh_load_method const method = *((enum fh_load_method *) data);
+	for (uint64_t i = 0; i < iterations; i++)
+		bh_Use(fh_LoadFiles(files.requests, N_SMALL_FILES, NULL, method));
+}
+
+void bench_Files()
+{
+	static struct { char const * name; enum fh_load_method method; }
+	const methods[] = {
+		{ "files/fh_LoadFiles_64x16KiB/io_uring", FH_LOAD_IO_URING },
+		{ "files/fh_LoadFiles_64x16KiB/threads",  FH_LOAD_THREADS },
+		{ "files/fh_LoadFiles_64x16KiB/serial",   FH_LOAD_SERIAL }
+	};
+
+	if (!bh_Selected("files/")) return;
+
+	char const * __restrict const tmp = getenv("TMPDIR");
+	snprintf(files.directory, sizeof(files.directory),
+	         "%s/myy-bench-files-XXXXXX", tmp ? tmp : "/tmp");
+	files.buffer = malloc(BIG_FILE_SIZE + N_SMALL_FILES * SMALL_FILE_SIZE);
+	if (files.buffer == NULL || mkdtemp(files.directory) == NULL) {
+		fprintf(stderr, "Could not prepare the files benchmarks\n");
+		free(files.buffer);
+		return;
+	}
+
+	for (size_t b = 0; b < BIG_FILE_SIZE; b++) files.buffer[b] = b * 31 + 7;
+
+	snprintf(files.big_file, sizeof(files.big_file), "%s/big.raw",
+	         files.directory);
+	int ret = write_file(files.big_file, files.buffer, BIG_FILE_SIZE);
+
+	uint8_t * __restrict small_buffer = files.buffer + BIG_FILE_SIZE;
+	for (unsigned int f = 0; f < N_SMALL_FILES && ret == 0; f++) {
+		snprintf(files.small_files[f], sizeof(files.small_files[f]),
+		         "%s/small_%02u.raw", files.directory, f);
+		ret = write_file(files.small_files[f], files.buffer, SMALL_FILE_SIZE);
+		files.requests[f].pathname    = files.small_files[f];
+		files.requests[f].buffer      = small_buffer;
+		files.requests[f].buffer_size = SMALL_FILE_SIZE;
+		small_buffer += SMALL_FILE_SIZE;
+	}
+
+	if (ret == 0) {
+		bh_Measure("files/fh_ReadFileToBuffer_1MiB",
+		           read_to_buffer, NULL, BIG_FILE_SIZE);
+		bh_Measure("files/fh_WholeFileToBuffer_1MiB",
+		           whole_file_to_buffer, NULL, BIG_FILE_SIZE);
+		bh_Measure("files/fh_MapFileToMemory_1MiB",
+		           map_file, NULL, BIG_FILE_SIZE);
+		for (unsigned int m = 0; m < sizeof(methods)/sizeof(methods[0]); m++) {
+			enum fh_load_method method = methods[m].method;
+			bh_Measure(methods[m].name, load_files, &method,
+			           N_SMALL_FILES * SMALL_FILE_SIZE);
+		}
+	}
+	else fprintf(stderr, "Could not write the files benchmarks files\n");
+
+	for (unsigned int f = 0; f < N_SMALL_FILES; f++)
+		if (files.small_files[f][0]) unlink(files.small_files[f]);
+	unlink(files.big_file);
+	rmdir(files.directory);
+	free(files.buffer);
+}
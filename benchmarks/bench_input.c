@@ -0,0 +1,324 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Input events dispatch, from parse_event to the cursor position.
+ * evdev.c is included to reach its static dispatch functions. */
+
+#include <evdev.c>
+
+#include "harness.h"
+#include "suites.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define N_EVENTS 4096
+/* REL_X, REL_Y and SYN_REPORT per report */
+#define N_TRACE_REPORTS 4096
+#define N_TRACE_EVENTS (N_TRACE_REPORTS * 3)
+/* 8 kHz polling */
+#define TRACE_INTERVAL_US 125
+
+/* Touch reports : 12 contacts moving, each with a slot, X and Y */
+#define N_TOUCH_CONTACTS 12
+#define N_TOUCH_REPORTS 1024
+#define N_TOUCH_EVENTS (N_TOUCH_REPORTS * (N_TOUCH_CONTACTS * 3 + 1))
+
+/* Motions handed to the application at once, as read by a 8 kHz mouse
+   during a 60 Hz frame */
+#define N_BATCH_EVENTS 128
+
+/* Pointers of the remote users, each moved once per frame, on two
+   outputs side by side */
+#define N_POINTERS 4096
+
+static struct input_event events[N_EVENTS];
+static struct input_event mixed_events[N_EVENTS];
+static int deltas[N_EVENTS][2];
+static struct input_event trace[N_TRACE_EVENTS];
+static struct input_event touch_trace[N_TOUCH_EVENTS];
+static struct myy_input_event batch_events[N_BATCH_EVENTS];
+static struct myy_input_batch const motions_batch = {
+	.n_events = N_BATCH_EVENTS,
+	.events   = batch_events
+};
+
+static struct ph_pointers remote_pointers;
+static _Alignas(32) int32_t remote_dx[N_POINTERS], remote_dy[N_POINTERS];
+
+static struct myy_evdev_data mouse = { .type = MYY_INPUT_MOUSE };
+static struct myy_evdev_data touchscreen = { .type = MYY_INPUT_TOUCHSCREEN };
+
+static uint32_t xorshift32(uint32_t * __restrict const state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void dispatch_events(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		parse_event(events + (i & (N_EVENTS - 1)), &mouse);
+}
+
+static void dispatch_mixed_events(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++)
+		parse_event(mixed_events + (i & (N_EVENTS - 1)), &mouse);
+}
+
+static void move_cursor(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i++) {
+		int const * __restrict const delta = deltas[i & (N_EVENTS - 1)];
+		myy_abs_mouse_move(delta[0], delta[1]);
+	}
+}
+
+static void replay_trace(void * __restrict data, uint64_t iterations)
+{
+	unsigned int e = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		parse_event(trace + e, &mouse);
+		if (++e == N_TRACE_EVENTS) e = 0;
+	}
+}
+
+static void replay_touch(void * __restrict data, uint64_t iterations)
+{
+	unsigned int e = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		parse_event(touch_trace + e, &touchscreen);
+		if (++e == N_TOUCH_EVENTS) e = 0;
+	}
+}
+
+/* The batch as a whole, against one callback per event.
+   Each iteration is one event. */
+static void handle_batch(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i += N_BATCH_EVENTS)
+		myy_input_batch(&motions_batch);
+}
+
+static void dispatch_batch(void * __restrict data, uint64_t iterations)
+{
+	for (uint64_t i = 0; i < iterations; i += N_BATCH_EVENTS)
+		myy_input_dispatch(&motions_batch);
+}
+
+/* A frame of remote motions : one delta per pointer, as decoded from
+   the network, then applied with the kernel. Each iteration is one
+   pointer. */
+static void move_pointers(void * __restrict data, uint64_t iterations)
+{
+	struct ph_pointers_kernels const * __restrict const kernel = data;
+	for (uint64_t i = 0; i < iterations; i += N_POINTERS) {
+		memcpy(remote_pointers.dx, remote_dx, sizeof(remote_dx));
+		memcpy(remote_pointers.dy, remote_dy, sizeof(remote_dy));
+		kernel->apply(&remote_pointers, N_POINTERS);
+	}
+	bh_Use(remote_pointers.x[0]);
+}
+
+static void set_event
+(struct input_event * __restrict const event,
+ uint64_t const time_us,
+ unsigned int const type, unsigned int const code, int const value)
+{
+	event->input_event_sec  = time_us / 1000000;
+	event->input_event_usec = time_us % 1000000;
+	event->type  = type;
+	event->code  = code;
+	event->value = value;
+}
+
+/* Every contact moving at each report, as on a 240 Hz touchscreen
+   whose contacts are all held down */
+static void generate_touch_trace()
+{
+	struct myy_touch_state * __restrict const touch = &touchscreen.touch;
+	struct input_event * __restrict event = touch_trace;
+
+	touch->n_slots = N_TOUCH_CONTACTS;
+	touch->scale_x = touch->scale_y = (1920 << 16) / 4096;
+	for (unsigned int c = 0; c < N_TOUCH_CONTACTS; c++)
+		touch->contacts[c].tracking_id = c;
+
+	for (unsigned int r = 0; r < N_TOUCH_REPORTS; r++) {
+		uint64_t const time_us = (uint64_t) r * 4167;
+		for (unsigned int c = 0; c < N_TOUCH_CONTACTS; c++) {
+			set_event(event++, time_us, EV_ABS, ABS_MT_SLOT, c);
+			set_event(event++, time_us, EV_ABS, ABS_MT_POSITION_X,
+			          (c * 300 + r * 3) % 4096);
+			set_event(event++, time_us, EV_ABS, ABS_MT_POSITION_Y,
+			          (c * 200 + r * 2) % 4096);
+		}
+		set_event(event++, time_us, EV_SYN, SYN_REPORT, 0);
+	}
+}
+
+static void accelerate(void * __restrict data, uint64_t iterations)
+{
+	struct ph_pointer * __restrict const accel = data;
+	int32_t px, py;
+	uint64_t sum = 0;
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		int const * __restrict const delta = deltas[i & (N_EVENTS - 1)];
+		ph_PointerMove(
+		  accel, delta[0] >> 6, delta[1] >> 6, i * TRACE_INTERVAL_US,
+		  &px, &py);
+		sum += px + py;
+	}
+	bh_Use(sum);
+}
+
+/* An 8 kHz mouse swept back and forth, slowly then quickly */
+static void generate_trace(uint32_t * __restrict const random_state)
+{
+	for (unsigned int r = 0; r < N_TRACE_REPORTS; r++) {
+		uint64_t const time_us = (uint64_t) r * TRACE_INTERVAL_US;
+		int const speed = 1 + (r / 512) % 8;
+		int const direction = ((r / 256) & 1) ? -1 : 1;
+		struct input_event * __restrict const report = trace + r * 3;
+
+		for (unsigned int e = 0; e < 3; e++) {
+			report[e].input_event_sec  = time_us / 1000000;
+			report[e].input_event_usec = time_us % 1000000;
+		}
+		report[0].type  = EV_REL;
+		report[0].code  = REL_X;
+		report[0].value = direction * speed;
+		report[1].type  = EV_REL;
+		report[1].code  = REL_Y;
+		report[1].value = (int) (xorshift32(random_state) % 3) - 1;
+		report[2].type  = EV_SYN;
+		report[2].code  = SYN_REPORT;
+		report[2].value = 0;
+	}
+}
+
+void bench_Input()
+{
+	struct ph_accel_config accel_config;
+	static struct ph_pointer accel;
+
+	ph_AccelDefaultConfig(&accel_config);
+	myy_evdev_set_acceleration(&accel_config);
+	ph_PointerInit(&accel, &accel_config);
+
+	uint32_t random_state = 0x4d797921;
+
+	/* A mouse report : mostly relative moves, some wheel events and
+	   synchronisation events, which are ignored */
+	for (unsigned int e = 0; e < N_EVENTS; e++) {
+		uint32_t const kind = xorshift32(&random_state) % 20;
+		struct input_event * __restrict const event = events+e;
+		event->type  = EV_REL;
+		event->value = (int) (xorshift32(&random_state) % 41) - 20;
+		if (kind < 9)       event->code = REL_X;
+		else if (kind < 18) event->code = REL_Y;
+		else if (kind < 19) event->code = REL_WHEEL;
+		else { event->type = EV_SYN; event->code = SYN_REPORT; event->value = 0; }
+	}
+
+	/* Every kind of event a gaming mouse sends : motions, high
+	   resolution wheels, buttons with their MSC_SCAN, and codes without
+	   handlers */
+	for (unsigned int e = 0; e < N_EVENTS; e++) {
+		static uint16_t const kinds[][2] = {
+			{ EV_REL, REL_X }, { EV_REL, REL_Y }, { EV_REL, REL_X },
+			{ EV_REL, REL_Y }, { EV_REL, REL_WHEEL },
+			{ EV_REL, REL_WHEEL_HI_RES }, { EV_REL, REL_HWHEEL_HI_RES },
+			{ EV_REL, REL_MISC }, { EV_MSC, MSC_SCAN },
+			{ EV_KEY, BTN_LEFT }, { EV_KEY, BTN_SIDE }, { EV_KEY, KEY_A },
+			{ EV_ABS, ABS_X }, { EV_SYN, SYN_REPORT }, { EV_SYN, SYN_REPORT },
+			{ EV_SYN, SYN_DROPPED }
+		};
+		uint16_t const * __restrict const kind =
+			kinds[xorshift32(&random_state) % (sizeof(kinds) / sizeof(kinds[0]))];
+		struct input_event * __restrict const event = mixed_events+e;
+		event->type  = kind[0];
+		event->code  = kind[1];
+		event->value = (kind[0] == EV_KEY)
+			? (int) (xorshift32(&random_state) & 1)
+			: (int) (xorshift32(&random_state) % 41) - 20;
+	}
+
+	/* Big enough moves to hit the screen edges regularly */
+	for (unsigned int d = 0; d < N_EVENTS; d++) {
+		deltas[d][0] = (int) (xorshift32(&random_state) % 1001) - 500;
+		deltas[d][1] = (int) (xorshift32(&random_state) % 1001) - 500;
+	}
+
+	for (unsigned int e = 0; e < N_BATCH_EVENTS; e++) {
+		struct myy_input_event * __restrict const event = batch_events + e;
+		event->time_offset_us = e * TRACE_INTERVAL_US;
+		event->type = myy_input_motion;
+		event->motion.dx = deltas[e][0] / 16;
+		event->motion.dy = deltas[e][1] / 16;
+	}
+
+	struct ph_pointers_bounds const outputs[2] = {
+		{ 0, 0, 1919, 1079 },
+		{ 1920, 0, 1920 + 2559, 1439 }
+	};
+	ph_PointersInit(&remote_pointers, N_POINTERS, NULL);
+	for (unsigned int p = 0; p < N_POINTERS; p++) {
+		struct ph_pointers_bounds const * __restrict const output =
+			outputs + (p & 1);
+		ph_PointersAdd(&remote_pointers, p, output,
+		  output->min_x + xorshift32(&random_state) % 1920,
+		  output->min_y + xorshift32(&random_state) % 1080);
+		remote_dx[p] = deltas[p & (N_EVENTS - 1)][0] / 8;
+		remote_dy[p] = deltas[p & (N_EVENTS - 1)][1] / 8;
+	}
+
+	generate_trace(&random_state);
+	generate_touch_trace();
+
+	bh_Measure("input/parse_event", dispatch_events, NULL, 0);
+	bh_Measure("input/parse_event_mixed", dispatch_mixed_events, NULL,
+	           sizeof(struct input_event));
+	bh_Measure("input/myy_abs_mouse_move", move_cursor, NULL, 0);
+	bh_Measure("input/ph_PointerMove", accelerate, &accel, 0);
+	bh_Measure("input/replay_8khz_trace", replay_trace, NULL, 0);
+	bh_Measure("input/replay_touch_12_contacts", replay_touch, NULL, 0);
+	bh_Measure("input/myy_input_batch", handle_batch, NULL, 0);
+	bh_Measure("input/myy_input_dispatch", dispatch_batch, NULL, 0);
+
+	unsigned int n_kernels;
+	struct ph_pointers_kernels const * __restrict const kernels =
+		ph_PointersKernels(&n_kernels);
+	for (unsigned int k = 0; k < n_kernels; k++) {
+		char name[64];
+		snprintf(name, sizeof(name), "input/ph_pointers_%u/%s",
+		         N_POINTERS, kernels[k].name);
+		bh_Measure(name, move_pointers, (void *) (kernels + k), 0);
+	}
+	ph_PointersFree(&remote_pointers);
+}
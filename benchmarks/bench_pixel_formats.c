@@ -0,0 +1,116 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Pixel formats conversions of a 256x256 RGBA8888 image, with each
+ * kernel supported by the CPU. See tools/texconv/pixel_formats.h */
+
+#include <texconv/pixel_formats.h>
+
+#include "harness.h"
+#include "suites.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define IMAGE_SIZE 256
+
+struct conversion {
+	struct pf_kernels const * kernel;
+	struct pf_format const * from;
+	struct pf_format const * to;
+	unsigned int dither;
+	uint8_t const * input;
+	uint32_t * row;
+	uint8_t * output;
+};
+
+static void convert(void * __restrict data, uint64_t iterations)
+{
+	struct conversion const * __restrict const conversion = data;
+	size_t const input_stride = IMAGE_SIZE * conversion->from->bytes_per_pixel;
+	size_t const output_stride = IMAGE_SIZE * conversion->to->bytes_per_pixel;
+	uint32_t offsets[4];
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		for (uint32_t y = 0; y < IMAGE_SIZE; y++) {
+			conversion->kernel->decode(
+			  conversion->from, conversion->input + y * input_stride,
+			  conversion->row, IMAGE_SIZE);
+			unsigned int const dithered =
+				conversion->dither && pf_DitherRow(conversion->to, y, offsets);
+			conversion->kernel->encode(
+			  conversion->to, conversion->row,
+			  conversion->output + y * output_stride,
+			  IMAGE_SIZE, dithered ? offsets : NULL);
+		}
+		bh_Use(conversion->output[i & (IMAGE_SIZE - 1)]);
+	}
+}
+
+void bench_PixelFormats()
+{
+	static char const * const targets[] = {
+		"rgba4444", "rgba5551", "bgra8888"
+	};
+	size_t const image_bytes = IMAGE_SIZE * IMAGE_SIZE * 4;
+
+	if (!bh_Selected("pixel_formats/")) return;
+
+	uint8_t * __restrict const input = malloc(image_bytes);
+	uint32_t * __restrict const row = malloc(IMAGE_SIZE * sizeof(uint32_t));
+	uint8_t * __restrict const output = malloc(image_bytes);
+	if (input == NULL || row == NULL || output == NULL) goto out;
+
+	for (size_t b = 0; b < image_bytes; b++) input[b] = b * 31 + (b >> 7);
+
+	unsigned int n_kernels;
+	struct pf_kernels const * __restrict const kernels = pf_Kernels(&n_kernels);
+
+	for (unsigned int k = 0; k < n_kernels; k++) {
+		for (unsigned int t = 0; t < sizeof(targets)/sizeof(targets[0]); t++) {
+			for (unsigned int dither = 0; dither < 2; dither++) {
+				struct conversion conversion = {
+					.kernel = kernels+k,
+					.from   = pf_FormatByName("rgba8888"),
+					.to     = pf_FormatByName(targets[t]),
+					.dither = dither,
+					.input  = input,
+					.row    = row,
+					.output = output
+				};
+				/* 32 bits formats aren't dithered */
+				if (dither && conversion.to->bytes_per_pixel == 4) continue;
+
+				char name[96];
+				snprintf(name, sizeof(name), "pixel_formats/%s/rgba8888_to_%s%s",
+				         kernels[k].name, targets[t], dither ? "_dither" : "");
+				bh_Measure(name, convert, &conversion, image_bytes);
+			}
+		}
+	}
+
+out:
+	free(output);
+	free(row);
+	free(input);
+}
@@ -0,0 +1,353 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Drawing N cursors and their labels into a 1920x1080 offscreen
+ * framebuffer, with each glh_sprite_batch method, and with one draw
+ * call per sprite as myy_draw did before batching them.
+ *
+ * Uses a surfaceless EGL display (EGL_MESA_platform_surfaceless), and
+ * Mesa's llvmpipe unless LIBGL_ALWAYS_SOFTWARE is already set, so
+ * that results don't depend on the GPU.
+ * Must be run from the repository root, to find the shaders and
+ * textures.
+ *
+ * The draw calls per frame and the CPU time spent submitting them,
+ * without waiting for the GPU, are then printed for each count, along
+ * with the GPU time of the clear and of the sprites, as measured by
+ * glhGpuTimer. */
+
+#include <helpers/gl_loaders.h>
+#include <helpers/gpu_timer.h>
+#include <helpers/sprite_batch.h>
+
+#include "harness.h"
+#include "suites.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAME_WIDTH 1920
+#define FRAME_HEIGHT 1080
+/* Frames drawn before reading the GPU times */
+#define GPU_TIMED_FRAMES 8
+/* Frames whose submission is timed */
+#define SUBMIT_TIMED_FRAMES 32
+/* A sprite for the cursor, another for its label */
+#define MAX_CURSORS 2048
+#define MAX_SPRITES (MAX_CURSORS * 2)
+
+enum sprites_method {
+	/* One draw call per sprite */
+	SPRITES_SEPARATE,
+	SPRITES_INSTANCED,
+	SPRITES_EXPANDED,
+	N_SPRITES_METHODS
+};
+
+static char const * const sprites_methods_names[N_SPRITES_METHODS] = {
+	[SPRITES_SEPARATE]  = "separate",
+	[SPRITES_INSTANCED] = "instanced",
+	[SPRITES_EXPANDED]  = "expanded"
+};
+
+struct sprites {
+	unsigned int n_cursors;
+	struct glh_sprite_batch * batch;
+	enum sprites_method method;
+	/* Issued by the last frame */
+	unsigned int draw_calls;
+};
+
+static struct glh_sprite sprites_data[MAX_SPRITES];
+
+/* The cursors move at every frame, their labels follow them */
+static void write_sprites(unsigned int const n_cursors, uint64_t const i)
+{
+	for (unsigned int c = 0; c < n_cursors; c++) {
+		float const x = (float) ((c * 97 + i * 13) % FRAME_WIDTH);
+		float const y = (float) ((c * 53 + i * 7) % FRAME_HEIGHT);
+		sprites_data[c * 2]     = (struct glh_sprite) { x, y, 0, 0 };
+		sprites_data[c * 2 + 1] =
+			(struct glh_sprite) { x + 14, y - 14, c % 64, 1 };
+	}
+}
+
+static void submit_frame
+(struct sprites * __restrict const sprites,
+ uint64_t const i)
+{
+	unsigned int const n_sprites = sprites->n_cursors * 2;
+
+	write_sprites(sprites->n_cursors, i);
+	if (sprites->method != SPRITES_SEPARATE) {
+		glhSpriteBatchDraw(sprites->batch, sprites_data, n_sprites);
+		sprites->draw_calls = sprites->batch->draw_calls;
+		return;
+	}
+
+	sprites->draw_calls = 0;
+	for (unsigned int s = 0; s < n_sprites; s++) {
+		glhSpriteBatchDraw(sprites->batch, sprites_data + s, 1);
+		sprites->draw_calls += sprites->batch->draw_calls;
+	}
+}
+
+static void draw_frame
+(struct sprites * __restrict const sprites,
+ uint64_t const i)
+{
+	glhGpuTimerPassBegin("clear");
+	glClear(GL_COLOR_BUFFER_BIT);
+	glhGpuTimerPassEnd();
+
+	glhGpuTimerPassBegin("sprites");
+	submit_frame(sprites, i);
+	glhGpuTimerPassEnd();
+}
+
+static void draw_frames(void * __restrict data, uint64_t iterations)
+{
+	struct sprites * __restrict const sprites = data;
+	for (uint64_t i = 0; i < iterations; i++) {
+		draw_frame(sprites, i);
+		glFinish();
+	}
+}
+
+static uint64_t now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Only the time spent in the draw calls, the GPU work being waited for
+   outside of the timed part */
+static void print_submit_time(struct sprites * __restrict const sprites)
+{
+	uint64_t total_ns = 0;
+
+	for (uint64_t i = 0; i < SUBMIT_TIMED_FRAMES; i++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		uint64_t const start_ns = now_ns();
+		submit_frame(sprites, i);
+		total_ns += now_ns() - start_ns;
+		glFinish();
+	}
+	fprintf(stderr, "sprites/%s_%u_cursors : %u draw calls per frame, "
+	        "CPU submit %.1f us\n",
+	        sprites_methods_names[sprites->method], sprites->n_cursors,
+	        sprites->draw_calls,
+	        total_ns / 1000.0 / SUBMIT_TIMED_FRAMES);
+}
+
+static void print_gpu_times(struct sprites * __restrict const sprites)
+{
+	struct glh_gpu_timer_results results;
+
+	for (uint64_t i = 0; i < GPU_TIMED_FRAMES; i++) {
+		glhGpuTimerFrameBegin();
+		draw_frame(sprites, i);
+		glFinish();
+	}
+	/* Collects the last frame */
+	glhGpuTimerFrameBegin();
+
+	if (!glhGpuTimerResults(&results)) return;
+	fprintf(stderr, "sprites/%s_%u_cursors GPU time :",
+	        sprites_methods_names[sprites->method], sprites->n_cursors);
+	for (unsigned int p = 0; p < results.n_passes; p++)
+		fprintf(stderr, " %s %.1f us,",
+		        results.names[p], results.ns[p] / 1000.0);
+	fprintf(stderr, " total %.1f us\n", results.total_ns / 1000.0);
+}
+
+static EGLContext create_context(EGLDisplay * __restrict const display)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC const get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (get_platform_display == NULL) return EGL_NO_CONTEXT;
+
+	*display = get_platform_display(
+	  EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (*display == EGL_NO_DISPLAY || !eglInitialize(*display, NULL, NULL))
+		return EGL_NO_CONTEXT;
+
+	/* Surfaceless displays have no window configurations */
+	static EGLint const config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_NONE
+	};
+	static EGLint const context_attribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint n_configs = 0;
+	eglBindAPI(EGL_OPENGL_ES_API);
+	if (!eglChooseConfig(*display, config_attribs, &config, 1, &n_configs) ||
+	    n_configs == 0)
+		return EGL_NO_CONTEXT;
+
+	EGLContext const context =
+		eglCreateContext(*display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT ||
+	    !eglMakeCurrent(*display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		return EGL_NO_CONTEXT;
+
+	return context;
+}
+
+void bench_Sprites()
+{
+	static unsigned int const counts[] = { 1, 64, 2048 };
+	unsigned int const n_counts = sizeof(counts)/sizeof(counts[0]);
+	EGLDisplay display = EGL_NO_DISPLAY;
+	GLuint framebuffer = 0, target = 0, texture = 0;
+	struct glh_sprite_batch instanced = {0}, expanded = {0};
+
+	if (!bh_Selected("sprites/")) return;
+
+	setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+	EGLContext const context = create_context(&display);
+	if (context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "No surfaceless EGL context. Skipping sprites.\n");
+		goto out;
+	}
+	fprintf(stderr, "Rendering with %s\n",
+	        (char const *) glGetString(GL_RENDERER));
+
+	GLuint const program = glhSetupAndUse(
+	  "shaders/cursor.vsh", "shaders/cursor.fsh", 2, "xyst\0sprite");
+	if (program == 0 ||
+	    !glhUploadMyyRawTextures("textures/cursor.raw", 1, &texture)) {
+		fprintf(stderr, "Run from the repository root. Skipping sprites.\n");
+		goto out;
+	}
+
+	glGenTextures(1, &target);
+	glBindTexture(GL_TEXTURE_2D, target);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FRAME_WIDTH, FRAME_HEIGHT, 0,
+	             GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+	                       GL_TEXTURE_2D, target, 0);
+	glViewport(0, 0, FRAME_WIDTH, FRAME_HEIGHT);
+
+	/* Same state as myy_display_initialised and myy_draw. The cursor
+	   texture stands for the labels atlas. */
+	GLfloat const quad_corners[GLH_SPRITE_CORNERS][4] = {
+		{ 24,   0, 1, 1 },
+		{  0,   0, 0, 1 },
+		{  0, -24, 0, 0 },
+		{ 24, -24, 1, 0 }
+	};
+	if (!glhSpriteBatchInit(&instanced, quad_corners, 0, 1, MAX_SPRITES,
+	                        GLH_SPRITES_INSTANCED) ||
+	    !glhSpriteBatchInit(&expanded, quad_corners, 0, 1, MAX_SPRITES,
+	                        GLH_SPRITES_EXPANDED))
+	{
+		fprintf(stderr, "Not enough memory. Skipping sprites.\n");
+		goto out;
+	}
+
+	glUniform4f(glGetUniformLocation(program, "px_to_norm"),
+	            2.0f / FRAME_WIDTH, 2.0f / FRAME_HEIGHT, -1, -1);
+	glUniform3f(glGetUniformLocation(program, "labels_cells"),
+	            1.0f / 8, 1.0f / 8, 8);
+	glhActiveTextures(&texture, 1);
+	glUniform1i(glGetUniformLocation(program, "sampler"), 0);
+	glUniform1i(glGetUniformLocation(program, "labels"), 0);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glClearColor(0.2f, 0.5f, 0.7f, 1.0f);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Incomplete framebuffer. Skipping sprites.\n");
+		goto out;
+	}
+
+	/* Without instancing, the instanced batch expands the vertices too */
+	struct sprites methods[N_SPRITES_METHODS] = {
+		[SPRITES_SEPARATE]  = { .batch = &instanced, .method = SPRITES_SEPARATE },
+		[SPRITES_INSTANCED] = { .batch = &instanced, .method = SPRITES_INSTANCED },
+		[SPRITES_EXPANDED]  = { .batch = &expanded,  .method = SPRITES_EXPANDED }
+	};
+	unsigned int const n_methods =
+		(instanced.method == GLH_SPRITES_INSTANCED)
+		? N_SPRITES_METHODS
+		: SPRITES_INSTANCED;
+	if (n_methods != N_SPRITES_METHODS) {
+		fprintf(stderr, "No instancing. Skipping sprites/instanced.\n");
+		methods[SPRITES_SEPARATE].batch = &expanded;
+		methods[SPRITES_INSTANCED] = methods[SPRITES_EXPANDED];
+	}
+
+	for (unsigned int m = 0; m < n_methods; m++) {
+		for (unsigned int c = 0; c < n_counts; c++) {
+			char name[64];
+			methods[m].n_cursors = counts[c];
+			snprintf(name, sizeof(name), "sprites/%s_%u_cursors",
+			         sprites_methods_names[methods[m].method], counts[c]);
+			bh_Measure(name, draw_frames, methods + m, 0);
+		}
+	}
+
+	for (unsigned int m = 0; m < n_methods; m++) {
+		for (unsigned int c = 0; c < n_counts; c++) {
+			methods[m].n_cursors = counts[c];
+			print_submit_time(methods + m);
+		}
+	}
+
+	if (glhGpuTimerStart(display) != GLH_GPU_TIMER_OFF) {
+		for (unsigned int m = 0; m < n_methods; m++) {
+			for (unsigned int c = 0; c < n_counts; c++) {
+				methods[m].n_cursors = counts[c];
+				print_gpu_times(methods + m);
+			}
+		}
+		glhGpuTimerStop();
+	}
+
+	glDeleteProgram(program);
+
+out:
+	if (context != EGL_NO_CONTEXT) {
+		glhSpriteBatchFree(&instanced);
+		glhSpriteBatchFree(&expanded);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteTextures(1, &target);
+		glDeleteTextures(1, &texture);
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	if (display != EGL_NO_DISPLAY) eglTerminate(display);
+}
@@ -0,0 +1,187 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Variable refresh rate detection, against a fake DRM device.
+ *
+ * Usage : drm_vrr_test
+ *
+ * The libdrm properties functions used by src/drm.c are replaced
+ * through the linker (-Wl,--wrap=...) by a table of fake properties.
+ * drm_init_vrr is then checked with and without the CRTC VRR_ENABLED
+ * and connector vrr_capable properties, and with MYY_DRM_VRR=0.
+ * Returns 1 if a check failed. */
+
+#include <myy_drm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FAKE_FD 42
+#define FAKE_CRTC 31
+#define FAKE_CONNECTOR 32
+
+enum fake_property_id {
+	fake_active = 1,
+	fake_vrr_enabled,
+	fake_dpms,
+	fake_vrr_capable,
+	n_fake_properties
+};
+
+static char const * const fake_names[n_fake_properties] = {
+	[fake_active]      = "ACTIVE",
+	[fake_vrr_enabled] = "VRR_ENABLED",
+	[fake_dpms]        = "DPMS",
+	[fake_vrr_capable] = "vrr_capable"
+};
+
+/* What the fake device reports */
+static struct {
+	unsigned int crtc_vrr_enabled;
+	unsigned int connector_vrr_capable;
+	uint64_t vrr_capable;
+	/* Returned by the wrappers and not freed yet */
+	int allocated;
+} device;
+
+/* drm.c calls the myy.h callbacks when releasing framebuffers */
+void myy_cleanup_drawing() {}
+
+drmModeObjectPropertiesPtr __wrap_drmModeObjectGetProperties
+(int fd, uint32_t object_id, uint32_t object_type)
+{
+	uint32_t ids[2];
+	uint64_t values[2];
+	unsigned int n = 0;
+
+	if (fd != FAKE_FD) return NULL;
+	if (object_id == FAKE_CRTC && object_type == DRM_MODE_OBJECT_CRTC) {
+		ids[n] = fake_active; values[n++] = 1;
+		if (device.crtc_vrr_enabled) {
+			ids[n] = fake_vrr_enabled; values[n++] = 0;
+		}
+	}
+	else if (object_id == FAKE_CONNECTOR &&
+	         object_type == DRM_MODE_OBJECT_CONNECTOR) {
+		ids[n] = fake_dpms; values[n++] = 0;
+		if (device.connector_vrr_capable) {
+			ids[n] = fake_vrr_capable; values[n++] = device.vrr_capable;
+		}
+	}
+	else return NULL;
+
+	drmModeObjectPropertiesPtr const props = calloc(1, sizeof(*props));
+	props->count_props = n;
+	props->props = calloc(n, sizeof(uint32_t));
+	props->prop_values = calloc(n, sizeof(uint64_t));
+	memcpy(props->props, ids, n * sizeof(uint32_t));
+	memcpy(props->prop_values, values, n * sizeof(uint64_t));
+	device.allocated++;
+	return props;
+}
+
+void __wrap_drmModeFreeObjectProperties(drmModeObjectPropertiesPtr props)
+{
+	if (props == NULL) return;
+	free(props->props);
+	free(props->prop_values);
+	free(props);
+	device.allocated--;
+}
+
+drmModePropertyPtr __wrap_drmModeGetProperty(int fd, uint32_t property_id)
+{
+	if (fd != FAKE_FD || property_id == 0 ||
+	    property_id >= n_fake_properties)
+		return NULL;
+
+	drmModePropertyPtr const property = calloc(1, sizeof(*property));
+	property->prop_id = property_id;
+	strncpy(property->name, fake_names[property_id],
+	        sizeof(property->name) - 1);
+	device.allocated++;
+	return property;
+}
+
+void __wrap_drmModeFreeProperty(drmModePropertyPtr property)
+{
+	if (property == NULL) return;
+	free(property);
+	device.allocated--;
+}
+
+static unsigned int n_failed;
+
+static void check
+(char const * __restrict const name,
+ unsigned int const crtc_vrr_enabled,
+ unsigned int const connector_vrr_capable,
+ uint64_t const vrr_capable,
+ char const * __restrict const wanted,
+ int const expected_ret)
+{
+	struct drm_infos drm = {
+		.fd = FAKE_FD,
+		.crtc_id = FAKE_CRTC,
+		.connector_id = FAKE_CONNECTOR,
+		.atomic = 1
+	};
+
+	device.crtc_vrr_enabled      = crtc_vrr_enabled;
+	device.connector_vrr_capable = connector_vrr_capable;
+	device.vrr_capable           = vrr_capable;
+	device.allocated             = 0;
+	if (wanted) setenv("MYY_DRM_VRR", wanted, 1);
+	else unsetenv("MYY_DRM_VRR");
+
+	int const ret = drm_init_vrr(&drm);
+	/* Found even when disabled, so that the first commit clears it */
+	uint32_t const expected_property =
+		crtc_vrr_enabled ? fake_vrr_enabled : 0;
+	unsigned int const ok =
+		ret == expected_ret &&
+		drm.vrr == (expected_ret == 0) &&
+		drm.crtc_props.vrr_enabled == expected_property &&
+		device.allocated == 0;
+
+	printf("%s : %s\n", ok ? "ok  " : "FAIL", name);
+	if (!ok) {
+		printf("       returned %d, vrr %u, VRR_ENABLED id %u, "
+		       "%d properties not freed\n",
+		       ret, drm.vrr, drm.crtc_props.vrr_enabled, device.allocated);
+		n_failed++;
+	}
+}
+
+int main()
+{
+	check("vrr_capable 1",              1, 1, 1, NULL, 0);
+	check("vrr_capable 0",              1, 1, 0, NULL, -1);
+	check("No vrr_capable",             1, 0, 0, NULL, -1);
+	check("No VRR_ENABLED on the CRTC", 0, 1, 1, NULL, -1);
+	check("MYY_DRM_VRR=0",              1, 1, 1, "0", -1);
+	check("MYY_DRM_VRR=1",              1, 1, 1, "1", 0);
+
+	return n_failed != 0;
+}
@@ -0,0 +1,229 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Bulk loads through fh_LoadFiles, with each loading method.
+ *
+ * Usage : file_batch_bench [n_files] [file_size] [tmpfs_dir] [disk_dir]
+ *
+ * Defaults : 2048 files of 64 KiB, in /dev/shm and /var/tmp.
+ *
+ * Files are loaded from the tmpfs directory, then from the disk
+ * directory after evicting them from the page cache. As root, every
+ * cache is dropped through /proc/sys/vm/drop_caches. Otherwise, only
+ * the files data are evicted, with posix_fadvise. */
+
+#include <helpers/file.h>
+#include <helpers/arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+struct bench_files {
+	char directory[256];
+	char ** names;
+	unsigned int n;
+	size_t size;
+};
+
+static double now_seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int create_files
+(struct bench_files * __restrict const files,
+ char const * __restrict const parent)
+{
+	snprintf(files->directory, sizeof(files->directory),
+	         "%s/myy-file-batch-XXXXXX", parent);
+	if (mkdtemp(files->directory) == NULL) {
+		fprintf(stderr, "Could not create a directory in %s\n", parent);
+		return -1;
+	}
+
+	uint8_t * __restrict const content = malloc(files->size);
+	if (content == NULL) return -1;
+	for (size_t b = 0; b < files->size; b++) content[b] = b * 31 + 7;
+
+	for (unsigned int f = 0; f < files->n; f++) {
+		size_t const length = strlen(files->directory) + 32;
+		files->names[f] = malloc(length);
+		snprintf(files->names[f], length, "%s/asset_%06u.raw",
+		         files->directory, f);
+
+		int const fd = open(files->names[f], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd == -1 || write(fd, content, files->size) != (ssize_t) files->size) {
+			fprintf(stderr, "Could not write %s\n", files->names[f]);
+			if (fd != -1) close(fd);
+			free(content);
+			return -1;
+		}
+		/* Clean pages can be evicted later */
+		fsync(fd);
+		close(fd);
+	}
+
+	free(content);
+	return 0;
+}
+
+static void remove_files(struct bench_files * __restrict const files)
+{
+	for (unsigned int f = 0; f < files->n; f++) {
+		if (files->names[f]) unlink(files->names[f]);
+		free(files->names[f]);
+		files->names[f] = NULL;
+	}
+	rmdir(files->directory);
+}
+
+static char const * drop_caches(struct bench_files const * __restrict const files)
+{
+	sync();
+	int const fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd != -1) {
+		ssize_t const written = write(fd, "3", 1);
+		close(fd);
+		if (written == 1) return "dropped";
+	}
+
+	for (unsigned int f = 0; f < files->n; f++) {
+		int const file_fd = open(files->names[f], O_RDONLY);
+		if (file_fd == -1) continue;
+		posix_fadvise(file_fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(file_fd);
+	}
+	return "evicted";
+}
+
+static int run
+(struct bench_files const * __restrict const files,
+ char const * __restrict const storage,
+ char const * __restrict const cache,
+ enum fh_load_method const method,
+ char const * __restrict const method_name,
+ struct fh_load_request * __restrict const requests,
+ struct ah_arena * __restrict const arena)
+{
+	for (unsigned int f = 0; f < files->n; f++) {
+		requests[f].pathname = files->names[f];
+		requests[f].buffer = NULL;
+		requests[f].buffer_size = 0;
+	}
+	ah_ArenaReset(arena);
+
+	double const start = now_seconds();
+	unsigned int const loaded = fh_LoadFiles(requests, files->n, arena, method);
+	double const seconds = now_seconds() - start;
+
+	unsigned int valid = (loaded == files->n);
+	for (unsigned int f = 0; valid && f < files->n; f++) {
+		uint8_t const * __restrict const data = requests[f].data;
+		valid = requests[f].size == files->size &&
+		        data[files->size-1] == (uint8_t) ((files->size-1) * 31 + 7);
+	}
+
+	double const megabytes = (double) files->n * files->size / (1024 * 1024);
+	printf("{\"benchmark\": \"file_batch\", \"storage\": \"%s\", "
+	       "\"cache\": \"%s\", \"method\": \"%s\", \"files\": %u, "
+	       "\"file_size\": %zu, \"seconds\": %.6f, "
+	       "\"files_per_second\": %.0f, \"mib_per_second\": %.1f, "
+	       "\"valid\": %s}\n",
+	       storage, cache, method_name, files->n, files->size, seconds,
+	       files->n / seconds, megabytes / seconds, valid ? "true" : "false");
+
+	return valid ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	static struct {
+		enum fh_load_method method;
+		char const * name;
+	} const methods[] = {
+		{ FH_LOAD_SERIAL,   "serial"   },
+		{ FH_LOAD_THREADS,  "threads"  },
+		{ FH_LOAD_IO_URING, "io_uring" }
+	};
+	unsigned int const n_methods = sizeof(methods) / sizeof(methods[0]);
+
+	struct bench_files files = {
+		.n    = argc > 1 ? strtoul(argv[1], NULL, 10) : 2048,
+		.size = argc > 2 ? strtoul(argv[2], NULL, 10) : 65536
+	};
+	char const * const tmpfs_dir = argc > 3 ? argv[3] : "/dev/shm";
+	char const * const disk_dir  = argc > 4 ? argv[4] : "/var/tmp";
+	int ret = 0;
+
+	if (files.n == 0 || files.size == 0) {
+		fprintf(stderr, "Usage : %s [n_files] [file_size] [tmpfs_dir] [disk_dir]\n",
+		        argv[0]);
+		return 1;
+	}
+
+	size_t const arena_size = files.n * (files.size + 32);
+	void * __restrict const arena_memory = malloc(arena_size);
+	files.names = calloc(files.n, sizeof(char *));
+	struct fh_load_request * __restrict const requests =
+		calloc(files.n, sizeof(struct fh_load_request));
+	if (arena_memory == NULL || files.names == NULL || requests == NULL) {
+		fprintf(stderr, "Not enough memory\n");
+		return 1;
+	}
+	/* Fault the arena pages in now, rather than during the first run */
+	memset(arena_memory, 0, arena_size);
+	struct ah_arena arena;
+	ah_ArenaInit(&arena, arena_memory, arena_size);
+
+	if (create_files(&files, tmpfs_dir) == 0) {
+		for (unsigned int m = 0; m < n_methods; m++)
+			ret |= run(&files, "tmpfs", "warm", methods[m].method,
+			           methods[m].name, requests, &arena);
+	}
+	else ret = -1;
+	remove_files(&files);
+
+	if (create_files(&files, disk_dir) == 0) {
+		for (unsigned int m = 0; m < n_methods; m++) {
+			char const * const cache = drop_caches(&files);
+			ret |= run(&files, "disk", cache, methods[m].method,
+			           methods[m].name, requests, &arena);
+		}
+	}
+	else ret = -1;
+	remove_files(&files);
+
+	free(requests);
+	free(files.names);
+	free(arena_memory);
+	return ret ? 1 : 0;
+}
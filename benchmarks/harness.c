@@ -0,0 +1,298 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "harness.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BH_MAX_RESULTS 256
+#define BH_MAX_REPETITIONS 1000
+
+struct bh_result {
+	char name[96];
+	uint64_t iterations;
+	unsigned int samples;
+	double min_ns, median_ns, mean_ns, p90_ns, p99_ns;
+	double bytes_per_second;
+};
+
+static struct {
+	unsigned int warmup;
+	unsigned int repetitions;
+	double sample_ns;
+	char const * filter;
+	char const * json_path;
+	char const * baseline_path;
+	char const * save_baseline_path;
+	double tolerance;
+
+	struct bh_result results[BH_MAX_RESULTS];
+	unsigned int n_results;
+} harness = {
+	.warmup      = 3,
+	.repetitions = 30,
+	.sample_ns   = 5e6,
+	.tolerance   = 0.10
+};
+
+static uint64_t now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void usage(char const * __restrict const program)
+{
+	fprintf(stderr,
+	  "Usage : %s [--filter name] [--warmup samples] [--repetitions samples]\n"
+	  "          [--sample-ms ms] [--json file] [--baseline file]\n"
+	  "          [--save-baseline file] [--tolerance ratio]\n"
+	  "\n"
+	  "--filter        Only run the benchmarks whose name contains `name`\n"
+	  "--json          Write the results to `file` instead of stdout\n"
+	  "--baseline      Compare the medians with `file`, and fail when one\n"
+	  "                is slower by more than --tolerance (default 0.10).\n"
+	  "                `file` is written if it does not exist yet.\n"
+	  "--save-baseline Write the results as the new baseline\n",
+	  program);
+}
+
+int bh_Init(int const argc, char ** const argv)
+{
+	for (int a = 1; a < argc; a++) {
+		char const * __restrict const arg = argv[a];
+		char const * __restrict const value = (a + 1 < argc) ? argv[a+1] : NULL;
+
+		if (value == NULL) goto bad_argument;
+		else if (strcmp(arg, "--filter") == 0) harness.filter = value;
+		else if (strcmp(arg, "--json") == 0) harness.json_path = value;
+		else if (strcmp(arg, "--baseline") == 0) harness.baseline_path = value;
+		else if (strcmp(arg, "--save-baseline") == 0)
+			harness.save_baseline_path = value;
+		else if (strcmp(arg, "--warmup") == 0)
+			harness.warmup = strtoul(value, NULL, 10);
+		else if (strcmp(arg, "--repetitions") == 0)
+			harness.repetitions = strtoul(value, NULL, 10);
+		else if (strcmp(arg, "--sample-ms") == 0)
+			harness.sample_ns = strtod(value, NULL) * 1e6;
+		else if (strcmp(arg, "--tolerance") == 0)
+			harness.tolerance = strtod(value, NULL);
+		else goto bad_argument;
+		a++;
+	}
+
+	if (harness.repetitions == 0 ||
+	    harness.repetitions > BH_MAX_REPETITIONS ||
+	    harness.sample_ns <= 0 || harness.tolerance < 0)
+		goto bad_argument;
+
+	return 0;
+
+bad_argument:
+	usage(argv[0]);
+	return -1;
+}
+
+unsigned int bh_Selected(char const * __restrict const name)
+{
+	return harness.filter == NULL || strstr(name, harness.filter) != NULL;
+}
+
+static int compare_doubles(void const * a, void const * b)
+{
+	double const x = *(double const *) a, y = *(double const *) b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of sorted samples */
+static double percentile
+(double const * __restrict const sorted,
+ unsigned int const n,
+ unsigned int const p)
+{
+	unsigned int rank = (p * n + 99) / 100;
+	if (rank == 0) rank = 1;
+	return sorted[rank - 1];
+}
+
+static uint64_t time_sample
+(bh_function const function,
+ void * __restrict const data,
+ uint64_t const iterations)
+{
+	uint64_t const start = now_ns();
+	function(data, iterations);
+	return now_ns() - start;
+}
+
+void bh_Measure
+(char const * __restrict const name,
+ bh_function const function,
+ void * __restrict const data,
+ uint64_t const bytes_per_operation)
+{
+	static double samples[BH_MAX_REPETITIONS];
+
+	if (!bh_Selected(name)) return;
+	if (harness.n_results == BH_MAX_RESULTS) {
+		fprintf(stderr, "Too many benchmarks. Skipping %s\n", name);
+		return;
+	}
+
+	/* Iterations per sample */
+	uint64_t iterations = 1;
+	while (time_sample(function, data, iterations) < harness.sample_ns &&
+	       iterations < (UINT64_C(1) << 40))
+		iterations *= 2;
+
+	for (unsigned int w = 0; w < harness.warmup; w++)
+		time_sample(function, data, iterations);
+
+	double total = 0;
+	for (unsigned int r = 0; r < harness.repetitions; r++) {
+		samples[r] =
+			(double) time_sample(function, data, iterations) / iterations;
+		total += samples[r];
+	}
+	qsort(samples, harness.repetitions, sizeof(double), compare_doubles);
+
+	struct bh_result * __restrict const result =
+		harness.results + harness.n_results++;
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	result->iterations = iterations;
+	result->samples    = harness.repetitions;
+	result->min_ns     = samples[0];
+	result->median_ns  = percentile(samples, harness.repetitions, 50);
+	result->mean_ns    = total / harness.repetitions;
+	result->p90_ns     = percentile(samples, harness.repetitions, 90);
+	result->p99_ns     = percentile(samples, harness.repetitions, 99);
+	result->bytes_per_second = bytes_per_operation
+		? bytes_per_operation * 1e9 / result->median_ns
+		: 0;
+
+	fprintf(stderr, "%-48s median %12.1f ns  p90 %12.1f ns  p99 %12.1f ns",
+	        result->name, result->median_ns, result->p90_ns, result->p99_ns);
+	if (bytes_per_operation)
+		fprintf(stderr, "  %9.1f MiB/s",
+		        result->bytes_per_second / (1024 * 1024));
+	fputc('\n', stderr);
+}
+
+static int write_results(char const * __restrict const path)
+{
+	FILE * __restrict const file =
+		(path && strcmp(path, "-") != 0) ? fopen(path, "w") : stdout;
+	if (file == NULL) {
+		fprintf(stderr, "Could not write %s\n", path);
+		return -1;
+	}
+
+	fprintf(file, "{\"benchmarks\": [\n");
+	for (unsigned int r = 0; r < harness.n_results; r++) {
+		struct bh_result const * __restrict const result = harness.results+r;
+		fprintf(file,
+		  "{\"name\": \"%s\", \"iterations\": %llu, \"samples\": %u, "
+		  "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+		  "\"p90_ns\": %.3f, \"p99_ns\": %.3f, \"bytes_per_second\": %.0f}%s\n",
+		  result->name, (unsigned long long) result->iterations,
+		  result->samples, result->min_ns, result->median_ns,
+		  result->mean_ns, result->p90_ns, result->p99_ns,
+		  result->bytes_per_second,
+		  (r + 1 < harness.n_results) ? "," : "");
+	}
+	fprintf(file, "]}\n");
+
+	if (file != stdout && fclose(file) != 0) return -1;
+	return 0;
+}
+
+/* Reads the medians of a file written by write_results.
+ * Returns the number of regressions, or -1 if it can't be read. */
+static int compare_with_baseline(char const * __restrict const path)
+{
+	FILE * __restrict const file = fopen(path, "r");
+	if (file == NULL) return -1;
+
+	char line[1024];
+	int regressions = 0;
+	unsigned int compared = 0;
+	while (fgets(line, sizeof(line), file)) {
+		char name[96];
+		char const * __restrict const median = strstr(line, "\"median_ns\": ");
+		double baseline_ns;
+		if (sscanf(line, "{\"name\": \"%95[^\"]\"", name) != 1 ||
+		    median == NULL ||
+		    sscanf(median, "\"median_ns\": %lf", &baseline_ns) != 1)
+			continue;
+
+		for (unsigned int r = 0; r < harness.n_results; r++) {
+			struct bh_result const * __restrict const result =
+				harness.results+r;
+			if (strcmp(result->name, name) != 0) continue;
+
+			compared++;
+			double const ratio = result->median_ns / baseline_ns;
+			if (ratio > 1 + harness.tolerance) {
+				fprintf(stderr, "REGRESSION %-37s %12.1f ns -> %12.1f ns (%+.1f%%)\n",
+				        name, baseline_ns, result->median_ns, (ratio - 1) * 100);
+				regressions++;
+			}
+			else if (ratio < 1 - harness.tolerance) {
+				fprintf(stderr, "improved   %-37s %12.1f ns -> %12.1f ns (%+.1f%%)\n",
+				        name, baseline_ns, result->median_ns, (ratio - 1) * 100);
+			}
+		}
+	}
+	fclose(file);
+
+	fprintf(stderr, "%u benchmarks compared with %s, %d regressions\n",
+	        compared, path, regressions);
+	return regressions;
+}
+
+int bh_Finish()
+{
+	int ret = 0;
+
+	if (write_results(harness.json_path) != 0) ret = 1;
+
+	if (harness.baseline_path) {
+		int const regressions = compare_with_baseline(harness.baseline_path);
+		if (regressions > 0) ret = 1;
+		else if (regressions < 0) {
+			fprintf(stderr, "No baseline yet. Saving it to %s\n",
+			        harness.baseline_path);
+			if (write_results(harness.baseline_path) != 0) ret = 1;
+		}
+	}
+
+	if (harness.save_baseline_path &&
+	    write_results(harness.save_baseline_path) != 0)
+		ret = 1;
+
+	return ret;
+}
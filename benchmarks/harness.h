@@ -0,0 +1,67 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_BENCHMARKS_HARNESS_H
+#define MYY_BENCHMARKS_HARNESS_H 1
+
+#include <stdint.h>
+
+/* Microbenchmarks harness.
+ *
+ * Each benchmark function performs `iterations` operations. The
+ * harness finds how many iterations take at least --sample-ms, runs a
+ * few warm-up samples, then times --repetitions samples.
+ * Per-operation minimum, median, mean, 90th and 99th percentiles are
+ * printed to stderr and written as JSON, one benchmark per line.
+ *
+ * Results can be compared against a baseline written by a previous
+ * run. A median slower than the baseline by more than --tolerance
+ * counts as a regression, and makes bh_Finish return 1. */
+
+typedef void (*bh_function)(void * __restrict data, uint64_t iterations);
+
+/* Parse the harness options. Returns 0 on success */
+int bh_Init(int const argc, char ** const argv);
+
+/* Time `function`, unless excluded by --filter.
+ * bytes_per_operation, when not 0, adds a throughput to the results. */
+void bh_Measure
+(char const * __restrict const name,
+ bh_function const function,
+ void * __restrict const data,
+ uint64_t const bytes_per_operation);
+
+/* Returns 1 if a benchmark matching `name` prefix would be run */
+unsigned int bh_Selected(char const * __restrict const name);
+
+/* Write the results, compare them to the baseline.
+ * Returns the program exit code. */
+int bh_Finish();
+
+/* Defeat dead code elimination of benchmarked results */
+static inline void bh_Use(uint64_t const value)
+{
+	__asm__ volatile("" : : "r"(value) : "memory");
+}
+
+#endif
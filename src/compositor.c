@@ -0,0 +1,289 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <myy_compositor.h>
+
+#include <helpers/log.h>
+
+#include <drm_fourcc.h>
+
+#include <errno.h>
+#include <string.h>
+
+struct compositor_plane {
+	uint32_t id;
+	struct drm_plane_properties props;
+	/* The layer to show. NULL when unused. */
+	struct myy_layer * layer;
+	/* Enabled by the last commit, and so to disable when unused */
+	unsigned int shown;
+};
+
+static struct {
+	int drm_fd;
+	/* Cursor planes first, as they are above the overlays */
+	struct compositor_plane planes[MYY_COMPOSITOR_MAX_PLANES];
+	unsigned int n_planes;
+	/* From bottom to top */
+	struct myy_layer layers[MYY_COMPOSITOR_MAX_LAYERS];
+	unsigned int n_layers;
+} compositor;
+
+static unsigned int plane_supports_format
+(drmModePlane const * __restrict const plane,
+ uint32_t const format)
+{
+	for (uint32_t f = 0; f < plane->count_formats; f++)
+		if (plane->formats[f] == format) return 1;
+	return 0;
+}
+
+static void add_planes_of_type
+(struct drm_infos const * __restrict const drm_infos,
+ drmModePlaneRes const * __restrict const planes,
+ int const type)
+{
+	for (uint32_t p = 0; p < planes->count_planes; p++) {
+		if (compositor.n_planes == MYY_COMPOSITOR_MAX_PLANES) return;
+
+		drmModePlane * __restrict const plane =
+			drmModeGetPlane(drm_infos->fd, planes->planes[p]);
+		if (plane == NULL) continue;
+
+		struct compositor_plane * __restrict const usable =
+			compositor.planes + compositor.n_planes;
+		if ((plane->possible_crtcs & (1 << drm_infos->crtc_index)) &&
+		    plane_supports_format(plane, DRM_FORMAT_ARGB8888) &&
+		    drm_plane_type(drm_infos, plane->plane_id) == type &&
+		    drm_plane_find_properties(
+		      drm_infos, plane->plane_id, &usable->props))
+		{
+			usable->id = plane->plane_id;
+			usable->layer = NULL;
+			usable->shown = 0;
+			compositor.n_planes++;
+		}
+
+		drmModeFreePlane(plane);
+	}
+}
+
+unsigned int myy_compositor_init
+(struct drm_infos const * __restrict const drm_infos)
+{
+	compositor.drm_fd = drm_infos->fd;
+	compositor.n_planes = 0;
+	compositor.n_layers = 0;
+
+	if (!drm_infos->atomic) return 0;
+
+	drmModePlaneRes * __restrict const planes =
+		drmModeGetPlaneResources(drm_infos->fd);
+	if (planes == NULL) return 0;
+
+	add_planes_of_type(drm_infos, planes, DRM_PLANE_TYPE_CURSOR);
+	add_planes_of_type(drm_infos, planes, DRM_PLANE_TYPE_OVERLAY);
+	drmModeFreePlaneResources(planes);
+
+	LOG("[Compositor] %u planes available for the layers\n",
+	    compositor.n_planes);
+	return compositor.n_planes;
+}
+
+void myy_compositor_free()
+{
+	for (unsigned int l = 0; l < compositor.n_layers; l++) {
+		struct myy_layer * __restrict const layer = compositor.layers + l;
+		drmModeRmFB(compositor.drm_fd, layer->fb_id);
+		gbm_bo_destroy(layer->bo);
+	}
+	compositor.n_layers = 0;
+	compositor.n_planes = 0;
+}
+
+void myy_compositor_cursor_size
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t * __restrict const width,
+ uint32_t * __restrict const height)
+{
+	uint64_t value;
+
+	*width = *height = 64;
+	if (drmGetCap(drm_infos->fd, DRM_CAP_CURSOR_WIDTH, &value) == 0)
+		*width = value;
+	if (drmGetCap(drm_infos->fd, DRM_CAP_CURSOR_HEIGHT, &value) == 0)
+		*height = value;
+}
+
+struct myy_layer * myy_compositor_add_layer
+(struct drm_infos const * __restrict const drm_infos,
+ struct gbm_device * __restrict const gbm_device,
+ uint32_t const * __restrict const pixels,
+ uint32_t const width,
+ uint32_t const height)
+{
+	if (compositor.n_layers == MYY_COMPOSITOR_MAX_LAYERS) {
+		LOG_ERROR("[Compositor] More than %d layers\n",
+		          MYY_COMPOSITOR_MAX_LAYERS);
+		return NULL;
+	}
+
+	/* Linear, so that it can be written by the CPU and scanned out by
+	   any plane */
+	struct gbm_bo * __restrict const bo = gbm_bo_create(
+	  gbm_device, width, height, GBM_FORMAT_ARGB8888,
+	  GBM_BO_USE_SCANOUT | GBM_BO_USE_LINEAR);
+	if (bo == NULL) {
+		LOG_ERROR("[Compositor] Could not create a %ux%u layer\n",
+		          width, height);
+		return NULL;
+	}
+
+	uint32_t stride;
+	void * map_data = NULL;
+	uint8_t * __restrict const mapped = gbm_bo_map(
+	  bo, 0, 0, width, height, GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+	if (mapped == NULL) {
+		LOG_ERROR("[Compositor] Could not map a layer buffer\n");
+		goto no_fb;
+	}
+	for (uint32_t row = 0; row < height; row++)
+		memcpy(mapped + row * stride, pixels + row * width, width * 4);
+	gbm_bo_unmap(bo, map_data);
+
+	uint32_t const handles[4] = { gbm_bo_get_handle(bo).u32 };
+	uint32_t const pitches[4] = { gbm_bo_get_stride(bo) };
+	uint32_t const offsets[4] = { 0 };
+	uint32_t fb_id;
+	if (drmModeAddFB2(
+	      drm_infos->fd, width, height, DRM_FORMAT_ARGB8888,
+	      handles, pitches, offsets, &fb_id, 0))
+	{
+		LOG_ERRNO("[Compositor] Could not create a layer framebuffer\n");
+		goto no_fb;
+	}
+
+	struct myy_layer * __restrict const layer =
+		compositor.layers + compositor.n_layers++;
+	layer->bo = bo;
+	layer->fb_id = fb_id;
+	layer->x = layer->y = 0;
+	layer->width = width;
+	layer->height = height;
+	layer->plane_id = 0;
+	return layer;
+
+no_fb:
+	gbm_bo_destroy(bo);
+	return NULL;
+}
+
+void myy_compositor_move_layer
+(struct myy_layer * __restrict const layer,
+ int32_t const x,
+ int32_t const y)
+{
+	layer->x = x;
+	layer->y = y;
+}
+
+void myy_compositor_add_planes
+(drmModeAtomicReq * __restrict const request,
+ struct drm_infos const * __restrict const drm_infos)
+{
+	for (unsigned int p = 0; p < compositor.n_planes; p++) {
+		struct compositor_plane const * __restrict const plane =
+			compositor.planes + p;
+		struct myy_layer const * __restrict const layer = plane->layer;
+
+		if (layer != NULL)
+			drm_atomic_add_plane(
+			  request, drm_infos, plane->id, &plane->props,
+			  layer->fb_id, layer->x, layer->y,
+			  layer->width, layer->height);
+		/* Planes can be shared between CRTCs. Only disable ours. */
+		else if (plane->shown)
+			drm_atomic_disable_plane(request, plane->id, &plane->props);
+	}
+}
+
+void myy_compositor_committed()
+{
+	for (unsigned int p = 0; p < compositor.n_planes; p++)
+		compositor.planes[p].shown = (compositor.planes[p].layer != NULL);
+}
+
+void myy_compositor_drop_planes()
+{
+	for (unsigned int p = 0; p < compositor.n_planes; p++)
+		compositor.planes[p].layer = NULL;
+	for (unsigned int l = 0; l < compositor.n_layers; l++)
+		compositor.layers[l].plane_id = 0;
+}
+
+static unsigned int test_planes
+(struct drm_infos * __restrict const drm_infos,
+ uint32_t const primary_fb_id)
+{
+	drmModeAtomicReq * __restrict const request =
+		drm_atomic_request(drm_infos, primary_fb_id, -1, NULL);
+	if (request == NULL) return 0;
+
+	myy_compositor_add_planes(request, drm_infos);
+	return drm_atomic_request_commit(
+	  drm_infos, request, DRM_MODE_ATOMIC_TEST_ONLY, NULL) == 0;
+}
+
+unsigned int myy_compositor_assign
+(struct drm_infos * __restrict const drm_infos,
+ uint32_t const primary_fb_id)
+{
+	unsigned int assigned = 0;
+
+	myy_compositor_drop_planes();
+
+	for (unsigned int l = compositor.n_layers; l-- > 0; ) {
+		struct myy_layer * __restrict const layer = compositor.layers + l;
+
+		for (unsigned int p = 0; p < compositor.n_planes; p++) {
+			struct compositor_plane * __restrict const plane =
+				compositor.planes + p;
+			if (plane->layer != NULL) continue;
+
+			plane->layer = layer;
+			if (test_planes(drm_infos, primary_fb_id)) {
+				layer->plane_id = plane->id;
+				assigned++;
+				break;
+			}
+			plane->layer = NULL;
+		}
+
+		/* The layers below are drawn by GL, below this one */
+		if (layer->plane_id == 0) break;
+	}
+
+	LOG("[Compositor] %u of %u layers shown by planes\n",
+	    assigned, compositor.n_layers);
+	return assigned;
+}
@@ -0,0 +1,591 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* accept4 */
+#define _GNU_SOURCE 1
+
+#include <myy_control.h>
+
+#include <helpers/file.h>
+#include <helpers/log.h>
+#include <helpers/pointer.h>
+#include <helpers/trace.h>
+
+#include <linux/input.h>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_SIZE 256
+#define CONTROL_REPLY_SIZE 1024
+/* Power of 2 */
+#define CONTROL_COMMANDS 16
+/* Input recordings bigger than this are refused */
+#define CONTROL_REPLAY_MAX_SIZE (64*1024*1024)
+
+struct control_client {
+	int fd;
+	size_t used;
+	char line[CONTROL_LINE_SIZE];
+};
+
+/* What the render thread publishes.
+ * Written under the `sequence` seqlock, copied by the control thread. */
+struct control_stats {
+	char mode_name[32];
+	unsigned int mode_width, mode_height, mode_refresh;
+	struct myy_control_frame frame;
+	uint64_t frames;
+	double fps, events_per_second;
+	/* Frame durations, in microseconds */
+	uint32_t frame_times[MYY_CONTROL_FRAME_TIMES];
+};
+
+static struct {
+	unsigned int running;
+	pthread_t thread;
+	int listen_fd;
+	/* Wakes the control thread up when stopping */
+	int wake_fd;
+	struct sockaddr_un address;
+	struct control_client clients[CONTROL_MAX_CLIENTS];
+
+	atomic_uint sequence;
+	struct control_stats stats;
+
+	/* Render thread only */
+	uint64_t previous_frame_ns;
+	uint64_t window_start_ns;
+	uint64_t window_frames;
+	uint64_t window_events;
+
+	/* Control thread -> Render thread */
+	struct myy_control_command commands[CONTROL_COMMANDS];
+	atomic_uint commands_head, commands_tail;
+} control = {
+	.listen_fd = -1,
+	.wake_fd = -1
+};
+
+/* -- Render thread side -- */
+
+static void stats_write_begin()
+{
+	unsigned int const sequence =
+		atomic_load_explicit(&control.sequence, memory_order_relaxed);
+	atomic_store_explicit(
+	  &control.sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static void stats_write_end()
+{
+	unsigned int const sequence =
+		atomic_load_explicit(&control.sequence, memory_order_relaxed);
+	atomic_store_explicit(
+	  &control.sequence, sequence + 1, memory_order_release);
+}
+
+void myy_control_set_mode
+(char const * __restrict const name,
+ unsigned int const width,
+ unsigned int const height,
+ unsigned int const refresh)
+{
+	stats_write_begin();
+	snprintf(
+	  control.stats.mode_name, sizeof(control.stats.mode_name), "%s", name);
+	control.stats.mode_width   = width;
+	control.stats.mode_height  = height;
+	control.stats.mode_refresh = refresh;
+	stats_write_end();
+}
+
+void myy_control_publish_frame
+(struct myy_control_frame const * __restrict const frame)
+{
+	if (!control.running) return;
+
+	struct control_stats * __restrict const stats = &control.stats;
+	uint64_t const now = frame->time_ns;
+
+	stats_write_begin();
+	if (control.previous_frame_ns != 0) {
+		uint64_t const frame_time = (now - control.previous_frame_ns) / 1000;
+		stats->frame_times[stats->frames % MYY_CONTROL_FRAME_TIMES] =
+			(frame_time > UINT32_MAX) ? UINT32_MAX : frame_time;
+		stats->frames++;
+	}
+	else {
+		control.window_start_ns = now;
+		control.window_events   = frame->input_events;
+	}
+	control.previous_frame_ns = now;
+
+	/* FPS and events per second, over the last second */
+	control.window_frames++;
+	uint64_t const window = now - control.window_start_ns;
+	if (window >= 1000000000) {
+		stats->fps = control.window_frames * 1e9 / window;
+		stats->events_per_second =
+			(frame->input_events - control.window_events) * 1e9 / window;
+		control.window_start_ns = now;
+		control.window_frames   = 0;
+		control.window_events   = frame->input_events;
+	}
+	stats->frame = *frame;
+	stats_write_end();
+}
+
+unsigned int myy_control_next_command
+(struct myy_control_command * __restrict const command)
+{
+	unsigned int const tail =
+		atomic_load_explicit(&control.commands_tail, memory_order_relaxed);
+	unsigned int const head =
+		atomic_load_explicit(&control.commands_head, memory_order_acquire);
+	if (tail == head) return 0;
+
+	*command = control.commands[tail % CONTROL_COMMANDS];
+	atomic_store_explicit(
+	  &control.commands_tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+/* -- Control thread side -- */
+
+static unsigned int command_push
+(struct myy_control_command const * __restrict const command)
+{
+	unsigned int const head =
+		atomic_load_explicit(&control.commands_head, memory_order_relaxed);
+	unsigned int const tail =
+		atomic_load_explicit(&control.commands_tail, memory_order_acquire);
+	if (head - tail >= CONTROL_COMMANDS) return 0;
+
+	control.commands[head % CONTROL_COMMANDS] = *command;
+	atomic_store_explicit(
+	  &control.commands_head, head + 1, memory_order_release);
+	return 1;
+}
+
+static void stats_read(struct control_stats * __restrict const copy)
+{
+	unsigned int before, after;
+	do {
+		before =
+			atomic_load_explicit(&control.sequence, memory_order_acquire);
+		memcpy(copy, &control.stats, sizeof(*copy));
+		atomic_thread_fence(memory_order_acquire);
+		after =
+			atomic_load_explicit(&control.sequence, memory_order_relaxed);
+	} while ((before & 1) || before != after);
+}
+
+static int compare_frame_times(void const * a, void const * b)
+{
+	uint32_t const time_a = *(uint32_t const *) a;
+	uint32_t const time_b = *(uint32_t const *) b;
+	return (time_a > time_b) - (time_a < time_b);
+}
+
+static int reply_stats(char * __restrict const reply, size_t const size)
+{
+	struct control_stats stats;
+	stats_read(&stats);
+
+	size_t const n_times = (stats.frames < MYY_CONTROL_FRAME_TIMES)
+		? stats.frames
+		: MYY_CONTROL_FRAME_TIMES;
+	qsort(stats.frame_times, n_times, sizeof(uint32_t), compare_frame_times);
+
+	uint32_t p50 = 0, p90 = 0, p99 = 0, max = 0;
+	if (n_times) {
+		p50 = stats.frame_times[n_times * 50 / 100];
+		p90 = stats.frame_times[n_times * 90 / 100];
+		p99 = stats.frame_times[n_times * 99 / 100];
+		max = stats.frame_times[n_times - 1];
+	}
+
+	return snprintf(reply, size,
+	  "{\"frames\":%llu,\"fps\":%.1f,"
+	  "\"frame_time_us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u},"
+	  "\"input\":{\"events\":%llu,\"events_per_second\":%.1f,"
+	  "\"resyncs\":%llu,\"dropped_reports\":%llu},"
+	  "\"framebuffers\":{\"hits\":%llu,\"misses\":%llu,"
+	  "\"in_use\":%u,\"capacity\":%u},"
+	  "\"mode\":{\"name\":\"%s\",\"width\":%u,\"height\":%u,"
+	  "\"refresh\":%u},"
+	  "\"gpu_frame_us\":%llu,\"vsync\":%s,\"vrr\":%s,"
+	  "\"prediction\":\"%s\"}\n",
+	  (unsigned long long) stats.frames, stats.fps,
+	  p50, p90, p99, max,
+	  (unsigned long long) stats.frame.input_events,
+	  stats.events_per_second,
+	  (unsigned long long) stats.frame.input_resyncs,
+	  (unsigned long long) stats.frame.input_dropped_reports,
+	  (unsigned long long) stats.frame.fb_hits,
+	  (unsigned long long) stats.frame.fb_misses,
+	  stats.frame.fb_in_use, stats.frame.fb_capacity,
+	  stats.mode_name, stats.mode_width, stats.mode_height,
+	  stats.mode_refresh,
+	  (unsigned long long) stats.frame.gpu_ns / 1000,
+	  stats.frame.vsync ? "true" : "false",
+	  stats.frame.vrr ? "true" : "false",
+	  ph_PredictModeName(stats.frame.prediction));
+}
+
+static int reply_replay
+(char const * __restrict const path,
+ char * __restrict const reply,
+ size_t const size)
+{
+	struct stat file_stats;
+	if (stat(path, &file_stats) < 0)
+		return snprintf(reply, size, "error: %s : %s\n", path, strerror(errno));
+
+	if (file_stats.st_size == 0 ||
+	    file_stats.st_size > CONTROL_REPLAY_MAX_SIZE ||
+	    file_stats.st_size % sizeof(struct input_event))
+		return snprintf(reply, size,
+		  "error: %s is not a recording of struct input_event\n", path);
+
+	void * __restrict const events = malloc(file_stats.st_size);
+	if (events == NULL)
+		return snprintf(reply, size, "error: not enough memory\n");
+
+	if (fh_ReadFileToBuffer(path, events, file_stats.st_size)
+	    != file_stats.st_size)
+	{
+		free(events);
+		return snprintf(reply, size, "error: could not read %s\n", path);
+	}
+
+	struct myy_control_command const command = {
+		.type = MYY_CONTROL_REPLAY_INPUT,
+		.data = events,
+		.size = file_stats.st_size
+	};
+	if (!command_push(&command)) {
+		free(events);
+		return snprintf(reply, size, "error: busy\n");
+	}
+
+	return snprintf(reply, size, "ok: replaying %zu events\n",
+	  (size_t) file_stats.st_size / sizeof(struct input_event));
+}
+
+/* Returns the reply size, or -1 to close the connection */
+static int command_execute
+(char * __restrict const line,
+ char * __restrict const reply,
+ size_t const size)
+{
+	char * saved;
+	char const * __restrict const name = strtok_r(line, " \t\r", &saved);
+	char const * __restrict const argument = strtok_r(NULL, " \t\r", &saved);
+
+	if (name == NULL) return 0;
+
+	if (strcmp(name, "stats") == 0)
+		return reply_stats(reply, size);
+
+	if (strcmp(name, "vsync") == 0) {
+		struct myy_control_command command = {
+			.type = MYY_CONTROL_SET_VSYNC
+		};
+		if (argument != NULL && strcmp(argument, "on") == 0)
+			command.value = 1;
+		else if (argument != NULL && strcmp(argument, "off") == 0)
+			command.value = 0;
+		else
+			return snprintf(reply, size, "error: vsync on|off\n");
+
+		return command_push(&command)
+			? snprintf(reply, size, "ok\n")
+			: snprintf(reply, size, "error: busy\n");
+	}
+
+	if (strcmp(name, "prediction") == 0) {
+		enum ph_predict_mode mode;
+		if (argument == NULL || !ph_PredictParseMode(argument, &mode))
+			return snprintf(reply, size,
+			  "error: prediction off|linear|kalman\n");
+
+		struct myy_control_command command = {
+			.type  = MYY_CONTROL_SET_PREDICTION,
+			.value = mode
+		};
+		return command_push(&command)
+			? snprintf(reply, size, "ok\n")
+			: snprintf(reply, size, "error: busy\n");
+	}
+
+	if (strcmp(name, "log") == 0) {
+		int const level =
+			(argument != NULL) ? lh_LogLevelFromName(argument) : -1;
+		if (level < 0)
+			return snprintf(reply, size,
+			  "error: log none|error|warn|info|debug\n");
+		lh_LogSetLevel(level);
+		return snprintf(reply, size, "ok\n");
+	}
+
+	if (strcmp(name, "trace") == 0)
+		return th_TraceExport(argument)
+			? snprintf(reply, size, "ok\n")
+			: snprintf(reply, size, "error: trace not written\n");
+
+	if (strcmp(name, "replay") == 0) {
+		if (argument == NULL)
+			return snprintf(reply, size, "error: replay file\n");
+		return reply_replay(argument, reply, size);
+	}
+
+	if (strcmp(name, "quit") == 0)
+		return -1;
+
+	if (strcmp(name, "help") == 0)
+		return snprintf(reply, size,
+		  "stats          Show the statistics, as JSON\n"
+		  "vsync on|off   Wait for the vertical blank before flipping\n"
+		  "prediction off|linear|kalman\n"
+		  "               Draw the cursor where it should be when seen\n"
+		  "log LEVEL      Log level : none, error, warn, info or debug\n"
+		  "trace [FILE]   Write the frames timeline\n"
+		  "replay FILE    Replay input events recorded from /dev/input\n"
+		  "quit           Close this connection\n");
+
+	return snprintf(reply, size, "error: unknown command %s\n", name);
+}
+
+static void client_close(struct control_client * __restrict const client)
+{
+	close(client->fd);
+	client->fd = -1;
+	client->used = 0;
+}
+
+static void client_read(struct control_client * __restrict const client)
+{
+	char reply[CONTROL_REPLY_SIZE];
+
+	ssize_t const received = recv(
+	  client->fd, client->line + client->used,
+	  CONTROL_LINE_SIZE - client->used, MSG_DONTWAIT);
+	if (received <= 0) {
+		if (received == 0 || (errno != EAGAIN && errno != EINTR))
+			client_close(client);
+		return;
+	}
+	client->used += received;
+
+	char * start = client->line;
+	char * end;
+	while ((end = memchr(start, '\n', client->used - (start - client->line)))) {
+		*end = '\0';
+		int reply_size = command_execute(start, reply, sizeof(reply));
+		if (reply_size < 0) {
+			client_close(client);
+			return;
+		}
+		if ((size_t) reply_size >= sizeof(reply))
+			reply_size = sizeof(reply) - 1;
+
+		/* Slow readers are dropped instead of waited for */
+		if (reply_size > 0 &&
+		    send(client->fd, reply, reply_size, MSG_DONTWAIT | MSG_NOSIGNAL)
+		    != reply_size)
+		{
+			client_close(client);
+			return;
+		}
+		start = end + 1;
+	}
+
+	size_t const remaining = client->used - (start - client->line);
+	if (remaining == CONTROL_LINE_SIZE) {
+		client_close(client);
+		return;
+	}
+	memmove(client->line, start, remaining);
+	client->used = remaining;
+}
+
+static void client_accept()
+{
+	int const fd = accept4(
+	  control.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	if (fd < 0) return;
+
+	for (unsigned int c = 0; c < CONTROL_MAX_CLIENTS; c++) {
+		if (control.clients[c].fd < 0) {
+			control.clients[c].fd = fd;
+			control.clients[c].used = 0;
+			return;
+		}
+	}
+
+	LOG_WARN("[Control] Too many clients\n");
+	close(fd);
+}
+
+static void * control_thread(void * unused)
+{
+	struct pollfd fds[CONTROL_MAX_CLIENTS + 2];
+	unsigned int running = 1;
+
+	th_TraceThreadName("control");
+
+	while (running) {
+		unsigned int n_fds = 0;
+		fds[n_fds++] = (struct pollfd) { control.wake_fd, POLLIN, 0 };
+		fds[n_fds++] = (struct pollfd) { control.listen_fd, POLLIN, 0 };
+		for (unsigned int c = 0; c < CONTROL_MAX_CLIENTS; c++)
+			fds[n_fds++] =
+				(struct pollfd) { control.clients[c].fd, POLLIN, 0 };
+
+		if (poll(fds, n_fds, -1) < 0) {
+			if (errno == EINTR) continue;
+			LOG_ERRNO("[Control] poll failed\n");
+			break;
+		}
+
+		if (fds[0].revents) running = 0;
+		if (fds[1].revents & POLLIN) client_accept();
+		for (unsigned int c = 0; c < CONTROL_MAX_CLIENTS; c++)
+			if (fds[c+2].revents) client_read(control.clients + c);
+	}
+
+	for (unsigned int c = 0; c < CONTROL_MAX_CLIENTS; c++)
+		if (control.clients[c].fd >= 0) client_close(control.clients + c);
+
+	return NULL;
+}
+
+static unsigned int control_listen(char const * __restrict const path)
+{
+	struct sockaddr_un * __restrict const address = &control.address;
+
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		LOG_ERROR("[Control] Socket path too long : %s\n", path);
+		return 0;
+	}
+	strcpy(address->sun_path, path);
+
+	control.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (control.listen_fd < 0) {
+		LOG_ERRNO("[Control] Could not create the socket\n");
+		return 0;
+	}
+
+	/* Left by a previous run that did not exit cleanly */
+	struct stat file_stats;
+	if (lstat(path, &file_stats) == 0 && S_ISSOCK(file_stats.st_mode))
+		unlink(path);
+
+	mode_t const previous_mask = umask(0077);
+	int const bound = bind(
+	  control.listen_fd, (struct sockaddr *) address, sizeof(*address));
+	umask(previous_mask);
+
+	if (bound < 0 || listen(control.listen_fd, CONTROL_MAX_CLIENTS) < 0) {
+		LOG_ERRNO("[Control] Could not listen on %s\n", path);
+		close(control.listen_fd);
+		control.listen_fd = -1;
+		return 0;
+	}
+
+	return 1;
+}
+
+unsigned int myy_control_start(char const * __restrict const default_path)
+{
+	char const * __restrict path = getenv("MYY_CONTROL_SOCKET");
+	if (path == NULL || *path == '\0') path = default_path;
+
+	if (!control_listen(path)) return 0;
+
+	control.wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (control.wake_fd < 0) {
+		LOG_ERRNO("[Control] Could not create the wake up eventfd\n");
+		goto no_eventfd;
+	}
+
+	for (unsigned int c = 0; c < CONTROL_MAX_CLIENTS; c++)
+		control.clients[c].fd = -1;
+
+	control.running = 1;
+	if (pthread_create(&control.thread, NULL, control_thread, NULL)) {
+		LOG_ERROR("[Control] Could not start the control thread\n");
+		control.running = 0;
+		goto no_thread;
+	}
+
+	LOG("[Control] Listening on %s\n", path);
+	return 1;
+
+no_thread:
+	close(control.wake_fd);
+	control.wake_fd = -1;
+no_eventfd:
+	close(control.listen_fd);
+	control.listen_fd = -1;
+	unlink(control.address.sun_path);
+	return 0;
+}
+
+void myy_control_stop()
+{
+	if (!control.running) return;
+
+	uint64_t const wake = 1;
+	if (write(control.wake_fd, &wake, sizeof(wake)) == sizeof(wake))
+		pthread_join(control.thread, NULL);
+	control.running = 0;
+
+	/* Commands never picked by the render thread */
+	struct myy_control_command command;
+	while (myy_control_next_command(&command))
+		if (command.type == MYY_CONTROL_REPLAY_INPUT) free(command.data);
+
+	close(control.wake_fd);
+	close(control.listen_fd);
+	unlink(control.address.sun_path);
+	control.wake_fd = -1;
+	control.listen_fd = -1;
+}
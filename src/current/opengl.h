@@ -6,6 +6,7 @@
 #define GL_GLEXT_PROTOTYPES 1
 
 #include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
@@ -26,7 +26,11 @@
 #include <myy_drm.h>
 #include <myy.h>
 
+#include <drm_fourcc.h>
+
 #include <helpers/log.h>
+#include <helpers/arena.h>
+#include <helpers/string.h>
 
 // open, read, close
 #include <sys/types.h>
@@ -37,7 +41,10 @@
 // assert
 #include <assert.h>
 
-// free, calloc
+// memset, strcmp
+#include <string.h>
+
+// getenv
 #include <stdlib.h>
 
 char * connector_states[] = {
@@ -49,7 +56,7 @@ char * connector_states[] = {
 static void print_connector_infos
 (drmModeConnector * __restrict const c, int const c_n)
 {
-	LOG("Connector %d\n"
+	LOG_DEBUG("Connector %d\n"
 	    "Connection state  : %s\n"
 	    "Connector id      : %d\n"
 	    "Connector type    : %d\n"
@@ -68,7 +75,7 @@ static void print_connector_infos
 	unsigned int n_modes = c->count_modes;
 	for (unsigned int m = 0; m < n_modes; m++) {
 		drmModeModeInfoPtr mode = c->modes+m;
-		LOG("Connector %d - Mode %d/%d\n"
+		LOG_DEBUG("Connector %d - Mode %d/%d\n"
 		    "Clock            : %d\n"
 		    "Flags            : %d\n"
 		    "Width            : %d\n"
@@ -224,17 +231,24 @@ int init_drm
 			"No encoder found !?\n"
 			"Searching for a CRTC manually...\n"
 		);
-		uint32_t crtc_id = find_crtc_for_connector(
+		crtc_id = find_crtc_for_connector(
 		  resources, connector, drm_infos
 		);
 		if (crtc_id == 0) {
 			LOG("no crtc found!\n");
 			return -1;
 		}
-
-		crtc_id = crtc_id;
 	}
 
+	uint64_t fb_modifiers = 0;
+	drm_infos->fb_modifiers =
+		drmGetCap(fd, DRM_CAP_ADDFB2_MODIFIERS, &fb_modifiers) == 0 &&
+		fb_modifiers;
+
+	drm_infos->crtc_index = 0;
+	for (i = 0; i < resources->count_crtcs; i++)
+		if (resources->crtcs[i] == crtc_id) drm_infos->crtc_index = i;
+
 	drm_infos->fd = fd;
 	drm_infos->mode = mode;
 	drm_infos->connector_id = connector->connector_id;
@@ -242,18 +256,544 @@ int init_drm
 	return 0;
 }
 
+struct drm_property_request {
+	char const * name;
+	uint32_t * id;
+};
+
+/* Fill the IDs of the `n_requests` properties of the object.
+ * Returns how many were found. */
+static unsigned int drm_find_properties
+(int const fd,
+ uint32_t const object_id,
+ uint32_t const object_type,
+ struct drm_property_request const * __restrict const requests,
+ unsigned int const n_requests)
+{
+	unsigned int found = 0;
+	drmModeObjectProperties * __restrict const props =
+		drmModeObjectGetProperties(fd, object_id, object_type);
+	if (props == NULL) return 0;
+
+	for (uint32_t p = 0; p < props->count_props; p++) {
+		drmModePropertyRes * __restrict const property =
+			drmModeGetProperty(fd, props->props[p]);
+		if (property == NULL) continue;
+
+		for (unsigned int r = 0; r < n_requests; r++) {
+			if (strcmp(property->name, requests[r].name) == 0) {
+				*requests[r].id = property->prop_id;
+				found++;
+			}
+		}
+		drmModeFreeProperty(property);
+	}
+
+	drmModeFreeObjectProperties(props);
+	return found;
+}
+
+/* Returns 1 and stores the value of the property `name` of the object
+ * in `value` if it exists. 0 otherwise. */
+static unsigned int drm_property_value
+(int const fd,
+ uint32_t const object_id,
+ uint32_t const object_type,
+ char const * __restrict const name,
+ uint64_t * __restrict const value)
+{
+	unsigned int found = 0;
+	drmModeObjectProperties * __restrict const props =
+		drmModeObjectGetProperties(fd, object_id, object_type);
+	if (props == NULL) return 0;
+
+	for (uint32_t p = 0; p < props->count_props && !found; p++) {
+		drmModePropertyRes * __restrict const property =
+			drmModeGetProperty(fd, props->props[p]);
+		if (property == NULL) continue;
+
+		if (strcmp(property->name, name) == 0) {
+			*value = props->prop_values[p];
+			found = 1;
+		}
+		drmModeFreeProperty(property);
+	}
+
+	drmModeFreeObjectProperties(props);
+	return found;
+}
+
+int drm_plane_type
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id)
+{
+	uint64_t type;
+	return drm_property_value(
+	  drm_infos->fd, plane_id, DRM_MODE_OBJECT_PLANE, "type", &type)
+		? (int) type
+		: -1;
+}
+
+unsigned int drm_plane_find_properties
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id,
+ struct drm_plane_properties * __restrict const plane)
+{
+	memset(plane, 0, sizeof(*plane));
+
+	/* The fences properties are optional */
+	struct drm_property_request const requests[] = {
+		{ "FB_ID", &plane->fb_id },     { "CRTC_ID", &plane->crtc_id },
+		{ "SRC_X", &plane->src_x },     { "SRC_Y", &plane->src_y },
+		{ "SRC_W", &plane->src_w },     { "SRC_H", &plane->src_h },
+		{ "CRTC_X", &plane->crtc_x },   { "CRTC_Y", &plane->crtc_y },
+		{ "CRTC_W", &plane->crtc_w },   { "CRTC_H", &plane->crtc_h },
+		{ "IN_FENCE_FD", &plane->in_fence_fd }
+	};
+	drm_find_properties(
+	  drm_infos->fd, plane_id, DRM_MODE_OBJECT_PLANE,
+	  requests, sizeof(requests)/sizeof(requests[0]));
+
+	return plane->fb_id && plane->crtc_id &&
+	       plane->src_x && plane->src_y && plane->src_w && plane->src_h &&
+	       plane->crtc_x && plane->crtc_y && plane->crtc_w && plane->crtc_h;
+}
+
+static uint32_t find_primary_plane
+(struct drm_infos const * __restrict const drm_infos)
+{
+	int const fd = drm_infos->fd;
+	uint32_t primary_plane_id = 0;
+
+	drmModePlaneRes * __restrict const planes = drmModeGetPlaneResources(fd);
+	if (planes == NULL) return 0;
+
+	for (uint32_t p = 0; p < planes->count_planes && !primary_plane_id; p++) {
+		drmModePlane * __restrict const plane =
+			drmModeGetPlane(fd, planes->planes[p]);
+		if (plane == NULL) continue;
+
+		if ((plane->possible_crtcs & (1 << drm_infos->crtc_index)) &&
+		    drm_plane_type(drm_infos, plane->plane_id)
+		      == DRM_PLANE_TYPE_PRIMARY)
+			primary_plane_id = plane->plane_id;
+
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(planes);
+	return primary_plane_id;
+}
+
+int init_drm_atomic
+(struct drm_infos * __restrict const drm_infos)
+{
+	int const fd = drm_infos->fd;
+
+	char const * __restrict const wanted = getenv("MYY_DRM_ATOMIC");
+	if (wanted != NULL && strcmp(wanted, "0") == 0) return -1;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+		LOG("Atomic modesetting unsupported. Using the legacy API.\n");
+		return -1;
+	}
+
+	drm_infos->plane_id = find_primary_plane(drm_infos);
+	if (drm_infos->plane_id == 0) {
+		LOG("No primary plane for CRTC %u\n", drm_infos->crtc_id);
+		goto legacy;
+	}
+
+	struct drm_crtc_properties * __restrict const crtc =
+		&drm_infos->crtc_props;
+	memset(crtc, 0, sizeof(*crtc));
+	drm_infos->connector_props.crtc_id = 0;
+
+	unsigned int const plane_ok = drm_plane_find_properties(
+	  drm_infos, drm_infos->plane_id, &drm_infos->plane_props);
+
+	struct drm_property_request const crtc_requests[] = {
+		{ "MODE_ID", &crtc->mode_id }, { "ACTIVE", &crtc->active },
+		{ "OUT_FENCE_PTR", &crtc->out_fence_ptr }
+	};
+	struct drm_property_request const connector_requests[] = {
+		{ "CRTC_ID", &drm_infos->connector_props.crtc_id }
+	};
+
+	drm_find_properties(
+	  fd, drm_infos->crtc_id, DRM_MODE_OBJECT_CRTC,
+	  crtc_requests, sizeof(crtc_requests)/sizeof(crtc_requests[0]));
+	drm_find_properties(
+	  fd, drm_infos->connector_id, DRM_MODE_OBJECT_CONNECTOR,
+	  connector_requests, 1);
+
+	if (!plane_ok || !crtc->mode_id || !crtc->active ||
+	    !drm_infos->connector_props.crtc_id) {
+		LOG("Missing atomic modesetting properties\n");
+		goto legacy;
+	}
+
+	if (drmModeCreatePropertyBlob(
+	      fd, drm_infos->mode, sizeof(*drm_infos->mode),
+	      &drm_infos->mode_blob_id)) {
+		LOG_ERRNO("Could not create the mode blob\n");
+		goto legacy;
+	}
+
+	/* Grown by the first commits, then reused by every frame */
+	drm_infos->request = drmModeAtomicAlloc();
+	if (drm_infos->request == NULL) {
+		LOG("Could not allocate the atomic request\n");
+		drmModeDestroyPropertyBlob(fd, drm_infos->mode_blob_id);
+		goto legacy;
+	}
+
+	LOG("Atomic modesetting on plane %u. "
+	    "Fences : in %s, out %s\n",
+	    drm_infos->plane_id,
+	    drm_infos->plane_props.in_fence_fd ? "yes" : "no",
+	    crtc->out_fence_ptr ? "yes" : "no");
+	drm_infos->atomic = 1;
+	drm_infos->atomic_modeset_done = 0;
+	drm_infos->vrr = 0;
+	return 0;
+
+legacy:
+	drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 0);
+	return -1;
+}
+
+void free_drm_atomic
+(struct drm_infos * __restrict const drm_infos)
+{
+	if (drm_infos->request != NULL) drmModeAtomicFree(drm_infos->request);
+	drm_infos->request = NULL;
+}
+
+int drm_init_vrr
+(struct drm_infos * __restrict const drm_infos)
+{
+	uint64_t capable = 0;
+	struct drm_crtc_properties * __restrict const crtc =
+		&drm_infos->crtc_props;
+
+	drm_infos->vrr = 0;
+	crtc->vrr_enabled = 0;
+
+	/* The property is only settable through atomic commits.
+	   Found even when disabled, so that the first commit turns off
+	   the variable refresh rate left by the previous DRM master. */
+	if (drm_infos->atomic) {
+		struct drm_property_request const crtc_requests[] = {
+			{ "VRR_ENABLED", &crtc->vrr_enabled }
+		};
+		drm_find_properties(
+		  drm_infos->fd, drm_infos->crtc_id, DRM_MODE_OBJECT_CRTC,
+		  crtc_requests, 1);
+	}
+
+	char const * __restrict const wanted = getenv("MYY_DRM_VRR");
+	if (wanted != NULL && strcmp(wanted, "0") == 0) return -1;
+
+	if (!drm_infos->atomic || !crtc->vrr_enabled) {
+		LOG("Variable refresh rate unsupported by the driver\n");
+		return -1;
+	}
+
+	if (!drm_property_value(
+	      drm_infos->fd, drm_infos->connector_id, DRM_MODE_OBJECT_CONNECTOR,
+	      "vrr_capable", &capable) || !capable)
+	{
+		LOG("Variable refresh rate unsupported by the display\n");
+		return -1;
+	}
+
+	LOG("Variable refresh rate enabled\n");
+	drm_infos->vrr = 1;
+	return 0;
+}
+
+void drm_atomic_add_plane
+(drmModeAtomicReq * __restrict const request,
+ struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id,
+ struct drm_plane_properties const * __restrict const plane,
+ uint32_t const fb_id,
+ int32_t const x, int32_t const y,
+ uint32_t const width, uint32_t const height)
+{
+	drmModeAtomicAddProperty(request, plane_id, plane->fb_id, fb_id);
+	drmModeAtomicAddProperty(
+	  request, plane_id, plane->crtc_id, drm_infos->crtc_id);
+	/* Source coordinates are in 16.16 fixed point */
+	drmModeAtomicAddProperty(request, plane_id, plane->src_x, 0);
+	drmModeAtomicAddProperty(request, plane_id, plane->src_y, 0);
+	drmModeAtomicAddProperty(
+	  request, plane_id, plane->src_w, (uint64_t) width << 16);
+	drmModeAtomicAddProperty(
+	  request, plane_id, plane->src_h, (uint64_t) height << 16);
+	/* CRTC_X and CRTC_Y are signed */
+	drmModeAtomicAddProperty(
+	  request, plane_id, plane->crtc_x, (uint64_t) (int64_t) x);
+	drmModeAtomicAddProperty(
+	  request, plane_id, plane->crtc_y, (uint64_t) (int64_t) y);
+	drmModeAtomicAddProperty(request, plane_id, plane->crtc_w, width);
+	drmModeAtomicAddProperty(request, plane_id, plane->crtc_h, height);
+}
+
+void drm_atomic_disable_plane
+(drmModeAtomicReq * __restrict const request,
+ uint32_t const plane_id,
+ struct drm_plane_properties const * __restrict const plane)
+{
+	drmModeAtomicAddProperty(request, plane_id, plane->fb_id, 0);
+	drmModeAtomicAddProperty(request, plane_id, plane->crtc_id, 0);
+}
+
+drmModeAtomicReq * drm_atomic_request
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const fb_id,
+ int const in_fence_fd,
+ int * __restrict const out_fence_fd)
+{
+	struct drm_plane_properties const * __restrict const plane =
+		&drm_infos->plane_props;
+	struct drm_crtc_properties const * __restrict const crtc =
+		&drm_infos->crtc_props;
+	uint32_t const plane_id = drm_infos->plane_id;
+	uint32_t const crtc_id = drm_infos->crtc_id;
+
+	drmModeAtomicReq * __restrict const request = drm_infos->request;
+	if (request == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	drmModeAtomicSetCursor(request, 0);
+
+	if (!drm_infos->atomic_modeset_done) {
+		drmModeAtomicAddProperty(request,
+		  drm_infos->connector_id, drm_infos->connector_props.crtc_id,
+		  crtc_id);
+		drmModeAtomicAddProperty(request,
+		  crtc_id, crtc->mode_id, drm_infos->mode_blob_id);
+		drmModeAtomicAddProperty(request, crtc_id, crtc->active, 1);
+		if (crtc->vrr_enabled)
+			drmModeAtomicAddProperty(
+			  request, crtc_id, crtc->vrr_enabled, drm_infos->vrr);
+		drm_atomic_add_plane(
+		  request, drm_infos, plane_id, plane, fb_id, 0, 0,
+		  drm_infos->mode->hdisplay, drm_infos->mode->vdisplay);
+	}
+	else
+		drmModeAtomicAddProperty(request, plane_id, plane->fb_id, fb_id);
+
+	if (in_fence_fd >= 0 && plane->in_fence_fd)
+		drmModeAtomicAddProperty(
+		  request, plane_id, plane->in_fence_fd, in_fence_fd);
+	if (out_fence_fd != NULL) {
+		*out_fence_fd = -1;
+		if (crtc->out_fence_ptr)
+			drmModeAtomicAddProperty(
+			  request, crtc_id, crtc->out_fence_ptr,
+			  (uint64_t) (uintptr_t) out_fence_fd);
+	}
+
+	return request;
+}
+
+int drm_atomic_request_commit
+(struct drm_infos * __restrict const drm_infos,
+ drmModeAtomicReq * __restrict const request,
+ uint32_t flags,
+ void * const user_data)
+{
+	if (!drm_infos->atomic_modeset_done)
+		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+
+	int const ret = drmModeAtomicCommit(
+	  drm_infos->fd, request, flags, user_data);
+
+	if (ret == 0 && !(flags & DRM_MODE_ATOMIC_TEST_ONLY))
+		drm_infos->atomic_modeset_done = 1;
+	return ret ? -1 : 0;
+}
+
+int drm_atomic_commit
+(struct drm_infos * __restrict const drm_infos,
+ uint32_t const fb_id,
+ int const in_fence_fd,
+ int * __restrict const out_fence_fd,
+ uint32_t const flags,
+ void * const user_data)
+{
+	drmModeAtomicReq * __restrict const request =
+		drm_atomic_request(drm_infos, fb_id, in_fence_fd, out_fence_fd);
+	if (request == NULL) return -1;
+
+	return drm_atomic_request_commit(drm_infos, request, flags, user_data);
+}
+
+/* Store, in `modifiers`, the modifiers the primary plane can scan out
+ * `format` with, according to its IN_FORMATS blob.
+ * Returns the number of modifiers stored. */
+static unsigned int drm_plane_modifiers
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const format,
+ uint64_t * __restrict const modifiers,
+ unsigned int const max_modifiers)
+{
+	uint64_t blob_id;
+	unsigned int n_modifiers = 0;
+
+	if (!drm_property_value(
+	      drm_infos->fd, drm_infos->plane_id, DRM_MODE_OBJECT_PLANE,
+	      "IN_FORMATS", &blob_id))
+		return 0;
+
+	drmModePropertyBlobRes * __restrict const blob =
+		drmModeGetPropertyBlob(drm_infos->fd, blob_id);
+	if (blob == NULL) return 0;
+
+	struct drm_format_modifier_blob const * __restrict const header =
+		blob->data;
+	uint32_t const * __restrict const formats = (uint32_t const *)
+		((uint8_t const *) blob->data + header->formats_offset);
+	struct drm_format_modifier const * __restrict const plane_modifiers =
+		(struct drm_format_modifier const *)
+		((uint8_t const *) blob->data + header->modifiers_offset);
+
+	/* Each modifier lists the formats it applies to, as a 64 bits mask
+	   of the formats array, starting from its `offset` index */
+	for (uint32_t f = 0; f < header->count_formats; f++) {
+		if (formats[f] != format) continue;
+
+		for (uint32_t m = 0; m < header->count_modifiers; m++) {
+			struct drm_format_modifier const * __restrict const modifier =
+				plane_modifiers + m;
+			if (f < modifier->offset || f >= modifier->offset + 64 ||
+			    !(modifier->formats & (1ULL << (f - modifier->offset))))
+				continue;
+			if (n_modifiers < max_modifiers)
+				modifiers[n_modifiers++] = modifier->modifier;
+		}
+	}
+
+	drmModeFreePropertyBlob(blob);
+	return n_modifiers;
+}
+
+/* Store, in `modifiers`, the modifiers EGL can render `format` with.
+ * `modifiers` must be able to store MYY_DRM_MAX_MODIFIERS values.
+ * Returns the number of modifiers stored. */
+static unsigned int egl_render_modifiers
+(struct gbm_device * __restrict const gbm_device,
+ uint32_t const format,
+ uint64_t * __restrict const modifiers)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC const get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	PFNEGLQUERYDMABUFMODIFIERSEXTPROC const query_modifiers =
+		(PFNEGLQUERYDMABUFMODIFIERSEXTPROC)
+		eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+	if (get_platform_display == NULL || query_modifiers == NULL) return 0;
+
+	/* add_gl_context will get the same display back */
+	EGLDisplay const display =
+		get_platform_display(EGL_PLATFORM_GBM_KHR, gbm_device, NULL);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL) ||
+	    !sh_hasExtension(
+	      eglQueryString(display, EGL_EXTENSIONS),
+	      "EGL_EXT_image_dma_buf_import_modifiers"))
+		return 0;
+
+	EGLuint64KHR egl_modifiers[MYY_DRM_MAX_MODIFIERS];
+	EGLBoolean external_only[MYY_DRM_MAX_MODIFIERS];
+	EGLint n_egl_modifiers = 0;
+	if (!query_modifiers(
+	      display, format, MYY_DRM_MAX_MODIFIERS,
+	      egl_modifiers, external_only, &n_egl_modifiers))
+		return 0;
+
+	/* External only modifiers cannot be rendered to */
+	unsigned int n_modifiers = 0;
+	for (EGLint m = 0; m < n_egl_modifiers; m++)
+		if (!external_only[m]) modifiers[n_modifiers++] = egl_modifiers[m];
+
+	return n_modifiers;
+}
+
+/* Modifiers both scanned out by the primary plane and rendered by EGL.
+ * Returns the number of modifiers stored in `modifiers`. */
+static unsigned int negotiate_modifiers
+(struct drm_infos const * __restrict const drm_infos,
+ struct gbm_device * __restrict const gbm_device,
+ uint64_t * __restrict const modifiers)
+{
+	uint64_t plane_modifiers[MYY_DRM_MAX_MODIFIERS];
+	uint64_t render_modifiers[MYY_DRM_MAX_MODIFIERS];
+	unsigned int n_modifiers = 0;
+
+	char const * __restrict const wanted = getenv("MYY_DRM_MODIFIERS");
+	if (wanted != NULL && strcmp(wanted, "0") == 0) return 0;
+
+	/* The plane is only known with atomic modesetting */
+	if (!drm_infos->atomic || !drm_infos->fb_modifiers) return 0;
+
+	unsigned int const n_plane_modifiers = drm_plane_modifiers(
+	  drm_infos, DRM_FORMAT_XRGB8888,
+	  plane_modifiers, MYY_DRM_MAX_MODIFIERS);
+	unsigned int const n_render_modifiers = egl_render_modifiers(
+	  gbm_device, DRM_FORMAT_ARGB8888, render_modifiers);
+
+	for (unsigned int p = 0; p < n_plane_modifiers; p++) {
+		for (unsigned int r = 0; r < n_render_modifiers; r++) {
+			if (plane_modifiers[p] == render_modifiers[r]) {
+				modifiers[n_modifiers++] = plane_modifiers[p];
+				break;
+			}
+		}
+	}
+
+	LOG("Modifiers : %u scanned out, %u rendered, %u in common\n",
+	    n_plane_modifiers, n_render_modifiers, n_modifiers);
+	return n_modifiers;
+}
+
 int init_gbm
 (struct drm_infos * __restrict const drm_infos,
  struct gbm_infos * __restrict const gbm_infos)
 {
+	uint64_t modifiers[MYY_DRM_MAX_MODIFIERS];
+
 	gbm_infos->dev = gbm_create_device(drm_infos->fd);
 
-	gbm_infos->surface = gbm_surface_create(
-	  gbm_infos->dev,
-	  drm_infos->mode->hdisplay, drm_infos->mode->vdisplay,
-	  GBM_FORMAT_ARGB8888, 
-	  GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING
-	);
+	/* Let the driver pick a tiled or compressed layout among the
+	   modifiers both the display and the GPU understand.
+	   Without modifiers, the driver picks an implicit layout, usually
+	   linear for scanout buffers. */
+	unsigned int const n_modifiers =
+		negotiate_modifiers(drm_infos, gbm_infos->dev, modifiers);
+	gbm_infos->surface = NULL;
+	if (n_modifiers > 0) {
+		gbm_infos->surface = gbm_surface_create_with_modifiers(
+		  gbm_infos->dev,
+		  drm_infos->mode->hdisplay, drm_infos->mode->vdisplay,
+		  GBM_FORMAT_ARGB8888,
+		  modifiers, n_modifiers
+		);
+		if (!gbm_infos->surface)
+			LOG("Could not use the modifiers. Using an implicit layout.\n");
+	}
+
+	if (!gbm_infos->surface)
+		gbm_infos->surface = gbm_surface_create(
+		  gbm_infos->dev,
+		  drm_infos->mode->hdisplay, drm_infos->mode->vdisplay,
+		  GBM_FORMAT_ARGB8888, 
+		  GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING
+		);
 
 	int ret = 0;
 	if (!gbm_infos->surface) {
@@ -341,10 +881,105 @@ int add_gl_context
 	egl_infos->config  = config;
 	egl_infos->surface = surface;
 	egl_infos->context = context;
+	egl_init_native_fences(egl_infos);
 
 	return 0;
 }
 
+unsigned int egl_init_native_fences
+(struct egl_infos * __restrict const egl_infos)
+{
+	egl_infos->create_sync = NULL;
+	egl_infos->destroy_sync = NULL;
+	egl_infos->dup_native_fence_fd = NULL;
+
+	if (!sh_hasExtension(
+	      eglQueryString(egl_infos->display, EGL_EXTENSIONS),
+	      "EGL_ANDROID_native_fence_sync"))
+		return 0;
+
+	PFNEGLCREATESYNCKHRPROC const create_sync = (PFNEGLCREATESYNCKHRPROC)
+	  eglGetProcAddress("eglCreateSyncKHR");
+	PFNEGLDESTROYSYNCKHRPROC const destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+	  eglGetProcAddress("eglDestroySyncKHR");
+	PFNEGLDUPNATIVEFENCEFDANDROIDPROC const dup_native_fence_fd =
+	  (PFNEGLDUPNATIVEFENCEFDANDROIDPROC)
+	  eglGetProcAddress("eglDupNativeFenceFDANDROID");
+	if (!create_sync || !destroy_sync || !dup_native_fence_fd) return 0;
+
+	egl_infos->create_sync = create_sync;
+	egl_infos->destroy_sync = destroy_sync;
+	egl_infos->dup_native_fence_fd = dup_native_fence_fd;
+	return 1;
+}
+
+EGLSyncKHR egl_native_fence_insert
+(struct egl_infos const * __restrict const egl_infos)
+{
+	if (egl_infos->create_sync == NULL) return EGL_NO_SYNC_KHR;
+
+	static EGLint const attribs[] = {
+		EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID,
+		EGL_NONE
+	};
+	return egl_infos->create_sync(
+	  egl_infos->display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+}
+
+int egl_native_fence_export
+(struct egl_infos const * __restrict const egl_infos,
+ EGLSyncKHR const fence)
+{
+	if (fence == EGL_NO_SYNC_KHR) return -1;
+
+	int const fd = egl_infos->dup_native_fence_fd(egl_infos->display, fence);
+	egl_infos->destroy_sync(egl_infos->display, fence);
+	return (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) ? -1 : fd;
+}
+
+/* The framebuffers records.
+ * GBM surfaces rotate between a few buffers at most, so the records
+ * attached to them come from a small static pool instead of the heap. */
+#define MYY_DRM_FB_POOL_SIZE 8
+
+static struct {
+	struct ah_pool pool;
+	struct drm_fb_stats stats;
+	void * memory[
+	  AH_POOL_MEMORY_SIZE(sizeof(struct drm_fb), MYY_DRM_FB_POOL_SIZE)
+	  / sizeof(void *)
+	];
+} drm_fbs;
+
+static struct drm_fb * drm_fb_alloc()
+{
+	if (drm_fbs.pool.memory == NULL) {
+		ah_PoolInit(
+		  &drm_fbs.pool, drm_fbs.memory,
+		  sizeof(struct drm_fb), MYY_DRM_FB_POOL_SIZE
+		);
+	}
+
+	struct drm_fb * __restrict const fb = ah_PoolAlloc(&drm_fbs.pool);
+	if (fb) {
+		memset(fb, 0, sizeof *fb);
+		drm_fbs.stats.in_use++;
+	}
+	return fb;
+}
+
+static void drm_fb_free(struct drm_fb * __restrict const fb)
+{
+	ah_PoolFree(&drm_fbs.pool, fb);
+	drm_fbs.stats.in_use--;
+}
+
+void drm_fb_get_stats(struct drm_fb_stats * __restrict const stats)
+{
+	*stats = drm_fbs.stats;
+	stats->capacity = MYY_DRM_FB_POOL_SIZE;
+}
+
 /* DRM cleanup */
 void drm_fb_destroy_callback
 (struct gbm_bo * __restrict const bo,
@@ -357,7 +992,7 @@ void drm_fb_destroy_callback
 	if (fb->fb_id)
 		drmModeRmFB(fb->drm->fd, fb->fb_id);
 
-	free(fb);
+	drm_fb_free(fb);
 }
 
 struct drm_fb * drm_fb_get_from_bo
@@ -368,10 +1003,17 @@ struct drm_fb * drm_fb_get_from_bo
 	uint32_t width, height, stride, handle;
 	int ret;
 
-	if (fb)
+	if (fb) {
+		drm_fbs.stats.hits++;
 		return fb;
+	}
 
-	fb = calloc(1, sizeof *fb);
+	drm_fbs.stats.misses++;
+	fb = drm_fb_alloc();
+	if (fb == NULL) {
+		LOG("More than %d framebuffers in use !\n", MYY_DRM_FB_POOL_SIZE);
+		return NULL;
+	}
 	fb->bo = bo;
 	fb->drm = drm_infos;
 
@@ -380,15 +1022,41 @@ struct drm_fb * drm_fb_get_from_bo
 	stride = gbm_bo_get_stride(bo);
 	handle = gbm_bo_get_handle(bo).u32;
 
-	ret = drmModeAddFB(
-	  drm_infos->fd,
-	  width, height,
-	  24, 32,
-	  stride, handle, &fb->fb_id
-	);
+	/* Tiled and compressed layouts can use several planes
+	   (e.g. compression metadata) */
+	uint64_t const modifier = gbm_bo_get_modifier(bo);
+	if (drm_infos->fb_modifiers && modifier != DRM_FORMAT_MOD_INVALID) {
+		uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
+		uint64_t modifiers[4] = {0};
+		int const n_planes = gbm_bo_get_plane_count(bo);
+
+		for (int p = 0; p < n_planes && p < 4; p++) {
+			handles[p]   = gbm_bo_get_handle_for_plane(bo, p).u32;
+			pitches[p]   = gbm_bo_get_stride_for_plane(bo, p);
+			offsets[p]   = gbm_bo_get_offset(bo, p);
+			modifiers[p] = modifier;
+		}
+
+		/* The alpha channel is ignored by the primary plane anyway */
+		ret = drmModeAddFB2WithModifiers(
+		  drm_infos->fd,
+		  width, height, DRM_FORMAT_XRGB8888,
+		  handles, pitches, offsets, modifiers,
+		  &fb->fb_id, DRM_MODE_FB_MODIFIERS
+		);
+		LOG_DEBUG("Framebuffer %u : modifier 0x%016llx, %d planes\n",
+		          fb->fb_id, (unsigned long long) modifier, n_planes);
+	}
+	else
+		ret = drmModeAddFB(
+		  drm_infos->fd,
+		  width, height,
+		  24, 32,
+		  stride, handle, &fb->fb_id
+		);
 	if (ret) {
 		LOG("failed to create fb: %s\n", strerror(errno));
-		free(fb);
+		drm_fb_free(fb);
 		return NULL;
 	}
 
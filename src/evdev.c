@@ -31,49 +31,623 @@
 #include <fcntl.h>
 
 #include <myy.h>
+#include <myy_keyboard.h>
 #include <helpers/log.h>
+#include <helpers/pointer.h>
+#include <helpers/trace.h>
 
 #include <ftw.h>
+#include <time.h>
 
 #include <unistd.h>
 
 #include "myy_evdev.h"
 
+#if !defined(input_event_sec)
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+/* Linux 5.0 */
+#if !defined(REL_WHEEL_HI_RES)
+#define REL_WHEEL_HI_RES  0x0b
+#define REL_HWHEEL_HI_RES 0x0c
+#endif
+
+static uint64_t event_time_us(struct input_event const * __restrict const ev)
+{
+	return (uint64_t) ev->input_event_sec * 1000000 + ev->input_event_usec;
+}
+
+/* The motion of the current report, accelerated once the report is
+   complete */
+static struct {
+	struct ph_pointer accel;
+	int32_t dx, dy;
+	struct ph_predictor predictor;
+	/* The cursor position once the queued events are applied, for the
+	   predictor. Kept inside the screen like myy_abs_mouse_move does,
+	   and synchronised with the application cursor after each batch. */
+	int32_t x, y;
+	int32_t width, height;
+} pointer;
+
+/* The events read since the last batch */
+static struct {
+	struct myy_input_event events[MYY_INPUT_BATCH_MAX_EVENTS];
+	unsigned int n_events;
+	uint64_t time_us;
+} batch;
+
+struct myy_input_event * myy_evdev_queue_event
+(uint8_t const type,
+ uint16_t const code,
+ uint8_t const state,
+ uint64_t const time_us)
+{
+	if (batch.n_events == MYY_INPUT_BATCH_MAX_EVENTS)
+		myy_evdev_flush_events();
+	if (batch.n_events == 0) batch.time_us = time_us;
+
+	struct myy_input_event * __restrict const event =
+		batch.events + batch.n_events++;
+	event->time_offset_us = (int32_t) (time_us - batch.time_us);
+	event->type  = type;
+	event->state = state;
+	event->code  = code;
+	event->motion.dx = event->motion.dy = 0;
+	return event;
+}
+
+unsigned int myy_evdev_flush_events()
+{
+	unsigned int const n_events = batch.n_events;
+	if (n_events == 0) return 0;
+
+	struct myy_input_batch const handed = {
+		.time_us  = batch.time_us,
+		.n_events = n_events,
+		.events   = batch.events
+	};
+	myy_input_batch(&handed);
+	batch.n_events = 0;
+	myy_cursor_position(&pointer.x, &pointer.y);
+
+	return n_events;
+}
+
+/* Between 0 and size - 1 */
+static int32_t clamp(int32_t const value, int32_t const size)
+{
+	return (value < 0) ? 0 : (value < size ? value : size - 1);
+}
+
+void myy_input_dispatch(struct myy_input_batch const * __restrict const batch)
+{
+	struct myy_touch_snapshot snapshot;
+	/* Fractions of notches not sent yet */
+	static int32_t wheels[2];
+
+	for (unsigned int e = 0; e < batch->n_events; e++) {
+		struct myy_input_event const * __restrict const event =
+			batch->events + e;
+		uint64_t const time_us = batch->time_us + event->time_offset_us;
+
+		switch (event->type) {
+		case myy_input_motion:
+			/* The callbacks only know the cursor */
+			if (event->code == 0)
+				myy_abs_mouse_move(event->motion.dx, event->motion.dy);
+			break;
+		case myy_input_wheel: {
+			unsigned int const horizontal = (event->code == REL_HWHEEL);
+			int32_t const value = wheels[horizontal] + event->wheel.value;
+			int32_t const notches = value / MYY_WHEEL_NOTCH;
+			wheels[horizontal] = value - notches * MYY_WHEEL_NOTCH;
+			if (notches)
+				myy_mouse_action(
+				  horizontal ? myy_mouse_hwheel_action : myy_mouse_wheel_action,
+				  notches);
+			break;
+		}
+		case myy_input_button:
+			myy_mouse_action(
+			  event->state
+			  ? myy_mouse_button_pressed_action
+			  : myy_mouse_button_released_action,
+			  event->code);
+			break;
+		case myy_input_key: {
+			struct myy_key_event const key = {
+				.time_us   = time_us,
+				.code      = event->code,
+				.state     = event->state,
+				.keysym    = event->key.keysym,
+				.utf32     = event->key.utf32,
+				.modifiers = event->key.modifiers
+			};
+			myy_key_action(&key);
+			break;
+		}
+		case myy_input_touch:
+			if (event->code == 0) {
+				snapshot.time_us  = time_us;
+				snapshot.n_points = 0;
+			}
+			if (event->state && snapshot.n_points < MYY_TOUCH_MAX_POINTS) {
+				struct myy_touch_point * __restrict const point =
+					snapshot.points + snapshot.n_points++;
+				point->id = event->touch.id;
+				point->x  = event->touch.x;
+				point->y  = event->touch.y;
+			}
+			if (snapshot.n_points == event->state) myy_touch_frame(&snapshot);
+			break;
+		}
+	}
+}
+
+void myy_evdev_set_acceleration
+(struct ph_accel_config const * __restrict const config)
+{
+	ph_PointerInit(&pointer.accel, config);
+	pointer.dx = pointer.dy = 0;
+}
+
+void myy_evdev_set_prediction(enum ph_predict_mode const mode)
+{
+	ph_PredictorInit(&pointer.predictor, mode);
+}
+
+enum ph_predict_mode myy_evdev_prediction()
+{
+	return pointer.predictor.mode;
+}
+
+void myy_evdev_predict_cursor
+(uint64_t const now_us,
+ uint64_t const scanout_us,
+ int * __restrict const x,
+ int * __restrict const y)
+{
+	float predicted_x, predicted_y;
+
+	if (ph_PredictorPredict(
+	      &pointer.predictor, now_us, scanout_us,
+	      &predicted_x, &predicted_y))
+	{
+		*x = (int) (predicted_x + (predicted_x < 0 ? -0.5f : 0.5f));
+		*y = (int) (predicted_y + (predicted_y < 0 ? -0.5f : 0.5f));
+	}
+	else myy_cursor_position(x, y);
+}
+
+/* Every handler receives the event and its device */
+typedef void (*event_handler)
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device);
+
+/* Resynchronisations.
+ *
+ * When a client does not read its events fast enough, the kernel
+ * drops its whole buffer and sends SYN_DROPPED. The report being read
+ * then is incomplete, and the reports lost cannot be recovered.
+ * Relative motions are lost for good : the motion of the incomplete
+ * report is discarded rather than applied with a part missing.
+ * Absolute axes and keys are states : libevdev compares the device
+ * state with the one it knew and sends the differences, which are
+ * applied like any other event. Recordings have no device to compare
+ * with, so the events following a SYN_DROPPED are discarded until the
+ * next SYN_REPORT, as the kernel documentation advises. */
+
+static void report_seen
+(struct myy_evdev_data * __restrict const device,
+ uint64_t const time_us)
+{
+	uint64_t const interval = time_us - device->last_report_us;
+
+	if (device->last_report_us && time_us > device->last_report_us &&
+	    (device->report_interval_us == 0 ||
+	     interval < device->report_interval_us))
+		device->report_interval_us = interval;
+	device->last_report_us = time_us;
+}
+
+/* The dropped event is timestamped when the kernel buffer overflowed.
+   Everything reported since the last report read was lost. */
+static void resync_start
+(struct input_event const * __restrict const dropped,
+ struct myy_evdev_data * __restrict const device)
+{
+	uint64_t const time_us = event_time_us(dropped);
+
+	device->resyncs++;
+	if (device->report_interval_us && device->last_report_us &&
+	    time_us > device->last_report_us)
+		device->dropped_reports +=
+			(time_us - device->last_report_us) / device->report_interval_us;
+
+	if (device->type == MYY_INPUT_MOUSE) pointer.dx = pointer.dy = 0;
+	TRACE_COUNTER("input resyncs", device->resyncs);
+}
+
+static void syn_dropped
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	resync_start(event, device);
+	device->dropping = 1;
+}
+
+static void dropping_done
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	device->dropping = 0;
+	report_seen(device, event_time_us(event));
+}
+
+/* Mice */
+
 /* parse horizontal relative move events */
-static void plus_x(int const code, int const value)
+static void plus_x
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
 {
-	myy_abs_mouse_move(value, 0);
+	pointer.dx += event->value;
 }
 
 /* parse vertical relative move events */
-static void plus_y(int const code, int const value) {
-	myy_abs_mouse_move(0, value);
+static void plus_y
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	pointer.dy += event->value;
+}
+
+/* Queue the motion once every axis of the report has been read */
+static void syn_report
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	int32_t px, py;
+	uint64_t const time_us = event_time_us(event);
+
+	report_seen(device, time_us);
+	if (pointer.dx == 0 && pointer.dy == 0) return;
+	ph_PointerMove(
+	  &pointer.accel, pointer.dx, pointer.dy, time_us, &px, &py);
+	pointer.dx = pointer.dy = 0;
+	if (px || py) {
+		struct myy_input_event * __restrict const motion =
+			myy_evdev_queue_event(myy_input_motion, device->pointer, 0, time_us);
+		motion->motion.dx = px;
+		motion->motion.dy = py;
+	}
+	/* Only the cursor is predicted */
+	if (device->pointer != 0) return;
+	pointer.x = clamp(pointer.x + px, pointer.width);
+	pointer.y = clamp(pointer.y + py, pointer.height);
+
+	/* Reports moving less than a pixel still tell the predictor that
+	   the pointer is slowing down */
+	if (pointer.predictor.mode != PH_PREDICT_OFF)
+		ph_PredictorAddSample(&pointer.predictor, pointer.x, pointer.y, time_us);
+}
+
+static void queue_wheel
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data const * __restrict const device,
+ uint16_t const axis,
+ int32_t const value)
+{
+	struct myy_input_event * __restrict const wheel = myy_evdev_queue_event(
+	  myy_input_wheel, axis, 0, event_time_us(event));
+	wheel->wheel.value   = value;
+	wheel->wheel.pointer = device->pointer;
+}
+
+/* parse mouse wheel like events.
+ * Wheels reporting REL_WHEEL_HI_RES or REL_HWHEEL_HI_RES also report the
+ * whole notches with REL_WHEEL or REL_HWHEEL, which are then ignored.
+ * Each axis is checked on its own, tilt wheels being rarely hi-res. */
+static void plus_wheel
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	if (device->hires_wheel) return;
+	queue_wheel(event, device, REL_WHEEL, event->value * MYY_WHEEL_NOTCH);
+}
+
+static void plus_hwheel
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	if (device->hires_hwheel) return;
+	queue_wheel(event, device, REL_HWHEEL, event->value * MYY_WHEEL_NOTCH);
+}
+
+/* Fractions of notches, in 120ths */
+static void plus_wheel_hi_res
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	queue_wheel(event, device, REL_WHEEL, event->value);
+}
+
+static void plus_hwheel_hi_res
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	queue_wheel(event, device, REL_HWHEEL, event->value);
+}
+
+/* Mouse buttons, from BTN_LEFT to BTN_TASK.
+ * The kernel does not repeat them, but recorded events may. */
+static void mouse_button
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	if (event->value == 2) return;
+	struct myy_input_event * __restrict const button = myy_evdev_queue_event(
+	  myy_input_button, event->code, event->value != 0,
+	  event_time_us(event));
+	button->button.pointer = device->pointer;
+}
+
+/* Keyboards. See keyboard.c */
+
+static void keyboard_key
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	myy_keyboard_key(event->code, event->value, event_time_us(event));
+}
+
+/* Touchscreens.
+ * Multi-touch protocol B devices report the changes of each contact
+ * slot, and single-touch devices one contact with ABS_X, ABS_Y and
+ * BTN_TOUCH. The state of the contacts is kept per device, and sent to
+ * the application as a snapshot at the end of each report that changed
+ * it. */
+
+static void touch_slot
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+
+	/* The events of the slots beyond MYY_TOUCH_MAX_POINTS go to the
+	   spare contact, never reported */
+	touch->slot = ((unsigned int) event->value < touch->n_slots)
+		? (unsigned int) event->value
+		: MYY_TOUCH_MAX_POINTS;
+}
+
+static void touch_tracking_id
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	touch->contacts[touch->slot].tracking_id = event->value;
+	touch->changed = 1;
+}
+
+static void touch_mt_x
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	touch->contacts[touch->slot].x = event->value;
+	touch->changed = 1;
+}
+
+static void touch_mt_y
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	touch->contacts[touch->slot].y = event->value;
+	touch->changed = 1;
+}
+
+/* Multi-touch devices also report their first contact with ABS_X,
+   ABS_Y and BTN_TOUCH, for single-touch clients */
+static void touch_x
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	if (touch->n_slots) return;
+	touch->contacts[0].x = event->value;
+	touch->changed = 1;
+}
+
+static void touch_y
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	if (touch->n_slots) return;
+	touch->contacts[0].y = event->value;
+	touch->changed = 1;
+}
+
+static void touch_button
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	if (touch->n_slots) return;
+	touch->contacts[0].tracking_id = event->value ? 0 : -1;
+	touch->changed = 1;
 }
 
-/* parse mouse wheel like events */
-static void plus_wheel(int const code, int const value) {
-	myy_mouse_action(myy_mouse_wheel_action, value);
+static inline int16_t touch_scale
+(int32_t const value, int32_t const min, uint32_t const scale)
+{
+	return (int16_t) (((int64_t) (value - min) * scale) >> 16);
+}
+
+/* Queue the points of the snapshot, within the same batch */
+static void touch_report
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	struct myy_touch_state * __restrict const touch = &device->touch;
+	unsigned int const n_contacts = touch->n_slots ? touch->n_slots : 1;
+	unsigned int n_points = 0;
+	uint64_t const time_us = event_time_us(event);
+
+	report_seen(device, time_us);
+	if (!touch->changed) return;
+	touch->changed = 0;
+
+	for (unsigned int c = 0; c < n_contacts; c++)
+		n_points += (touch->contacts[c].tracking_id >= 0);
+	if (n_points == 0) {
+		myy_evdev_queue_event(myy_input_touch, 0, 0, time_us);
+		return;
+	}
+
+	if (batch.n_events + n_points > MYY_INPUT_BATCH_MAX_EVENTS)
+		myy_evdev_flush_events();
+
+	unsigned int p = 0;
+	for (unsigned int c = 0; c < n_contacts; c++) {
+		struct myy_touch_contact const * __restrict const contact =
+			touch->contacts + c;
+		if (contact->tracking_id < 0) continue;
+
+		struct myy_input_event * __restrict const point =
+			myy_evdev_queue_event(myy_input_touch, p, n_points, time_us);
+		point->touch.id = contact->tracking_id;
+		point->touch.x  = touch_scale(contact->x, touch->min_x, touch->scale_x);
+		point->touch.y  = touch_scale(contact->y, touch->min_y, touch->scale_y);
+
+		/* The first contact moves the cursor */
+		if (p++ == 0) {
+			pointer.x = clamp(point->touch.x, pointer.width);
+			pointer.y = clamp(point->touch.y, pointer.height);
+		}
+	}
 }
 
-/* parse unknown events */
-static void plus_wut(int code, int value) {
-	LOG("??? : %d\n", value);
+/* Dispatch tables.
+ *
+ * Events are dispatched by device type, then event type, to a table
+ * indexed by the event code. Each code table covers the codes up to
+ * the last one handled, every code in between having a handler, so
+ * that dispatching costs two bounds checks and an indirect call,
+ * whatever the number of codes handled.
+ * Codes past the end of their table, and types without table, like
+ * EV_MSC (MSC_SCAN, MSC_TIMESTAMP), are ignored. */
+
+static void ignore_event
+(struct input_event const * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
 }
 
-static void (*plus_rels[])(int code, int value) = {
+static event_handler const mouse_syn[SYN_DROPPED + 1] = {
+	[0 ... SYN_DROPPED] = ignore_event,
+	[SYN_REPORT] = syn_report,
+	[SYN_DROPPED] = syn_dropped
+};
+
+static event_handler const mouse_keys[BTN_TASK + 1] = {
+	[0 ... BTN_MOUSE - 1] = ignore_event,
+	[BTN_MOUSE ... BTN_TASK] = mouse_button
+};
+
+static event_handler const mouse_rels[REL_CNT] = {
+	[0 ... REL_MAX] = ignore_event,
 	[REL_X] = plus_x,
 	[REL_Y] = plus_y,
 	[REL_WHEEL] = plus_wheel,
-	plus_wut
+	[REL_HWHEEL] = plus_hwheel,
+	[REL_WHEEL_HI_RES] = plus_wheel_hi_res,
+	[REL_HWHEEL_HI_RES] = plus_hwheel_hi_res
+};
+
+static event_handler const touch_syn[SYN_DROPPED + 1] = {
+	[0 ... SYN_DROPPED] = ignore_event,
+	[SYN_REPORT] = touch_report,
+	[SYN_DROPPED] = syn_dropped
+};
+
+static event_handler const touch_keys[BTN_TOUCH + 1] = {
+	[0 ... BTN_TOUCH - 1] = ignore_event,
+	[BTN_TOUCH] = touch_button
+};
+
+static event_handler const touch_abs[ABS_MT_TRACKING_ID + 1] = {
+	[0 ... ABS_MT_TRACKING_ID] = ignore_event,
+	[ABS_X] = touch_x,
+	[ABS_Y] = touch_y,
+	[ABS_MT_SLOT] = touch_slot,
+	[ABS_MT_POSITION_X] = touch_mt_x,
+	[ABS_MT_POSITION_Y] = touch_mt_y,
+	[ABS_MT_TRACKING_ID] = touch_tracking_id
+};
+
+static event_handler const keyboard_syn[SYN_DROPPED + 1] = {
+	[0 ... SYN_DROPPED] = ignore_event,
+	[SYN_DROPPED] = syn_dropped
+};
+
+static event_handler const keyboard_keys[KEY_CNT] = {
+	[0 ... KEY_MAX] = keyboard_key
+};
+
+/* Every event is discarded, up to the end of the report */
+static event_handler const dropping_syn[] = {
+	[SYN_REPORT] = dropping_done
+};
+
+struct code_handlers {
+	event_handler const * handlers;
+	unsigned int n_codes;
+};
+
+#define CODE_HANDLERS(table) { table, sizeof(table) / sizeof(event_handler) }
+
+/* Used instead of the device type ones while device->dropping */
+#define DROPPING_HANDLERS (MYY_INPUT_KEYBOARD + 1)
+
+static struct code_handlers const dispatch[][EV_CNT] = {
+	[MYY_INPUT_MOUSE] = {
+		[EV_SYN] = CODE_HANDLERS(mouse_syn),
+		[EV_KEY] = CODE_HANDLERS(mouse_keys),
+		[EV_REL] = CODE_HANDLERS(mouse_rels)
+	},
+	[MYY_INPUT_TOUCHSCREEN] = {
+		[EV_SYN] = CODE_HANDLERS(touch_syn),
+		[EV_KEY] = CODE_HANDLERS(touch_keys),
+		[EV_ABS] = CODE_HANDLERS(touch_abs)
+	},
+	[MYY_INPUT_KEYBOARD] = {
+		[EV_SYN] = CODE_HANDLERS(keyboard_syn),
+		[EV_KEY] = CODE_HANDLERS(keyboard_keys)
+	},
+	[DROPPING_HANDLERS] = {
+		[EV_SYN] = CODE_HANDLERS(dropping_syn)
+	}
 };
 
 /* Parse an input data. */
-static void parse_event
-(struct input_event * __restrict const event) {
-	/* If it's a relative move event, we'll parse it as a mouse move
-	 * event */
-	if (event->type == EV_REL)
-		plus_rels[event->code](event->code, event->value);
+static inline void parse_event
+(struct input_event * __restrict const event,
+ struct myy_evdev_data * __restrict const device)
+{
+	if (event->type >= EV_CNT) return;
+
+	unsigned int const handlers =
+		device->dropping ? DROPPING_HANDLERS : device->type;
+	struct code_handlers const * __restrict const codes =
+		&dispatch[handlers][event->type];
+	if (event->code < codes->n_codes)
+		codes->handlers[event->code](event, device);
 }
 
 /* Recatch all dropped input data. That WILL happen, no matter what.
@@ -85,19 +659,22 @@ static void parse_event
 	 - move the mouse,
 	 - release 'Scroll Lock',
 	 - move it again.
+	 `event` is the SYN_DROPPED event. The events read afterwards restore
+	 the device state, and carry no relative motion worth applying.
  */
 static void parse_dropped_events
 (struct input_event * __restrict const event,
- struct libevdev * __restrict const dev) 
+ struct myy_evdev_data * __restrict const device) 
 {
 	int rc;
-	//LOG("Resyncing !! ------------------------\n");
-	do {
-		parse_event(event);
-		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_SYNC, event);
+
+	resync_start(event, device);
+	while ((rc = libevdev_next_event(
+	          device->dev, LIBEVDEV_READ_FLAG_SYNC, event))
+	       == LIBEVDEV_READ_STATUS_SYNC)
+	{
+		if (event->type != EV_REL) parse_event(event, device);
 	}
-	while (rc == LIBEVDEV_READ_STATUS_SYNC);
-	//LOG("Resync Complete ! ++++++++++++++++++\n");
 }
 
 /* When everything's fine, we'll just parse the last event.
@@ -116,87 +693,323 @@ static inline int is_a_valid_mouse
           libevdev_has_event_code(dev, EV_KEY, BTN_LEFT));
 }
 
-/* Check if the provided file path is a mouse Evdev input node */
-static int mouse_check
+/* Absolute positions on the screen itself. Touchpads also report
+ * absolute positions, but of a finger on the pad, and are left out. */
+static inline int is_a_touchscreen
+(struct libevdev const * const dev) {
+  return (libevdev_has_property(dev, INPUT_PROP_DIRECT) &&
+          (libevdev_has_event_code(dev, EV_ABS, ABS_MT_POSITION_X) ||
+           libevdev_has_event_code(dev, EV_ABS, ABS_X)));
+}
+
+/* Letters, a space bar and an enter key. Devices reporting only a few
+ * keys, like power buttons or multimedia keys, are left out. */
+static inline int is_a_keyboard
+(struct libevdev const * const dev) {
+  return (libevdev_has_event_code(dev, EV_KEY, KEY_A) &&
+          libevdev_has_event_code(dev, EV_KEY, KEY_Z) &&
+          libevdev_has_event_code(dev, EV_KEY, KEY_SPACE) &&
+          libevdev_has_event_code(dev, EV_KEY, KEY_ENTER));
+}
+
+/* Start from the contacts already on the screen */
+static void touch_init
+(struct myy_touch_state * __restrict const touch,
+ struct libevdev const * __restrict const dev)
+{
+	int const n_slots = libevdev_get_num_slots(dev);
+
+	memset(touch, 0, sizeof(*touch));
+	touch->scale_x = touch->scale_y = 1 << 16;
+
+	if (n_slots > 0) {
+		touch->n_slots = (n_slots < MYY_TOUCH_MAX_POINTS)
+			? n_slots
+			: MYY_TOUCH_MAX_POINTS;
+		for (unsigned int s = 0; s < touch->n_slots; s++) {
+			struct myy_touch_contact * __restrict const contact =
+				touch->contacts + s;
+			contact->tracking_id =
+				libevdev_get_slot_value(dev, s, ABS_MT_TRACKING_ID);
+			contact->x = libevdev_get_slot_value(dev, s, ABS_MT_POSITION_X);
+			contact->y = libevdev_get_slot_value(dev, s, ABS_MT_POSITION_Y);
+		}
+		int const slot = libevdev_get_current_slot(dev);
+		touch->slot = (slot >= 0 && (unsigned int) slot < touch->n_slots)
+			? (unsigned int) slot
+			: MYY_TOUCH_MAX_POINTS;
+	}
+	else {
+		touch->contacts[0].tracking_id =
+			libevdev_get_event_value(dev, EV_KEY, BTN_TOUCH) ? 0 : -1;
+		touch->contacts[0].x = libevdev_get_event_value(dev, EV_ABS, ABS_X);
+		touch->contacts[0].y = libevdev_get_event_value(dev, EV_ABS, ABS_Y);
+	}
+}
+
+/* ftw() callbacks cannot receive arguments */
+static struct {
+	struct myy_evdev_data * devices;
+	unsigned int n, max;
+	/* Grab the mice and touchscreens */
+	unsigned int grab;
+	/* Each mouse moves its own pointer */
+	unsigned int multi_pointer;
+	unsigned int n_mice;
+} scan;
+
+/* Keep the provided file path if it's a mouse, a touchscreen or a
+ * keyboard Evdev input node */
+static int device_check
 (char const * __restrict const file_path, 
  struct stat const * __restrict const file_stats,
  int const filetype)
 {
 	struct libevdev *dev = NULL;
 	int fd = open(file_path, O_RDONLY|O_NONBLOCK);
+	if (fd < 0) return 0;
+
 	int rc = libevdev_new_from_fd(fd, &dev);
-	// nftw() continue if 0 is returned. 
-	// Since we want to return the fd, we need to avoid 0 values
-	int ret = fd + 1;
+	if (rc < 0) {
+		close(fd);
+		return 0;
+	}
 
-	if (rc < 0 || !is_a_valid_mouse(dev))
-	{
-		if (rc >= 0) close(fd);
-		ret = 0;
+	struct myy_evdev_data * __restrict const device =
+		scan.devices + scan.n;
+	if (is_a_valid_mouse(dev)) {
+		device->type = MYY_INPUT_MOUSE;
+		device->hires_wheel =
+			libevdev_has_event_code(dev, EV_REL, REL_WHEEL_HI_RES);
+		device->hires_hwheel =
+			libevdev_has_event_code(dev, EV_REL, REL_HWHEEL_HI_RES);
+		device->pointer = scan.multi_pointer ? scan.n_mice++ : 0;
 	}
-	libevdev_free(dev);
-	return ret;
-}
+	else if (is_a_touchscreen(dev)) {
+		device->type = MYY_INPUT_TOUCHSCREEN;
+		touch_init(&device->touch, dev);
+	}
+	else if (is_a_keyboard(dev))
+		device->type = MYY_INPUT_KEYBOARD;
+	else {
+		libevdev_free(dev);
+		close(fd);
+		return 0;
+	}
+
+	static char const * const type_names[] = {
+		[MYY_INPUT_MOUSE]       = "Mouse",
+		[MYY_INPUT_TOUCHSCREEN] = "Touchscreen",
+		[MYY_INPUT_KEYBOARD]    = "Keyboard"
+	};
+	LOG("[Input] %s : %s\n", type_names[device->type], file_path);
+	/* Timestamp the events like the page flips and the frames */
+	libevdev_set_clock_id(dev, CLOCK_MONOTONIC);
+	device->grabbed = 0;
+	if (scan.grab && device->type != MYY_INPUT_KEYBOARD) {
+		rc = libevdev_grab(dev, LIBEVDEV_GRAB);
+		if (rc < 0)
+			LOG_WARN("[Input] Could not grab %s : %s\n",
+			         file_path, strerror(-rc));
+		device->grabbed = (rc == 0);
+	}
+	device->dev = dev;
+	device->fd  = fd;
+	device->events = device->resyncs = device->dropped_reports = 0;
+	device->last_report_us = device->report_interval_us = 0;
+	device->dropping = 0;
 
-/* Scan all /dev/input nodes for a mouse */
-static int acquire_mouse() {
-	int incremented_fd = 
-		ftw("/dev/input", mouse_check, 1);
-	int ret = -1;
-	if (incremented_fd) ret = incremented_fd - 1;
-	return ret;
+	// ftw() continue if 0 is returned.
+	return ++scan.n == scan.max;
 }
 
-/* Read input from the provided mouse device */
+/* Read input from the provided device */
 unsigned int myy_evdev_read_input
-(struct myy_evdev_data const * const mouse) 
+(struct myy_evdev_data * const mouse) 
 {
 	int rc = 0;
 	int ret = 1;
-	struct libevdev const * const dev = mouse->dev;
+	unsigned int n_events = 0;
+	struct libevdev * const dev = mouse->dev;
 	
 	/* Read all available inputs data.
 	 * rc == -EAGAIN when no input data can be read is available now. */
 	do {
 		struct input_event ev;
 		rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
-		if (rc >= 0) handlers[rc](&ev, dev);
+		if (rc >= 0) { handlers[rc](&ev, mouse); n_events++; }
 	}
 	while (rc == LIBEVDEV_READ_STATUS_SUCCESS
 	    || rc == LIBEVDEV_READ_STATUS_SYNC);
 
+	TRACE_COUNTER("input events", n_events);
+	mouse->events += n_events;
+
 	return 1;
 }
 
-/* Scan for mouses and use them. Return 0 if no mouse found */
-static unsigned int init_mouse
-(struct myy_evdev_data * const mouse) {
+/* Input replay */
+
+static struct {
+	struct input_event * events;
+	size_t n_events;
+	size_t next;
+	/* When the first event is replayed */
+	uint64_t start_us;
+	/* When the first event was recorded */
+	uint64_t first_us;
+	/* The events are dispatched as read from this mouse */
+	struct myy_evdev_data device;
+} replay = { .device = { .type = MYY_INPUT_MOUSE } };
+
+void myy_evdev_replay_start
+(struct input_event * __restrict const events,
+ size_t const n_events,
+ uint64_t const now_us)
+{
+	free(replay.events);
+	replay.events   = events;
+	replay.n_events = n_events;
+	replay.next     = 0;
+	replay.start_us = now_us;
+	replay.first_us = events ? event_time_us(events) : 0;
+	replay.device.dropping = 0;
+	replay.device.last_report_us = replay.device.report_interval_us = 0;
+}
 
-	int ret = 0;
-	int fd = acquire_mouse();
-	if (fd >= 0) {
-		libevdev_new_from_fd(fd, &(mouse->dev));
-		mouse->fd = fd;
-		ret = 1;
+unsigned int myy_evdev_replay
+(struct myy_evdev_data * const mouse,
+ uint64_t const now_us)
+{
+	unsigned int n_events = 0;
+
+	if (replay.events == NULL) return 0;
+
+	uint64_t const first_us = replay.first_us;
+	uint64_t const elapsed_us = now_us - replay.start_us;
+	uint64_t const resyncs = replay.device.resyncs;
+	uint64_t const dropped_reports = replay.device.dropped_reports;
+	while (replay.next < replay.n_events) {
+		struct input_event * __restrict const ev =
+			replay.events + replay.next;
+		uint64_t const time_us = event_time_us(ev);
+		if (time_us > first_us && time_us - first_us > elapsed_us) break;
+
+		/* Dispatched as if it just happened, on the same clock as the
+		   live events */
+		uint64_t const replayed_us = replay.start_us +
+			(time_us > first_us ? time_us - first_us : 0);
+		ev->input_event_sec  = replayed_us / 1000000;
+		ev->input_event_usec = replayed_us % 1000000;
+		parse_event(ev, &replay.device);
+		replay.next++;
+		n_events++;
 	}
-	return ret;
+	mouse->events += n_events;
+	/* The SYN_DROPPED found in the recording */
+	mouse->resyncs += replay.device.resyncs - resyncs;
+	mouse->dropped_reports += replay.device.dropped_reports - dropped_reports;
+
+	if (replay.next == replay.n_events) {
+		LOG("[Input replay] %zu events replayed\n", replay.n_events);
+		myy_evdev_replay_start(NULL, 0, 0);
+	}
+
+	return n_events;
 }
 
-/* We currently only read mouse input */
+unsigned int myy_evdev_replaying() { return replay.events != NULL; }
+
+/* Mice, touchscreens and keyboards */
 unsigned int myy_init_input_devices
-(struct myy_evdev_data * const mouse,
+(struct myy_evdev_data * const devices,
  unsigned int const n_devices) 
 {
-	return init_mouse(mouse);
+	struct ph_accel_config accel;
+	char const * __restrict const profile = getenv("MYY_POINTER_ACCEL");
+
+	ph_AccelDefaultConfig(&accel);
+	if (profile != NULL && !ph_AccelParseConfig(profile, &accel))
+		LOG_WARN("Invalid MYY_POINTER_ACCEL : %s\n", profile);
+	myy_evdev_set_acceleration(&accel);
+
+	enum ph_predict_mode prediction = PH_PREDICT_OFF;
+	char const * __restrict const mode = getenv("MYY_CURSOR_PREDICTION");
+	if (mode != NULL && !ph_PredictParseMode(mode, &prediction))
+		LOG_WARN("Invalid MYY_CURSOR_PREDICTION : %s\n", mode);
+	myy_evdev_set_prediction(prediction);
+
+	char const * __restrict const grab = getenv("MYY_INPUT_GRAB");
+	char const * __restrict const multi_pointer = getenv("MYY_MULTI_POINTER");
+
+	scan.devices = devices;
+	scan.n = 0;
+	scan.max = n_devices;
+	scan.grab = (grab != NULL && strcmp(grab, "1") == 0);
+	scan.multi_pointer =
+		(multi_pointer != NULL && strcmp(multi_pointer, "1") == 0);
+	scan.n_mice = 0;
+	if (n_devices) ftw("/dev/input", device_check, 1);
+
+	for (unsigned int d = 0; d < scan.n; d++) {
+		if (devices[d].type != MYY_INPUT_KEYBOARD) continue;
+		if (!myy_keyboard_init())
+			LOG_WARN("[Input] The keyboards keys will be ignored\n");
+		break;
+	}
+
+	return scan.n;
+}
+
+void myy_evdev_set_screen_size
+(struct myy_evdev_data * const devices,
+ unsigned int const n_devices,
+ unsigned int const width,
+ unsigned int const height)
+{
+	pointer.width  = width;
+	pointer.height = height;
+	myy_cursor_position(&pointer.x, &pointer.y);
+
+	for (unsigned int d = 0; d < n_devices; d++) {
+		struct myy_touch_state * __restrict const touch = &devices[d].touch;
+		if (devices[d].type != MYY_INPUT_TOUCHSCREEN) continue;
+
+		unsigned int const x_code =
+			touch->n_slots ? ABS_MT_POSITION_X : ABS_X;
+		unsigned int const y_code =
+			touch->n_slots ? ABS_MT_POSITION_Y : ABS_Y;
+		struct input_absinfo const * __restrict const x_axis =
+			libevdev_get_abs_info(devices[d].dev, x_code);
+		struct input_absinfo const * __restrict const y_axis =
+			libevdev_get_abs_info(devices[d].dev, y_code);
+		if (x_axis == NULL || y_axis == NULL) continue;
+
+		/* Device minimum to 0, device maximum to the last pixel */
+		int64_t const range_x = (int64_t) x_axis->maximum - x_axis->minimum;
+		int64_t const range_y = (int64_t) y_axis->maximum - y_axis->minimum;
+		touch->min_x = x_axis->minimum;
+		touch->min_y = y_axis->minimum;
+		touch->scale_x = (range_x > 0)
+			? ((uint64_t) (width  ? width  - 1 : 0) << 16) / range_x : 0;
+		touch->scale_y = (range_y > 0)
+			? ((uint64_t) (height ? height - 1 : 0) << 16) / range_y : 0;
+	}
 }
 
 /* Release and stop reading data from the previously acquired devices */
 unsigned int myy_free_input_devices
-(struct myy_evdev_data * const mouse,
+(struct myy_evdev_data * const devices,
  unsigned int const n_devices)
 {
-	libevdev_free(mouse->dev);
-	close(mouse->fd);
+	for (unsigned int d = 0; d < n_devices; d++) {
+		if (devices[d].grabbed)
+			libevdev_grab(devices[d].dev, LIBEVDEV_UNGRAB);
+		libevdev_free(devices[d].dev);
+		close(devices[d].fd);
+	}
+	myy_keyboard_free();
+	return n_devices;
 }
 
 // LIBEVDEV_READ_STATUS_SUCCESS 0
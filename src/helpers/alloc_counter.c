@@ -0,0 +1,105 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/alloc_counter.h>
+
+#include <stddef.h>
+#include <errno.h>
+
+#if defined(MYY_COUNT_ALLOCATIONS)
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * address, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void * address);
+
+/* Counting must not allocate itself : Only static TLS is used here */
+static _Thread_local struct ah_allocation_counts counts;
+
+void * malloc(size_t size)
+{
+	counts.allocations++;
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t n, size_t size)
+{
+	counts.allocations++;
+	return __libc_calloc(n, size);
+}
+
+/* realloc(0, size) allocates and realloc(address, 0) frees */
+void * realloc(void * address, size_t size)
+{
+	if (address == NULL) counts.allocations++;
+	else if (size == 0) counts.frees++;
+	else counts.allocations++;
+	return __libc_realloc(address, size);
+}
+
+void * memalign(size_t alignment, size_t size)
+{
+	counts.allocations++;
+	return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(size_t alignment, size_t size)
+{
+	counts.allocations++;
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** address, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void *) != 0 ||
+	    (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	counts.allocations++;
+	void * const memory = __libc_memalign(alignment, size);
+	if (memory == NULL) return ENOMEM;
+	*address = memory;
+	return 0;
+}
+
+void free(void * address)
+{
+	if (address) counts.frees++;
+	__libc_free(address);
+}
+
+struct ah_allocation_counts ah_ThreadAllocationCounts()
+{
+	return counts;
+}
+
+#else
+
+struct ah_allocation_counts ah_ThreadAllocationCounts()
+{
+	struct ah_allocation_counts const none = {0};
+	return none;
+}
+
+#endif
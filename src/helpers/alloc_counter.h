@@ -0,0 +1,47 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_ALLOC_COUNTER_H
+#define MYY_SRC_HELPERS_ALLOC_COUNTER_H 1
+
+#include <stdint.h>
+
+/* Heap allocations counting hook.
+ *
+ * When built with MYY_COUNT_ALLOCATIONS, malloc, calloc, realloc,
+ * free and the aligned allocators are replaced, for the whole process
+ * (drivers included), by versions counting each call in the calling
+ * thread, before forwarding it to the C library.
+ * Requires glibc, which exports the original allocator as __libc_*.
+ *
+ * Without MYY_COUNT_ALLOCATIONS, the counts stay at 0. */
+
+struct ah_allocation_counts {
+	uint64_t allocations;
+	uint64_t frees;
+};
+
+/* Allocations performed by the calling thread, since it started */
+struct ah_allocation_counts ah_ThreadAllocationCounts();
+
+#endif
@@ -0,0 +1,71 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/arena.h>
+#include <helpers/log.h>
+
+#include <stdlib.h>
+
+static struct {
+	struct ah_arena arena;
+	size_t peak;
+} frame;
+
+unsigned int ah_FrameArenaInit(size_t const size)
+{
+	void * __restrict const memory = malloc(size);
+	if (memory == NULL) {
+		LOG("[Frame arena] Could not allocate %zu bytes\n", size);
+		return 0;
+	}
+	ah_ArenaInit(&frame.arena, memory, size);
+	frame.peak = 0;
+	return 1;
+}
+
+void ah_FrameArenaFree()
+{
+	free(frame.arena.memory);
+	ah_ArenaInit(&frame.arena, NULL, 0);
+}
+
+void * ah_FrameAlloc(size_t const size)
+{
+	void * __restrict const memory = ah_ArenaAlloc(&frame.arena, size, 16);
+	if (memory == NULL) {
+		LOG("[Frame arena] Exhausted : %zu bytes used, %zu requested\n",
+		    frame.arena.used, size);
+	}
+	return memory;
+}
+
+void ah_FrameArenaReset()
+{
+	if (frame.arena.used > frame.peak) frame.peak = frame.arena.used;
+	ah_ArenaReset(&frame.arena);
+}
+
+size_t ah_FrameArenaPeak()
+{
+	return frame.arena.used > frame.peak ? frame.arena.used : frame.peak;
+}
@@ -0,0 +1,158 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_ARENA_H
+#define MYY_SRC_HELPERS_ARENA_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Linear allocator over a caller-provided memory block.
+ * Allocations are never freed individually. The whole arena is
+ * recycled at once with ah_ArenaReset.
+ * Not thread-safe. */
+struct ah_arena {
+	uint8_t * memory;
+	size_t size;
+	size_t used;
+};
+
+static inline void ah_ArenaInit
+(struct ah_arena * __restrict const arena,
+ void * __restrict const memory,
+ size_t const size)
+{
+	arena->memory = (uint8_t *) memory;
+	arena->size   = size;
+	arena->used   = 0;
+}
+
+/** Allocate `size` bytes from the arena.
+ *
+ * @param arena     The arena
+ * @param size      The number of bytes to allocate
+ * @param alignment The address alignment. Must be a power of 2.
+ *
+ * @return The allocated memory, or 0 if the arena is full.
+ */
+static inline void * ah_ArenaAlloc
+(struct ah_arena * __restrict const arena,
+ size_t const size,
+ size_t const alignment)
+{
+	uintptr_t const base    = (uintptr_t) arena->memory;
+	uintptr_t const current = base + arena->used;
+	uintptr_t const start   = (current + alignment - 1) & ~(alignment - 1);
+	size_t const end = (start - base) + size;
+
+	if (end > arena->size || end < arena->used) return (void *) 0;
+
+	arena->used = end;
+	return (void *) start;
+}
+
+/* Forget every allocation. The memory is reused by the next ones. */
+static inline void ah_ArenaReset
+(struct ah_arena * __restrict const arena)
+{
+	arena->used = 0;
+}
+
+/* Fixed-size objects pool over a caller-provided memory block.
+ * Freed objects are chained in a free list and reused first.
+ * Not thread-safe. */
+struct ah_pool {
+	uint8_t * memory;
+	size_t object_size;
+	unsigned int capacity;
+	/* Objects never allocated yet start at memory + used * object_size */
+	unsigned int used;
+	void * free_list;
+};
+
+/* Memory size required by a pool of `capacity` objects of `size` bytes */
+#define AH_POOL_OBJECT_SIZE(size) \
+	(((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define AH_POOL_MEMORY_SIZE(size, capacity) \
+	(AH_POOL_OBJECT_SIZE(size) * (capacity))
+
+/**
+ * @param pool        The pool
+ * @param memory      AH_POOL_MEMORY_SIZE(object_size, capacity) bytes,
+ *                    aligned for the objects
+ * @param object_size The size of the objects. At least sizeof(void *).
+ * @param capacity    How many objects can be allocated at the same time
+ */
+static inline void ah_PoolInit
+(struct ah_pool * __restrict const pool,
+ void * __restrict const memory,
+ size_t const object_size,
+ unsigned int const capacity)
+{
+	pool->memory      = (uint8_t *) memory;
+	pool->object_size = AH_POOL_OBJECT_SIZE(object_size);
+	pool->capacity    = capacity;
+	pool->used        = 0;
+	pool->free_list   = (void *) 0;
+}
+
+/* Returns an uninitialised object, or 0 if every object is in use */
+static inline void * ah_PoolAlloc
+(struct ah_pool * __restrict const pool)
+{
+	void * object = pool->free_list;
+	if (object) pool->free_list = *((void **) object);
+	else if (pool->used < pool->capacity)
+		object = pool->memory + pool->object_size * pool->used++;
+	return object;
+}
+
+static inline void ah_PoolFree
+(struct ah_pool * __restrict const pool,
+ void * __restrict const object)
+{
+	*((void **) object) = pool->free_list;
+	pool->free_list = object;
+}
+
+/* The frame arena.
+ * Memory that only lives until the end of the current frame.
+ * Allocated once by ah_FrameArenaInit, and recycled after each page
+ * flip by ah_FrameArenaReset.
+ * Only usable from the render thread. */
+
+/* Returns 1 if the frame arena could be allocated, 0 otherwise */
+unsigned int ah_FrameArenaInit(size_t const size);
+
+void ah_FrameArenaFree();
+
+/* Returns `size` bytes aligned on 16 bytes, valid until the next
+ * ah_FrameArenaReset, or 0 if the frame arena is exhausted. */
+void * ah_FrameAlloc(size_t const size);
+
+void ah_FrameArenaReset();
+
+/* Returns the highest amount of memory used during a frame */
+size_t ah_FrameArenaPeak();
+
+#endif
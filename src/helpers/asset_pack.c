@@ -0,0 +1,178 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/asset_pack.h>
+#include <helpers/log.h>
+
+#include <string.h>
+
+/* open, fstat, close */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* mmap */
+#include <sys/mman.h>
+
+static struct {
+	uint8_t const * address;
+	size_t length;
+	struct myy_asset_pack_entry const * entries;
+	char const * names;
+	uint32_t n_entries;
+} pack;
+
+static unsigned int pack_is_valid
+(uint8_t const * __restrict const address,
+ size_t const length)
+{
+	struct myy_asset_pack_header const * __restrict const header =
+		(struct myy_asset_pack_header const *) address;
+
+	if (length < sizeof(*header) ||
+	    memcmp(header->magic, MYY_ASSET_PACK_MAGIC, 8) != 0) {
+		LOG("[Asset pack] Invalid magic\n");
+		return 0;
+	}
+	if (header->size != length) {
+		LOG("[Asset pack] Truncated : %lu bytes instead of %lu\n",
+		    (unsigned long) length, (unsigned long) header->size);
+		return 0;
+	}
+
+	size_t const entries_end =
+		sizeof(*header) +
+		(size_t) header->n_entries * sizeof(struct myy_asset_pack_entry);
+	if (entries_end > header->names_offset ||
+	    header->names_offset > length) {
+		LOG("[Asset pack] Invalid table of contents\n");
+		return 0;
+	}
+
+	struct myy_asset_pack_entry const * __restrict const entries =
+		(struct myy_asset_pack_entry const *) (address + sizeof(*header));
+	char const * __restrict const names =
+		(char const *) (address + header->names_offset);
+	size_t const names_length = length - header->names_offset;
+
+	/* Check everything once, so that lookups do not have to */
+	for (uint32_t e = 0; e < header->n_entries; e++) {
+		struct myy_asset_pack_entry const * __restrict const entry =
+			entries+e;
+		if (entry->name_offset >= names_length ||
+		    names_length - entry->name_offset <= entry->name_length ||
+		    names[entry->name_offset + entry->name_length] != '\0' ||
+		    entry->offset > length ||
+		    length - entry->offset < entry->size) {
+			LOG("[Asset pack] Entry %u is corrupted\n", e);
+			return 0;
+		}
+		if (e > 0 &&
+		    strcmp(names + entries[e-1].name_offset,
+		           names + entry->name_offset) >= 0) {
+			LOG("[Asset pack] Entries are not sorted\n");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+unsigned int fh_OpenAssetPack
+(char const * __restrict const pathname)
+{
+	struct stat pack_stats;
+	void * address = MAP_FAILED;
+
+	fh_CloseAssetPack();
+
+	int const fd = open(pathname, O_RDONLY);
+	if (fd == -1) {
+		LOG_ERRNO("[Asset pack] Could not open %s\n", pathname);
+		return 0;
+	}
+
+	if (fstat(fd, &pack_stats) == 0 && pack_stats.st_size > 0)
+		address = mmap(0, pack_stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (address == MAP_FAILED) {
+		LOG_ERRNO("[Asset pack] Could not map %s\n", pathname);
+		return 0;
+	}
+
+	size_t const length = pack_stats.st_size;
+	if (!pack_is_valid(address, length)) {
+		LOG("[Asset pack] %s is not a valid asset pack\n", pathname);
+		munmap(address, length);
+		return 0;
+	}
+
+	struct myy_asset_pack_header const * __restrict const header =
+		(struct myy_asset_pack_header const *) address;
+	pack.address   = address;
+	pack.length    = length;
+	pack.entries   =
+		(struct myy_asset_pack_entry const *) (pack.address + sizeof(*header));
+	pack.names     = (char const *) (pack.address + header->names_offset);
+	pack.n_entries = header->n_entries;
+
+	LOG("[Asset pack] %s : %u assets\n", pathname, pack.n_entries);
+	return 1;
+}
+
+void fh_CloseAssetPack()
+{
+	if (pack.address) munmap((void *) pack.address, pack.length);
+	pack.address   = NULL;
+	pack.length    = 0;
+	pack.entries   = NULL;
+	pack.names     = NULL;
+	pack.n_entries = 0;
+}
+
+void const * fh_FindInAssetPack
+(char const * __restrict pathname,
+ size_t * __restrict const size)
+{
+	uint32_t first = 0, last = pack.n_entries;
+
+	if (pathname[0] == '.' && pathname[1] == '/') pathname += 2;
+
+	while (first < last) {
+		uint32_t const middle = first + (last - first) / 2;
+		struct myy_asset_pack_entry const * __restrict const entry =
+			pack.entries+middle;
+		int const order = strcmp(pathname, pack.names + entry->name_offset);
+
+		if (order == 0) {
+			*size = entry->size;
+			return pack.address + entry->offset;
+		}
+		if (order < 0) last = middle;
+		else first = middle + 1;
+	}
+
+	return NULL;
+}
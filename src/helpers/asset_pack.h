@@ -0,0 +1,113 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_ASSET_PACK
+#define MYY_SRC_HELPERS_ASSET_PACK 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Asset pack layout. Every field is little-endian.
+ *
+ * struct myy_asset_pack_header
+ * struct myy_asset_pack_entry entries[n_entries]
+ *   Sorted by name (strcmp order), so that they can be binary searched.
+ * char names[]
+ *   Every name followed by a '\0'.
+ * data
+ *   Every asset starts on a MYY_ASSET_PACK_ALIGNMENT boundary, and is
+ *   followed by at least one '\0', so that text assets can be used as
+ *   C strings directly. */
+
+#define MYY_ASSET_PACK_MAGIC "MYYPACK1"
+#define MYY_ASSET_PACK_ALIGNMENT 64
+
+struct myy_asset_pack_header {
+	uint8_t  magic[8];
+	uint32_t n_entries;
+	/* Offset of the names, from the start of the pack */
+	uint32_t names_offset;
+	/* Size of the whole pack, to detect truncated packs */
+	uint64_t size;
+	uint64_t reserved;
+};
+
+struct myy_asset_pack_entry {
+	/* Offset of the data, from the start of the pack */
+	uint64_t offset;
+	uint64_t size;
+	/* Offset of the name, from names_offset */
+	uint32_t name_offset;
+	/* Name length, without the final '\0' */
+	uint32_t name_length;
+	uint64_t reserved;
+};
+
+/**
+ * Map the asset pack at `pathname` in memory.
+ *
+ * Once opened, every fh_* function looks for the requested files in
+ * the pack first, and only falls back to the filesystem when they are
+ * not packed. Files served from the pack are never copied, nor mapped
+ * again : fh_MapFileToMemory returns an address inside the pack.
+ *
+ * Only one pack can be opened at a time. Opening another pack closes
+ * the previous one.
+ *
+ * CAUTION :
+ * - Do not open or close a pack while other threads use fh_*
+ *   functions. Lookups themselves are thread-safe.
+ *
+ * PARAMS :
+ * @param pathname The pack path (e.g. assets.pack)
+ *
+ * RETURNS :
+ * @return 1 if the pack was mapped and is valid, 0 otherwise
+ */
+unsigned int fh_OpenAssetPack
+(char const * __restrict const pathname);
+
+/**
+ * Unmap the current asset pack.
+ * Every address returned from the pack becomes invalid.
+ */
+void fh_CloseAssetPack();
+
+/**
+ * Look for `pathname` in the current asset pack.
+ * A leading "./" is ignored.
+ *
+ * PARAMS :
+ * @param pathname The asset path, as stored in the pack
+ *                 (e.g. shaders/cursor.vsh)
+ * @param size     Receives the asset size, if found
+ *
+ * RETURNS :
+ * @return The address of the asset data in the pack, or 0 if no pack
+ *         is opened or if the pack does not contain pathname.
+ */
+void const * fh_FindInAssetPack
+(char const * __restrict const pathname,
+ size_t * __restrict const size);
+
+#endif
@@ -22,8 +22,11 @@
 */
 
 #include <helpers/file.h>
+#include <helpers/asset_pack.h>
 #include <helpers/log.h>
 
+#include <string.h>
+
 /* read - close */
 #include <unistd.h>
 
@@ -42,6 +45,14 @@ unsigned int fh_WholeFileToBuffer
 	ssize_t bytes_read;
 	off_t file_size;
 	struct stat fd_stats;
+	size_t packed_size;
+	void const * __restrict const packed =
+		fh_FindInAssetPack(pathname, &packed_size);
+
+	if (packed) {
+		memcpy(buffer, packed, packed_size);
+		return 1;
+	}
 
 	int fd = open(pathname, O_RDONLY);
 
@@ -69,6 +80,16 @@ int fh_ReadFileToBuffer
  unsigned int const size) {
 
 	int bytes_read = -1;
+	size_t packed_size;
+	void const * __restrict const packed =
+		fh_FindInAssetPack(pathname, &packed_size);
+
+	if (packed) {
+		bytes_read = packed_size < size ? packed_size : size;
+		memcpy(buffer, packed, bytes_read);
+		return bytes_read;
+	}
+
 	int fd = open(pathname, O_RDONLY);
 	if (fd != -1) {
 		bytes_read = read(fd, buffer, size);
@@ -100,6 +121,17 @@ int fh_ReadBytesFromFile
 {
 
 	int bytes_read = -1;
+	size_t packed_size;
+	void const * __restrict const packed =
+		fh_FindInAssetPack(pathname, &packed_size);
+
+	if (packed) {
+		size_t const left = offset < packed_size ? packed_size - offset : 0;
+		bytes_read = left < size ? left : size;
+		memcpy(buffer, (uint8_t const *) packed + offset, bytes_read);
+		return bytes_read;
+	}
+
 	int fd = open(pathname, O_RDONLY);
 	if (fd != -1) {
 		lseek(fd, offset, SEEK_SET);
@@ -116,12 +148,26 @@ struct myy_fh_map_handle fh_MapFileToMemory
 {
 	LOG("[fh_MapFileToMemory]\n");
 	LOG("  pathname : %s\n", pathname);
+
+	size_t packed_size;
+	void const * __restrict const packed =
+		fh_FindInAssetPack(pathname, &packed_size);
+	if (packed) {
+		struct myy_fh_map_handle handle = {
+			.ok      = 1,
+			.address = packed,
+			.length  = (int) packed_size,
+			.in_pack = 1
+		};
+		return handle;
+	}
+
 	int fd = open(pathname, O_RDONLY);
 	void * mapped_address = MAP_FAILED;
 	off_t file_size = 0;
 	unsigned int ok = 0;
 
-	if (fd != 1) {
+	if (fd != -1) {
 		struct stat file_stats;
 		fstat(fd, &file_stats);
 		file_size = file_stats.st_size;
@@ -141,12 +187,13 @@ struct myy_fh_map_handle fh_MapFileToMemory
 	struct myy_fh_map_handle handle = {
 		.ok      = ok,
 		.address = mapped_address,
-		.length  = (int) file_size
+		.length  = (int) file_size,
+		.in_pack = 0
 	};
 	return handle;
 }
 
 void fh_UnmapFileFromMemory
 (struct myy_fh_map_handle const handle) {
-	if (handle.ok) munmap(handle.address, handle.length);
+	if (handle.ok && !handle.in_pack) munmap(handle.address, handle.length);
 }
@@ -25,6 +25,11 @@
 #define MYY_INCLUDE_FILE_HELPERS 1
 
 #include <stdint.h>
+#include <stddef.h>
+
+/* Maximum number of files loaded concurrently by fh_LoadFiles */
+#define FH_LOAD_QUEUE_DEPTH 64
+#define FH_LOAD_MAX_THREADS 8
 
 /**
  * Read `size` bytes from the file at `pathname` into `buffer`
@@ -116,11 +121,17 @@ struct myy_fh_map_handle {
 	unsigned int ok;
 	void const * address;
 	int length;
+	/* The address points inside the asset pack. Nothing to unmap. */
+	unsigned int in_pack;
 };
 
 /**
  * Map an entire file in memory (mmap).
  *
+ * If the file is stored in the opened asset pack (see
+ * helpers/asset_pack.h), the returned address points directly inside
+ * the pack, and no system call is performed.
+ *
  * PARAMS :
  * @param pathname The file's path in the Assets archive.
  *
@@ -146,4 +157,68 @@ struct myy_fh_map_handle fh_MapFileToMemory
 void fh_UnmapFileFromMemory
 (struct myy_fh_map_handle const handle);
 
+struct ah_arena;
+
+enum fh_load_method {
+	/* io_uring when the kernel supports it, threads otherwise */
+	FH_LOAD_AUTO,
+	FH_LOAD_IO_URING,
+	FH_LOAD_THREADS,
+	/* One file after the other, in the caller thread */
+	FH_LOAD_SERIAL
+};
+
+struct fh_load_request {
+	/* Set by the caller */
+	char const * pathname;
+	/* Where to store the file contents, up to buffer_size bytes.
+	 * When 0, a buffer large enough for the whole file is allocated.
+	 * See fh_LoadFiles. */
+	void * buffer;
+	size_t buffer_size;
+
+	/* Set by fh_LoadFiles */
+	/* 0 on success, -errno on failure */
+	int status;
+	/* The file contents */
+	void const * data;
+	size_t size;
+	/* data points inside the asset pack. Never modify it. */
+	uint8_t in_pack;
+	/* data was allocated with malloc, and must be freed by the caller */
+	uint8_t allocated;
+};
+
+/**
+ * Load many files at once.
+ *
+ * Opens, reads and closes are submitted for up to
+ * FH_LOAD_QUEUE_DEPTH files at the same time, through io_uring, or
+ * through a pool of FH_LOAD_MAX_THREADS threads when io_uring is not
+ * available. Cold loads then wait for the slowest file of each batch,
+ * instead of the sum of every file latency.
+ *
+ * Files stored in the opened asset pack are copied into their buffer,
+ * or returned directly when no buffer was provided (in_pack is set).
+ *
+ * Files without a buffer are stored in memory allocated from `arena`
+ * or, when `arena` is 0, with malloc. These buffers are terminated by
+ * a '\0' not counted in size, so that text files can be used as C
+ * strings.
+ *
+ * PARAMS :
+ * @param requests The files to load
+ * @param n        The number of requests
+ * @param arena    Where to allocate buffers. Can be 0.
+ * @param method   How to perform the loads
+ *
+ * RETURNS :
+ * @return The number of files loaded successfully
+ */
+unsigned int fh_LoadFiles
+(struct fh_load_request * __restrict const requests,
+ unsigned int const n,
+ struct ah_arena * __restrict const arena,
+ enum fh_load_method const method);
+
 #endif
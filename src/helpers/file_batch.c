@@ -0,0 +1,630 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* struct statx */
+#define _GNU_SOURCE 1
+
+#include <helpers/file.h>
+#include <helpers/arena.h>
+#include <helpers/asset_pack.h>
+#include <helpers/log.h>
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/* open, fstat, read, close */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* io_uring, through raw system calls */
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* IO_URING_OP_SUPPORTED comes with the operations probing API (5.6) */
+#if defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+#define FH_HAVE_IO_URING 1
+#endif
+
+struct load_batch {
+	struct fh_load_request * __restrict requests;
+	unsigned int n;
+	struct ah_arena * __restrict arena;
+	pthread_mutex_t arena_lock;
+	atomic_uint next;
+};
+
+/* Allocate a buffer for `size` bytes, plus the final '\0' */
+static uint8_t * allocate
+(struct load_batch * __restrict const batch,
+ struct fh_load_request * __restrict const request,
+ size_t const size)
+{
+	uint8_t * buffer;
+	if (batch->arena) {
+		pthread_mutex_lock(&batch->arena_lock);
+		buffer = ah_ArenaAlloc(batch->arena, size+1, 16);
+		pthread_mutex_unlock(&batch->arena_lock);
+	}
+	else {
+		buffer = malloc(size+1);
+		request->allocated = (buffer != NULL);
+	}
+	return buffer;
+}
+
+/* Serve the request from the asset pack, if possible */
+static unsigned int load_from_pack
+(struct fh_load_request * __restrict const request)
+{
+	size_t packed_size;
+	void const * __restrict const packed =
+		fh_FindInAssetPack(request->pathname, &packed_size);
+
+	if (packed == NULL) return 0;
+
+	if (request->buffer) {
+		size_t const size =
+			packed_size < request->buffer_size ? packed_size : request->buffer_size;
+		memcpy(request->buffer, packed, size);
+		request->data = request->buffer;
+		request->size = size;
+	}
+	else {
+		request->data    = packed;
+		request->size    = packed_size;
+		request->in_pack = 1;
+	}
+	request->status = 0;
+	return 1;
+}
+
+static void reset_request
+(struct fh_load_request * __restrict const request)
+{
+	request->status    = 0;
+	request->data      = NULL;
+	request->size      = 0;
+	request->in_pack   = 0;
+	request->allocated = 0;
+}
+
+static void load_failed
+(struct fh_load_request * __restrict const request,
+ int const status)
+{
+	if (request->allocated) free((void *) request->data);
+	request->status    = status;
+	request->data      = NULL;
+	request->size      = 0;
+	request->allocated = 0;
+}
+
+/* ---- Blocking loads, used by the serial and threaded methods ---- */
+
+static void load_blocking
+(struct load_batch * __restrict const batch,
+ struct fh_load_request * __restrict const request)
+{
+	reset_request(request);
+	if (load_from_pack(request)) return;
+
+	int const fd = open(request->pathname, O_RDONLY);
+	if (fd == -1) {
+		load_failed(request, -errno);
+		return;
+	}
+
+	uint8_t * buffer = request->buffer;
+	size_t capacity = request->buffer_size;
+	if (buffer == NULL) {
+		struct stat file_stats;
+		if (fstat(fd, &file_stats) != 0) {
+			load_failed(request, -errno);
+			close(fd);
+			return;
+		}
+		capacity = file_stats.st_size;
+		buffer = allocate(batch, request, capacity);
+	}
+	request->data = buffer;
+
+	if (buffer == NULL) {
+		load_failed(request, -ENOMEM);
+		close(fd);
+		return;
+	}
+
+	size_t done = 0;
+	while (done < capacity) {
+		ssize_t const bytes_read = read(fd, buffer+done, capacity-done);
+		if (bytes_read < 0 && errno == EINTR) continue;
+		if (bytes_read <= 0) {
+			if (bytes_read < 0) load_failed(request, -errno);
+			break;
+		}
+		done += bytes_read;
+	}
+	close(fd);
+
+	if (request->status == 0) {
+		if (request->buffer == NULL) buffer[done] = 0;
+		request->size = done;
+	}
+}
+
+static void * load_thread(void * batch_address)
+{
+	struct load_batch * __restrict const batch = batch_address;
+	unsigned int index;
+	while ((index = atomic_fetch_add(&batch->next, 1)) < batch->n)
+		load_blocking(batch, batch->requests+index);
+	return NULL;
+}
+
+static void load_with_threads
+(struct load_batch * __restrict const batch)
+{
+	pthread_t threads[FH_LOAD_MAX_THREADS];
+	unsigned int n_threads =
+		batch->n < FH_LOAD_MAX_THREADS ? batch->n : FH_LOAD_MAX_THREADS;
+	unsigned int started = 0;
+
+	for (; started < n_threads; started++)
+		if (pthread_create(threads+started, NULL, load_thread, batch)) break;
+
+	/* Whatever could not be handed to a thread is loaded here */
+	load_thread(batch);
+
+	for (unsigned int t = 0; t < started; t++)
+		pthread_join(threads[t], NULL);
+}
+
+/* ---- io_uring ----
+ * Each file goes through : OPENAT (+ STATX when a buffer must be
+ * allocated) -> READ, until the buffer is full or EOF -> CLOSE.
+ * The next operation of a file is submitted when the previous one
+ * completes, and FH_LOAD_QUEUE_DEPTH files progress concurrently. */
+
+#if defined(FH_HAVE_IO_URING)
+
+enum uring_op { URING_OPEN, URING_STATX, URING_READ, URING_CLOSE };
+
+#define URING_USER_DATA(index, op) (((uint64_t) (index) << 2) | (op))
+
+struct uring_file {
+	int fd;
+	unsigned int pending;
+	size_t capacity;
+	size_t done;
+	struct statx stats;
+};
+
+struct uring {
+	int fd;
+	void * sq_ring, * cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe * sqes;
+	size_t sqes_size;
+	unsigned int * sq_head, * sq_tail, * sq_mask, * sq_array;
+	unsigned int * cq_head, * cq_tail, * cq_mask;
+	struct io_uring_cqe * cqes;
+	unsigned int sq_entries;
+	unsigned int to_submit;
+};
+
+static int uring_enter
+(int const fd, unsigned int const to_submit,
+ unsigned int const min_complete, unsigned int const flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		NULL, 0);
+}
+
+static void uring_exit(struct uring * __restrict const ring)
+{
+	if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+}
+
+/* Check that the kernel knows every operation used here (5.6+) */
+static unsigned int uring_supports_operations(int const fd)
+{
+	static uint8_t const needed[] = {
+		IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE
+	};
+	unsigned int supported = 0;
+	size_t const probe_size =
+		sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe * __restrict const probe = calloc(1, probe_size);
+
+	if (probe && syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+	                     probe, 256) == 0) {
+		supported = 1;
+		for (unsigned int o = 0; o < sizeof(needed); o++) {
+			if (needed[o] > probe->last_op ||
+			    !(probe->ops[needed[o]].flags & IO_URING_OP_SUPPORTED))
+				supported = 0;
+		}
+	}
+
+	free(probe);
+	return supported;
+}
+
+static unsigned int uring_init
+(struct uring * __restrict const ring,
+ unsigned int const entries)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) return 0;
+
+	if (!uring_supports_operations(ring->fd)) goto no_uring;
+
+	ring->sq_ring_size =
+		params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size =
+		params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(0, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		goto no_uring;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(0, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto no_uring;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(0, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto no_uring;
+	}
+
+	uint8_t * __restrict const sq = ring->sq_ring;
+	uint8_t * __restrict const cq = ring->cq_ring;
+	ring->sq_head  = (unsigned int *) (sq + params.sq_off.head);
+	ring->sq_tail  = (unsigned int *) (sq + params.sq_off.tail);
+	ring->sq_mask  = (unsigned int *) (sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *) (sq + params.sq_off.array);
+	ring->cq_head  = (unsigned int *) (cq + params.cq_off.head);
+	ring->cq_tail  = (unsigned int *) (cq + params.cq_off.tail);
+	ring->cq_mask  = (unsigned int *) (cq + params.cq_off.ring_mask);
+	ring->cqes     = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+	ring->sq_entries = params.sq_entries;
+	return 1;
+
+no_uring:
+	uring_exit(ring);
+	return 0;
+}
+
+/* The queue depth guarantees that the submission queue never fills */
+static struct io_uring_sqe * uring_sqe
+(struct uring * __restrict const ring,
+ uint8_t const opcode,
+ uint64_t const user_data)
+{
+	unsigned int const tail = *ring->sq_tail;
+	unsigned int const index = tail & *ring->sq_mask;
+	struct io_uring_sqe * __restrict const sqe = ring->sqes+index;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->user_data = user_data;
+	ring->sq_array[index] = index;
+	return sqe;
+}
+
+static void uring_push(struct uring * __restrict const ring)
+{
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit++;
+}
+
+static void uring_read
+(struct uring * __restrict const ring,
+ unsigned int const index,
+ struct uring_file const * __restrict const file,
+ struct fh_load_request const * __restrict const request)
+{
+	struct io_uring_sqe * __restrict const sqe =
+		uring_sqe(ring, IORING_OP_READ, URING_USER_DATA(index, URING_READ));
+	sqe->fd   = file->fd;
+	sqe->addr = (uintptr_t) ((uint8_t const *) request->data + file->done);
+	sqe->len  = file->capacity - file->done;
+	sqe->off  = file->done;
+	uring_push(ring);
+}
+
+static void uring_close
+(struct uring * __restrict const ring,
+ unsigned int const index,
+ struct uring_file * __restrict const file)
+{
+	struct io_uring_sqe * __restrict const sqe =
+		uring_sqe(ring, IORING_OP_CLOSE, URING_USER_DATA(index, URING_CLOSE));
+	sqe->fd = file->fd;
+	file->pending++;
+	uring_push(ring);
+}
+
+/* Returns 1 if the file still has operations in flight */
+static unsigned int uring_start
+(struct uring * __restrict const ring,
+ struct load_batch * __restrict const batch,
+ unsigned int const index,
+ struct uring_file * __restrict const file)
+{
+	struct fh_load_request * __restrict const request =
+		batch->requests+index;
+
+	reset_request(request);
+	if (load_from_pack(request)) return 0;
+
+	file->fd = -1;
+	file->done = 0;
+	file->pending = 1;
+
+	struct io_uring_sqe * sqe =
+		uring_sqe(ring, IORING_OP_OPENAT, URING_USER_DATA(index, URING_OPEN));
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uintptr_t) request->pathname;
+	sqe->open_flags = O_RDONLY;
+	uring_push(ring);
+
+	if (request->buffer == NULL) {
+		/* Get the size at the same time */
+		sqe = uring_sqe(ring, IORING_OP_STATX,
+			URING_USER_DATA(index, URING_STATX));
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t) request->pathname;
+		sqe->len = STATX_SIZE;
+		sqe->off = (uintptr_t) &file->stats;
+		uring_push(ring);
+		file->pending++;
+	}
+	else {
+		request->data  = request->buffer;
+		file->capacity = request->buffer_size;
+	}
+
+	return 1;
+}
+
+/* Returns 1 if the file still has operations in flight */
+static unsigned int uring_complete
+(struct uring * __restrict const ring,
+ struct load_batch * __restrict const batch,
+ unsigned int const index,
+ struct uring_file * __restrict const file,
+ enum uring_op const op,
+ int const result)
+{
+	struct fh_load_request * __restrict const request =
+		batch->requests+index;
+
+	file->pending--;
+
+	switch (op) {
+	case URING_OPEN:
+		if (result < 0) load_failed(request, result);
+		else file->fd = result;
+		break;
+	case URING_STATX:
+		if (result < 0) load_failed(request, result);
+		else if (request->status == 0) {
+			file->capacity = file->stats.stx_size;
+			request->data = allocate(batch, request, file->capacity);
+			if (request->data == NULL) load_failed(request, -ENOMEM);
+		}
+		break;
+	case URING_READ:
+		if (result < 0 && result != -EINTR && result != -EAGAIN)
+			load_failed(request, result);
+		else if (result > 0) file->done += result;
+		/* Short read. Read the rest. */
+		if (request->status == 0 && result != 0 &&
+		    file->done < file->capacity) {
+			uring_read(ring, index, file, request);
+			file->pending++;
+			return 1;
+		}
+		break;
+	case URING_CLOSE:
+		file->fd = -1;
+		break;
+	}
+
+	if (file->pending) return 1;
+
+	if ((op == URING_OPEN || op == URING_STATX) &&
+	    request->status == 0 && file->capacity > 0) {
+		uring_read(ring, index, file, request);
+		file->pending++;
+		return 1;
+	}
+
+	/* Everything was read. Empty files never go through READ. */
+	if (op != URING_CLOSE && request->status == 0) {
+		request->size = file->done;
+		if (request->buffer == NULL)
+			((uint8_t *) request->data)[file->done] = 0;
+	}
+
+	if (file->fd >= 0) {
+		uring_close(ring, index, file);
+		return 1;
+	}
+
+	return 0;
+}
+
+static unsigned int load_with_uring
+(struct load_batch * __restrict const batch)
+{
+	unsigned int const depth =
+		batch->n < FH_LOAD_QUEUE_DEPTH ? batch->n : FH_LOAD_QUEUE_DEPTH;
+	struct uring ring;
+
+	/* OPENAT + STATX per file, at most */
+	if (!uring_init(&ring, depth * 2)) return 0;
+
+	struct uring_file * __restrict const files =
+		calloc(batch->n, sizeof(struct uring_file));
+	if (files == NULL) {
+		uring_exit(&ring);
+		return 0;
+	}
+
+	unsigned int next = 0, in_flight = 0;
+	while (next < batch->n || in_flight) {
+		while (next < batch->n && in_flight < depth) {
+			in_flight += uring_start(&ring, batch, next, files+next);
+			next++;
+		}
+		if (in_flight == 0) break;
+
+		int const submitted = uring_enter(
+			ring.fd, ring.to_submit, 1, IORING_ENTER_GETEVENTS);
+		if (submitted < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+			/* Not expected once the ring is set up. Give up on the
+			   remaining files, but leave them in a coherent state. */
+			LOG_ERRNO("[fh_LoadFiles] io_uring_enter failed\n");
+			break;
+		}
+		ring.to_submit -= submitted;
+
+		unsigned int head = *ring.cq_head;
+		unsigned int const tail =
+			__atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe const * __restrict const cqe =
+				ring.cqes + (head & *ring.cq_mask);
+			unsigned int const index = cqe->user_data >> 2;
+			if (!uring_complete(&ring, batch, index, files+index,
+			                    cqe->user_data & 3, cqe->res))
+				in_flight--;
+		}
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	if (next < batch->n || in_flight) {
+		/* io_uring_enter failed. Files that were not started are loaded
+		   the old way. The kernel might still write into the buffers and
+		   statx results of the files in flight, so these are leaked. */
+		for (unsigned int f = 0; f < batch->n; f++) {
+			if (f >= next) load_blocking(batch, batch->requests+f);
+			else if (files[f].pending) {
+				batch->requests[f].status    = -EIO;
+				batch->requests[f].data      = NULL;
+				batch->requests[f].size      = 0;
+				batch->requests[f].allocated = 0;
+			}
+		}
+		uring_exit(&ring);
+		return 1;
+	}
+
+	free(files);
+	uring_exit(&ring);
+	return 1;
+}
+
+#endif
+
+unsigned int fh_LoadFiles
+(struct fh_load_request * __restrict const requests,
+ unsigned int const n,
+ struct ah_arena * __restrict const arena,
+ enum fh_load_method const method)
+{
+	struct load_batch batch = {
+		.requests = requests,
+		.n        = n,
+		.arena    = arena
+	};
+	unsigned int loaded = 0;
+
+	atomic_init(&batch.next, 0);
+	pthread_mutex_init(&batch.arena_lock, NULL);
+
+	switch (method) {
+	case FH_LOAD_AUTO:
+	case FH_LOAD_IO_URING:
+#if defined(FH_HAVE_IO_URING)
+		if (load_with_uring(&batch)) break;
+#endif
+		if (method == FH_LOAD_IO_URING) {
+			LOG("[fh_LoadFiles] io_uring unavailable. Using threads.\n");
+		}
+		/* fallthrough */
+	case FH_LOAD_THREADS:
+		load_with_threads(&batch);
+		break;
+	case FH_LOAD_SERIAL:
+		load_thread(&batch);
+		break;
+	}
+
+	pthread_mutex_destroy(&batch.arena_lock);
+
+	for (unsigned int r = 0; r < n; r++) {
+		if (requests[r].status == 0) loaded++;
+		else {
+			LOG("[fh_LoadFiles] %s : %s\n",
+			    requests[r].pathname, strerror(-requests[r].status));
+		}
+	}
+	return loaded;
+}
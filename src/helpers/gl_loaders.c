@@ -26,9 +26,9 @@
 #include <helpers/file.h>
 #include <helpers/log.h>
 #include <helpers/string.h>
+#include <helpers/texture_codecs.h>
 
-/* TODO : Replace exit by an "implementation-defined" panic function */
-/* exit */
+/* malloc, free */
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -165,14 +165,332 @@ GLuint glhSetupAndUse
 	return p;
 }
 
-/* TODO : This must be customised */
-static void setupTexture()
+#define GLH_MAX_COMPRESSED_FORMATS 64
+
+static struct {
+	unsigned int probed;
+	unsigned int npot_mipmaps;
+	unsigned int n_compressed;
+	GLenum compressed[GLH_MAX_COMPRESSED_FORMATS];
+} texture_support = {0};
+
+static unsigned int is_power_of_two(uint32_t const value)
+{
+	return value && !(value & (value - 1));
+}
+
+static unsigned int full_mipmaps_chain
+(struct glh_raw_texture const * __restrict const tex)
 {
-  glGenerateMipmap(GL_TEXTURE_2D);
+	uint32_t width  = tex->levels[0].width;
+	uint32_t height = tex->levels[0].height;
+	unsigned int expected_levels = 1;
+
+	while (width > 1 || height > 1) {
+		width  = width  > 1 ? width  / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+		expected_levels++;
+	}
+
+	return tex->n_levels == expected_levels;
+}
+
+static unsigned int is_mipmap_filter(GLenum const filter)
+{
+	return filter == GL_NEAREST_MIPMAP_NEAREST ||
+	       filter == GL_LINEAR_MIPMAP_NEAREST  ||
+	       filter == GL_NEAREST_MIPMAP_LINEAR  ||
+	       filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+void glhSetupTexture
+(struct glh_raw_texture const * __restrict const tex)
+{
+	if (!texture_support.probed) glhProbeTextureSupport();
+
+	/* OpenGL ES 2.x cannot limit the sampled levels
+	   (no GL_TEXTURE_MAX_LEVEL), so partial chains are unusable */
+	unsigned int const can_mipmap =
+	  full_mipmaps_chain(tex) && tex->n_levels > 1 &&
+	  (texture_support.npot_mipmaps ||
+	   (is_power_of_two(tex->levels[0].width) &&
+	    is_power_of_two(tex->levels[0].height)));
+
+	GLenum min_filter = tex->min_filter;
+	if (min_filter == 0)
+		min_filter = can_mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+	else if (is_mipmap_filter(min_filter) && !can_mipmap)
+		min_filter = GL_LINEAR;
+
+	GLenum const mag_filter = tex->mag_filter ? tex->mag_filter : GL_LINEAR;
+
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+}
+
+/**
+ * Define the currently bound GL_TEXTURE_2D as a 1x1 fully transparent
+ * texture.
+ * Used as a stand-in for textures that are not available yet (still
+ * streaming) or could not be loaded at all.
+ */
+void glhUploadPlaceholderTexture()
+{
+	static uint8_t const transparent_texel[4] = {0, 0, 0, 0};
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(
+	  GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0,
+	  GL_RGBA, GL_UNSIGNED_BYTE, transparent_texel
+	);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+}
+
+static uint32_t bytes_per_pixel(GLenum const format, GLenum const type)
+{
+	switch(type) {
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_5_6_5:
+			return 2;
+		case GL_UNSIGNED_BYTE:
+			switch(format) {
+				case GL_RGBA:
+				case GL_BGRA_EXT:        return 4;
+				case GL_RGB:             return 3;
+				case GL_LUMINANCE_ALPHA: return 2;
+				case GL_LUMINANCE:
+				case GL_ALPHA:           return 1;
+			}
+	}
+	return 0;
+}
+
+static uint32_t row_size
+(GLenum const format, GLenum const type,
+ uint32_t const alignment, uint32_t const width)
+{
+	uint32_t const unpadded = width * bytes_per_pixel(format, type);
+	return (unpadded + alignment - 1) / alignment * alignment;
+}
+
+uint32_t glhRawTextureRowSize
+(struct glh_raw_texture const * __restrict const tex,
+ unsigned int const level)
+{
+	uint32_t const width = tex->levels[level].width;
+	return tex->compressed
+	  ? tc_CompressedSize(tex->format, width, 1)
+	  : row_size(tex->format, tex->type, tex->alignment, width);
+}
+
+static uint32_t expected_level_size
+(struct glh_raw_texture const * __restrict const tex,
+ uint32_t const width, uint32_t const height)
+{
+	return tex->compressed
+	  ? tc_CompressedSize(tex->format, width, height)
+	  : row_size(tex->format, tex->type, tex->alignment, width) * height;
+}
+
+unsigned int glhParseMyyRawTexture
+(void const * __restrict const content, size_t const size,
+ struct glh_raw_texture * __restrict const tex)
+{
+	struct myy_raw_texture_content const * __restrict const raw = content;
+
+	if (size < sizeof(*raw) || raw->myy_target != GL_TEXTURE_2D)
+		return 0;
+
+	uint32_t const flags = raw->alignment & ~MYY_RAW_TEXTURE_ALIGNMENT_MASK;
+	uint8_t const * __restrict const data = (uint8_t const *) raw->data;
+	size_t const data_size = size - sizeof(*raw);
+
+	tex->target     = raw->myy_target;
+	tex->format     = raw->myy_format;
+	tex->type       = raw->myy_type;
+	tex->alignment  = raw->alignment & MYY_RAW_TEXTURE_ALIGNMENT_MASK;
+	tex->compressed = (flags & MYY_RAW_TEXTURE_FLAG_COMPRESSED) != 0;
+	tex->min_filter = 0;
+	tex->mag_filter = 0;
+
+	/* glPixelStorei(GL_UNPACK_ALIGNMENT) only accepts these */
+	switch(tex->alignment) {
+		case 1: case 2: case 4: case 8: break;
+		default: return 0;
+	}
+
+	if (tex->compressed
+	    ? tc_CompressedSize(tex->format, 1, 1) == 0
+	    : bytes_per_pixel(tex->format, tex->type) == 0) {
+		LOG("Unknown texture format %x - type %x\n", tex->format, tex->type);
+		return 0;
+	}
+
+	if (!(flags & MYY_RAW_TEXTURE_FLAG_LEVELS)) {
+		/* Compressed data cannot be described without levels */
+		uint32_t const level_size =
+		  expected_level_size(tex, raw->width, raw->height);
+		if (tex->compressed || level_size > data_size ||
+		    raw->width == 0 || raw->height == 0)
+			return 0;
+
+		tex->n_levels = 1;
+		tex->levels[0].width  = raw->width;
+		tex->levels[0].height = raw->height;
+		tex->levels[0].size   = level_size;
+		tex->levels[0].data   = data;
+		return 1;
+	}
+
+	struct myy_raw_texture_levels const * __restrict const levels =
+	  (struct myy_raw_texture_levels const *) data;
+
+	if (data_size < sizeof(*levels) ||
+	    levels->n_levels == 0 ||
+	    levels->n_levels > GLH_MAX_TEXTURE_LEVELS ||
+	    data_size < sizeof(*levels) +
+	                levels->n_levels * sizeof(levels->level[0]))
+		return 0;
+
+	tex->n_levels   = levels->n_levels;
+	tex->min_filter = levels->filters & 0xffff;
+	tex->mag_filter = levels->filters >> 16;
+	for (unsigned int l = 0; l < tex->n_levels; l++) {
+		struct myy_raw_texture_level const * __restrict const level =
+		  levels->level+l;
+		/* Empty levels have no rows to upload */
+		if (level->width == 0 || level->height == 0 ||
+		    level->size <
+		      expected_level_size(tex, level->width, level->height) ||
+		    (uint64_t) level->offset + level->size > data_size)
+			return 0;
+
+		tex->levels[l].width  = level->width;
+		tex->levels[l].height = level->height;
+		tex->levels[l].size   = level->size;
+		tex->levels[l].data   = data + level->offset;
+	}
+
+	return 1;
+}
+
+void glhProbeTextureSupport()
+{
+	GLint n_formats = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &n_formats);
+
+	GLint * const formats = malloc(sizeof(GLint) * (n_formats+1));
+	unsigned int n = 0;
+
+	if (formats != NULL) {
+		glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats);
+		for (GLint f = 0; f < n_formats && n < GLH_MAX_COMPRESSED_FORMATS; f++)
+			texture_support.compressed[n++] = formats[f];
+		free(formats);
+	}
+
+	/* Some drivers only advertise ETC1 through its extension */
+	char const * __restrict const extensions =
+	  (char const *) glGetString(GL_EXTENSIONS);
+	if (sh_hasExtension(extensions, "GL_OES_compressed_ETC1_RGB8_texture") &&
+	    n < GLH_MAX_COMPRESSED_FORMATS)
+		texture_support.compressed[n++] = GL_ETC1_RGB8_OES;
+
+	for (unsigned int f = 0; f < n; f++)
+		LOG_DEBUG("Compressed format supported : 0x%x\n",
+		    texture_support.compressed[f]);
+
+	texture_support.n_compressed = n;
+	texture_support.npot_mipmaps =
+	  sh_hasExtension(extensions, "GL_OES_texture_npot");
+	texture_support.probed = 1;
+}
+
+unsigned int glhCompressedFormatSupported(GLenum const format)
+{
+	if (!texture_support.probed) glhProbeTextureSupport();
+
+	for (unsigned int f = 0; f < texture_support.n_compressed; f++)
+		if (texture_support.compressed[f] == format) return 1;
+	return 0;
+}
+
+void * glhDecompressRawTexture
+(struct glh_raw_texture * __restrict const tex)
+{
+	if (!tex->compressed ||
+	    glhCompressedFormatSupported(tex->format) ||
+	    !tc_CanDecompress(tex->format))
+		return NULL;
+
+	size_t total_size = 0;
+	for (unsigned int l = 0; l < tex->n_levels; l++)
+		total_size +=
+		  (size_t) tex->levels[l].width * tex->levels[l].height * 4;
+
+	uint8_t * const pixels = malloc(total_size);
+	if (pixels == NULL) return NULL;
+
+	LOG("Decompressing texture format 0x%x on the CPU\n", tex->format);
+	uint8_t * __restrict level_pixels = pixels;
+	for (unsigned int l = 0; l < tex->n_levels; l++) {
+		struct glh_texture_level * __restrict const level = tex->levels+l;
+		tc_DecompressToRGBA8(
+		  tex->format, level->width, level->height,
+		  level->data, level_pixels
+		);
+		level->data = level_pixels;
+		level->size = level->width * level->height * 4;
+		level_pixels += level->size;
+	}
+
+	tex->compressed = 0;
+	tex->format     = GL_RGBA;
+	tex->type       = GL_UNSIGNED_BYTE;
+	tex->alignment  = 4;
+
+	return pixels;
+}
+
+unsigned int glhUploadRawTexture
+(struct glh_raw_texture const * __restrict const tex)
+{
+	if (tex->compressed && !glhCompressedFormatSupported(tex->format)) {
+		LOG("Compressed format 0x%x not supported\n", tex->format);
+		return 0;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, tex->alignment);
+	for (unsigned int l = 0; l < tex->n_levels; l++) {
+		struct glh_texture_level const * __restrict const level =
+		  tex->levels+l;
+		LOG_DEBUG(
+		  "glTex%sImage2D(%d, %d, %d, %d, %d) - %u bytes\n",
+		  tex->compressed ? "Compressed" : "",
+		  tex->target, l, tex->format,
+		  level->width, level->height, level->size
+		);
+		if (tex->compressed)
+			glCompressedTexImage2D(
+			  tex->target, l, tex->format,
+			  level->width, level->height, 0,
+			  level->size, level->data
+			);
+		else
+			glTexImage2D(
+			  tex->target, l, tex->format,
+			  level->width, level->height, 0,
+			  tex->format, tex->type, level->data
+			);
+	}
+	glhSetupTexture(tex);
+
+	return 1;
 }
 
 /**
@@ -180,7 +498,7 @@ static void setupTexture()
  *  each \0 separated filename in "textures_names" into these buffers.
  * 
  * The raw files are supposed to follow a specific format, described by
- * the 
+ * struct myy_raw_texture_content .
  *
  * Example :
  * GLuint textures_id[2];
@@ -205,7 +523,7 @@ static void setupTexture()
  *   Once the textures uploaded, use glhActiveTextures to enable
  * multi-texturing.
  */
-void glhUploadMyyRawTextures
+unsigned int glhUploadMyyRawTextures
 (char const * __restrict const textures_names, int const n,
  GLuint * __restrict const texid)
 {
@@ -225,6 +543,7 @@ void glhUploadMyyRawTextures
 	glGenTextures(n, texid);
 
 	const char *current_name = textures_names;
+	unsigned int n_uploaded = 0;
 
 	for (int i = 0; i < n; i++) {
 		/* glTexImage2D
@@ -234,37 +553,31 @@ void glhUploadMyyRawTextures
 		LOG("Loading texture : %s\n", current_name);
 		struct myy_fh_map_handle mapped_file_infos =
 			fh_MapFileToMemory(current_name);
-		if (mapped_file_infos.ok) {
-
-			struct myy_raw_texture_content const * const tex = 
-				(struct myy_raw_texture_content const *)
-				mapped_file_infos.address;
-
-			glBindTexture(tex->myy_target, texid[i]);
-			glPixelStorei(GL_UNPACK_ALIGNMENT, tex->alignment);
-			LOG(
-			  "glPixelStorei(%d)\n"
-			  "glTexImage2D(%d, %d, %d, %d, %d, %d, %d, %d, %p)\n",
-			  tex->alignment,
-			  tex->myy_target, 0, tex->myy_format,
-			  tex->width, tex->height, 0,
-			  tex->myy_format, tex->myy_type, tex->data
-			);
-			glTexImage2D(
-			  tex->myy_target, 0, tex->myy_format,
-			  tex->width, tex->height, 0,
-			  tex->myy_format, tex->myy_type, tex->data
-			);
-			setupTexture();
-
-			fh_UnmapFileFromMemory(mapped_file_infos);
-			sh_pointToNextString(current_name);
+		struct glh_raw_texture tex;
+		unsigned int uploaded = 0;
+
+		glBindTexture(GL_TEXTURE_2D, texid[i]);
+		if (mapped_file_infos.ok &&
+		    glhParseMyyRawTexture(
+		      mapped_file_infos.address, mapped_file_infos.length, &tex
+		    )) {
+			void * const decompressed = glhDecompressRawTexture(&tex);
+			uploaded = glhUploadRawTexture(&tex);
+			free(decompressed);
 		}
+		fh_UnmapFileFromMemory(mapped_file_infos);
+
+		if (uploaded) n_uploaded++;
 		else {
+			/* Keep going. The texture name stays valid and samples as
+			   transparent, which beats killing the whole program. */
 			LOG("You're sure about that file : %s ?\n", current_name);
-			exit(1);
+			glhUploadPlaceholderTexture();
 		}
+		sh_pointToNextString(current_name);
 	}
+
+	return n_uploaded;
 }
 
 /**
@@ -2,6 +2,7 @@
 #define MYY_SRC_HELPERS_OPENGL_LOADERS 1
 
 #include <current/opengl.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -34,6 +35,17 @@ GLuint glhSetupAndUse
  uint8_t n_attributes,
  char const * __restrict const attributes_names);
 
+/* Flags stored in the upper bits of myy_raw_texture_content.alignment.
+ * Files generated before these flags existed only use the lower byte.
+ * - LEVELS : data starts with a struct myy_raw_texture_levels header
+ *            describing each mipmap level.
+ * - COMPRESSED : myy_format is a compressed internal format, to upload
+ *                with glCompressedTexImage2D. myy_type is 0.
+ *                Compressed textures always have a LEVELS header. */
+#define MYY_RAW_TEXTURE_ALIGNMENT_MASK  0xffu
+#define MYY_RAW_TEXTURE_FLAG_COMPRESSED (1u << 30)
+#define MYY_RAW_TEXTURE_FLAG_LEVELS     (1u << 31)
+
 struct myy_raw_texture_content {
 	/* The texture width */
 	uint32_t const width;
@@ -45,12 +57,114 @@ struct myy_raw_texture_content {
 	uint32_t const myy_format;
 	/* myy_type   = gl_type   */
 	uint32_t const myy_type;
-	/* Used for glPixelStorei */
+	/* Used for glPixelStorei, and MYY_RAW_TEXTURE_FLAG_* */
 	uint32_t const alignment;
 	/* The texture raw data */
 	uint32_t const data[];
 };
 
+struct myy_raw_texture_level {
+	uint32_t const width;
+	uint32_t const height;
+	/* The level data size, in bytes */
+	uint32_t const size;
+	/* The level data offset, from the start of data[] */
+	uint32_t const offset;
+};
+
+struct myy_raw_texture_levels {
+	/* Level 0 is the full size image */
+	uint32_t const n_levels;
+	/* Lower 16 bits : GL_TEXTURE_MIN_FILTER
+	 * Upper 16 bits : GL_TEXTURE_MAG_FILTER
+	 * 0 selects the default filter. See glhSetupTexture */
+	uint32_t const filters;
+	struct myy_raw_texture_level const level[];
+};
+
+#define GLH_MAX_TEXTURE_LEVELS 16
+
+struct glh_texture_level {
+	uint32_t width, height, size;
+	void const * data;
+};
+
+/* A myy raw texture, checked and ready to be uploaded */
+struct glh_raw_texture {
+	GLenum target, format, type;
+	GLint alignment;
+	unsigned int compressed;
+	/* 0 when not specified by the file */
+	GLenum min_filter, mag_filter;
+	unsigned int n_levels;
+	struct glh_texture_level levels[GLH_MAX_TEXTURE_LEVELS];
+};
+
+/**
+ * Check the content of a myy raw texture file and describe it.
+ *
+ * PARAMS :
+ * @param content The texture file content
+ * @param size    The texture file size
+ * @param tex     The structure receiving the texture description.
+ *                The levels data point inside content.
+ *
+ * RETURNS :
+ * @return 1 if the content is a valid texture. 0 otherwise.
+ */
+unsigned int glhParseMyyRawTexture
+(void const * __restrict const content, size_t const size,
+ struct glh_raw_texture * __restrict const tex);
+
+/**
+ * @return The size of a row of pixels of the provided level,
+ *         padding included.
+ *         For compressed textures, the size of a row of blocks.
+ */
+uint32_t glhRawTextureRowSize
+(struct glh_raw_texture const * __restrict const tex,
+ unsigned int const level);
+
+/**
+ * Query the compressed formats supported by the current context, and
+ * whether non power of two textures can be mipmapped.
+ * Must be called from a thread with a current context, before any
+ * call to glhCompressedFormatSupported or glhSetupTexture from another
+ * thread.
+ */
+void glhProbeTextureSupport();
+
+/**
+ * @return 1 if the compressed format can be uploaded as is.
+ *         0 otherwise.
+ */
+unsigned int glhCompressedFormatSupported(GLenum const format);
+
+/**
+ * If the texture is compressed in a format that the GPU cannot sample,
+ * decompress it into RGBA8888 levels.
+ *
+ * tex is then updated to describe the decompressed data.
+ *
+ * RETURNS :
+ * @return The malloc'd buffer now containing the levels data.
+ *         The caller must free it once the texture uploaded.
+ *         NULL if the texture did not need decompression, or if the
+ *         format cannot be decompressed. Check tex->compressed and
+ *         glhCompressedFormatSupported to tell the difference.
+ */
+void * glhDecompressRawTexture
+(struct glh_raw_texture * __restrict const tex);
+
+/**
+ * Upload every level of tex in the currently bound texture.
+ *
+ * RETURNS :
+ * @return 1 if the texture could be uploaded. 0 otherwise.
+ */
+unsigned int glhUploadRawTexture
+(struct glh_raw_texture const * __restrict const tex);
+
 /**
  *  Create n textures buffers and upload the content of
  *  each \0 separated filename in "textures_names" into these buffers.
@@ -77,14 +191,44 @@ struct myy_raw_texture_content {
  *
  * @param texid          The buffer receiving the generated textures id
  *
+ * Files that cannot be read are replaced by a 1x1 transparent
+ * placeholder texture, so every generated texture name stays usable.
+ *
+ * RETURNS :
+ * @return The number of textures that were actually loaded from their
+ *         files. n if everything went fine.
+ *
  * ADVICE :
  *   Once the textures uploaded, use glhActiveTextures to enable
  * multi-texturing.
+ *   See glhStreamMyyRawTextures in helpers/texture_streamer.h to load
+ * textures without stalling the render loop.
  */
-void glhUploadMyyRawTextures
+unsigned int glhUploadMyyRawTextures
 (char const * __restrict const textures_names, int const n,
  GLuint * __restrict const texid);
 
+/**
+ * Define the currently bound GL_TEXTURE_2D as a 1x1 transparent
+ * texture.
+ */
+void glhUploadPlaceholderTexture();
+
+/**
+ * Set the sampling parameters of the currently bound GL_TEXTURE_2D,
+ * once the content of tex has been uploaded.
+ *
+ * No mipmap is generated at runtime. Mipmapped minification filters
+ * are only used when the file provides the whole mipmaps chain, and
+ * when the GPU can sample it (power of two sizes, or
+ * GL_OES_texture_npot). GL_LINEAR is used otherwise.
+ *
+ * When the file does not specify any filter, textures with a complete
+ * mipmaps chain use GL_LINEAR_MIPMAP_LINEAR.
+ */
+void glhSetupTexture
+(struct glh_raw_texture const * __restrict const tex);
+
 /**
  * Activate and bind the provided textures, in order.
  * The first texture will be activated and bound to GL_TEXTURE0
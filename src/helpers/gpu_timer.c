@@ -0,0 +1,404 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/gpu_timer.h>
+#include <helpers/log.h>
+#include <helpers/string.h>
+#include <helpers/trace.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Every fence of every frame can be waited for at the same time,
+   plus the stop request. Power of 2. */
+#define FENCES_QUEUE_SIZE (GLH_GPU_TIMER_FRAMES*GLH_GPU_TIMER_MAX_PASSES*4)
+
+struct gpu_fence {
+	EGLSyncKHR sync;
+	/* Set by the waiter thread when the GPU signaled the fence */
+	_Atomic uint64_t signaled_ns;
+};
+
+struct gpu_pass {
+	char const * name;
+	GLuint query;
+	struct gpu_fence begin, end;
+};
+
+struct gpu_frame {
+	uint64_t number;
+	unsigned int n_passes;
+	/* Set until the results are collected */
+	unsigned int pending;
+	struct gpu_pass passes[GLH_GPU_TIMER_MAX_PASSES];
+};
+
+static struct {
+	enum glh_gpu_timer_method method;
+	EGLDisplay display;
+
+	PFNGLGENQUERIESEXTPROC gen_queries;
+	PFNGLDELETEQUERIESEXTPROC delete_queries;
+	PFNGLBEGINQUERYEXTPROC begin_query;
+	PFNGLENDQUERYEXTPROC end_query;
+	PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv;
+	PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v;
+
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+
+	struct gpu_frame frames[GLH_GPU_TIMER_FRAMES];
+	/* Frames started, recorded in `frames` and collected */
+	uint64_t started, recorded, collected;
+	/* NULL when the current frame is not measured */
+	struct gpu_frame * current;
+	struct gpu_pass * pass;
+
+	struct glh_gpu_timer_results results;
+	unsigned int results_changed;
+
+	/* Fences waited for by the waiter thread, in submission order.
+	   A NULL fence stops the thread. */
+	pthread_t waiter;
+	sem_t fences_ready;
+	struct gpu_fence * fences[FENCES_QUEUE_SIZE];
+	unsigned int fences_head;
+} gpu;
+
+char const * glhGpuTimerMethodName(enum glh_gpu_timer_method const method)
+{
+	switch (method) {
+	case GLH_GPU_TIMER_QUERIES: return "GL_EXT_disjoint_timer_query";
+	case GLH_GPU_TIMER_FENCES:  return "EGL_KHR_fence_sync estimation";
+	default: return "off";
+	}
+}
+
+/* -- Fences -- */
+
+static void * fences_waiter(void * unused)
+{
+	unsigned int tail = 0;
+
+	th_TraceThreadName("gpu fences");
+	while (1) {
+		while (sem_wait(&gpu.fences_ready) < 0 && errno == EINTR);
+
+		struct gpu_fence * __restrict const fence =
+			gpu.fences[tail++ % FENCES_QUEUE_SIZE];
+		if (fence == NULL) break;
+
+		if (fence->sync != EGL_NO_SYNC_KHR)
+			gpu.client_wait_sync(
+			  gpu.display, fence->sync, 0, EGL_FOREVER_KHR);
+		atomic_store_explicit(
+		  &fence->signaled_ns, th_TraceNow(), memory_order_release);
+	}
+
+	return NULL;
+}
+
+static void fences_push(struct gpu_fence * __restrict const fence)
+{
+	gpu.fences[gpu.fences_head++ % FENCES_QUEUE_SIZE] = fence;
+	sem_post(&gpu.fences_ready);
+}
+
+static void fence_insert(struct gpu_fence * __restrict const fence)
+{
+	atomic_store_explicit(&fence->signaled_ns, 0, memory_order_relaxed);
+	fence->sync = gpu.create_sync(gpu.display, EGL_SYNC_FENCE_KHR, NULL);
+	fences_push(fence);
+}
+
+static uint64_t fence_signaled(struct gpu_fence * __restrict const fence)
+{
+	return atomic_load_explicit(&fence->signaled_ns, memory_order_acquire);
+}
+
+static void fence_release(struct gpu_fence * __restrict const fence)
+{
+	if (fence->sync != EGL_NO_SYNC_KHR)
+		gpu.destroy_sync(gpu.display, fence->sync);
+	fence->sync = EGL_NO_SYNC_KHR;
+}
+
+static unsigned int fences_start(char const * __restrict const extensions)
+{
+	if (!sh_hasExtension(extensions, "EGL_KHR_fence_sync")) return 0;
+
+	gpu.create_sync = (PFNEGLCREATESYNCKHRPROC)
+	  eglGetProcAddress("eglCreateSyncKHR");
+	gpu.destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+	  eglGetProcAddress("eglDestroySyncKHR");
+	gpu.client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+	  eglGetProcAddress("eglClientWaitSyncKHR");
+	if (!gpu.create_sync || !gpu.destroy_sync || !gpu.client_wait_sync)
+		return 0;
+
+	sem_init(&gpu.fences_ready, 0, 0);
+	gpu.fences_head = 0;
+	if (pthread_create(&gpu.waiter, NULL, fences_waiter, NULL)) {
+		LOG_ERROR("[GPU timer] Could not start the fences waiter\n");
+		sem_destroy(&gpu.fences_ready);
+		return 0;
+	}
+
+	return 1;
+}
+
+/* -- Queries -- */
+
+static unsigned int queries_start(char const * __restrict const extensions)
+{
+	if (!sh_hasExtension(extensions, "GL_EXT_disjoint_timer_query"))
+		return 0;
+
+	gpu.gen_queries = (PFNGLGENQUERIESEXTPROC)
+	  eglGetProcAddress("glGenQueriesEXT");
+	gpu.delete_queries = (PFNGLDELETEQUERIESEXTPROC)
+	  eglGetProcAddress("glDeleteQueriesEXT");
+	gpu.begin_query = (PFNGLBEGINQUERYEXTPROC)
+	  eglGetProcAddress("glBeginQueryEXT");
+	gpu.end_query = (PFNGLENDQUERYEXTPROC)
+	  eglGetProcAddress("glEndQueryEXT");
+	gpu.get_query_uiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)
+	  eglGetProcAddress("glGetQueryObjectuivEXT");
+	gpu.get_query_ui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+	  eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if (!gpu.gen_queries || !gpu.delete_queries || !gpu.begin_query ||
+	    !gpu.end_query || !gpu.get_query_uiv || !gpu.get_query_ui64v)
+		return 0;
+
+	for (unsigned int f = 0; f < GLH_GPU_TIMER_FRAMES; f++)
+		for (unsigned int p = 0; p < GLH_GPU_TIMER_MAX_PASSES; p++)
+			gpu.gen_queries(1, &gpu.frames[f].passes[p].query);
+
+	/* Clear any disjoint event that happened before */
+	GLint disjoint;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	return 1;
+}
+
+/* -- Frames -- */
+
+static unsigned int frame_done(struct gpu_frame * __restrict const frame)
+{
+	if (frame->n_passes == 0) return 1;
+
+	struct gpu_pass * __restrict const last =
+		frame->passes + frame->n_passes - 1;
+	if (gpu.method == GLH_GPU_TIMER_QUERIES) {
+		GLuint available = 0;
+		gpu.get_query_uiv(
+		  last->query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+		return available;
+	}
+	/* The fences are signaled in order */
+	return fence_signaled(&last->end) != 0;
+}
+
+static void frame_collect
+(struct gpu_frame * __restrict const frame,
+ unsigned int const disjoint)
+{
+	struct glh_gpu_timer_results * __restrict const results = &gpu.results;
+	uint64_t total = 0;
+
+	for (unsigned int p = 0; p < frame->n_passes; p++) {
+		struct gpu_pass * __restrict const pass = frame->passes + p;
+		uint64_t ns = 0;
+
+		if (gpu.method == GLH_GPU_TIMER_QUERIES) {
+			GLuint64 elapsed = 0;
+			gpu.get_query_ui64v(pass->query, GL_QUERY_RESULT_EXT, &elapsed);
+			ns = elapsed;
+		}
+		else {
+			ns = fence_signaled(&pass->end) - fence_signaled(&pass->begin);
+			fence_release(&pass->begin);
+			fence_release(&pass->end);
+		}
+
+		results->names[p] = pass->name;
+		results->ns[p] = ns;
+		total += ns;
+	}
+	frame->pending = 0;
+
+	if (disjoint) {
+		results->frames_skipped++;
+		return;
+	}
+
+	results->frame = frame->number;
+	results->n_passes = frame->n_passes;
+	results->total_ns = total;
+	gpu.results_changed = 1;
+
+	for (unsigned int p = 0; p < frame->n_passes; p++)
+		TRACE_COUNTER(results->names[p], results->ns[p] / 1000);
+	TRACE_COUNTER("gpu frame (us)", total / 1000);
+}
+
+static void frames_collect()
+{
+	GLint disjoint = 0;
+	if (gpu.method == GLH_GPU_TIMER_QUERIES)
+		glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	for (; gpu.collected < gpu.recorded; gpu.collected++) {
+		struct gpu_frame * __restrict const frame =
+			gpu.frames + gpu.collected % GLH_GPU_TIMER_FRAMES;
+		if (!frame_done(frame)) break;
+		frame_collect(frame, disjoint);
+	}
+}
+
+void glhGpuTimerFrameBegin()
+{
+	if (gpu.method == GLH_GPU_TIMER_OFF) return;
+
+	if (gpu.pass != NULL) glhGpuTimerPassEnd();
+	frames_collect();
+
+	struct gpu_frame * __restrict const frame =
+		gpu.frames + gpu.recorded % GLH_GPU_TIMER_FRAMES;
+	if (frame->pending) {
+		/* The GPU is too far behind */
+		gpu.current = NULL;
+		gpu.results.frames_skipped++;
+	}
+	else {
+		frame->number = gpu.started;
+		frame->n_passes = 0;
+		frame->pending = 1;
+		gpu.current = frame;
+		gpu.recorded++;
+	}
+	gpu.started++;
+}
+
+void glhGpuTimerPassBegin(char const * __restrict const name)
+{
+	struct gpu_frame * __restrict const frame = gpu.current;
+	if (frame == NULL || gpu.pass != NULL ||
+	    frame->n_passes == GLH_GPU_TIMER_MAX_PASSES)
+		return;
+
+	struct gpu_pass * __restrict const pass =
+		frame->passes + frame->n_passes++;
+	pass->name = name;
+	if (gpu.method == GLH_GPU_TIMER_QUERIES)
+		gpu.begin_query(GL_TIME_ELAPSED_EXT, pass->query);
+	else
+		fence_insert(&pass->begin);
+	gpu.pass = pass;
+}
+
+void glhGpuTimerPassEnd()
+{
+	struct gpu_pass * __restrict const pass = gpu.pass;
+	if (pass == NULL) return;
+
+	if (gpu.method == GLH_GPU_TIMER_QUERIES)
+		gpu.end_query(GL_TIME_ELAPSED_EXT);
+	else
+		fence_insert(&pass->end);
+	gpu.pass = NULL;
+}
+
+unsigned int glhGpuTimerResults
+(struct glh_gpu_timer_results * __restrict const results)
+{
+	unsigned int const changed = gpu.results_changed;
+	*results = gpu.results;
+	gpu.results_changed = 0;
+	return changed;
+}
+
+enum glh_gpu_timer_method glhGpuTimerStart(EGLDisplay const display)
+{
+	char const * __restrict const requested = getenv("MYY_GPU_TIMER");
+	unsigned int const queries_allowed =
+		requested == NULL || strcmp(requested, "queries") == 0;
+	unsigned int const fences_allowed =
+		requested == NULL || strcmp(requested, "fences") == 0;
+
+	if (gpu.method != GLH_GPU_TIMER_OFF) return gpu.method;
+
+	memset(&gpu.results, 0, sizeof(gpu.results));
+	gpu.display = display;
+	gpu.started = gpu.recorded = gpu.collected = 0;
+	gpu.current = NULL;
+	gpu.pass = NULL;
+
+	if (queries_allowed &&
+	    queries_start((char const *) glGetString(GL_EXTENSIONS)))
+		gpu.method = GLH_GPU_TIMER_QUERIES;
+	else if (fences_allowed &&
+	         fences_start(eglQueryString(display, EGL_EXTENSIONS)))
+		gpu.method = GLH_GPU_TIMER_FENCES;
+
+	LOG("[GPU timer] %s\n", glhGpuTimerMethodName(gpu.method));
+	return gpu.method;
+}
+
+void glhGpuTimerStop()
+{
+	if (gpu.method == GLH_GPU_TIMER_OFF) return;
+
+	glhGpuTimerPassEnd();
+
+	if (gpu.method == GLH_GPU_TIMER_QUERIES) {
+		for (unsigned int f = 0; f < GLH_GPU_TIMER_FRAMES; f++)
+			for (unsigned int p = 0; p < GLH_GPU_TIMER_MAX_PASSES; p++)
+				gpu.delete_queries(1, &gpu.frames[f].passes[p].query);
+	}
+	else {
+		/* Every fence will be signaled, and waited for */
+		glFinish();
+		fences_push(NULL);
+		pthread_join(gpu.waiter, NULL);
+		sem_destroy(&gpu.fences_ready);
+
+		for (unsigned int f = 0; f < GLH_GPU_TIMER_FRAMES; f++) {
+			struct gpu_frame * __restrict const frame = gpu.frames + f;
+			if (!frame->pending) continue;
+			for (unsigned int p = 0; p < frame->n_passes; p++) {
+				fence_release(&frame->passes[p].begin);
+				fence_release(&frame->passes[p].end);
+			}
+		}
+	}
+
+	for (unsigned int f = 0; f < GLH_GPU_TIMER_FRAMES; f++)
+		gpu.frames[f].pending = 0;
+	gpu.method = GLH_GPU_TIMER_OFF;
+}
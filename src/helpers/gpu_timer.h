@@ -0,0 +1,98 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_GPU_TIMER
+#define MYY_SRC_HELPERS_GPU_TIMER 1
+
+#include <current/opengl.h>
+#include <stdint.h>
+
+/* GPU time spent in each named pass of a frame.
+ *
+ * With GL_EXT_disjoint_timer_query, each pass is measured by a
+ * GL_TIME_ELAPSED_EXT query. Without it, EGL_KHR_fence_sync fences are
+ * inserted before and after each pass, and a thread records when the
+ * GPU signals them. This estimation also counts the time the GPU waited
+ * for commands during the pass, so it is only accurate when the GPU is
+ * the bottleneck.
+ *
+ * Queries and fences are kept for GLH_GPU_TIMER_FRAMES frames, and only
+ * read once the GPU is done with them. When the GPU is more frames
+ * behind, frames are simply not measured. Reading the results never
+ * waits for the GPU.
+ *
+ * Set MYY_GPU_TIMER to "off", "queries" or "fences" to choose the
+ * method at runtime. */
+
+/* Power of 2 */
+#define GLH_GPU_TIMER_FRAMES 4
+#define GLH_GPU_TIMER_MAX_PASSES 8
+
+enum glh_gpu_timer_method {
+	GLH_GPU_TIMER_OFF,
+	GLH_GPU_TIMER_QUERIES,
+	GLH_GPU_TIMER_FENCES
+};
+
+struct glh_gpu_timer_results {
+	/* The measured frame, counted from glhGpuTimerStart */
+	uint64_t frame;
+	/* Frames not measured, since the GPU was too far behind or the
+	   timer was disjoint (e.g. GPU frequency change) */
+	uint64_t frames_skipped;
+	uint64_t total_ns;
+	unsigned int n_passes;
+	char const * names[GLH_GPU_TIMER_MAX_PASSES];
+	uint64_t ns[GLH_GPU_TIMER_MAX_PASSES];
+};
+
+/**
+ * Choose the timing method and allocate its resources.
+ * Must be called from the render thread, with its context current.
+ *
+ * @return The method used. GLH_GPU_TIMER_OFF when neither
+ *         GL_EXT_disjoint_timer_query or EGL_KHR_fence_sync are
+ *         available, in which case the other functions do nothing.
+ */
+enum glh_gpu_timer_method glhGpuTimerStart(EGLDisplay const display);
+
+/* Release the queries, fences and thread used */
+void glhGpuTimerStop();
+
+char const * glhGpuTimerMethodName(enum glh_gpu_timer_method const method);
+
+/* Collect the results of the previous frames the GPU completed, and
+ * start measuring a new frame */
+void glhGpuTimerFrameBegin();
+
+/* Passes cannot be nested. Names must outlive the program, and are
+ * also used as trace counters names (in microseconds). */
+void glhGpuTimerPassBegin(char const * __restrict const name);
+void glhGpuTimerPassEnd();
+
+/* Copy the latest completed frame results.
+ * Returns 1 if they changed since the last call, 0 otherwise. */
+unsigned int glhGpuTimerResults
+(struct glh_gpu_timer_results * __restrict const results);
+
+#endif
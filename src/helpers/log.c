@@ -0,0 +1,679 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/log.h>
+
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Per thread ring size. Must be a power of 2. */
+#define LH_RING_SIZE (64*1024)
+/* Biggest record, header included. Longer strings are truncated. */
+#define LH_RECORD_MAX_SIZE 1024
+/* How often the background thread writes the pending records */
+#define LH_FLUSH_PERIOD_NS (20*1000*1000)
+
+atomic_uint lh_log_level = MYY_LOG_LEVEL_DEBUG;
+
+struct lh_record {
+	uint64_t timestamp;
+	/* NULL marks the end of the ring : the next record is at 0 */
+	char const * format;
+	/* Header included, multiple of 8 */
+	uint32_t size;
+	uint32_t level;
+};
+
+enum lh_ring_state {
+	LH_RING_ACTIVE,
+	/* The thread owning the ring exited. Reused by the next thread. */
+	LH_RING_ORPHAN
+};
+
+struct lh_ring {
+	/* Written by the producer */
+	alignas(64) atomic_uint_fast64_t head;
+	atomic_uint dropped;
+	/* Written by the consumer */
+	alignas(64) atomic_uint_fast64_t tail;
+	unsigned int dropped_reported;
+
+	atomic_uint state;
+	struct lh_ring * next;
+	alignas(8) uint8_t data[LH_RING_SIZE];
+};
+
+static struct {
+	_Atomic(struct lh_ring *) rings;
+	pthread_once_t started;
+	pthread_key_t ring_key;
+	pthread_mutex_t draining;
+	pthread_t writer;
+} logger = {
+	.started  = PTHREAD_ONCE_INIT,
+	.draining = PTHREAD_MUTEX_INITIALIZER
+};
+
+static _Thread_local struct lh_ring * thread_ring;
+
+/* -- printf conversions -- */
+
+enum lh_length {
+	LH_LENGTH_NONE, LH_LENGTH_HH, LH_LENGTH_H, LH_LENGTH_L, LH_LENGTH_LL,
+	LH_LENGTH_J, LH_LENGTH_Z, LH_LENGTH_T, LH_LENGTH_LONG_DOUBLE
+};
+
+struct lh_conversion {
+	char const * flags;
+	unsigned int n_flags;
+	/* Width and precision digits, when not given by '*' */
+	char const * width;
+	unsigned int n_width;
+	char const * precision;
+	unsigned int n_precision;
+	unsigned int width_argument;
+	unsigned int precision_argument;
+	unsigned int has_precision;
+	enum lh_length length;
+	char conversion;
+};
+
+/* `format` points just after a '%'. Returns the end of the conversion */
+static char const * parse_conversion
+(char const * __restrict format,
+ struct lh_conversion * __restrict const conversion)
+{
+	memset(conversion, 0, sizeof(*conversion));
+
+	conversion->flags = format;
+	while (*format && strchr("-+ #0'", *format)) format++;
+	conversion->n_flags = format - conversion->flags;
+
+	if (*format == '*') { conversion->width_argument = 1; format++; }
+	else {
+		conversion->width = format;
+		while (*format >= '0' && *format <= '9') format++;
+		conversion->n_width = format - conversion->width;
+	}
+
+	if (*format == '.') {
+		conversion->has_precision = 1;
+		format++;
+		if (*format == '*') { conversion->precision_argument = 1; format++; }
+		else {
+			conversion->precision = format;
+			while (*format >= '0' && *format <= '9') format++;
+			conversion->n_precision = format - conversion->precision;
+		}
+	}
+
+	switch (*format) {
+	case 'h':
+		format++;
+		if (*format == 'h') { conversion->length = LH_LENGTH_HH; format++; }
+		else conversion->length = LH_LENGTH_H;
+		break;
+	case 'l':
+		format++;
+		if (*format == 'l') { conversion->length = LH_LENGTH_LL; format++; }
+		else conversion->length = LH_LENGTH_L;
+		break;
+	case 'j': conversion->length = LH_LENGTH_J; format++; break;
+	case 'z': conversion->length = LH_LENGTH_Z; format++; break;
+	case 't': conversion->length = LH_LENGTH_T; format++; break;
+	case 'L': conversion->length = LH_LENGTH_LONG_DOUBLE; format++; break;
+	}
+
+	conversion->conversion = *format;
+	return *format ? format + 1 : format;
+}
+
+static int64_t signed_argument
+(enum lh_length const length, va_list * const args)
+{
+	switch (length) {
+	case LH_LENGTH_HH: return (signed char) va_arg(*args, int);
+	case LH_LENGTH_H:  return (short) va_arg(*args, int);
+	case LH_LENGTH_L:  return va_arg(*args, long);
+	case LH_LENGTH_LL: return va_arg(*args, long long);
+	case LH_LENGTH_J:  return va_arg(*args, intmax_t);
+	case LH_LENGTH_Z:  return (ssize_t) va_arg(*args, size_t);
+	case LH_LENGTH_T:  return va_arg(*args, ptrdiff_t);
+	default:           return va_arg(*args, int);
+	}
+}
+
+static uint64_t unsigned_argument
+(enum lh_length const length, va_list * const args)
+{
+	switch (length) {
+	case LH_LENGTH_HH: return (unsigned char) va_arg(*args, unsigned int);
+	case LH_LENGTH_H:  return (unsigned short) va_arg(*args, unsigned int);
+	case LH_LENGTH_L:  return va_arg(*args, unsigned long);
+	case LH_LENGTH_LL: return va_arg(*args, unsigned long long);
+	case LH_LENGTH_J:  return va_arg(*args, uintmax_t);
+	case LH_LENGTH_Z:  return va_arg(*args, size_t);
+	case LH_LENGTH_T:  return (uint64_t) va_arg(*args, ptrdiff_t);
+	default:           return va_arg(*args, unsigned int);
+	}
+}
+
+/* Copy the arguments described by `format` after the record header.
+ * Returns the record size, rounded up to 8 bytes. */
+static size_t encode_record
+(uint8_t * __restrict const record,
+ char const * __restrict format,
+ va_list * const args)
+{
+	uint8_t * __restrict cursor = record + sizeof(struct lh_record);
+	uint8_t * __restrict const end = record + LH_RECORD_MAX_SIZE;
+
+#define PUSH(value) do { \
+	__typeof__(value) const pushed = (value); \
+	if (cursor + sizeof(pushed) > end) goto full; \
+	memcpy(cursor, &pushed, sizeof(pushed)); \
+	cursor += sizeof(pushed); \
+} while (0)
+
+	while ((format = strchr(format, '%')) != NULL) {
+		struct lh_conversion conversion;
+		format = parse_conversion(format + 1, &conversion);
+
+		if (conversion.width_argument) PUSH(va_arg(*args, int));
+		if (conversion.precision_argument) PUSH(va_arg(*args, int));
+
+		switch (conversion.conversion) {
+		case 'd': case 'i':
+			PUSH(signed_argument(conversion.length, args));
+			break;
+		case 'u': case 'o': case 'x': case 'X':
+			PUSH(unsigned_argument(conversion.length, args));
+			break;
+		case 'c':
+			PUSH(va_arg(*args, int));
+			break;
+		case 'p':
+			PUSH(va_arg(*args, void *));
+			break;
+		case 'n':
+			(void) va_arg(*args, void *);
+			break;
+		case 'f': case 'F': case 'e': case 'E':
+		case 'g': case 'G': case 'a': case 'A':
+			if (conversion.length == LH_LENGTH_LONG_DOUBLE)
+				PUSH(va_arg(*args, long double));
+			else
+				PUSH(va_arg(*args, double));
+			break;
+		case 's': {
+			char const * string = va_arg(*args, char const *);
+			if (string == NULL || conversion.length != LH_LENGTH_NONE)
+				string = "(null)";
+			size_t const available = end - cursor;
+			if (available == 0) goto full;
+			size_t length = strnlen(string, available - 1);
+			memcpy(cursor, string, length);
+			cursor[length] = '\0';
+			cursor += length + 1;
+			break;
+		}
+		case '%':
+			break;
+		default:
+			/* Unknown conversion. The remaining arguments can't be read. */
+			goto full;
+		}
+	}
+
+full:
+#undef PUSH
+	return ((cursor - record) + 7) & ~((size_t) 7);
+}
+
+/* -- Rings -- */
+
+static void ring_orphan(void * const ring)
+{
+	atomic_store_explicit(
+	  &((struct lh_ring *) ring)->state, LH_RING_ORPHAN,
+	  memory_order_release
+	);
+}
+
+static void * writer_thread(void * unused);
+
+static void logger_start()
+{
+	pthread_key_create(&logger.ring_key, ring_orphan);
+	if (pthread_create(&logger.writer, NULL, writer_thread, NULL) == 0)
+		pthread_detach(logger.writer);
+	atexit(lh_LogFlush);
+}
+
+static struct lh_ring * ring_acquire()
+{
+	pthread_once(&logger.started, logger_start);
+
+	/* Reuse the ring of a thread that exited */
+	struct lh_ring * ring =
+		atomic_load_explicit(&logger.rings, memory_order_acquire);
+	for (; ring != NULL; ring = ring->next) {
+		unsigned int orphan = LH_RING_ORPHAN;
+		if (atomic_compare_exchange_strong(
+		      &ring->state, &orphan, LH_RING_ACTIVE))
+			goto acquired;
+	}
+
+	ring = aligned_alloc(alignof(struct lh_ring), sizeof(struct lh_ring));
+	if (ring == NULL) return NULL;
+
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->dropped, 0);
+	atomic_init(&ring->state, LH_RING_ACTIVE);
+	ring->dropped_reported = 0;
+	ring->next = atomic_load_explicit(&logger.rings, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak_explicit(
+	         &logger.rings, &ring->next, ring,
+	         memory_order_release, memory_order_relaxed));
+
+acquired:
+	pthread_setspecific(logger.ring_key, ring);
+	thread_ring = ring;
+	return ring;
+}
+
+static void ring_write
+(struct lh_ring * __restrict const ring,
+ uint8_t const * __restrict const record,
+ size_t const size)
+{
+	uint64_t head =
+		atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint64_t const tail =
+		atomic_load_explicit(&ring->tail, memory_order_acquire);
+	size_t const offset = head & (LH_RING_SIZE - 1);
+	size_t const until_end = LH_RING_SIZE - offset;
+	size_t const needed = (until_end < size) ? until_end + size : size;
+
+	if (LH_RING_SIZE - (head - tail) < needed) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	if (until_end < size) {
+		if (until_end >= sizeof(struct lh_record)) {
+			struct lh_record const end_marker = { .format = NULL };
+			memcpy(ring->data + offset, &end_marker, sizeof(end_marker));
+		}
+		head += until_end;
+	}
+
+	memcpy(ring->data + (head & (LH_RING_SIZE - 1)), record, size);
+	atomic_store_explicit(&ring->head, head + size, memory_order_release);
+}
+
+static void log_record
+(unsigned int const level,
+ char const * __restrict const format,
+ va_list * const args)
+{
+	struct lh_ring * __restrict ring = thread_ring;
+	if (ring == NULL && (ring = ring_acquire()) == NULL) return;
+
+	alignas(8) uint8_t record[LH_RECORD_MAX_SIZE];
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct lh_record header = {
+		.timestamp = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec,
+		.format    = format,
+		.level     = level
+	};
+	header.size = encode_record(record, format, args);
+	memcpy(record, &header, sizeof(header));
+
+	ring_write(ring, record, header.size);
+}
+
+void lh_Log
+(unsigned int const level,
+ char const * __restrict const format,
+ ...)
+{
+	va_list args;
+	va_start(args, format);
+	log_record(level, format, &args);
+	va_end(args);
+}
+
+void lh_LogErrno
+(int const error,
+ char const * __restrict const format,
+ ...)
+{
+	lh_Log(MYY_LOG_LEVEL_ERROR, "Error : %s\n", strerror(error));
+
+	va_list args;
+	va_start(args, format);
+	log_record(MYY_LOG_LEVEL_ERROR, format, &args);
+	va_end(args);
+}
+
+void lh_LogSetLevel(unsigned int const level)
+{
+	atomic_store_explicit(&lh_log_level, level, memory_order_relaxed);
+}
+
+int lh_LogLevelFromName(char const * __restrict const name)
+{
+	static char const * const names[] = {
+		[MYY_LOG_LEVEL_NONE]  = "none",
+		[MYY_LOG_LEVEL_ERROR] = "error",
+		[MYY_LOG_LEVEL_WARN]  = "warn",
+		[MYY_LOG_LEVEL_INFO]  = "info",
+		[MYY_LOG_LEVEL_DEBUG] = "debug"
+	};
+
+	for (unsigned int l = 0; l < sizeof(names)/sizeof(names[0]); l++)
+		if (strcasecmp(name, names[l]) == 0) return l;
+
+	return -1;
+}
+
+void lh_LogSetLevelFromEnvironment()
+{
+	char const * __restrict const name = getenv("MYY_LOG_LEVEL");
+	if (name == NULL) return;
+
+	int const level = lh_LogLevelFromName(name);
+	if (level >= 0) lh_LogSetLevel(level);
+	else LOG_WARN("Unknown log level %s\n", name);
+}
+
+/* -- Formatting -- */
+
+struct lh_output {
+	char buffer[16*1024];
+	size_t used;
+};
+
+static void output_flush(struct lh_output * __restrict const output)
+{
+	size_t written = 0;
+	while (written < output->used) {
+		ssize_t const ret =
+			write(2, output->buffer + written, output->used - written);
+		if (ret <= 0) break;
+		written += ret;
+	}
+	output->used = 0;
+}
+
+static void output_append
+(struct lh_output * __restrict const output,
+ char const * __restrict const text,
+ size_t length)
+{
+	while (length) {
+		if (output->used == sizeof(output->buffer)) output_flush(output);
+		size_t n = sizeof(output->buffer) - output->used;
+		if (n > length) n = length;
+		memcpy(output->buffer + output->used, text, n);
+		output->used += n;
+		length       -= n;
+	}
+}
+
+/* Rebuilds one conversion, with the captured '*' arguments, and
+ * integers promoted to long long as they were stored. */
+static void format_conversion
+(struct lh_output * __restrict const output,
+ struct lh_conversion const * __restrict const conversion,
+ uint8_t const ** __restrict const cursor,
+ uint8_t const * __restrict const end)
+{
+	char spec[64];
+	char text[512];
+	size_t s = 0;
+	int value;
+
+#define POP(variable) do { \
+	if (*cursor + sizeof(variable) > end) return; \
+	memcpy(&(variable), *cursor, sizeof(variable)); \
+	*cursor += sizeof(variable); \
+} while (0)
+
+	spec[s++] = '%';
+	memcpy(spec + s, conversion->flags, conversion->n_flags);
+	s += conversion->n_flags;
+
+	if (conversion->width_argument) {
+		POP(value);
+		s += snprintf(spec + s, sizeof(spec) - s, "%d", value);
+	}
+	else {
+		memcpy(spec + s, conversion->width, conversion->n_width);
+		s += conversion->n_width;
+	}
+
+	if (conversion->has_precision) {
+		spec[s++] = '.';
+		if (conversion->precision_argument) {
+			POP(value);
+			s += snprintf(spec + s, sizeof(spec) - s, "%d", value);
+		}
+		else {
+			memcpy(spec + s, conversion->precision, conversion->n_precision);
+			s += conversion->n_precision;
+		}
+	}
+
+	int length = 0;
+	switch (conversion->conversion) {
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': {
+		long long integer;
+		POP(integer);
+		spec[s++] = 'l'; spec[s++] = 'l';
+		spec[s++] = conversion->conversion; spec[s] = '\0';
+		length = snprintf(text, sizeof(text), spec, integer);
+		break;
+	}
+	case 'c': {
+		int character;
+		POP(character);
+		spec[s++] = 'c'; spec[s] = '\0';
+		length = snprintf(text, sizeof(text), spec, character);
+		break;
+	}
+	case 'p': {
+		void * pointer;
+		POP(pointer);
+		spec[s++] = 'p'; spec[s] = '\0';
+		length = snprintf(text, sizeof(text), spec, pointer);
+		break;
+	}
+	case 'f': case 'F': case 'e': case 'E':
+	case 'g': case 'G': case 'a': case 'A':
+		if (conversion->length == LH_LENGTH_LONG_DOUBLE) {
+			long double real;
+			POP(real);
+			spec[s++] = 'L';
+			spec[s++] = conversion->conversion; spec[s] = '\0';
+			length = snprintf(text, sizeof(text), spec, real);
+		}
+		else {
+			double real;
+			POP(real);
+			spec[s++] = conversion->conversion; spec[s] = '\0';
+			length = snprintf(text, sizeof(text), spec, real);
+		}
+		break;
+	case 's': {
+		/* Records truncated before this string stop here */
+		if (*cursor >= end) return;
+		char const * const string = (char const *) *cursor;
+		size_t const available = end - *cursor;
+		size_t const string_length = strnlen(string, available);
+		/* Stored strings are terminated, unless the record is corrupted */
+		if (string_length == available) {
+			*cursor = end;
+			return;
+		}
+		*cursor += string_length + 1;
+		/* Plain %s is the common case. Avoid truncating long strings. */
+		if (s == 1) {
+			output_append(output, string, string_length);
+			return;
+		}
+		spec[s++] = 's'; spec[s] = '\0';
+		length = snprintf(text, sizeof(text), spec, string);
+		break;
+	}
+	case '%':
+		output_append(output, "%", 1);
+		return;
+	case 'n':
+		return;
+	default:
+		*cursor = end;
+		return;
+	}
+#undef POP
+
+	if (length > 0) {
+		if ((size_t) length >= sizeof(text)) length = sizeof(text) - 1;
+		output_append(output, text, length);
+	}
+}
+
+static void format_record
+(struct lh_output * __restrict const output,
+ struct lh_record const * __restrict const header,
+ uint8_t const * __restrict const record)
+{
+	uint8_t const * cursor = record + sizeof(struct lh_record);
+	uint8_t const * const end = record + header->size;
+	char const * format = header->format;
+	char const * percent;
+
+	while ((percent = strchr(format, '%')) != NULL) {
+		output_append(output, format, percent - format);
+		struct lh_conversion conversion;
+		format = parse_conversion(percent + 1, &conversion);
+		format_conversion(output, &conversion, &cursor, end);
+	}
+	output_append(output, format, strlen(format));
+}
+
+/* Returns the next record of the ring, or NULL if it is empty */
+static struct lh_record const * ring_peek
+(struct lh_ring * __restrict const ring)
+{
+	uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint64_t const head =
+		atomic_load_explicit(&ring->head, memory_order_acquire);
+
+	while (tail != head) {
+		size_t const offset = tail & (LH_RING_SIZE - 1);
+		size_t const until_end = LH_RING_SIZE - offset;
+		struct lh_record const * const record =
+			(struct lh_record const *) (ring->data + offset);
+
+		if (until_end >= sizeof(struct lh_record) && record->format != NULL)
+			return record;
+
+		tail += until_end;
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+	}
+	return NULL;
+}
+
+static struct lh_output output;
+
+/* Writes every pending record, oldest first. */
+static void drain()
+{
+	pthread_mutex_lock(&logger.draining);
+
+	while (1) {
+		struct lh_ring * oldest_ring = NULL;
+		struct lh_record const * oldest = NULL;
+
+		for (struct lh_ring * ring =
+		       atomic_load_explicit(&logger.rings, memory_order_acquire);
+		     ring != NULL; ring = ring->next)
+		{
+			unsigned int const dropped = atomic_load_explicit(
+			  &ring->dropped, memory_order_relaxed);
+			if (dropped != ring->dropped_reported) {
+				char text[64];
+				int const length = snprintf(text, sizeof(text),
+				  "[Log] %u records dropped\n", dropped - ring->dropped_reported);
+				output_append(&output, text, length);
+				ring->dropped_reported = dropped;
+			}
+
+			struct lh_record const * const record = ring_peek(ring);
+			if (record && (!oldest || record->timestamp < oldest->timestamp)) {
+				oldest = record;
+				oldest_ring = ring;
+			}
+		}
+
+		if (oldest == NULL) break;
+
+		format_record(&output, oldest, (uint8_t const *) oldest);
+		atomic_fetch_add_explicit(
+		  &oldest_ring->tail, oldest->size, memory_order_release);
+	}
+
+	output_flush(&output);
+	pthread_mutex_unlock(&logger.draining);
+}
+
+static void * writer_thread(void * unused)
+{
+	struct timespec const period = { .tv_nsec = LH_FLUSH_PERIOD_NS };
+	while (1) {
+		drain();
+		nanosleep(&period, NULL);
+	}
+	return NULL;
+}
+
+void lh_LogFlush()
+{
+	if (atomic_load_explicit(&logger.rings, memory_order_acquire) != NULL)
+		drain();
+}
@@ -24,24 +24,114 @@
 #ifndef MYY_LOG_H
 #define MYY_LOG_H 1
 
-#if defined(DEBUG)
-#if defined(__ANDROID__)
-
-#include <android/log.h>
-#define LOG(...) ((void)__android_log_print(ANDROID_LOG_WARN, "native-insanity", __VA_ARGS__))
-#define LOG_ERRNO(...) ((void)__android_log_print(ANDROID_LOG_ERROR, "native-insanity", "Error : %s\n", strerror(errno))); ((void)__android_log_print(ANDROID_LOG_ERROR, "native-insanity", __VA_ARGS__)
+/* Log levels.
+ *
+ * MYY_LOG_LEVEL selects, at compile time, the most verbose level kept
+ * in the binary. Everything above it is compiled out.
+ * Defaults to MYY_LOG_LEVEL_DEBUG with DEBUG, MYY_LOG_LEVEL_NONE
+ * otherwise.
+ * lh_LogSetLevel then filters the remaining levels at runtime. */
+#define MYY_LOG_LEVEL_NONE  0
+#define MYY_LOG_LEVEL_ERROR 1
+#define MYY_LOG_LEVEL_WARN  2
+#define MYY_LOG_LEVEL_INFO  3
+#define MYY_LOG_LEVEL_DEBUG 4
 
+#if !defined(MYY_LOG_LEVEL)
+#if defined(DEBUG)
+#define MYY_LOG_LEVEL MYY_LOG_LEVEL_DEBUG
 #else
+#define MYY_LOG_LEVEL MYY_LOG_LEVEL_NONE
+#endif
+#endif
+
+#if !defined(__ANDROID__)
 
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
-#define LOG(...) fprintf(stderr, __VA_ARGS__)
-#define LOG_ERRNO(...)  fprintf(stderr, "Error : %s\n", strerror(errno)); fprintf(stderr, __VA_ARGS__)
+#include <stdatomic.h>
+
+/* Asynchronous logging.
+ *
+ * LOG calls only copy the format pointer, the arguments and a
+ * timestamp into a lock-free ring owned by the calling thread.
+ * Strings passed as %s are copied, so they can be freed right after
+ * the call.
+ * A background thread formats the records, ordered by timestamp,
+ * and writes them to stderr.
+ *
+ * When a ring is full, records are dropped and the number of lost
+ * records is reported once the ring is drained.
+ * Formats must be string literals, or at least outlive the program. */
+
+extern atomic_uint lh_log_level;
+
+/* Only the printf conversions are supported, without positional
+ * arguments ("%1$d"). */
+void lh_Log(unsigned int const level, char const * __restrict const format,
+            ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Logs "Error : strerror(error)" and then the message */
+void lh_LogErrno(int const error, char const * __restrict const format, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Only log messages at `level` and below */
+void lh_LogSetLevel(unsigned int const level);
+
+/* Returns the level named `name` (none, error, warn, info or debug),
+ * or -1 if there is no such level */
+int lh_LogLevelFromName(char const * __restrict const name);
+
+/* Set the runtime level from the MYY_LOG_LEVEL environment variable :
+ * none, error, warn, info or debug */
+void lh_LogSetLevelFromEnvironment();
+
+/* Write all the pending records now */
+void lh_LogFlush();
+
+#endif
+
+#if MYY_LOG_LEVEL == MYY_LOG_LEVEL_NONE
+
+#define MYY_LOG_AT(level, ...) do {} while (0)
+#define LOG_ERRNO(...) do {} while (0)
+
+#elif defined(__ANDROID__)
+
+#include <android/log.h>
+#include <string.h>
+#include <errno.h>
+
+#define MYY_LOG_AT(level, ...) do { \
+	if ((level) <= MYY_LOG_LEVEL) \
+		((void)__android_log_print( \
+		  ANDROID_LOG_FATAL - (level), "native-insanity", __VA_ARGS__)); \
+} while (0)
+#define LOG_ERRNO(...) do { \
+	((void)__android_log_print(ANDROID_LOG_ERROR, "native-insanity", "Error : %s\n", strerror(errno))); \
+	((void)__android_log_print(ANDROID_LOG_ERROR, "native-insanity", __VA_ARGS__)); \
+} while (0)
+
+#else
+
+#define MYY_LOG_AT(level, ...) do { \
+	if ((level) <= MYY_LOG_LEVEL && \
+	    (level) <= atomic_load_explicit(&lh_log_level, memory_order_relaxed)) \
+		lh_Log(level, __VA_ARGS__); \
+} while (0)
+#define LOG_ERRNO(...) do { \
+	if (MYY_LOG_LEVEL_ERROR <= \
+	    atomic_load_explicit(&lh_log_level, memory_order_relaxed)) \
+		lh_LogErrno(errno, __VA_ARGS__); \
+} while (0)
 
 #endif
-#else // DEBUG
-#define LOG(...)
-#define LOG_ERRNO(...)
-#endif // DEBUG
+
+#define LOG_ERROR(...) MYY_LOG_AT(MYY_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  MYY_LOG_AT(MYY_LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG(...)       MYY_LOG_AT(MYY_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) MYY_LOG_AT(MYY_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
 #endif
@@ -0,0 +1,675 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/pointer.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PH_HAVE_AVX2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* Reports closer than this are considered to come from an 8 kHz
+   device. Avoids divisions by 0 with coalesced timestamps. */
+#define MIN_INTERVAL_US 125
+/* After a longer pause, the pointer is considered stopped */
+#define MAX_INTERVAL_US 100000
+/* Alpha-beta filter gains : how much of the position and velocity
+   errors are corrected by each sample */
+#define PREDICT_ALPHA 0.5f
+#define PREDICT_BETA  0.1f
+/* Time constant of the velocity smoothing. Smoothing with a fixed
+   weight per report would behave differently at each polling rate. */
+#define VELOCITY_SMOOTHING_US 4000
+
+void ph_AccelDefaultConfig(struct ph_accel_config * __restrict const config)
+{
+	memset(config, 0, sizeof(*config));
+	config->profile      = PH_ACCEL_ADAPTIVE;
+	config->speed        = 1.0f;
+	config->threshold    = 4.0f;
+	config->acceleration = 0.25f;
+	config->max_gain     = 3.0f;
+}
+
+/* Parse the float at *cursor, followed by `separator` or the end of
+   the string. Returns 1 on success, with *cursor after the separator. */
+static unsigned int parse_float
+(char const * __restrict * __restrict const cursor,
+ char const separator,
+ float * __restrict const value)
+{
+	char * end;
+	float const parsed = strtof(*cursor, &end);
+
+	if (end == *cursor || (*end != separator && *end != '\0')) return 0;
+	*value = parsed;
+	*cursor = (*end == '\0') ? end : end + 1;
+	return 1;
+}
+
+unsigned int ph_AccelParseConfig
+(char const * __restrict const description,
+ struct ph_accel_config * __restrict const config)
+{
+	struct ph_accel_config parsed;
+	char const * cursor;
+
+	ph_AccelDefaultConfig(&parsed);
+
+	if (strncmp(description, "flat", 4) == 0) {
+		cursor = description + 4;
+		parsed.profile = PH_ACCEL_FLAT;
+		if (*cursor == ':') {
+			cursor++;
+			if (!parse_float(&cursor, '\0', &parsed.speed)) return 0;
+		}
+		if (*cursor != '\0') return 0;
+	}
+	else if (strncmp(description, "adaptive", 8) == 0) {
+		float * __restrict const values[] = {
+			&parsed.speed, &parsed.threshold,
+			&parsed.acceleration, &parsed.max_gain
+		};
+		cursor = description + 8;
+		if (*cursor == ':') cursor++;
+		else if (*cursor != '\0') return 0;
+		for (unsigned int v = 0; v < 4 && *cursor != '\0'; v++)
+			if (!parse_float(&cursor, ':', values[v])) return 0;
+		if (*cursor != '\0') return 0;
+	}
+	else if (strncmp(description, "custom:", 7) == 0) {
+		cursor = description + 7;
+		parsed.profile = PH_ACCEL_CUSTOM;
+		while (*cursor != '\0') {
+			if (parsed.n_points == PH_ACCEL_MAX_POINTS) return 0;
+			struct ph_accel_point * __restrict const point =
+				parsed.points + parsed.n_points;
+			if (!parse_float(&cursor, '=', &point->velocity) ||
+			    !parse_float(&cursor, ',', &point->gain))
+				return 0;
+			if (parsed.n_points &&
+			    point->velocity <= point[-1].velocity)
+				return 0;
+			parsed.n_points++;
+		}
+		if (parsed.n_points == 0) return 0;
+	}
+	else return 0;
+
+	*config = parsed;
+	return 1;
+}
+
+static float custom_gain
+(struct ph_accel_config const * __restrict const config,
+ float const velocity)
+{
+	struct ph_accel_point const * __restrict const points = config->points;
+	unsigned int const n = config->n_points;
+
+	if (n == 0) return 1.0f;
+	if (velocity <= points[0].velocity) return points[0].gain;
+
+	for (unsigned int p = 1; p < n; p++) {
+		if (velocity <= points[p].velocity) {
+			float const t =
+				(velocity - points[p-1].velocity) /
+				(points[p].velocity - points[p-1].velocity);
+			return points[p-1].gain + t * (points[p].gain - points[p-1].gain);
+		}
+	}
+	return points[n-1].gain;
+}
+
+static float config_gain
+(struct ph_accel_config const * __restrict const config,
+ float const velocity)
+{
+	switch (config->profile) {
+	case PH_ACCEL_FLAT:
+		return config->speed;
+	case PH_ACCEL_ADAPTIVE: {
+		if (velocity <= config->threshold) return config->speed;
+		float const gain = config->speed +
+			(velocity - config->threshold) * config->acceleration;
+		return gain < config->max_gain ? gain : config->max_gain;
+	}
+	case PH_ACCEL_CUSTOM:
+		return custom_gain(config, velocity);
+	}
+	return 1.0f;
+}
+
+void ph_PointerInit
+(struct ph_pointer * __restrict const pointer,
+ struct ph_accel_config const * __restrict const config)
+{
+	for (unsigned int i = 0; i < PH_ACCEL_LUT_SIZE; i++) {
+		float const gain =
+			config_gain(config, (float) i / PH_ACCEL_STEPS_PER_UNIT);
+		pointer->gain[i] = (gain > 0) ? (uint32_t) (gain * 65536.0f + 0.5f) : 0;
+	}
+	pointer->velocity    = 0;
+	pointer->last_us     = 0;
+	pointer->remainder_x = 0;
+	pointer->remainder_y = 0;
+}
+
+static inline uint32_t absolute(int32_t const value)
+{
+	return (value < 0) ? -(uint32_t) value : (uint32_t) value;
+}
+
+void ph_PointerMove
+(struct ph_pointer * __restrict const pointer,
+ int32_t const dx, int32_t const dy,
+ uint64_t const time_us,
+ int32_t * __restrict const px, int32_t * __restrict const py)
+{
+	/* Replayed or coalesced reports can share, or go back in, time */
+	uint64_t interval = time_us - pointer->last_us;
+	if (time_us < pointer->last_us || interval < MIN_INTERVAL_US)
+		interval = MIN_INTERVAL_US;
+	pointer->last_us = time_us;
+
+	/* max + min/2 approximates the motion length within 12%, without
+	   a square root */
+	uint32_t const ax = absolute(dx), ay = absolute(dy);
+	uint64_t const distance =
+		(ax > ay) ? ax + (ay >> 1) : ay + (ax >> 1);
+	uint64_t const velocity = (distance << 8) * 1000 / interval;
+
+	if (interval >= MAX_INTERVAL_US)
+		pointer->velocity = velocity;
+	else {
+		/* Exponential smoothing, weighted by the time elapsed */
+		int64_t const weight =
+			(interval << 8) / (interval + VELOCITY_SMOOTHING_US);
+		int64_t const current = pointer->velocity;
+		pointer->velocity =
+			current + ((((int64_t) velocity - current) * weight) >> 8);
+	}
+
+	uint64_t step = ((uint64_t) pointer->velocity
+	                 * PH_ACCEL_STEPS_PER_UNIT) >> 8;
+	if (step >= PH_ACCEL_LUT_SIZE) step = PH_ACCEL_LUT_SIZE - 1;
+	int64_t const gain = pointer->gain[step];
+
+	/* Whole pixels move now, fractions wait for the next reports.
+	   Truncating moves the same way in both directions. */
+	int64_t const x = pointer->remainder_x + dx * gain;
+	int64_t const y = pointer->remainder_y + dy * gain;
+	*px = (int32_t) (x / 65536);
+	*py = (int32_t) (y / 65536);
+	pointer->remainder_x = x - (int64_t) *px * 65536;
+	pointer->remainder_y = y - (int64_t) *py * 65536;
+}
+
+static char const * const predict_modes_names[PH_PREDICT_MODES] = {
+	[PH_PREDICT_OFF]    = "off",
+	[PH_PREDICT_LINEAR] = "linear",
+	[PH_PREDICT_KALMAN] = "kalman"
+};
+
+unsigned int ph_PredictParseMode
+(char const * __restrict const name,
+ enum ph_predict_mode * __restrict const mode)
+{
+	for (unsigned int m = 0; m < PH_PREDICT_MODES; m++) {
+		if (strcmp(name, predict_modes_names[m]) == 0) {
+			*mode = m;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+char const * ph_PredictModeName(enum ph_predict_mode const mode)
+{
+	return (mode < PH_PREDICT_MODES) ? predict_modes_names[mode] : "unknown";
+}
+
+void ph_PredictorInit
+(struct ph_predictor * __restrict const predictor,
+ enum ph_predict_mode const mode)
+{
+	memset(predictor, 0, sizeof(*predictor));
+	predictor->mode = mode;
+}
+
+static void kalman_update
+(struct ph_predictor * __restrict const predictor,
+ float const x, float const y,
+ uint64_t const interval_us)
+{
+	if (predictor->count == 0 || interval_us >= PH_PREDICT_STOPPED_US) {
+		predictor->filtered_x = x;
+		predictor->filtered_y = y;
+		predictor->velocity_x = predictor->velocity_y = 0;
+		return;
+	}
+
+	float const dt = (interval_us < MIN_INTERVAL_US)
+		? MIN_INTERVAL_US
+		: (float) interval_us;
+	float const predicted_x = predictor->filtered_x + predictor->velocity_x * dt;
+	float const predicted_y = predictor->filtered_y + predictor->velocity_y * dt;
+	float const error_x = x - predicted_x;
+	float const error_y = y - predicted_y;
+
+	predictor->filtered_x = predicted_x + PREDICT_ALPHA * error_x;
+	predictor->filtered_y = predicted_y + PREDICT_ALPHA * error_y;
+	predictor->velocity_x += PREDICT_BETA * error_x / dt;
+	predictor->velocity_y += PREDICT_BETA * error_y / dt;
+}
+
+void ph_PredictorAddSample
+(struct ph_predictor * __restrict const predictor,
+ int32_t const x, int32_t const y,
+ uint64_t const time_us)
+{
+	uint64_t const interval_us = (predictor->count)
+		? time_us - predictor->time_us[predictor->last]
+		: 0;
+
+	if (predictor->mode == PH_PREDICT_KALMAN)
+		kalman_update(predictor, x, y, interval_us);
+
+	unsigned int const next = (predictor->last + 1) % PH_PREDICT_HISTORY;
+	predictor->x[next] = x;
+	predictor->y[next] = y;
+	predictor->time_us[next] = time_us;
+	predictor->last = next;
+	if (predictor->count < PH_PREDICT_HISTORY) predictor->count++;
+}
+
+/* Least squares slope of the positions over the last
+   PH_PREDICT_WINDOW_US, in pixels per microsecond */
+static void linear_velocity
+(struct ph_predictor const * __restrict const predictor,
+ float * __restrict const velocity_x,
+ float * __restrict const velocity_y)
+{
+	unsigned int const last = predictor->last;
+	uint64_t const last_us = predictor->time_us[last];
+	float t[PH_PREDICT_HISTORY], mean_t = 0, mean_x = 0, mean_y = 0;
+	unsigned int n = 0;
+
+	for (; n < predictor->count; n++) {
+		unsigned int const s =
+			(last + PH_PREDICT_HISTORY - n) % PH_PREDICT_HISTORY;
+		uint64_t const age_us = last_us - predictor->time_us[s];
+		if (age_us > PH_PREDICT_WINDOW_US) break;
+		t[n] = -(float) age_us;
+		mean_t += t[n];
+		mean_x += predictor->x[s];
+		mean_y += predictor->y[s];
+	}
+
+	*velocity_x = *velocity_y = 0;
+	if (n < 2) return;
+	mean_t /= n; mean_x /= n; mean_y /= n;
+
+	float covariance_x = 0, covariance_y = 0, variance = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		unsigned int const s =
+			(last + PH_PREDICT_HISTORY - i) % PH_PREDICT_HISTORY;
+		float const dt = t[i] - mean_t;
+		covariance_x += dt * (predictor->x[s] - mean_x);
+		covariance_y += dt * (predictor->y[s] - mean_y);
+		variance += dt * dt;
+	}
+	if (variance > 0) {
+		*velocity_x = covariance_x / variance;
+		*velocity_y = covariance_y / variance;
+	}
+}
+
+/* The extrapolated offset, on one axis. 0 when the last motion went
+   the other way : overshooting a direction change is worse than
+   lagging behind. */
+static float clamped_offset
+(float const velocity,
+ float const last_motion,
+ float const horizon_us)
+{
+	if (velocity * last_motion <= 0) return 0;
+
+	float const offset = velocity * horizon_us;
+	if (offset >  PH_PREDICT_MAX_OFFSET) return  PH_PREDICT_MAX_OFFSET;
+	if (offset < -PH_PREDICT_MAX_OFFSET) return -PH_PREDICT_MAX_OFFSET;
+	return offset;
+}
+
+unsigned int ph_PredictorPredict
+(struct ph_predictor const * __restrict const predictor,
+ uint64_t const now_us,
+ uint64_t const target_us,
+ float * __restrict const x, float * __restrict const y)
+{
+	if (predictor->count == 0) return 0;
+
+	unsigned int const last = predictor->last;
+	uint64_t const last_us = predictor->time_us[last];
+	*x = predictor->x[last];
+	*y = predictor->y[last];
+
+	if (predictor->mode == PH_PREDICT_OFF || predictor->count < 2 ||
+	    target_us <= last_us)
+		return 1;
+
+	/* The pointer stopped when no report came for twice the last
+	   interval, with some slack for the reports jitter */
+	unsigned int const previous =
+		(last + PH_PREDICT_HISTORY - 1) % PH_PREDICT_HISTORY;
+	uint64_t stopped_us = 2 * (last_us - predictor->time_us[previous]) + 2000;
+	if (stopped_us > PH_PREDICT_STOPPED_US) stopped_us = PH_PREDICT_STOPPED_US;
+	if (now_us > last_us && now_us - last_us > stopped_us) return 1;
+
+	uint64_t horizon_us = target_us - last_us;
+	if (horizon_us > PH_PREDICT_MAX_HORIZON_US)
+		horizon_us = PH_PREDICT_MAX_HORIZON_US;
+
+	float velocity_x, velocity_y;
+	if (predictor->mode == PH_PREDICT_KALMAN) {
+		velocity_x = predictor->velocity_x;
+		velocity_y = predictor->velocity_y;
+	}
+	else linear_velocity(predictor, &velocity_x, &velocity_y);
+
+	*x += clamped_offset(
+	  velocity_x, predictor->x[last] - predictor->x[previous], horizon_us);
+	*y += clamped_offset(
+	  velocity_y, predictor->y[last] - predictor->y[previous], horizon_us);
+	return 1;
+}
+
+/* ---- Pointers store ---- */
+
+static inline int32_t clamp_bounds
+(int32_t const value, int32_t const min, int32_t const max)
+{
+	int32_t const low = (value > min) ? value : min;
+	return (low < max) ? low : max;
+}
+
+/* Unsigned additions : the motions wrap around instead of being
+ * undefined behaviour, as the SIMD additions do */
+static inline int32_t add_wrapping(int32_t const a, int32_t const b)
+{
+	return (int32_t) ((uint32_t) a + (uint32_t) b);
+}
+
+static void scalar_apply
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const n_lanes)
+{
+	for (unsigned int p = 0; p < n_lanes; p++) {
+		pointers->x[p] = clamp_bounds(
+		  add_wrapping(pointers->x[p], pointers->dx[p]),
+		  pointers->min_x[p], pointers->max_x[p]);
+		pointers->y[p] = clamp_bounds(
+		  add_wrapping(pointers->y[p], pointers->dy[p]),
+		  pointers->min_y[p], pointers->max_y[p]);
+		pointers->dx[p] = pointers->dy[p] = 0;
+	}
+}
+
+/* ---- SSE2 ----
+ * SSE2 has no 32 bits min and max : the comparisons masks select the
+ * bounds instead. */
+
+#if defined(__SSE2__)
+
+static inline __m128i sse2_clamp
+(__m128i const value, __m128i const min, __m128i const max)
+{
+	__m128i const below = _mm_cmplt_epi32(value, min);
+	__m128i const low =
+		_mm_or_si128(_mm_and_si128(below, min), _mm_andnot_si128(below, value));
+	__m128i const above = _mm_cmpgt_epi32(low, max);
+	return
+		_mm_or_si128(_mm_and_si128(above, max), _mm_andnot_si128(above, low));
+}
+
+static void sse2_apply
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const n_lanes)
+{
+	__m128i const zero = _mm_setzero_si128();
+	for (unsigned int p = 0; p < n_lanes; p += 4) {
+		__m128i * __restrict const x  = (__m128i *) (pointers->x + p);
+		__m128i * __restrict const y  = (__m128i *) (pointers->y + p);
+		__m128i * __restrict const dx = (__m128i *) (pointers->dx + p);
+		__m128i * __restrict const dy = (__m128i *) (pointers->dy + p);
+
+		_mm_store_si128(x, sse2_clamp(
+		  _mm_add_epi32(_mm_load_si128(x), _mm_load_si128(dx)),
+		  _mm_load_si128((__m128i const *) (pointers->min_x + p)),
+		  _mm_load_si128((__m128i const *) (pointers->max_x + p))));
+		_mm_store_si128(y, sse2_clamp(
+		  _mm_add_epi32(_mm_load_si128(y), _mm_load_si128(dy)),
+		  _mm_load_si128((__m128i const *) (pointers->min_y + p)),
+		  _mm_load_si128((__m128i const *) (pointers->max_y + p))));
+		_mm_store_si128(dx, zero);
+		_mm_store_si128(dy, zero);
+	}
+}
+
+#endif
+
+/* ---- AVX2 ----
+ * Selected at runtime, with __builtin_cpu_supports. */
+
+#if defined(PH_HAVE_AVX2)
+
+#define PH_AVX2 __attribute__((target("avx2")))
+
+PH_AVX2 static void avx2_apply
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const n_lanes)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	for (unsigned int p = 0; p < n_lanes; p += 8) {
+		__m256i * __restrict const x  = (__m256i *) (pointers->x + p);
+		__m256i * __restrict const y  = (__m256i *) (pointers->y + p);
+		__m256i * __restrict const dx = (__m256i *) (pointers->dx + p);
+		__m256i * __restrict const dy = (__m256i *) (pointers->dy + p);
+
+		__m256i const new_x =
+			_mm256_add_epi32(_mm256_load_si256(x), _mm256_load_si256(dx));
+		__m256i const new_y =
+			_mm256_add_epi32(_mm256_load_si256(y), _mm256_load_si256(dy));
+		_mm256_store_si256(x, _mm256_min_epi32(
+		  _mm256_max_epi32(new_x,
+		    _mm256_load_si256((__m256i const *) (pointers->min_x + p))),
+		  _mm256_load_si256((__m256i const *) (pointers->max_x + p))));
+		_mm256_store_si256(y, _mm256_min_epi32(
+		  _mm256_max_epi32(new_y,
+		    _mm256_load_si256((__m256i const *) (pointers->min_y + p))),
+		  _mm256_load_si256((__m256i const *) (pointers->max_y + p))));
+		_mm256_store_si256(dx, zero);
+		_mm256_store_si256(dy, zero);
+	}
+}
+
+#endif
+
+/* ---- NEON ---- */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static void neon_apply
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const n_lanes)
+{
+	int32x4_t const zero = vdupq_n_s32(0);
+	for (unsigned int p = 0; p < n_lanes; p += 4) {
+		int32x4_t const new_x =
+			vaddq_s32(vld1q_s32(pointers->x + p), vld1q_s32(pointers->dx + p));
+		int32x4_t const new_y =
+			vaddq_s32(vld1q_s32(pointers->y + p), vld1q_s32(pointers->dy + p));
+		vst1q_s32(pointers->x + p, vminq_s32(
+		  vmaxq_s32(new_x, vld1q_s32(pointers->min_x + p)),
+		  vld1q_s32(pointers->max_x + p)));
+		vst1q_s32(pointers->y + p, vminq_s32(
+		  vmaxq_s32(new_y, vld1q_s32(pointers->min_y + p)),
+		  vld1q_s32(pointers->max_y + p)));
+		vst1q_s32(pointers->dx + p, zero);
+		vst1q_s32(pointers->dy + p, zero);
+	}
+}
+
+#endif
+
+static struct ph_pointers_kernels const pointers_kernels[] = {
+#if defined(PH_HAVE_AVX2)
+	{ .name = "avx2", .apply = avx2_apply },
+#endif
+#if defined(__SSE2__)
+	{ .name = "sse2", .apply = sse2_apply },
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	{ .name = "neon", .apply = neon_apply },
+#endif
+	{ .name = "scalar", .apply = scalar_apply }
+};
+
+struct ph_pointers_kernels const * ph_PointersKernels
+(unsigned int * __restrict const count)
+{
+	unsigned int first = 0;
+#if defined(PH_HAVE_AVX2)
+	if (!__builtin_cpu_supports("avx2")) first = 1;
+#endif
+	*count = sizeof(pointers_kernels) / sizeof(struct ph_pointers_kernels)
+		- first;
+	return pointers_kernels+first;
+}
+
+/* Pointers processed by the kernels, padding included */
+static inline unsigned int lanes(unsigned int const n_pointers)
+{
+	return (n_pointers + PH_POINTERS_LANES - 1) & ~(PH_POINTERS_LANES - 1);
+}
+
+unsigned int ph_PointersInit
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const capacity,
+ void * __restrict const memory)
+{
+	size_t const array_size = lanes(capacity) * sizeof(int32_t);
+	/* The AVX2 kernel loads aligned 32 bytes vectors */
+	uint8_t * __restrict const arrays = (memory || array_size == 0)
+		? memory
+		: aligned_alloc(32, PH_POINTERS_SIZE(capacity));
+
+	memset(pointers, 0, sizeof(*pointers));
+	if (arrays == NULL) return 0;
+	memset(arrays, 0, PH_POINTERS_SIZE(capacity));
+
+	pointers->capacity  = capacity;
+	pointers->allocated = (memory == NULL);
+	pointers->x       = (int32_t *)  (arrays + 0 * array_size);
+	pointers->y       = (int32_t *)  (arrays + 1 * array_size);
+	pointers->dx      = (int32_t *)  (arrays + 2 * array_size);
+	pointers->dy      = (int32_t *)  (arrays + 3 * array_size);
+	pointers->min_x   = (int32_t *)  (arrays + 4 * array_size);
+	pointers->min_y   = (int32_t *)  (arrays + 5 * array_size);
+	pointers->max_x   = (int32_t *)  (arrays + 6 * array_size);
+	pointers->max_y   = (int32_t *)  (arrays + 7 * array_size);
+	pointers->buttons = (uint32_t *) (arrays + 8 * array_size);
+	pointers->device  = (uint32_t *) (arrays + 9 * array_size);
+	return 1;
+}
+
+void ph_PointersFree(struct ph_pointers * __restrict const pointers)
+{
+	/* x is the start of the arrays */
+	if (pointers->allocated) free(pointers->x);
+	memset(pointers, 0, sizeof(*pointers));
+}
+
+int ph_PointersAdd
+(struct ph_pointers * __restrict const pointers,
+ uint32_t const device,
+ struct ph_pointers_bounds const * __restrict const bounds,
+ int32_t const x, int32_t const y)
+{
+	if (pointers->n == pointers->capacity) return -1;
+
+	unsigned int const p = pointers->n++;
+	pointers->dx[p] = pointers->dy[p] = 0;
+	pointers->buttons[p] = 0;
+	pointers->device[p] = device;
+	pointers->x[p] = x;
+	pointers->y[p] = y;
+	ph_PointersSetBounds(pointers, p, 1, bounds);
+	return p;
+}
+
+int ph_PointersFind
+(struct ph_pointers const * __restrict const pointers,
+ uint32_t const device)
+{
+	for (unsigned int p = 0; p < pointers->n; p++)
+		if (pointers->device[p] == device) return p;
+	return -1;
+}
+
+void ph_PointersSetBounds
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const first,
+ unsigned int const count,
+ struct ph_pointers_bounds const * __restrict const bounds)
+{
+	for (unsigned int p = first; p < first + count && p < pointers->n; p++) {
+		pointers->min_x[p] = bounds->min_x;
+		pointers->min_y[p] = bounds->min_y;
+		pointers->max_x[p] = bounds->max_x;
+		pointers->max_y[p] = bounds->max_y;
+		pointers->x[p] = clamp_bounds(pointers->x[p], bounds->min_x, bounds->max_x);
+		pointers->y[p] = clamp_bounds(pointers->y[p], bounds->min_y, bounds->max_y);
+	}
+}
+
+void ph_PointersApply(struct ph_pointers * __restrict const pointers)
+{
+	static ph_pointers_apply_fn apply = NULL;
+	if (apply == NULL) {
+		unsigned int n_kernels;
+		apply = ph_PointersKernels(&n_kernels)->apply;
+	}
+	apply(pointers, lanes(pointers->n));
+}
@@ -0,0 +1,306 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_POINTER_H
+#define MYY_SRC_HELPERS_POINTER_H 1
+
+#include <stdint.h>
+
+/* Pointer acceleration.
+ *
+ * Relative motion reports are turned into pixels by a gain depending on
+ * the pointer velocity. The gain curve of the chosen profile is
+ * compiled into a lookup table once, so each report only costs a few
+ * integer operations, whatever the polling rate.
+ * Fractions of pixels are kept in 16.16 fixed point, and added to the
+ * next reports instead of being dropped. */
+
+/* Velocities are expressed in device units per millisecond.
+ * The lookup table covers 0 to PH_ACCEL_MAX_VELOCITY, in steps of
+ * 1/PH_ACCEL_STEPS_PER_UNIT. Faster motions use the last gain. */
+#define PH_ACCEL_STEPS_PER_UNIT 2
+#define PH_ACCEL_LUT_SIZE 256
+#define PH_ACCEL_MAX_VELOCITY (PH_ACCEL_LUT_SIZE / PH_ACCEL_STEPS_PER_UNIT)
+#define PH_ACCEL_MAX_POINTS 16
+
+enum ph_accel_profile {
+	/* The same gain at every velocity */
+	PH_ACCEL_FLAT,
+	/* No acceleration for slow, precise motions, then a gain growing
+	   linearly with the velocity, up to a maximum */
+	PH_ACCEL_ADAPTIVE,
+	/* Gains interpolated between user-provided points */
+	PH_ACCEL_CUSTOM
+};
+
+struct ph_accel_point {
+	/* Device units per millisecond */
+	float velocity;
+	float gain;
+};
+
+struct ph_accel_config {
+	enum ph_accel_profile profile;
+	/* FLAT : the gain.
+	   ADAPTIVE : the gain of slow motions. */
+	float speed;
+	/* ADAPTIVE : velocity from which motions are accelerated,
+	   gain added per unit/ms above it, and maximum gain */
+	float threshold, acceleration, max_gain;
+	/* CUSTOM : points sorted by velocity. The first and last gains are
+	   used outside of the points range. */
+	unsigned int n_points;
+	struct ph_accel_point points[PH_ACCEL_MAX_POINTS];
+};
+
+struct ph_pointer {
+	/* Gain for each velocity step, in 16.16 fixed point */
+	uint32_t gain[PH_ACCEL_LUT_SIZE];
+	/* Smoothed velocity, in 1/256 units per millisecond */
+	uint32_t velocity;
+	/* Timestamp of the last report, in microseconds */
+	uint64_t last_us;
+	/* Fractions of pixels not moved yet, in 16.16 fixed point */
+	int64_t remainder_x, remainder_y;
+};
+
+/* Adaptive profile : a gain of 1 up to 4 units/ms, then growing by
+   0.25 per unit/ms, up to 3 */
+void ph_AccelDefaultConfig(struct ph_accel_config * __restrict const config);
+
+/**
+ * Parse an acceleration profile description :
+ * - "flat" or "flat:SPEED"
+ * - "adaptive" or "adaptive:SPEED:THRESHOLD:ACCELERATION:MAX_GAIN".
+ *   Omitted values keep their defaults.
+ * - "custom:VELOCITY=GAIN,VELOCITY=GAIN,..."
+ *
+ * @return 1 if the description is valid, 0 otherwise. config is only
+ *         modified when the description is valid.
+ */
+unsigned int ph_AccelParseConfig
+(char const * __restrict const description,
+ struct ph_accel_config * __restrict const config);
+
+/* Compile the config gain curve and forget the previous motions */
+void ph_PointerInit
+(struct ph_pointer * __restrict const pointer,
+ struct ph_accel_config const * __restrict const config);
+
+/**
+ * Accelerate a motion report.
+ *
+ * @param pointer The pointer state
+ * @param dx, dy  The motion, in device units
+ * @param time_us When the motion was reported, in microseconds
+ * @param px, py  Receive the motion in whole pixels. The remaining
+ *                fractions are added to the next reports.
+ */
+void ph_PointerMove
+(struct ph_pointer * __restrict const pointer,
+ int32_t const dx, int32_t const dy,
+ uint64_t const time_us,
+ int32_t * __restrict const px, int32_t * __restrict const py);
+
+/* Pointer position prediction.
+ *
+ * Frames show the cursor where it was when they were drawn, at least
+ * one frame before they are scanned out. The predictor extrapolates the
+ * recent motion to the expected scanout time instead.
+ * Extrapolation stops on the axes where the pointer just reversed its
+ * direction, is limited to PH_PREDICT_MAX_OFFSET pixels, and to
+ * PH_PREDICT_MAX_HORIZON_US ahead. A pointer that missed its next
+ * report, or did not move for PH_PREDICT_STOPPED_US, is considered
+ * stopped and is not extrapolated. */
+
+#define PH_PREDICT_HISTORY 8
+#define PH_PREDICT_WINDOW_US 32000
+#define PH_PREDICT_STOPPED_US 32000
+#define PH_PREDICT_MAX_HORIZON_US 50000
+#define PH_PREDICT_MAX_OFFSET 64.0f
+
+enum ph_predict_mode {
+	PH_PREDICT_OFF,
+	/* Least squares line through the samples of the last
+	   PH_PREDICT_WINDOW_US */
+	PH_PREDICT_LINEAR,
+	/* Alpha-beta filter : the steady state of a Kalman filter tracking
+	   a constant velocity motion */
+	PH_PREDICT_KALMAN,
+	PH_PREDICT_MODES
+};
+
+struct ph_predictor {
+	enum ph_predict_mode mode;
+	/* The last positions, in pixels, and when they were reached */
+	float x[PH_PREDICT_HISTORY], y[PH_PREDICT_HISTORY];
+	uint64_t time_us[PH_PREDICT_HISTORY];
+	/* Index of the last sample */
+	unsigned int last;
+	unsigned int count;
+	/* PH_PREDICT_KALMAN state. Velocities in pixels per microsecond. */
+	float filtered_x, filtered_y;
+	float velocity_x, velocity_y;
+};
+
+/* "off", "linear" or "kalman".
+ * Returns 1 and sets mode if the name is known, 0 otherwise. */
+unsigned int ph_PredictParseMode
+(char const * __restrict const name,
+ enum ph_predict_mode * __restrict const mode);
+
+char const * ph_PredictModeName(enum ph_predict_mode const mode);
+
+/* Forget the previous samples */
+void ph_PredictorInit
+(struct ph_predictor * __restrict const predictor,
+ enum ph_predict_mode const mode);
+
+/* Record the pointer position at time_us */
+void ph_PredictorAddSample
+(struct ph_predictor * __restrict const predictor,
+ int32_t const x, int32_t const y,
+ uint64_t const time_us);
+
+/**
+ * Predict the pointer position at target_us.
+ *
+ * @param now_us    The current time, to tell whether the pointer stopped
+ * @param target_us When the prediction will be seen
+ * @param x, y Receive the predicted position. The last position
+ *             recorded when nothing can be predicted.
+ * @return 1 if a sample was recorded, 0 otherwise (x and y are left
+ *         untouched).
+ */
+unsigned int ph_PredictorPredict
+(struct ph_predictor const * __restrict const predictor,
+ uint64_t const now_us,
+ uint64_t const target_us,
+ float * __restrict const x, float * __restrict const y);
+
+/* Pointers store.
+ *
+ * The state of every pointer on screen, one per pointing device or
+ * per remote user, kept as a structure of arrays. Moving and clamping
+ * all of them at once are then loops over contiguous int32_t arrays,
+ * run PH_POINTERS_LANES pointers at a time by the SIMD kernels.
+ * The arrays are padded to a multiple of PH_POINTERS_LANES : the
+ * padding pointers stay at 0, with 0 wide bounds. */
+
+#define PH_POINTERS_LANES 8
+/* x, y, dx, dy, min_x, min_y, max_x, max_y, buttons and device */
+#define PH_POINTERS_ARRAYS 10
+/* Size of the arrays of `capacity` pointers, in bytes */
+#define PH_POINTERS_SIZE(capacity) \
+	((((capacity) + PH_POINTERS_LANES - 1) & ~(PH_POINTERS_LANES - 1)) \
+	 * sizeof(int32_t) * PH_POINTERS_ARRAYS)
+
+/* Inclusive : the pointers reach max_x and max_y, not beyond.
+ * A width x height output is { 0, 0, width - 1, height - 1 }. */
+struct ph_pointers_bounds {
+	int32_t min_x, min_y, max_x, max_y;
+};
+
+struct ph_pointers {
+	/* Pointers added, and room for them */
+	unsigned int n, capacity;
+	/* Positions, in pixels */
+	int32_t * __restrict x, * __restrict y;
+	/* Motions added since the last ph_PointersApply */
+	int32_t * __restrict dx, * __restrict dy;
+	/* The output each pointer moves on */
+	int32_t * __restrict min_x, * __restrict min_y;
+	int32_t * __restrict max_x, * __restrict max_y;
+	/* Bit b set : button BTN_MOUSE + b held */
+	uint32_t * __restrict buttons;
+	/* Who moves the pointer. Chosen by the caller. */
+	uint32_t * __restrict device;
+	/* The arrays were allocated by ph_PointersInit */
+	unsigned int allocated;
+};
+
+/* x = clamp(x + dx), then dx = 0, on both axes, for n_lanes pointers.
+ * n_lanes is a multiple of PH_POINTERS_LANES. */
+typedef void (*ph_pointers_apply_fn)
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const n_lanes);
+
+struct ph_pointers_kernels {
+	char const * __restrict const name;
+	ph_pointers_apply_fn apply;
+};
+
+/* Returns the kernels usable on this CPU, fastest first, and stores
+ * their number in `count`. The last one is always the scalar one. */
+struct ph_pointers_kernels const * ph_PointersKernels
+(unsigned int * __restrict const count);
+
+/* Make room for `capacity` pointers, without any pointer, in `memory` :
+ * PH_POINTERS_SIZE(capacity) bytes aligned on 32 bytes, or NULL to
+ * allocate them.
+ * Returns 0 when the memory cannot be allocated. */
+unsigned int ph_PointersInit
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const capacity,
+ void * __restrict const memory);
+
+void ph_PointersFree(struct ph_pointers * __restrict const pointers);
+
+/* Add a pointer at x, y, kept inside `bounds`, with no button held.
+ * Returns its index, or -1 when the store is full. */
+int ph_PointersAdd
+(struct ph_pointers * __restrict const pointers,
+ uint32_t const device,
+ struct ph_pointers_bounds const * __restrict const bounds,
+ int32_t const x, int32_t const y);
+
+/* The index of the first pointer moved by `device`, or -1 */
+int ph_PointersFind
+(struct ph_pointers const * __restrict const pointers,
+ uint32_t const device);
+
+/* Move `count` pointers, from `first`, to another output, or the
+ * same output resized. They are moved back inside at once. */
+void ph_PointersSetBounds
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const first,
+ unsigned int const count,
+ struct ph_pointers_bounds const * __restrict const bounds);
+
+/* Add a motion to the pointer, applied by the next ph_PointersApply.
+ * The motions added between two applications must stay within
+ * +/- 2^30 pixels. */
+static inline void ph_PointersMove
+(struct ph_pointers * __restrict const pointers,
+ unsigned int const index,
+ int32_t const dx, int32_t const dy)
+{
+	pointers->dx[index] += dx;
+	pointers->dy[index] += dy;
+}
+
+/* Apply the motions added to every pointer, keeping each one inside
+ * its bounds, with the fastest kernel */
+void ph_PointersApply(struct ph_pointers * __restrict const pointers);
+
+#endif
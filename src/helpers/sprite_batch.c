@@ -0,0 +1,231 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/sprite_batch.h>
+#include <helpers/log.h>
+#include <helpers/string.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The triangle fan corners, as two triangles */
+static uint8_t const fan_triangles[6] = { 0, 1, 2, 0, 2, 3 };
+
+static char const * const methods_names[GLH_SPRITES_METHODS] = {
+	[GLH_SPRITES_AUTO]      = "auto",
+	[GLH_SPRITES_INSTANCED] = "instanced",
+	[GLH_SPRITES_EXPANDED]  = "expanded"
+};
+
+char const * glhSpriteBatchMethodName
+(enum glh_sprite_batch_method const method)
+{
+	return (method < GLH_SPRITES_METHODS) ? methods_names[method] : "unknown";
+}
+
+unsigned int glhSpriteBatchParseMethod
+(char const * __restrict const name,
+ enum glh_sprite_batch_method * __restrict const method)
+{
+	for (unsigned int m = 0; m < GLH_SPRITES_METHODS; m++) {
+		if (strcmp(name, methods_names[m]) == 0) {
+			*method = m;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* OpenGL ES 3.0 draws instances without extensions. The extensions
+   functions have the same signatures. */
+static unsigned int load_instancing
+(struct glh_sprite_batch * __restrict const batch)
+{
+	static char const * const functions[][2] = {
+		{ NULL,                        "" },
+		{ "GL_EXT_instanced_arrays",   "EXT" },
+		{ "GL_ANGLE_instanced_arrays", "ANGLE" }
+	};
+	char const * __restrict const version =
+		(char const *) glGetString(GL_VERSION);
+	char const * __restrict const extensions =
+		(char const *) glGetString(GL_EXTENSIONS);
+	unsigned int const es3 = (version != NULL &&
+	  strncmp(version, "OpenGL ES ", 10) == 0 && version[10] >= '3');
+
+	for (unsigned int f = 0; f < sizeof(functions)/sizeof(functions[0]); f++) {
+		char draw_name[48], divisor_name[48];
+		if (f == 0 ? !es3 : !sh_hasExtension(extensions, functions[f][0]))
+			continue;
+
+		strcpy(draw_name, "glDrawArraysInstanced");
+		strcat(draw_name, functions[f][1]);
+		strcpy(divisor_name, "glVertexAttribDivisor");
+		strcat(divisor_name, functions[f][1]);
+		batch->draw_arrays_instanced = (PFNGLDRAWARRAYSINSTANCEDEXTPROC)
+		  eglGetProcAddress(draw_name);
+		batch->vertex_attrib_divisor = (PFNGLVERTEXATTRIBDIVISOREXTPROC)
+		  eglGetProcAddress(divisor_name);
+		if (batch->draw_arrays_instanced && batch->vertex_attrib_divisor) {
+			LOG("[Sprites] Instancing with %s\n",
+			    f ? functions[f][0] : "OpenGL ES 3.0");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+unsigned int glhSpriteBatchInit
+(struct glh_sprite_batch * __restrict const batch,
+ GLfloat const corners[GLH_SPRITE_CORNERS][4],
+ GLuint const corner_attrib,
+ GLuint const sprite_attrib,
+ unsigned int const capacity,
+ enum glh_sprite_batch_method const method)
+{
+	memset(batch, 0, sizeof(*batch));
+	memcpy(batch->corners, corners, sizeof(batch->corners));
+	batch->corner_attrib = corner_attrib;
+	batch->sprite_attrib = sprite_attrib;
+	batch->capacity = capacity;
+
+	batch->method = GLH_SPRITES_EXPANDED;
+	if (method != GLH_SPRITES_EXPANDED) {
+		if (load_instancing(batch)) batch->method = GLH_SPRITES_INSTANCED;
+		else if (method == GLH_SPRITES_INSTANCED)
+			LOG_WARN("[Sprites] No instancing. Expanding the vertices.\n");
+	}
+
+	GLsizeiptr sprites_size = capacity * sizeof(struct glh_sprite);
+	if (batch->method == GLH_SPRITES_EXPANDED) {
+		sprites_size = capacity * 6 * sizeof(struct glh_sprite_vertex);
+		batch->vertices = malloc(sprites_size);
+		if (batch->vertices == NULL && capacity) return 0;
+	}
+	else {
+		glGenBuffers(1, &batch->corners_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, batch->corners_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(batch->corners), batch->corners,
+		             GL_STATIC_DRAW);
+	}
+
+	glGenBuffers(1, &batch->sprites_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, batch->sprites_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sprites_size, NULL, GL_STREAM_DRAW);
+	return 1;
+}
+
+/* Replace the buffer storage instead of waiting for the GPU to be done
+   with the previous sprites */
+static void stream
+(GLuint const buffer,
+ GLsizeiptr const capacity_size,
+ void const * __restrict const data,
+ GLsizeiptr const size)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, capacity_size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+static void draw_instanced
+(struct glh_sprite_batch * __restrict const batch,
+ struct glh_sprite const * __restrict const sprites,
+ unsigned int const n_sprites)
+{
+	GLuint const corner = batch->corner_attrib, sprite = batch->sprite_attrib;
+
+	glBindBuffer(GL_ARRAY_BUFFER, batch->corners_buffer);
+	glEnableVertexAttribArray(corner);
+	glVertexAttribPointer(corner, 4, GL_FLOAT, GL_FALSE, 0, (uint8_t *) 0);
+
+	stream(batch->sprites_buffer,
+	  batch->capacity * sizeof(struct glh_sprite),
+	  sprites, n_sprites * sizeof(struct glh_sprite));
+	glEnableVertexAttribArray(sprite);
+	glVertexAttribPointer(sprite, 4, GL_FLOAT, GL_FALSE, 0, (uint8_t *) 0);
+
+	batch->vertex_attrib_divisor(sprite, 1);
+	batch->draw_arrays_instanced(
+	  GL_TRIANGLE_FAN, 0, GLH_SPRITE_CORNERS, n_sprites);
+	/* Other programs may use this location for per-vertex attributes */
+	batch->vertex_attrib_divisor(sprite, 0);
+}
+
+static void draw_expanded
+(struct glh_sprite_batch * __restrict const batch,
+ struct glh_sprite const * __restrict const sprites,
+ unsigned int const n_sprites)
+{
+	struct glh_sprite_vertex * __restrict vertex = batch->vertices;
+	GLuint const corner = batch->corner_attrib, sprite = batch->sprite_attrib;
+
+	for (unsigned int s = 0; s < n_sprites; s++) {
+		for (unsigned int v = 0; v < 6; v++, vertex++) {
+			memcpy(vertex->corner, batch->corners[fan_triangles[v]],
+			       sizeof(vertex->corner));
+			vertex->sprite = sprites[s];
+		}
+	}
+
+	stream(batch->sprites_buffer,
+	  batch->capacity * 6 * sizeof(struct glh_sprite_vertex),
+	  batch->vertices, n_sprites * 6 * sizeof(struct glh_sprite_vertex));
+	glEnableVertexAttribArray(corner);
+	glVertexAttribPointer(corner, 4, GL_FLOAT, GL_FALSE,
+	  sizeof(struct glh_sprite_vertex),
+	  (uint8_t *) offsetof(struct glh_sprite_vertex, corner));
+	glEnableVertexAttribArray(sprite);
+	glVertexAttribPointer(sprite, 4, GL_FLOAT, GL_FALSE,
+	  sizeof(struct glh_sprite_vertex),
+	  (uint8_t *) offsetof(struct glh_sprite_vertex, sprite));
+
+	glDrawArrays(GL_TRIANGLES, 0, n_sprites * 6);
+}
+
+void glhSpriteBatchDraw
+(struct glh_sprite_batch * __restrict const batch,
+ struct glh_sprite const * __restrict const sprites,
+ unsigned int const n_sprites)
+{
+	unsigned int const n =
+		(n_sprites < batch->capacity) ? n_sprites : batch->capacity;
+
+	batch->draw_calls = 0;
+	if (n == 0) return;
+
+	if (batch->method == GLH_SPRITES_INSTANCED)
+		draw_instanced(batch, sprites, n);
+	else
+		draw_expanded(batch, sprites, n);
+	batch->draw_calls = 1;
+}
+
+void glhSpriteBatchFree(struct glh_sprite_batch * __restrict const batch)
+{
+	if (batch->corners_buffer) glDeleteBuffers(1, &batch->corners_buffer);
+	if (batch->sprites_buffer) glDeleteBuffers(1, &batch->sprites_buffer);
+	free(batch->vertices);
+	memset(batch, 0, sizeof(*batch));
+}
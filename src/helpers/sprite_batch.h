@@ -0,0 +1,127 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_SPRITE_BATCH
+#define MYY_SRC_HELPERS_SPRITE_BATCH 1
+
+#include <current/opengl.h>
+#include <stdint.h>
+
+/* Sprites batches.
+ *
+ * Many copies of a quad, each at its own position and showing its own
+ * image, drawn with a single draw call. The sprites are streamed to a
+ * buffer before each draw, then :
+ * - with instancing (OpenGL ES 3.0, GL_EXT_instanced_arrays or
+ *   GL_ANGLE_instanced_arrays), the quad is drawn once per sprite, the
+ *   sprite attribute advancing once per instance.
+ * - otherwise, the quad corners are copied for each sprite, into two
+ *   triangles, and all the triangles are drawn at once.
+ * Both use the same shader : a vec4 attribute receiving the quad
+ * corners, and a vec4 attribute receiving the sprite. */
+
+enum glh_sprite_batch_method {
+	/* Instancing when available, expanded vertices otherwise */
+	GLH_SPRITES_AUTO,
+	GLH_SPRITES_INSTANCED,
+	GLH_SPRITES_EXPANDED,
+	GLH_SPRITES_METHODS
+};
+
+/* The quad, as a triangle fan */
+#define GLH_SPRITE_CORNERS 4
+
+/* What the shader receives for each sprite */
+struct glh_sprite {
+	/* Position, in pixels */
+	GLfloat x, y;
+	/* The image shown, as understood by the shader. e.g. an atlas cell
+	   and the atlas. */
+	GLfloat image, atlas;
+};
+
+/* GLH_SPRITES_EXPANDED vertices */
+struct glh_sprite_vertex {
+	GLfloat corner[4];
+	struct glh_sprite sprite;
+};
+
+struct glh_sprite_batch {
+	enum glh_sprite_batch_method method;
+	GLuint corner_attrib, sprite_attrib;
+	/* GLH_SPRITES_INSTANCED only */
+	GLuint corners_buffer;
+	/* The sprites, or their vertices */
+	GLuint sprites_buffer;
+	GLfloat corners[GLH_SPRITE_CORNERS][4];
+	/* Sprites drawn at most */
+	unsigned int capacity;
+	/* GLH_SPRITES_EXPANDED : 6 per sprite */
+	struct glh_sprite_vertex * vertices;
+	PFNGLDRAWARRAYSINSTANCEDEXTPROC draw_arrays_instanced;
+	PFNGLVERTEXATTRIBDIVISOREXTPROC vertex_attrib_divisor;
+	/* Issued by the last glhSpriteBatchDraw */
+	unsigned int draw_calls;
+};
+
+/**
+ * Prepare the buffers to draw up to `capacity` sprites.
+ * Must be called with the context current.
+ *
+ * @param corners The quad corners, as a triangle fan
+ * @param corner_attrib, sprite_attrib The shader attributes locations
+ *        receiving the corners and the sprites. The sprite attribute
+ *        location should not be 0 : some implementations cannot draw
+ *        without an attribute 0 advancing per vertex.
+ * @param method GLH_SPRITES_AUTO, or a method to use when available
+ *
+ * @return 1 on success, 0 if the memory cannot be allocated.
+ *         batch->method tells the method used.
+ */
+unsigned int glhSpriteBatchInit
+(struct glh_sprite_batch * __restrict const batch,
+ GLfloat const corners[GLH_SPRITE_CORNERS][4],
+ GLuint const corner_attrib,
+ GLuint const sprite_attrib,
+ unsigned int const capacity,
+ enum glh_sprite_batch_method const method);
+
+/* Draw the first n_sprites sprites, up to the batch capacity, with the
+ * program and textures currently used, in one draw call */
+void glhSpriteBatchDraw
+(struct glh_sprite_batch * __restrict const batch,
+ struct glh_sprite const * __restrict const sprites,
+ unsigned int const n_sprites);
+
+void glhSpriteBatchFree(struct glh_sprite_batch * __restrict const batch);
+
+/* "auto", "instanced" or "expanded" */
+char const * glhSpriteBatchMethodName
+(enum glh_sprite_batch_method const method);
+
+/* Returns 1 and sets method if the name is known, 0 otherwise */
+unsigned int glhSpriteBatchParseMethod
+(char const * __restrict const name,
+ enum glh_sprite_batch_method * __restrict const method);
+
+#endif
@@ -53,4 +53,37 @@ static inline unsigned int myy_string_size(const uint8_t * const string) {
 	return c;
 }
 
+/** Check if the space separated extensions list contains name.
+ *
+ * Works for both glGetString(GL_EXTENSIONS) and
+ * eglQueryString(display, EGL_EXTENSIONS) lists.
+ *
+ * @param extensions The extensions list. Can be NULL.
+ * @param name       The extension name
+ *
+ * @return 1 if the extension is listed, 0 otherwise.
+ */
+static inline unsigned int sh_hasExtension
+(char const * __restrict const extensions,
+ char const * __restrict const name)
+{
+	if (extensions == NULL) return 0;
+
+	unsigned int const name_length = myy_string_size((uint8_t const *) name);
+	char const * __restrict list = extensions;
+
+	while (*list) {
+		unsigned int word_length = 0;
+		while (list[word_length] && list[word_length] != ' ') word_length++;
+		if (word_length == name_length) {
+			unsigned int c = 0;
+			while (c < name_length && list[c] == name[c]) c++;
+			if (c == name_length) return 1;
+		}
+		list += word_length;
+		while (*list == ' ') list++;
+	}
+	return 0;
+}
+
 #endif
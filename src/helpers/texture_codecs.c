@@ -0,0 +1,381 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/texture_codecs.h>
+
+/* Decoders for the ETC family, used when the GPU cannot sample these
+ * formats directly.
+ * The references are the "ETC2 Compression" and "EAC" sections of the
+ * Khronos Data Format Specification. Blocks are 4x4 pixels, stored as
+ * big-endian 64 bits words. Inside a block, pixels are indexed column
+ * by column (index = x*4 + y). */
+
+static uint32_t const astc_block_sizes[][2] = {
+	{ 4, 4}, { 5, 4}, { 5, 5}, { 6, 5},
+	{ 6, 6}, { 8, 5}, { 8, 6}, { 8, 8},
+	{10, 5}, {10, 6}, {10, 8}, {10,10},
+	{12,10}, {12,12}
+};
+
+uint32_t tc_CompressedSize
+(uint32_t const format, uint32_t const width, uint32_t const height)
+{
+	uint32_t const blocks_4x4 = ((width+3)/4) * ((height+3)/4);
+
+	switch(format) {
+		case TC_ETC1_RGB8:
+		case TC_ETC2_RGB8:
+			return blocks_4x4 * 8;
+		case TC_ETC2_RGBA8_EAC:
+			return blocks_4x4 * 16;
+	}
+
+	if (format >= TC_ASTC_RGBA_4x4 && format <= TC_ASTC_RGBA_12x12) {
+		uint32_t const * const block =
+		  astc_block_sizes[format - TC_ASTC_RGBA_4x4];
+		return ((width + block[0] - 1) / block[0]) *
+		       ((height + block[1] - 1) / block[1]) * 16;
+	}
+
+	return 0;
+}
+
+unsigned int tc_CanDecompress(uint32_t const format)
+{
+	return format == TC_ETC1_RGB8 ||
+	       format == TC_ETC2_RGB8 ||
+	       format == TC_ETC2_RGBA8_EAC;
+}
+
+static inline uint64_t read_block(uint8_t const * __restrict const b)
+{
+	return ((uint64_t) b[0] << 56) | ((uint64_t) b[1] << 48) |
+	       ((uint64_t) b[2] << 40) | ((uint64_t) b[3] << 32) |
+	       ((uint64_t) b[4] << 24) | ((uint64_t) b[5] << 16) |
+	       ((uint64_t) b[6] <<  8) |  (uint64_t) b[7];
+}
+
+static inline uint32_t bits
+(uint64_t const block, unsigned int const high, unsigned int const n)
+{
+	return (block >> (high + 1 - n)) & ((1u << n) - 1);
+}
+
+static inline int32_t clamp_255(int32_t const value)
+{
+	return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static inline uint32_t extend_4(uint32_t const c) { return (c << 4) | c; }
+static inline uint32_t extend_5(uint32_t const c) { return (c << 3) | (c >> 2); }
+static inline uint32_t extend_6(uint32_t const c) { return (c << 2) | (c >> 4); }
+static inline uint32_t extend_7(uint32_t const c) { return (c << 1) | (c >> 6); }
+
+static int32_t const etc_modifiers[8][4] = {
+	{ 2,   8,  -2,   -8},
+	{ 5,  17,  -5,  -17},
+	{ 9,  29,  -9,  -29},
+	{13,  42, -13,  -42},
+	{18,  60, -18,  -60},
+	{24,  80, -24,  -80},
+	{33, 106, -33, -106},
+	{47, 183, -47, -183}
+};
+
+static int32_t const etc2_distances[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+/* 2 bits index of the pixel (x, y). The MSB and LSB are stored in
+   separate 16 bits planes. */
+static inline uint32_t pixel_index
+(uint64_t const block, unsigned int const x, unsigned int const y)
+{
+	unsigned int const i = x*4 + y;
+	return (((block >> (16 + i)) & 1) << 1) | ((block >> i) & 1);
+}
+
+/* out is a 4x4 RGBA8888 block, 16 bytes per row */
+static void write_pixel
+(uint8_t * __restrict const out,
+ unsigned int const x, unsigned int const y,
+ int32_t const r, int32_t const g, int32_t const b)
+{
+	uint8_t * __restrict const pixel = out + y*16 + x*4;
+	pixel[0] = clamp_255(r);
+	pixel[1] = clamp_255(g);
+	pixel[2] = clamp_255(b);
+	pixel[3] = 255;
+}
+
+/* Individual and differential modes, shared by ETC1 and ETC2 */
+static void decode_etc1_modes
+(uint64_t const block, unsigned int const differential,
+ uint8_t * __restrict const out)
+{
+	int32_t base[2][3];
+	unsigned int const flip = block >> 32 & 1;
+	unsigned int const tables[2] = { bits(block, 39, 3), bits(block, 36, 3) };
+
+	if (differential) {
+		for (unsigned int c = 0; c < 3; c++) {
+			int32_t const c1 = bits(block, 63 - c*8, 5);
+			int32_t const delta =
+			  ((int32_t) (bits(block, 58 - c*8, 3) << 29)) >> 29;
+			base[0][c] = extend_5(c1);
+			base[1][c] = extend_5((c1 + delta) & 31);
+		}
+	}
+	else {
+		for (unsigned int c = 0; c < 3; c++) {
+			base[0][c] = extend_4(bits(block, 63 - c*8, 4));
+			base[1][c] = extend_4(bits(block, 59 - c*8, 4));
+		}
+	}
+
+	for (unsigned int x = 0; x < 4; x++) {
+		for (unsigned int y = 0; y < 4; y++) {
+			unsigned int const sub = flip ? (y >= 2) : (x >= 2);
+			int32_t const modifier =
+			  etc_modifiers[tables[sub]][pixel_index(block, x, y)];
+			write_pixel(
+			  out, x, y,
+			  base[sub][0] + modifier,
+			  base[sub][1] + modifier,
+			  base[sub][2] + modifier
+			);
+		}
+	}
+}
+
+static void decode_paint_colors
+(uint64_t const block, int32_t const paint[4][3],
+ uint8_t * __restrict const out)
+{
+	for (unsigned int x = 0; x < 4; x++) {
+		for (unsigned int y = 0; y < 4; y++) {
+			int32_t const * const color = paint[pixel_index(block, x, y)];
+			write_pixel(out, x, y, color[0], color[1], color[2]);
+		}
+	}
+}
+
+static void decode_etc2_t_mode
+(uint64_t const block, uint8_t * __restrict const out)
+{
+	int32_t const c1[3] = {
+		extend_4((bits(block, 60, 2) << 2) | bits(block, 57, 2)),
+		extend_4(bits(block, 55, 4)),
+		extend_4(bits(block, 51, 4))
+	};
+	int32_t const c2[3] = {
+		extend_4(bits(block, 47, 4)),
+		extend_4(bits(block, 43, 4)),
+		extend_4(bits(block, 39, 4))
+	};
+	int32_t const d =
+	  etc2_distances[(bits(block, 35, 2) << 1) | bits(block, 32, 1)];
+	int32_t paint[4][3];
+
+	for (unsigned int c = 0; c < 3; c++) {
+		paint[0][c] = c1[c];
+		paint[1][c] = c2[c] + d;
+		paint[2][c] = c2[c];
+		paint[3][c] = c2[c] - d;
+	}
+	decode_paint_colors(block, paint, out);
+}
+
+static void decode_etc2_h_mode
+(uint64_t const block, uint8_t * __restrict const out)
+{
+	uint32_t const c1_444[3] = {
+		bits(block, 62, 4),
+		(bits(block, 58, 3) << 1) | bits(block, 52, 1),
+		(bits(block, 51, 1) << 3) | bits(block, 49, 3)
+	};
+	uint32_t const c2_444[3] = {
+		bits(block, 46, 4), bits(block, 42, 4), bits(block, 38, 4)
+	};
+	uint32_t const c1_packed = (c1_444[0] << 8) | (c1_444[1] << 4) | c1_444[2];
+	uint32_t const c2_packed = (c2_444[0] << 8) | (c2_444[1] << 4) | c2_444[2];
+	int32_t const d = etc2_distances[
+	  (bits(block, 34, 1) << 2) | (bits(block, 32, 1) << 1) |
+	  (c1_packed >= c2_packed)
+	];
+	int32_t paint[4][3];
+
+	for (unsigned int c = 0; c < 3; c++) {
+		int32_t const c1 = extend_4(c1_444[c]), c2 = extend_4(c2_444[c]);
+		paint[0][c] = c1 + d;
+		paint[1][c] = c1 - d;
+		paint[2][c] = c2 + d;
+		paint[3][c] = c2 - d;
+	}
+	decode_paint_colors(block, paint, out);
+}
+
+static void decode_etc2_planar_mode
+(uint64_t const block, uint8_t * __restrict const out)
+{
+	int32_t const origin[3] = {
+		extend_6(bits(block, 62, 6)),
+		extend_7((bits(block, 56, 1) << 6) | bits(block, 54, 6)),
+		extend_6((bits(block, 48, 1) << 5) | (bits(block, 44, 2) << 3) |
+		         bits(block, 41, 3))
+	};
+	int32_t const horizontal[3] = {
+		extend_6((bits(block, 38, 5) << 1) | bits(block, 32, 1)),
+		extend_7(bits(block, 31, 7)),
+		extend_6(bits(block, 24, 6))
+	};
+	int32_t const vertical[3] = {
+		extend_6(bits(block, 18, 6)),
+		extend_7(bits(block, 12, 7)),
+		extend_6(bits(block,  5, 6))
+	};
+
+	for (int32_t x = 0; x < 4; x++) {
+		for (int32_t y = 0; y < 4; y++) {
+			int32_t color[3];
+			for (unsigned int c = 0; c < 3; c++)
+				color[c] = (x * (horizontal[c] - origin[c]) +
+				            y * (vertical[c] - origin[c]) +
+				            4 * origin[c] + 2) >> 2;
+			write_pixel(out, x, y, color[0], color[1], color[2]);
+		}
+	}
+}
+
+static void decode_etc2_rgb_block
+(uint8_t const * __restrict const src, uint8_t * __restrict const out)
+{
+	uint64_t const block = read_block(src);
+
+	if (!(block >> 33 & 1)) {
+		decode_etc1_modes(block, 0, out);
+		return;
+	}
+
+	/* In differential mode, overflowing the 5 bits base colors
+	   selects one of the ETC2 specific modes */
+	int32_t const r = bits(block, 63, 5) +
+	  (((int32_t) (bits(block, 58, 3) << 29)) >> 29);
+	int32_t const g = bits(block, 55, 5) +
+	  (((int32_t) (bits(block, 50, 3) << 29)) >> 29);
+	int32_t const b = bits(block, 47, 5) +
+	  (((int32_t) (bits(block, 42, 3) << 29)) >> 29);
+
+	if (r < 0 || r > 31)      decode_etc2_t_mode(block, out);
+	else if (g < 0 || g > 31) decode_etc2_h_mode(block, out);
+	else if (b < 0 || b > 31) decode_etc2_planar_mode(block, out);
+	else                      decode_etc1_modes(block, 1, out);
+}
+
+static void decode_etc1_block
+(uint8_t const * __restrict const src, uint8_t * __restrict const out)
+{
+	uint64_t const block = read_block(src);
+	decode_etc1_modes(block, block >> 33 & 1, out);
+}
+
+static int32_t const eac_modifiers[16][8] = {
+	{-3, -6, -9, -15, 2, 5, 8, 14},
+	{-3, -7, -10, -13, 2, 6, 9, 12},
+	{-2, -5, -8, -13, 1, 4, 7, 12},
+	{-2, -4, -6, -13, 1, 3, 5, 12},
+	{-3, -6, -8, -12, 2, 5, 7, 11},
+	{-3, -7, -9, -11, 2, 6, 8, 10},
+	{-4, -7, -8, -11, 3, 6, 7, 10},
+	{-3, -5, -8, -11, 2, 4, 7, 10},
+	{-2, -6, -8, -10, 1, 5, 7, 9},
+	{-2, -5, -8, -10, 1, 4, 7, 9},
+	{-2, -4, -8, -10, 1, 3, 7, 9},
+	{-2, -5, -7, -10, 1, 4, 6, 9},
+	{-3, -4, -7, -10, 2, 3, 6, 9},
+	{-1, -2, -3, -10, 0, 1, 2, 9},
+	{-4, -6, -8, -9, 3, 5, 7, 8},
+	{-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+static void decode_eac_alpha_block
+(uint8_t const * __restrict const src, uint8_t * __restrict const out)
+{
+	uint64_t const block = read_block(src);
+	int32_t const base = bits(block, 63, 8);
+	int32_t const multiplier = bits(block, 55, 4);
+	int32_t const * const modifiers = eac_modifiers[bits(block, 51, 4)];
+
+	for (unsigned int x = 0; x < 4; x++) {
+		for (unsigned int y = 0; y < 4; y++) {
+			unsigned int const index = bits(block, 47 - (x*4+y)*3, 3);
+			out[y*16 + x*4 + 3] =
+			  clamp_255(base + modifiers[index] * multiplier);
+		}
+	}
+}
+
+unsigned int tc_DecompressToRGBA8
+(uint32_t const format,
+ uint32_t const width, uint32_t const height,
+ uint8_t const * __restrict const src,
+ uint8_t * __restrict const dst)
+{
+	if (!tc_CanDecompress(format)) return 0;
+
+	uint32_t const block_size = (format == TC_ETC2_RGBA8_EAC) ? 16 : 8;
+	uint8_t const * __restrict block = src;
+
+	for (uint32_t by = 0; by < height; by += 4) {
+		for (uint32_t bx = 0; bx < width; bx += 4) {
+			uint8_t pixels[4*4*4];
+
+			switch(format) {
+				case TC_ETC1_RGB8:
+					decode_etc1_block(block, pixels);
+					break;
+				case TC_ETC2_RGB8:
+					decode_etc2_rgb_block(block, pixels);
+					break;
+				case TC_ETC2_RGBA8_EAC:
+					decode_etc2_rgb_block(block+8, pixels);
+					decode_eac_alpha_block(block, pixels);
+					break;
+			}
+			block += block_size;
+
+			/* Blocks overlapping the image borders are cropped */
+			for (uint32_t y = 0; y < 4 && by + y < height; y++) {
+				for (uint32_t x = 0; x < 4 && bx + x < width; x++) {
+					uint8_t const * __restrict const in = pixels + y*16 + x*4;
+					uint8_t * __restrict const pixel =
+					  dst + ((by + y) * width + bx + x) * 4;
+					pixel[0] = in[0];
+					pixel[1] = in[1];
+					pixel[2] = in[2];
+					pixel[3] = in[3];
+				}
+			}
+		}
+	}
+
+	return 1;
+}
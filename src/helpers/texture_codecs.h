@@ -0,0 +1,80 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_TEXTURE_CODECS
+#define MYY_SRC_HELPERS_TEXTURE_CODECS 1
+
+#include <stdint.h>
+
+/* Compressed formats known by the decoders.
+   The values are the OpenGL ones, defined here since ETC2 is only part
+   of OpenGL ES 3.x headers. */
+#define TC_ETC1_RGB8              0x8D64
+#define TC_ETC2_RGB8              0x9274
+#define TC_ETC2_RGBA8_EAC         0x9278
+#define TC_ASTC_RGBA_4x4          0x93B0
+#define TC_ASTC_RGBA_12x12        0x93BD
+
+/**
+ * Compute the size, in bytes, of a width x height image compressed
+ * with the provided format.
+ *
+ * @param format The compressed format (TC_*)
+ * @param width  The image width, in pixels
+ * @param height The image height, in pixels
+ *
+ * @return The size in bytes, or 0 if the format is unknown
+ */
+uint32_t tc_CompressedSize
+(uint32_t const format, uint32_t const width, uint32_t const height);
+
+/**
+ * Check if tc_DecompressToRGBA8 can decompress the provided format.
+ *
+ * @return 1 if it can, 0 otherwise
+ */
+unsigned int tc_CanDecompress(uint32_t const format);
+
+/**
+ * Decompress a width x height image into RGBA8888 pixels, stored as
+ * R, G, B, A bytes, rows after rows, without padding.
+ *
+ * ASSUMPTIONS :
+ * - src contains tc_CompressedSize(format, width, height) bytes
+ * - dst can contain width * height * 4 bytes
+ *
+ * @param format The compressed format (TC_*)
+ * @param width  The image width, in pixels
+ * @param height The image height, in pixels
+ * @param src    The compressed data
+ * @param dst    The buffer receiving the RGBA8888 pixels
+ *
+ * @return 1 on success, 0 if the format cannot be decompressed
+ */
+unsigned int tc_DecompressToRGBA8
+(uint32_t const format,
+ uint32_t const width, uint32_t const height,
+ uint8_t const * __restrict const src,
+ uint8_t * __restrict const dst);
+
+#endif
@@ -0,0 +1,533 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <helpers/texture_streamer.h>
+#include <helpers/gl_loaders.h>
+#include <helpers/file.h>
+#include <helpers/log.h>
+#include <helpers/trace.h>
+#include <helpers/string.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* pthread_create, pthread_join, ... */
+#include <pthread.h>
+
+/* sysconf */
+#include <unistd.h>
+
+struct stream_request {
+	/* Set by the render thread when queuing */
+	char pathname[GLH_TEXTURE_STREAMER_MAX_PATH];
+	GLuint * slot;
+	/* Set by the loader thread.
+	   staging points inside the asset pack when staging_owned is 0 */
+	uint8_t const * staging;
+	unsigned int staging_owned;
+	void * decompressed;
+	struct glh_raw_texture tex;
+	unsigned int ok;
+	/* Set by the loader thread when uploading through its own context */
+	GLuint shared_texture;
+	EGLSyncKHR fence;
+	/* Used by the render thread for banded uploads */
+	GLuint texture;
+	unsigned int level;
+	uint32_t uploaded_rows;
+};
+
+/* The queue is a single-producer single-consumer ring :
+ * - The render thread fills requests[queued] and increments queued.
+ * - The loader thread stages requests[loaded] and increments loaded.
+ * - The render thread uploads requests[uploaded] and increments it.
+ * The mutex is only used to put the loader thread to sleep when there's
+ * nothing to load. */
+static struct {
+	struct stream_request requests[GLH_TEXTURE_STREAMER_QUEUE_SIZE];
+	atomic_uint queued;
+	atomic_uint loaded;
+	unsigned int uploaded;
+
+	atomic_int running;
+	pthread_t loader;
+	pthread_mutex_t lock;
+	pthread_cond_t wake_up;
+
+	EGLDisplay display;
+	EGLContext loader_context;
+	unsigned int shared_uploads;
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+} streamer = {
+	.lock    = PTHREAD_MUTEX_INITIALIZER,
+	.wake_up = PTHREAD_COND_INITIALIZER,
+	.loader_context = EGL_NO_CONTEXT
+};
+
+#define QUEUE_INDEX(n) ((n) & (GLH_TEXTURE_STREAMER_QUEUE_SIZE-1))
+
+static uint64_t now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static void release_staging
+(struct stream_request * __restrict const request)
+{
+	if (request->staging_owned) free((void *) request->staging);
+	request->staging = NULL;
+	request->staging_owned = 0;
+}
+
+/* Packed assets are only mapped. Fault their pages in from the loader
+   thread, rather than during the render thread uploads. */
+static void prefault
+(uint8_t const * __restrict const data,
+ size_t const size)
+{
+	long const page_size = sysconf(_SC_PAGESIZE);
+	uint8_t volatile sum = 0;
+	for (size_t offset = 0; offset < size; offset += page_size)
+		sum += data[offset];
+	(void) sum;
+}
+
+/* Loader thread : Upload the whole texture through the shared context
+   and insert a fence, so that the render thread knows when it's done */
+static void loader_upload
+(struct stream_request * __restrict const request)
+{
+	glGenTextures(1, &request->shared_texture);
+	glBindTexture(GL_TEXTURE_2D, request->shared_texture);
+	glhUploadRawTexture(&request->tex);
+	request->fence = streamer.create_sync(
+	  streamer.display, EGL_SYNC_FENCE_KHR, NULL
+	);
+	/* Without a fence, wait for the upload here, so that the render
+	   thread can use the texture as soon as it sees it.
+	   Without a flush, the fence might never be signaled. */
+	if (request->fence == EGL_NO_SYNC_KHR) {
+		LOG_WARN("[Texture streamer] No fence for %s. Waiting for its upload.\n",
+		         request->pathname);
+		glFinish();
+	}
+	else glFlush();
+
+	release_staging(request);
+	free(request->decompressed);
+	request->decompressed = NULL;
+}
+
+static void loader_stage
+(struct stream_request * __restrict const request,
+ struct fh_load_request const * __restrict const file)
+{
+	uint8_t const * __restrict const content = file->data;
+	size_t const size = file->size;
+	unsigned int const owned = file->allocated;
+
+	request->ok = 0;
+	if (file->status != 0) {
+		LOG("[Texture streamer] Could not read %s\n", request->pathname);
+		return;
+	}
+
+	if (file->in_pack) prefault(content, size);
+
+	if (!glhParseMyyRawTexture(content, size, &request->tex)) {
+		LOG("[Texture streamer] %s is not a valid texture file\n",
+		    request->pathname);
+		if (owned) free((void *) content);
+		return;
+	}
+
+	/* Formats the GPU cannot sample are decompressed here, rather than
+	   in the render thread */
+	request->decompressed = glhDecompressRawTexture(&request->tex);
+	if (request->tex.compressed &&
+	    !glhCompressedFormatSupported(request->tex.format)) {
+		LOG("[Texture streamer] %s : Format 0x%x unsupported\n",
+		    request->pathname, request->tex.format);
+		if (owned) free((void *) content);
+		return;
+	}
+
+	request->staging       = content;
+	request->staging_owned = owned;
+	request->ok            = 1;
+
+	if (streamer.shared_uploads) loader_upload(request);
+}
+
+static void * loader_thread(void * unused)
+{
+	static struct fh_load_request files[GLH_TEXTURE_STREAMER_QUEUE_SIZE];
+
+	th_TraceThreadName("texture loader");
+
+	if (streamer.loader_context != EGL_NO_CONTEXT) {
+		streamer.shared_uploads = eglMakeCurrent(
+		  streamer.display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+		  streamer.loader_context
+		);
+		LOG("[Texture streamer] Shared context uploads : %d\n",
+		    streamer.shared_uploads);
+	}
+
+	while (1) {
+		unsigned int const loaded =
+		  atomic_load_explicit(&streamer.loaded, memory_order_relaxed);
+
+		pthread_mutex_lock(&streamer.lock);
+		while (atomic_load(&streamer.running) &&
+		       atomic_load(&streamer.queued) == loaded)
+			pthread_cond_wait(&streamer.wake_up, &streamer.lock);
+		pthread_mutex_unlock(&streamer.lock);
+
+		if (!atomic_load(&streamer.running)) break;
+
+		/* Read every queued file at once, then stage them in order */
+		unsigned int const queued =
+		  atomic_load_explicit(&streamer.queued, memory_order_acquire);
+		unsigned int const n_files = queued - loaded;
+		for (unsigned int f = 0; f < n_files; f++) {
+			files[f].pathname =
+			  streamer.requests[QUEUE_INDEX(loaded+f)].pathname;
+			files[f].buffer = NULL;
+			files[f].buffer_size = 0;
+		}
+		TRACE_BEGIN("fh_LoadFiles");
+		fh_LoadFiles(files, n_files, NULL, FH_LOAD_AUTO);
+		TRACE_END("fh_LoadFiles");
+
+		TRACE_BEGIN("loader_stage");
+		for (unsigned int f = 0; f < n_files; f++) {
+			loader_stage(&streamer.requests[QUEUE_INDEX(loaded+f)], files+f);
+			atomic_store_explicit(
+			  &streamer.loaded, loaded+f+1, memory_order_release
+			);
+		}
+		TRACE_END("loader_stage");
+	}
+
+	if (streamer.shared_uploads)
+		eglMakeCurrent(
+		  streamer.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT
+		);
+
+	return NULL;
+}
+
+unsigned int glhTextureStreamerStart
+(EGLDisplay const display,
+ EGLConfig const config,
+ EGLContext const main_context)
+{
+	static EGLint const context_attribs[] = {
+		MYY_CURRENT_GL_CONTEXT,
+		EGL_NONE, EGL_NONE
+	};
+
+	if (atomic_load(&streamer.running)) return 1;
+
+	/* The loader thread needs to know which formats to decompress */
+	glhProbeTextureSupport();
+
+	char const * __restrict const egl_extensions =
+	  eglQueryString(display, EGL_EXTENSIONS);
+
+	streamer.display = display;
+	streamer.loader_context = EGL_NO_CONTEXT;
+	streamer.shared_uploads = 0;
+
+	if (main_context != EGL_NO_CONTEXT &&
+	    sh_hasExtension(egl_extensions, "EGL_KHR_fence_sync") &&
+	    sh_hasExtension(egl_extensions, "EGL_KHR_surfaceless_context")) {
+		streamer.create_sync = (PFNEGLCREATESYNCKHRPROC)
+		  eglGetProcAddress("eglCreateSyncKHR");
+		streamer.destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+		  eglGetProcAddress("eglDestroySyncKHR");
+		streamer.client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+		  eglGetProcAddress("eglClientWaitSyncKHR");
+
+		if (streamer.create_sync && streamer.destroy_sync &&
+		    streamer.client_wait_sync)
+			streamer.loader_context = eglCreateContext(
+			  display, config, main_context, context_attribs
+			);
+	}
+
+	atomic_store(&streamer.running, 1);
+	if (pthread_create(&streamer.loader, NULL, loader_thread, NULL)) {
+		LOG_ERRNO("[Texture streamer] Could not start the loader\n");
+		atomic_store(&streamer.running, 0);
+		if (streamer.loader_context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, streamer.loader_context);
+		streamer.loader_context = EGL_NO_CONTEXT;
+		return 0;
+	}
+
+	return 1;
+}
+
+static void release_request
+(struct stream_request * __restrict const request)
+{
+	release_staging(request);
+	free(request->decompressed);
+	request->decompressed = NULL;
+	if (request->texture) glDeleteTextures(1, &request->texture);
+	request->texture = 0;
+	if (request->shared_texture)
+		glDeleteTextures(1, &request->shared_texture);
+	request->shared_texture = 0;
+	if (request->fence != NULL)
+		streamer.destroy_sync(streamer.display, request->fence);
+	request->fence = NULL;
+}
+
+void glhTextureStreamerStop()
+{
+	if (!atomic_load(&streamer.running)) return;
+
+	pthread_mutex_lock(&streamer.lock);
+	atomic_store(&streamer.running, 0);
+	pthread_cond_signal(&streamer.wake_up);
+	pthread_mutex_unlock(&streamer.lock);
+	pthread_join(streamer.loader, NULL);
+
+	/* The requests that were never staged do not own anything */
+	unsigned int const loaded = atomic_load(&streamer.loaded);
+	for (; streamer.uploaded != loaded; streamer.uploaded++)
+		release_request(
+		  &streamer.requests[QUEUE_INDEX(streamer.uploaded)]
+		);
+	atomic_store(&streamer.queued, loaded);
+
+	if (streamer.loader_context != EGL_NO_CONTEXT)
+		eglDestroyContext(streamer.display, streamer.loader_context);
+	streamer.loader_context = EGL_NO_CONTEXT;
+}
+
+unsigned int glhStreamMyyRawTextures
+(char const * __restrict const textures_names, int const n,
+ GLuint * __restrict const texid)
+{
+	char const * current_name = textures_names;
+	unsigned int n_queued = 0;
+
+	glGenTextures(n, texid);
+
+	for (int i = 0; i < n; i++) {
+		unsigned int const queued =
+		  atomic_load_explicit(&streamer.queued, memory_order_relaxed);
+		size_t const name_length = strlen(current_name);
+
+		glBindTexture(GL_TEXTURE_2D, texid[i]);
+
+		if (!atomic_load(&streamer.running) ||
+		    queued - streamer.uploaded == GLH_TEXTURE_STREAMER_QUEUE_SIZE ||
+		    name_length >= GLH_TEXTURE_STREAMER_MAX_PATH) {
+			/* Do it the old way. texid[i] is replaced, though. */
+			glDeleteTextures(1, texid+i);
+			glhUploadMyyRawTextures(current_name, 1, texid+i);
+		}
+		else {
+			struct stream_request * __restrict const request =
+			  &streamer.requests[QUEUE_INDEX(queued)];
+			glhUploadPlaceholderTexture();
+
+			memcpy(request->pathname, current_name, name_length+1);
+			request->slot = texid+i;
+			request->staging = NULL;
+			request->staging_owned = 0;
+			request->decompressed = NULL;
+			request->ok = 0;
+			request->shared_texture = 0;
+			request->fence = NULL;
+			request->texture = 0;
+			request->level = 0;
+			request->uploaded_rows = 0;
+
+			pthread_mutex_lock(&streamer.lock);
+			atomic_store_explicit(
+			  &streamer.queued, queued+1, memory_order_release
+			);
+			pthread_cond_signal(&streamer.wake_up);
+			pthread_mutex_unlock(&streamer.lock);
+			n_queued++;
+		}
+		sh_pointToNextString(current_name);
+	}
+
+	return n_queued;
+}
+
+/* Replace the placeholder by the real texture */
+static void swap_in
+(struct stream_request * __restrict const request,
+ GLuint const texture)
+{
+	glDeleteTextures(1, request->slot);
+	*request->slot = texture;
+}
+
+/* Render thread : Upload as many rows as the budget permits.
+ * Compressed levels are uploaded whole.
+ * budget_bytes is the budget of the whole frame, spent_bytes what the
+ * previous textures of the frame already used.
+ * Returns 1 when the whole texture has been uploaded. */
+static unsigned int upload_band
+(struct stream_request * __restrict const request,
+ uint32_t const budget_bytes,
+ uint32_t * __restrict const spent_bytes)
+{
+	struct glh_raw_texture const * __restrict const tex = &request->tex;
+
+	if (request->texture == 0) glGenTextures(1, &request->texture);
+	glBindTexture(GL_TEXTURE_2D, request->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, tex->alignment);
+
+	while (request->level < tex->n_levels) {
+		unsigned int const l = request->level;
+		struct glh_texture_level const * __restrict const level =
+		  tex->levels+l;
+		uint32_t const row_size = glhRawTextureRowSize(tex, l);
+		uint32_t const remaining_rows = level->height - request->uploaded_rows;
+		uint32_t const budget_left =
+		  budget_bytes > *spent_bytes ? budget_bytes - *spent_bytes : 0;
+		uint32_t rows;
+		if (tex->compressed)
+			rows = level->size <= budget_left ? remaining_rows : 0;
+		else if (row_size != 0)
+			rows = budget_left / row_size;
+		/* Empty levels are rejected by glhParseMyyRawTexture, but a
+		   division by 0 would kill the render thread */
+		else
+			rows = remaining_rows;
+
+		if (rows == 0) {
+			/* Only the first band of a frame can go over budget */
+			if (*spent_bytes != 0) return 0;
+			rows = tex->compressed ? remaining_rows : 1;
+		}
+		if (rows > remaining_rows) rows = remaining_rows;
+
+		if (tex->compressed) {
+			glCompressedTexImage2D(
+			  tex->target, l, tex->format,
+			  level->width, level->height, 0,
+			  level->size, level->data
+			);
+			*spent_bytes += level->size;
+		}
+		else {
+			if (request->uploaded_rows == 0)
+				glTexImage2D(
+				  tex->target, l, tex->format,
+				  level->width, level->height, 0,
+				  tex->format, tex->type, NULL
+				);
+			glTexSubImage2D(
+			  tex->target, l,
+			  0, request->uploaded_rows, level->width, rows,
+			  tex->format, tex->type,
+			  ((uint8_t const *) level->data) +
+			  request->uploaded_rows * row_size
+			);
+			*spent_bytes += rows * row_size;
+		}
+
+		request->uploaded_rows += rows;
+		if (request->uploaded_rows == level->height) {
+			request->level++;
+			request->uploaded_rows = 0;
+		}
+	}
+
+	return 1;
+}
+
+unsigned int glhTextureStreamerUpload
+(uint32_t const max_bytes, uint64_t const max_ns)
+{
+	uint64_t const start = now_ns();
+	uint32_t spent_bytes = 0;
+	unsigned int n_available = 0;
+	unsigned int const loaded =
+	  atomic_load_explicit(&streamer.loaded, memory_order_acquire);
+
+	while (streamer.uploaded != loaded) {
+		struct stream_request * __restrict const request =
+		  &streamer.requests[QUEUE_INDEX(streamer.uploaded)];
+
+		if (!request->ok) {
+			/* The placeholder stays. Nothing else to do. */
+			LOG("[Texture streamer] Could not load %s\n", request->pathname);
+		}
+		else if (request->shared_texture != 0) {
+			if (request->fence != NULL) {
+				EGLint const status = streamer.client_wait_sync(
+				  streamer.display, request->fence, 0, 0
+				);
+				/* Textures are made available in order */
+				if (status != EGL_CONDITION_SATISFIED_KHR) break;
+				streamer.destroy_sync(streamer.display, request->fence);
+				request->fence = NULL;
+			}
+			swap_in(request, request->shared_texture);
+			request->shared_texture = 0;
+			n_available++;
+		}
+		else {
+			if (spent_bytes >= max_bytes && spent_bytes != 0) break;
+			unsigned int const complete = upload_band(
+			  request, max_bytes, &spent_bytes
+			);
+			if (!complete) break;
+			glhSetupTexture(&request->tex);
+			swap_in(request, request->texture);
+			request->texture = 0;
+			release_staging(request);
+			free(request->decompressed);
+			request->decompressed = NULL;
+			n_available++;
+		}
+
+		streamer.uploaded++;
+		if (now_ns() - start >= max_ns) break;
+	}
+
+	return n_available;
+}
+
+unsigned int glhTextureStreamerPending()
+{
+	return atomic_load(&streamer.queued) - streamer.uploaded;
+}
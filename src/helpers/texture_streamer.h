@@ -0,0 +1,118 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_TEXTURE_STREAMER
+#define MYY_SRC_HELPERS_TEXTURE_STREAMER 1
+
+#include <current/opengl.h>
+#include <stdint.h>
+
+/* How many textures can wait for their upload at the same time.
+   Must be a power of 2. */
+#define GLH_TEXTURE_STREAMER_QUEUE_SIZE 64
+#define GLH_TEXTURE_STREAMER_MAX_PATH 256
+
+/**
+ * Start the background texture loader thread.
+ *
+ * The loader thread reads and checks the textures files, outside of
+ * the render loop. The textures are then uploaded by the render thread,
+ * through glhTextureStreamerUpload, under a per-frame budget.
+ *
+ * If the EGL implementation provides EGL_KHR_fence_sync and
+ * EGL_KHR_surfaceless_context, the loader thread will also do the
+ * uploads itself, in its own context sharing its objects with
+ * main_context. The render thread will then only swap the textures
+ * names once the GPU signaled that the upload is complete.
+ * Pass EGL_NO_CONTEXT as main_context to avoid this behaviour.
+ *
+ * PARAMS :
+ * @param display      The display the main context was created on
+ * @param config       The configuration used to create main_context
+ * @param main_context The render thread context
+ *
+ * RETURNS :
+ * @return 1 if the loader thread was started. 0 otherwise, in which
+ *         case glhStreamMyyRawTextures will load textures synchronously.
+ */
+unsigned int glhTextureStreamerStart
+(EGLDisplay const display,
+ EGLConfig const config,
+ EGLContext const main_context);
+
+/**
+ * Stop the loader thread and release every pending request.
+ * Must be called from the render thread.
+ */
+void glhTextureStreamerStop();
+
+/**
+ * Same as glhUploadMyyRawTextures, except that the files are loaded by
+ * the loader thread.
+ *
+ * Each texid receives a name bound to a 1x1 transparent placeholder
+ * texture immediately. Once the real texture is uploaded, by
+ * glhTextureStreamerUpload, texid[i] is replaced by the name of the
+ * real texture, and the placeholder is deleted.
+ * So DO NOT cache the texids values. Read them when binding.
+ *
+ * CAUTION :
+ * - texid must stay valid until the textures are uploaded.
+ * - This will replace the current texture binding.
+ *
+ * PARAMS :
+ * @param textures_names The \0 separated filepaths of the textures
+ * @param n              The number of textures to load
+ * @param texid          The buffer receiving the textures names
+ *
+ * RETURNS :
+ * @return The number of textures queued.
+ *         Textures that could not be queued are loaded synchronously.
+ */
+unsigned int glhStreamMyyRawTextures
+(char const * __restrict const textures_names, int const n,
+ GLuint * __restrict const texid);
+
+/**
+ * Upload the textures loaded by the loader thread, until either
+ * max_bytes bytes have been sent or max_ns nanoseconds have elapsed.
+ *
+ * Big textures are uploaded in bands of rows, across multiple frames
+ * if required. At least one band is uploaded per call, so that a tiny
+ * budget cannot stall the streaming completely.
+ *
+ * To be called once per frame, from the render thread.
+ *
+ * RETURNS :
+ * @return The number of textures that became available during this
+ *         call.
+ */
+unsigned int glhTextureStreamerUpload
+(uint32_t const max_bytes, uint64_t const max_ns);
+
+/**
+ * @return The number of textures queued but not available yet.
+ */
+unsigned int glhTextureStreamerPending();
+
+#endif
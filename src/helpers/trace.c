@@ -0,0 +1,540 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* program_invocation_short_name */
+#define _GNU_SOURCE 1
+
+#include <helpers/trace.h>
+#include <helpers/log.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(MYY_TRACE)
+
+/* Events kept per thread. Must be a power of 2. */
+#define TH_TRACE_EVENTS (64*1024)
+/* Threads beyond this limit are not traced */
+#define TH_TRACE_MAX_THREADS 16
+/* Distinct counters in the Perfetto traces */
+#define TH_TRACE_MAX_COUNTERS 64
+
+struct th_event {
+	uint64_t timestamp;
+	char const * name;
+	int64_t value;
+	uint32_t phase;
+};
+
+struct th_buffer {
+	/* Events written since the thread started */
+	atomic_uint_fast64_t written;
+	pid_t tid;
+	char const * name;
+	struct th_event events[TH_TRACE_EVENTS];
+};
+
+static struct {
+	_Atomic(struct th_buffer *) buffers[TH_TRACE_MAX_THREADS];
+	atomic_uint n_buffers;
+	char const * path;
+	volatile sig_atomic_t export_requested;
+} tracer;
+
+static _Thread_local struct th_buffer * thread_buffer;
+/* Set when the thread could not get a buffer */
+static _Thread_local unsigned int thread_untraced;
+
+static struct th_buffer * buffer_acquire()
+{
+	if (thread_untraced) return NULL;
+
+	unsigned int const slot = atomic_fetch_add(&tracer.n_buffers, 1);
+	struct th_buffer * __restrict const buffer =
+		(slot < TH_TRACE_MAX_THREADS)
+		? calloc(1, sizeof(struct th_buffer))
+		: NULL;
+
+	if (buffer == NULL) {
+		LOG_WARN("[Trace] Thread %ld will not be traced\n",
+		         (long) syscall(SYS_gettid));
+		thread_untraced = 1;
+		return NULL;
+	}
+
+	buffer->tid  = syscall(SYS_gettid);
+	buffer->name = "";
+	atomic_store_explicit(
+	  &tracer.buffers[slot], buffer, memory_order_release);
+	thread_buffer = buffer;
+	return buffer;
+}
+
+/* Returns the n-th thread buffer, or NULL if not available yet */
+static struct th_buffer const * buffer_get(unsigned int const b)
+{
+	return atomic_load_explicit(&tracer.buffers[b], memory_order_acquire);
+}
+
+static unsigned int buffers_count()
+{
+	unsigned int const n = atomic_load(&tracer.n_buffers);
+	return (n < TH_TRACE_MAX_THREADS) ? n : TH_TRACE_MAX_THREADS;
+}
+
+void th_TraceEvent
+(enum th_trace_phase const phase,
+ char const * __restrict const name,
+ int64_t const value)
+{
+	struct th_buffer * __restrict buffer = thread_buffer;
+	if (buffer == NULL && (buffer = buffer_acquire()) == NULL) return;
+
+	uint64_t const n =
+		atomic_load_explicit(&buffer->written, memory_order_relaxed);
+	struct th_event * __restrict const event =
+		buffer->events + (n & (TH_TRACE_EVENTS - 1));
+
+	/* The exporter checks `written` after reading an event, to discard
+	   the events overwritten while it was reading them */
+	atomic_thread_fence(memory_order_release);
+	event->timestamp = th_TraceNow();
+	event->name      = name;
+	event->value     = value;
+	event->phase     = phase;
+	atomic_store_explicit(&buffer->written, n + 1, memory_order_release);
+}
+
+void th_TraceThreadName(char const * __restrict const name)
+{
+	struct th_buffer * __restrict buffer = thread_buffer;
+	if (buffer == NULL && (buffer = buffer_acquire()) == NULL) return;
+	buffer->name = name;
+}
+
+/* Calls `callback` on each event still available, oldest first */
+static void buffer_events
+(struct th_buffer const * __restrict const buffer,
+ void (*callback)(struct th_buffer const *, struct th_event const *, void *),
+ void * const data)
+{
+	/* Events arriving during the export are ignored */
+	uint64_t const end =
+		atomic_load_explicit(&buffer->written, memory_order_acquire);
+	uint64_t const start =
+		(end > TH_TRACE_EVENTS) ? end - TH_TRACE_EVENTS : 0;
+
+	for (uint64_t i = start; i < end; i++) {
+		struct th_event event = buffer->events[i & (TH_TRACE_EVENTS - 1)];
+		atomic_thread_fence(memory_order_acquire);
+		uint64_t const written = atomic_load_explicit(
+		  &((struct th_buffer *) buffer)->written, memory_order_relaxed);
+		if (written >= i + TH_TRACE_EVENTS) continue;
+		callback(buffer, &event, data);
+	}
+}
+
+/* -- Chrome JSON traces -- */
+
+static void json_string
+(FILE * __restrict const file,
+ char const * __restrict string)
+{
+	fputc('"', file);
+	for (; *string; string++) {
+		if (*string == '"' || *string == '\\') fputc('\\', file);
+		if ((unsigned char) *string >= 0x20) fputc(*string, file);
+	}
+	fputc('"', file);
+}
+
+static void json_event
+(struct th_buffer const * __restrict const buffer,
+ struct th_event const * __restrict const event,
+ void * const data)
+{
+	static char const phases[] = {
+		[TH_TRACE_BEGIN]   = 'B',
+		[TH_TRACE_END]     = 'E',
+		[TH_TRACE_COUNTER] = 'C'
+	};
+	FILE * __restrict const file = data;
+
+	fputs(",\n{\"name\":", file);
+	json_string(file, event->name);
+	fprintf(file, ",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d",
+	        phases[event->phase],
+	        (unsigned long long) (event->timestamp / 1000),
+	        (unsigned int) (event->timestamp % 1000),
+	        (int) getpid(), (int) buffer->tid);
+	if (event->phase == TH_TRACE_COUNTER)
+		fprintf(file, ",\"args\":{\"value\":%lld}", (long long) event->value);
+	fputc('}', file);
+}
+
+static void export_json(FILE * __restrict const file)
+{
+	unsigned int const n_buffers = buffers_count();
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	              "\"args\":{\"name\":", (int) getpid());
+	json_string(file, program_invocation_short_name);
+	fputs("}}", file);
+
+	for (unsigned int b = 0; b < n_buffers; b++) {
+		struct th_buffer const * __restrict const buffer = buffer_get(b);
+		if (buffer == NULL) continue;
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+		              "\"tid\":%d,\"args\":{\"name\":",
+		        (int) getpid(), (int) buffer->tid);
+		json_string(file, buffer->name);
+		fputs("}}", file);
+		buffer_events(buffer, json_event, file);
+	}
+	fputs("\n]}\n", file);
+}
+
+/* -- Perfetto protobuf traces --
+ * Only the few fields of perfetto/trace/trace_packet.proto used here
+ * are encoded. */
+
+enum pb_wire_type { PB_VARINT = 0, PB_LENGTH_DELIMITED = 2 };
+
+/* Trace */
+#define PB_TRACE_PACKET 1
+/* TracePacket */
+#define PB_PACKET_TIMESTAMP 8
+#define PB_PACKET_SEQUENCE_ID 10
+#define PB_PACKET_TRACK_EVENT 11
+#define PB_PACKET_SEQUENCE_FLAGS 13
+#define PB_PACKET_TIMESTAMP_CLOCK_ID 58
+#define PB_PACKET_TRACK_DESCRIPTOR 60
+/* TracePacket.sequence_flags */
+#define PB_SEQ_INCREMENTAL_STATE_CLEARED 1
+/* BuiltinClock */
+#define PB_CLOCK_MONOTONIC 3
+/* TrackDescriptor */
+#define PB_TRACK_UUID 1
+#define PB_TRACK_NAME 2
+#define PB_TRACK_PROCESS 3
+#define PB_TRACK_THREAD 4
+#define PB_TRACK_PARENT_UUID 5
+#define PB_TRACK_COUNTER 8
+/* ProcessDescriptor */
+#define PB_PROCESS_PID 1
+#define PB_PROCESS_NAME 6
+/* ThreadDescriptor */
+#define PB_THREAD_PID 1
+#define PB_THREAD_TID 2
+#define PB_THREAD_NAME 5
+/* TrackEvent */
+#define PB_EVENT_TYPE 9
+#define PB_EVENT_TRACK_UUID 11
+#define PB_EVENT_NAME 23
+#define PB_EVENT_COUNTER_VALUE 30
+/* TrackEvent.Type */
+#define PB_EVENT_SLICE_BEGIN 1
+#define PB_EVENT_SLICE_END 2
+#define PB_EVENT_COUNTER 4
+
+/* Tracks identifiers */
+#define PB_PROCESS_TRACK_UUID 1
+#define PB_COUNTER_TRACK_UUID(index) (0x100 + (index))
+#define PB_THREAD_TRACK_UUID(tid) (0x100000000ull + (uint64_t) (tid))
+
+struct pb_message {
+	uint8_t data[256];
+	size_t size;
+};
+
+static void pb_bytes
+(struct pb_message * __restrict const message,
+ void const * __restrict const bytes,
+ size_t size)
+{
+	if (size > sizeof(message->data) - message->size)
+		size = sizeof(message->data) - message->size;
+	memcpy(message->data + message->size, bytes, size);
+	message->size += size;
+}
+
+static void pb_varint
+(struct pb_message * __restrict const message,
+ uint64_t value)
+{
+	uint8_t encoded[10];
+	size_t n = 0;
+	do {
+		encoded[n++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+		value >>= 7;
+	} while (value);
+	pb_bytes(message, encoded, n);
+}
+
+static void pb_uint
+(struct pb_message * __restrict const message,
+ unsigned int const field,
+ uint64_t const value)
+{
+	pb_varint(message, (field << 3) | PB_VARINT);
+	pb_varint(message, value);
+}
+
+static void pb_string
+(struct pb_message * __restrict const message,
+ unsigned int const field,
+ char const * __restrict const string)
+{
+	size_t const length = strlen(string);
+	pb_varint(message, (field << 3) | PB_LENGTH_DELIMITED);
+	pb_varint(message, length);
+	pb_bytes(message, string, length);
+}
+
+static void pb_submessage
+(struct pb_message * __restrict const message,
+ unsigned int const field,
+ struct pb_message const * __restrict const submessage)
+{
+	pb_varint(message, (field << 3) | PB_LENGTH_DELIMITED);
+	pb_varint(message, submessage->size);
+	pb_bytes(message, submessage->data, submessage->size);
+}
+
+struct pb_export {
+	FILE * file;
+	char const * counters[TH_TRACE_MAX_COUNTERS];
+	unsigned int n_counters;
+};
+
+static void pb_write_packet
+(FILE * __restrict const file,
+ struct pb_message const * __restrict const packet)
+{
+	struct pb_message header = {0};
+	pb_varint(&header, (PB_TRACE_PACKET << 3) | PB_LENGTH_DELIMITED);
+	pb_varint(&header, packet->size);
+	fwrite(header.data, 1, header.size, file);
+	fwrite(packet->data, 1, packet->size, file);
+}
+
+static void pb_write_track
+(FILE * __restrict const file,
+ struct pb_message const * __restrict const track)
+{
+	struct pb_message packet = {0};
+	pb_uint(&packet, PB_PACKET_SEQUENCE_ID, 1);
+	pb_submessage(&packet, PB_PACKET_TRACK_DESCRIPTOR, track);
+	pb_write_packet(file, &packet);
+}
+
+static void pb_counter_track
+(struct pb_export * __restrict const export,
+ char const * __restrict const name,
+ uint64_t * __restrict const uuid)
+{
+	unsigned int c;
+	for (c = 0; c < export->n_counters; c++) {
+		if (strcmp(export->counters[c], name) == 0) {
+			*uuid = PB_COUNTER_TRACK_UUID(c);
+			return;
+		}
+	}
+
+	if (c == TH_TRACE_MAX_COUNTERS) {
+		*uuid = 0;
+		return;
+	}
+	export->counters[export->n_counters++] = name;
+	*uuid = PB_COUNTER_TRACK_UUID(c);
+
+	struct pb_message counter = {0};
+	struct pb_message track = {0};
+	pb_uint(&track, PB_TRACK_UUID, *uuid);
+	pb_uint(&track, PB_TRACK_PARENT_UUID, PB_PROCESS_TRACK_UUID);
+	pb_string(&track, PB_TRACK_NAME, name);
+	pb_submessage(&track, PB_TRACK_COUNTER, &counter);
+	pb_write_track(export->file, &track);
+}
+
+static void pb_event
+(struct th_buffer const * __restrict const buffer,
+ struct th_event const * __restrict const event,
+ void * const data)
+{
+	struct pb_export * __restrict const export = data;
+	struct pb_message track_event = {0};
+	struct pb_message packet = {0};
+	uint64_t track_uuid = PB_THREAD_TRACK_UUID(buffer->tid);
+
+	switch (event->phase) {
+	case TH_TRACE_BEGIN:
+		pb_uint(&track_event, PB_EVENT_TYPE, PB_EVENT_SLICE_BEGIN);
+		pb_string(&track_event, PB_EVENT_NAME, event->name);
+		break;
+	case TH_TRACE_END:
+		pb_uint(&track_event, PB_EVENT_TYPE, PB_EVENT_SLICE_END);
+		break;
+	case TH_TRACE_COUNTER:
+		pb_counter_track(export, event->name, &track_uuid);
+		if (track_uuid == 0) return;
+		pb_uint(&track_event, PB_EVENT_TYPE, PB_EVENT_COUNTER);
+		pb_uint(&track_event, PB_EVENT_COUNTER_VALUE, (uint64_t) event->value);
+		break;
+	}
+	pb_uint(&track_event, PB_EVENT_TRACK_UUID, track_uuid);
+
+	pb_uint(&packet, PB_PACKET_TIMESTAMP, event->timestamp);
+	pb_uint(&packet, PB_PACKET_TIMESTAMP_CLOCK_ID, PB_CLOCK_MONOTONIC);
+	pb_uint(&packet, PB_PACKET_SEQUENCE_ID, 1);
+	pb_submessage(&packet, PB_PACKET_TRACK_EVENT, &track_event);
+	pb_write_packet(export->file, &packet);
+}
+
+static void export_perfetto(FILE * __restrict const file)
+{
+	unsigned int const n_buffers = buffers_count();
+	struct pb_export export = { .file = file };
+
+	/* The process */
+	{
+		struct pb_message process = {0};
+		struct pb_message track = {0};
+		struct pb_message packet = {0};
+		pb_uint(&process, PB_PROCESS_PID, getpid());
+		pb_string(&process, PB_PROCESS_NAME, program_invocation_short_name);
+		pb_uint(&track, PB_TRACK_UUID, PB_PROCESS_TRACK_UUID);
+		pb_submessage(&track, PB_TRACK_PROCESS, &process);
+		pb_uint(&packet, PB_PACKET_SEQUENCE_ID, 1);
+		pb_uint(&packet, PB_PACKET_SEQUENCE_FLAGS,
+		        PB_SEQ_INCREMENTAL_STATE_CLEARED);
+		pb_submessage(&packet, PB_PACKET_TRACK_DESCRIPTOR, &track);
+		pb_write_packet(file, &packet);
+	}
+
+	for (unsigned int b = 0; b < n_buffers; b++) {
+		struct th_buffer const * __restrict const buffer = buffer_get(b);
+		if (buffer == NULL) continue;
+
+		struct pb_message thread = {0};
+		struct pb_message track = {0};
+		pb_uint(&thread, PB_THREAD_PID, getpid());
+		pb_uint(&thread, PB_THREAD_TID, buffer->tid);
+		pb_string(&thread, PB_THREAD_NAME, buffer->name);
+		pb_uint(&track, PB_TRACK_UUID, PB_THREAD_TRACK_UUID(buffer->tid));
+		pb_uint(&track, PB_TRACK_PARENT_UUID, PB_PROCESS_TRACK_UUID);
+		pb_submessage(&track, PB_TRACK_THREAD, &thread);
+		pb_write_track(file, &track);
+
+		buffer_events(buffer, pb_event, &export);
+	}
+}
+
+unsigned int th_TraceExport(char const * __restrict path)
+{
+	if (path == NULL) path = tracer.path;
+	if (path == NULL) {
+		LOG_WARN("[Trace] No file to export to\n");
+		return 0;
+	}
+
+	FILE * __restrict const file = fopen(path, "wb");
+	if (file == NULL) {
+		LOG_ERRNO("[Trace] Could not open %s\n", path);
+		return 0;
+	}
+
+	size_t const path_length = strlen(path);
+	if (path_length >= 5 && strcmp(path + path_length - 5, ".json") == 0)
+		export_json(file);
+	else
+		export_perfetto(file);
+
+	unsigned int const written = (ferror(file) == 0);
+	if (fclose(file) != 0 || !written) {
+		LOG_ERRNO("[Trace] Could not write %s\n", path);
+		return 0;
+	}
+	LOG("[Trace] Written to %s\n", path);
+	return 1;
+}
+
+static void export_requested(int signal_number)
+{
+	tracer.export_requested = 1;
+}
+
+static void export_at_exit()
+{
+	th_TraceExport(tracer.path);
+}
+
+void th_TraceStart(char const * __restrict const default_path)
+{
+	char const * __restrict const path = getenv("MYY_TRACE_FILE");
+	tracer.path = (path != NULL && *path != '\0') ? path : default_path;
+
+	struct sigaction action = { .sa_handler = export_requested };
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &action, NULL);
+
+	atexit(export_at_exit);
+}
+
+void th_TraceExportIfRequested()
+{
+	if (tracer.export_requested) {
+		tracer.export_requested = 0;
+		th_TraceExport(tracer.path);
+	}
+}
+
+#else
+
+void th_TraceEvent
+(enum th_trace_phase const phase,
+ char const * __restrict const name,
+ int64_t const value)
+{
+}
+
+void th_TraceThreadName(char const * __restrict const name) {}
+void th_TraceStart(char const * __restrict const default_path) {}
+void th_TraceExportIfRequested() {}
+
+unsigned int th_TraceExport(char const * __restrict const path)
+{
+	return 0;
+}
+
+#endif
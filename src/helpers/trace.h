@@ -0,0 +1,92 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_SRC_HELPERS_TRACE_H
+#define MYY_SRC_HELPERS_TRACE_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+/* Timeline tracing.
+ *
+ * When built with MYY_TRACE, TRACE_BEGIN/TRACE_END pairs and
+ * TRACE_COUNTER values are stored, with a CLOCK_MONOTONIC timestamp,
+ * in a buffer preallocated for each thread.
+ * When a buffer is full, the oldest events are overwritten.
+ *
+ * The buffers are exported when calling th_TraceExport, and at exit
+ * or on SIGUSR1 once th_TraceStart has been called.
+ * Files ending with .json are written as Chrome JSON traces
+ * (chrome://tracing), anything else as Perfetto protobuf traces
+ * (ui.perfetto.dev).
+ *
+ * Without MYY_TRACE, the macros do nothing and the functions return
+ * immediately. */
+
+enum th_trace_phase {
+	TH_TRACE_BEGIN,
+	TH_TRACE_END,
+	TH_TRACE_COUNTER
+};
+
+/* Names must be string literals, or at least outlive the program */
+void th_TraceEvent
+(enum th_trace_phase const phase,
+ char const * __restrict const name,
+ int64_t const value);
+
+/* Name the calling thread in the exported traces, and allocate its
+ * buffer now instead of on its first event */
+void th_TraceThreadName(char const * __restrict const name);
+
+/* Export to `default_path`, or $MYY_TRACE_FILE when defined,
+ * on exit and when receiving SIGUSR1 */
+void th_TraceStart(char const * __restrict const default_path);
+
+/* Export if SIGUSR1 was received since the last call.
+ * Call it once per frame. */
+void th_TraceExportIfRequested();
+
+/* Export to `path`, or to the th_TraceStart path when NULL.
+ * Returns 1 if the trace could be written, 0 otherwise */
+unsigned int th_TraceExport(char const * __restrict const path);
+
+static inline uint64_t th_TraceNow()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#if defined(MYY_TRACE)
+#define TRACE_BEGIN(name) th_TraceEvent(TH_TRACE_BEGIN, name, 0)
+#define TRACE_END(name)   th_TraceEvent(TH_TRACE_END, name, 0)
+#define TRACE_COUNTER(name, value) \
+	th_TraceEvent(TH_TRACE_COUNTER, name, value)
+#else
+#define TRACE_BEGIN(name) do {} while (0)
+#define TRACE_END(name)   do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#endif
+
+#endif
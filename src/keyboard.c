@@ -0,0 +1,435 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <myy_keyboard.h>
+#include <myy_evdev.h>
+#include <myy.h>
+
+#include <helpers/file.h>
+#include <helpers/log.h>
+
+#include <linux/input-event-codes.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(MYY_XKBCOMMON)
+#include <xkbcommon/xkbcommon.h>
+
+/* Evdev codes are shifted by 8 in XKB keymaps */
+#define XKB_EVDEV_OFFSET 8
+
+/* myy_key_mod_* bits, in order */
+static char const * const xkb_modifiers_names[] = {
+	XKB_MOD_NAME_SHIFT,
+	XKB_MOD_NAME_CTRL,
+	XKB_MOD_NAME_ALT,
+	XKB_MOD_NAME_LOGO
+};
+#define N_MODIFIERS (sizeof(xkb_modifiers_names) / sizeof(char const *))
+#endif
+
+static struct {
+	unsigned int started;
+#if defined(MYY_XKBCOMMON)
+	struct xkb_context * context;
+	struct xkb_keymap * keymap;
+	struct xkb_state * state;
+	xkb_mod_index_t modifiers_indices[N_MODIFIERS];
+#else
+	/* Tracked from the modifiers keys codes */
+	uint32_t modifiers;
+#endif
+	/* Repetition */
+	int timer_fd;
+	uint64_t delay_us, interval_us;
+	/* The held key repeated. 0 when none. */
+	uint16_t repeat_code;
+	/* When the next repetition is due */
+	uint64_t repeat_us;
+	uint64_t repeats;
+} keyboard = { .timer_fd = -1 };
+
+#if defined(MYY_XKBCOMMON)
+
+/* Where the keymap compiled from `names` is cached.
+ * Returns 0 when no cache directory is known. */
+static unsigned int keymap_cache_path
+(struct xkb_rule_names const * __restrict const names,
+ char * __restrict const path,
+ size_t const path_size)
+{
+	char const * __restrict const values[] = {
+		names->rules, names->model, names->layout,
+		names->variant, names->options
+	};
+	/* FNV-1a of the names, each one terminated */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned int v = 0; v < sizeof(values) / sizeof(char *); v++) {
+		char const * __restrict c = values[v] ? values[v] : "";
+		do {
+			hash ^= (uint8_t) *c;
+			hash *= 0x100000001b3ULL;
+		} while (*c++);
+	}
+
+	char const * __restrict const xdg_cache = getenv("XDG_CACHE_HOME");
+	char const * __restrict const home = getenv("HOME");
+	int written;
+	if (xdg_cache && xdg_cache[0])
+		written = snprintf(path, path_size, "%s/myy-keymap-%016llx.xkb",
+		  xdg_cache, (unsigned long long) hash);
+	else if (home && home[0])
+		written = snprintf(path, path_size, "%s/.cache/myy-keymap-%016llx.xkb",
+		  home, (unsigned long long) hash);
+	else return 0;
+
+	return written > 0 && (size_t) written < path_size;
+}
+
+static struct xkb_keymap * keymap_load_cached
+(char const * __restrict const path)
+{
+	struct xkb_keymap * keymap = NULL;
+	struct myy_fh_map_handle const cached = fh_MapFileToMemory(path);
+
+	if (!cached.ok) return NULL;
+	if (cached.length > 0)
+		keymap = xkb_keymap_new_from_buffer(
+		  keyboard.context, cached.address, cached.length,
+		  XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	fh_UnmapFileFromMemory(cached);
+
+	return keymap;
+}
+
+/* Written to a temporary file first, so that another instance never
+   reads a partial keymap */
+static void keymap_save_cached
+(struct xkb_keymap * __restrict const keymap,
+ char const * __restrict const path)
+{
+	char temporary_path[512];
+	char * __restrict const text =
+		xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (text == NULL) return;
+
+	int written = snprintf(temporary_path, sizeof(temporary_path),
+	  "%s.%d", path, (int) getpid());
+	if (written <= 0 || (size_t) written >= sizeof(temporary_path))
+		goto out;
+
+	int const fd = open(temporary_path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0) {
+		LOG_DEBUG("[Keyboard] Cannot cache the keymap in %s : %s\n",
+		          temporary_path, strerror(errno));
+		goto out;
+	}
+
+	size_t const size = strlen(text);
+	size_t done = 0;
+	while (done < size) {
+		ssize_t const ret = write(fd, text + done, size - done);
+		if (ret < 0 && errno == EINTR) continue;
+		if (ret <= 0) break;
+		done += ret;
+	}
+	close(fd);
+
+	if (done != size || rename(temporary_path, path) < 0)
+		unlink(temporary_path);
+
+out:
+	free(text);
+}
+
+/* Compiling a keymap from its names resolves the rules and reads
+   dozens of files. The result is saved once, and parsed directly on
+   the next starts. */
+static unsigned int keymap_init()
+{
+	char path[384];
+	struct xkb_rule_names const names = {
+		.rules   = getenv("XKB_DEFAULT_RULES"),
+		.model   = getenv("XKB_DEFAULT_MODEL"),
+		.layout  = getenv("XKB_DEFAULT_LAYOUT"),
+		.variant = getenv("XKB_DEFAULT_VARIANT"),
+		.options = getenv("XKB_DEFAULT_OPTIONS")
+	};
+
+	/* The include paths are only needed to compile from the names */
+	keyboard.context = xkb_context_new(
+	  XKB_CONTEXT_NO_DEFAULT_INCLUDES | XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+	if (keyboard.context == NULL) {
+		LOG_WARN("[Keyboard] Could not create the XKB context\n");
+		return 0;
+	}
+
+	unsigned int const cacheable =
+		keymap_cache_path(&names, path, sizeof(path));
+	if (cacheable) {
+		keyboard.keymap = keymap_load_cached(path);
+		if (keyboard.keymap)
+			LOG_DEBUG("[Keyboard] Keymap loaded from %s\n", path);
+	}
+
+	if (keyboard.keymap == NULL) {
+		xkb_context_include_path_append_default(keyboard.context);
+		keyboard.keymap = xkb_keymap_new_from_names(
+		  keyboard.context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+		if (keyboard.keymap == NULL) {
+			LOG_WARN("[Keyboard] Could not compile the keymap\n");
+			return 0;
+		}
+		if (cacheable) keymap_save_cached(keyboard.keymap, path);
+	}
+
+	keyboard.state = xkb_state_new(keyboard.keymap);
+	if (keyboard.state == NULL) return 0;
+
+	for (unsigned int m = 0; m < N_MODIFIERS; m++)
+		keyboard.modifiers_indices[m] = xkb_keymap_mod_get_index(
+		  keyboard.keymap, xkb_modifiers_names[m]);
+
+	return 1;
+}
+
+static void keymap_free()
+{
+	xkb_state_unref(keyboard.state);
+	xkb_keymap_unref(keyboard.keymap);
+	xkb_context_unref(keyboard.context);
+	keyboard.state   = NULL;
+	keyboard.keymap  = NULL;
+	keyboard.context = NULL;
+}
+
+static unsigned int key_repeats(uint16_t const code)
+{
+	return xkb_keymap_key_repeats(keyboard.keymap, code + XKB_EVDEV_OFFSET);
+}
+
+/* The keysym and character are the ones of the key before its own
+   effect on the modifiers */
+static void key_translate
+(struct myy_key_event * __restrict const event,
+ int const pressed)
+{
+	xkb_keycode_t const keycode = event->code + XKB_EVDEV_OFFSET;
+
+	event->keysym = xkb_state_key_get_one_sym(keyboard.state, keycode);
+	event->utf32  = xkb_state_key_get_utf32(keyboard.state, keycode);
+	if (event->state != myy_key_repeated)
+		xkb_state_update_key(
+		  keyboard.state, keycode, pressed ? XKB_KEY_DOWN : XKB_KEY_UP);
+
+	uint32_t modifiers = 0;
+	for (unsigned int m = 0; m < N_MODIFIERS; m++) {
+		xkb_mod_index_t const index = keyboard.modifiers_indices[m];
+		if (index != XKB_MOD_INVALID &&
+		    xkb_state_mod_index_is_active(
+		      keyboard.state, index, XKB_STATE_MODS_EFFECTIVE) > 0)
+			modifiers |= 1 << m;
+	}
+	event->modifiers = modifiers;
+}
+
+#else
+
+static unsigned int keymap_init()
+{
+	LOG_DEBUG("[Keyboard] Built without xkbcommon. Keys are sent "
+	          "without keysyms.\n");
+	keyboard.modifiers = 0;
+	return 1;
+}
+
+static void keymap_free() {}
+
+static uint32_t modifier_of(uint16_t const code)
+{
+	switch (code) {
+	case KEY_LEFTSHIFT: case KEY_RIGHTSHIFT: return myy_key_mod_shift;
+	case KEY_LEFTCTRL:  case KEY_RIGHTCTRL:  return myy_key_mod_ctrl;
+	case KEY_LEFTALT:   case KEY_RIGHTALT:   return myy_key_mod_alt;
+	case KEY_LEFTMETA:  case KEY_RIGHTMETA:  return myy_key_mod_logo;
+	default: return 0;
+	}
+}
+
+static unsigned int key_repeats(uint16_t const code)
+{
+	return modifier_of(code) == 0;
+}
+
+static void key_translate
+(struct myy_key_event * __restrict const event,
+ int const pressed)
+{
+	uint32_t const modifier = modifier_of(event->code);
+
+	if (pressed) keyboard.modifiers |= modifier;
+	else keyboard.modifiers &= ~modifier;
+	event->keysym    = 0;
+	event->utf32     = 0;
+	event->modifiers = keyboard.modifiers;
+}
+
+#endif
+
+static void send_key
+(uint16_t const code,
+ enum myy_key_state const state,
+ uint64_t const time_us)
+{
+	struct myy_key_event event = {
+		.time_us = time_us,
+		.code    = code,
+		.state   = state
+	};
+
+	key_translate(&event, state != myy_key_released);
+
+	struct myy_input_event * __restrict const queued =
+		myy_evdev_queue_event(myy_input_key, code, state, time_us);
+	queued->key.keysym    = event.keysym;
+	queued->key.utf32     = event.utf32;
+	queued->key.modifiers = event.modifiers;
+}
+
+static void repeat_arm(uint16_t const code, uint64_t const time_us)
+{
+	struct itimerspec timer = {0};
+
+	keyboard.repeat_code = code;
+	if (code) {
+		/* Absolute, as the events are timestamped on the same clock */
+		keyboard.repeat_us = time_us + keyboard.delay_us;
+		timer.it_value.tv_sec     = keyboard.repeat_us / 1000000;
+		timer.it_value.tv_nsec    = (keyboard.repeat_us % 1000000) * 1000;
+		timer.it_interval.tv_sec  = keyboard.interval_us / 1000000;
+		timer.it_interval.tv_nsec = (keyboard.interval_us % 1000000) * 1000;
+	}
+	timerfd_settime(keyboard.timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+unsigned int myy_keyboard_init()
+{
+	unsigned int delay_ms = MYY_KEY_REPEAT_DELAY_MS;
+	unsigned int rate     = MYY_KEY_REPEAT_RATE;
+
+	if (keyboard.started) return 1;
+
+	char const * __restrict const repeat = getenv("MYY_KEY_REPEAT");
+	if (repeat != NULL &&
+	    sscanf(repeat, "%u:%u", &delay_ms, &rate) != 2)
+	{
+		LOG_WARN("Invalid MYY_KEY_REPEAT : %s\n", repeat);
+		delay_ms = MYY_KEY_REPEAT_DELAY_MS;
+		rate     = MYY_KEY_REPEAT_RATE;
+	}
+
+	if (!keymap_init()) {
+		keymap_free();
+		return 0;
+	}
+
+	keyboard.timer_fd = -1;
+	if (rate) {
+		keyboard.timer_fd = timerfd_create(
+		  CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if (keyboard.timer_fd < 0)
+			LOG_WARN("[Keyboard] No key repetition : %s\n", strerror(errno));
+	}
+	keyboard.delay_us    = (uint64_t) delay_ms * 1000;
+	keyboard.interval_us = rate ? 1000000 / rate : 0;
+	keyboard.repeat_code = 0;
+	keyboard.repeats     = 0;
+	keyboard.started     = 1;
+
+	return 1;
+}
+
+void myy_keyboard_free()
+{
+	if (!keyboard.started) return;
+
+	if (keyboard.timer_fd >= 0) close(keyboard.timer_fd);
+	keyboard.timer_fd = -1;
+	keymap_free();
+	keyboard.started = 0;
+}
+
+void myy_keyboard_key
+(uint16_t const code,
+ int32_t const value,
+ uint64_t const time_us)
+{
+	/* Repeated by the timer instead, at our own pace */
+	if (!keyboard.started || value == 2) return;
+
+	unsigned int const pressed = (value != 0);
+	send_key(code, pressed ? myy_key_pressed : myy_key_released, time_us);
+
+	if (keyboard.timer_fd < 0) return;
+	if (pressed && key_repeats(code))
+		repeat_arm(code, time_us);
+	else if (!pressed && code == keyboard.repeat_code)
+		repeat_arm(0, 0);
+}
+
+int myy_keyboard_repeat_fd()
+{
+	return keyboard.timer_fd;
+}
+
+unsigned int myy_keyboard_repeat()
+{
+	uint64_t expirations;
+
+	if (keyboard.repeat_code == 0) return 0;
+	if (read(keyboard.timer_fd, &expirations, sizeof(expirations))
+	    != sizeof(expirations))
+		return 0;
+
+	/* Also sends the repetitions missed during a long frame */
+	for (uint64_t e = 0; e < expirations; e++) {
+		send_key(keyboard.repeat_code, myy_key_repeated, keyboard.repeat_us);
+		keyboard.repeat_us += keyboard.interval_us;
+	}
+	keyboard.repeats += expirations;
+
+	return (unsigned int) expirations;
+}
+
+uint64_t myy_keyboard_repeats()
+{
+	return keyboard.repeats;
+}
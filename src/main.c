@@ -37,40 +37,280 @@
 #include <myy.h>
 #include <myy_drm.h>
 #include <myy_evdev.h>
+#include <myy_keyboard.h>
+#include <myy_control.h>
+#include <myy_compositor.h>
 #include <helpers/log.h>
+#include <helpers/arena.h>
+#include <helpers/alloc_counter.h>
+#include <helpers/asset_pack.h>
+#include <helpers/gpu_timer.h>
+#include <helpers/trace.h>
+#include <helpers/texture_streamer.h>
 
 #include <unistd.h>
 
+/* Textures streaming budget, per frame.
+   Keep it well under the frame duration, or vblanks will be missed. */
+#define MYY_TEXTURE_UPLOAD_BYTES_PER_FRAME (2*1024*1024)
+#define MYY_TEXTURE_UPLOAD_NS_PER_FRAME    (3*1000*1000)
+
+/* Generated by myy-pack at build time. Assets not found in the pack
+   are read from the filesystem. */
+#define MYY_ASSET_PACK "assets.pack"
+
+/* Memory for data living only until the next page flip */
+#define MYY_FRAME_ARENA_SIZE (256*1024)
+
+/* Frames after which the render loop must not touch the heap anymore,
+   as long as no texture is being streamed.
+   Only checked when built with MYY_COUNT_ALLOCATIONS. */
+#define MYY_ALLOCATION_WARMUP_FRAMES 120
+
+/* Where the frames timeline is written, when built with MYY_TRACE.
+   MYY_TRACE_FILE overrides it. */
+#define MYY_TRACE_DEFAULT_FILE "myy-trace.json"
+
+/* Where the control socket listens. MYY_CONTROL_SOCKET overrides it. */
+#define MYY_CONTROL_DEFAULT_SOCKET "/tmp/myy-control.sock"
+
+/* Frames without input after which the flip rate is lowered, when the
+   refresh rate is fixed */
+#define MYY_IDLE_FRAMES 30
+/* Longest wait for input while idle. Frames are still shown at this
+   pace, so that control socket commands get applied. */
+#define MYY_IDLE_WAIT_NS (100*1000*1000)
+
+/* Largest cursor image that can be shown by a cursor plane */
+#define MYY_CURSOR_MAX_PIXELS (256*256)
+
+/* When the last page flip was queued */
+static uint64_t flip_queued_at;
+/* When the last page flip was displayed, and the time between two
+   vblanks, in microseconds */
+static uint64_t last_vblank_us, refresh_us;
+
+static void flip_done
+(int * __restrict const waiting_for_flip,
+ uint64_t const vblank_us)
+{
+	*waiting_for_flip = 0;
+	last_vblank_us = vblank_us;
+	TRACE_COUNTER(
+	  "flip latency (us)", (th_TraceNow() - flip_queued_at) / 1000);
+}
+
 static void page_flip_handler
 (int fd, unsigned int frame,
  unsigned int sec, unsigned int usec,
  void * data)
 {
-	int *waiting_for_flip = data;
-	*waiting_for_flip = 0;
+	flip_done(data, (uint64_t) sec * 1000000 + usec);
+}
+
+/* When the frame drawn now should be scanned out : at the next vblank,
+ * or the one after if the previous frame is still waiting for it. */
+static uint64_t expected_scanout_us
+(uint64_t const now_us,
+ int const waiting_for_flip)
+{
+	uint64_t const queued = waiting_for_flip ? refresh_us : 0;
+
+	if (last_vblank_us == 0 || now_us < last_vblank_us)
+		return now_us + refresh_us + queued;
+
+	uint64_t const next_vblank = last_vblank_us +
+		refresh_us * ((now_us - last_vblank_us) / refresh_us + 1);
+	return next_vblank + queued;
+}
+
+/* Show fb_id at the next vblank, or immediately without vsync.
+ * With atomic modesetting, the display waits for gpu_fence_fd, and
+ * kms_fence_fd receives a fence signaled once the flip is done.
+ * When the driver cannot provide this fence, a page flip event is sent
+ * instead, like with the legacy API.
+ * The compositor layers are shown in the same commit. */
+static int queue_flip
+(struct drm_infos * __restrict const drm,
+ uint32_t const fb_id,
+ unsigned int const vsync,
+ int const gpu_fence_fd,
+ int * __restrict const kms_fence_fd,
+ int * __restrict const waiting_for_flip)
+{
+	uint32_t const async = vsync ? 0 : DRM_MODE_PAGE_FLIP_ASYNC;
+
+	if (drm->atomic) {
+		uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK | async;
+		if (!drm->crtc_props.out_fence_ptr) flags |= DRM_MODE_PAGE_FLIP_EVENT;
+
+		drmModeAtomicReq * __restrict const request =
+			drm_atomic_request(drm, fb_id, gpu_fence_fd, kms_fence_fd);
+		if (request == NULL) return -1;
+		myy_compositor_add_planes(request, drm);
+
+		int const ret = drm_atomic_request_commit(
+		  drm, request, flags, waiting_for_flip);
+		if (ret == 0) myy_compositor_committed();
+		return ret;
+	}
+
+	return drmModePageFlip(
+	  drm->fd, drm->crtc_id, fb_id,
+	  DRM_MODE_PAGE_FLIP_EVENT | async, waiting_for_flip);
+}
+
+/* The mice, touchscreens and keyboards */
+static struct myy_evdev_data input_devices[MYY_INPUT_MAX_DEVICES];
+static unsigned int n_input_devices;
+
+static void read_input()
+{
+	TRACE_BEGIN("myy_evdev_read_input");
+	for (unsigned int d = 0; d < n_input_devices; d++)
+		myy_evdev_read_input(input_devices + d);
+	myy_keyboard_repeat();
+	TRACE_END("myy_evdev_read_input");
+}
+
+/* Add the input devices, and the keys repetition timer, to `fds`.
+ * Returns the highest descriptor. */
+static int input_fds(fd_set * __restrict const fds)
+{
+	int max_fd = myy_keyboard_repeat_fd();
+	if (max_fd >= 0) FD_SET(max_fd, fds);
+	else max_fd = 0;
+
+	for (unsigned int d = 0; d < n_input_devices; d++) {
+		int const fd = input_devices[d].fd;
+		FD_SET(fd, fds);
+		if (fd > max_fd) max_fd = fd;
+	}
+	return max_fd;
+}
+
+/* Events read, resyncs and reports dropped, on every device */
+static void input_counts
+(uint64_t * __restrict const events,
+ uint64_t * __restrict const resyncs,
+ uint64_t * __restrict const dropped_reports)
+{
+	*events = *resyncs = *dropped_reports = 0;
+	for (unsigned int d = 0; d < n_input_devices; d++) {
+		*events  += input_devices[d].events;
+		*resyncs += input_devices[d].resyncs;
+		*dropped_reports += input_devices[d].dropped_reports;
+	}
+}
+
+static uint64_t input_activity()
+{
+	uint64_t events, resyncs, dropped_reports;
+	input_counts(&events, &resyncs, &dropped_reports);
+	return events + resyncs + myy_keyboard_repeats();
+}
+
+/* Read input until `fd` becomes readable.
+ * Returns 0 once it is, 1 if the user interrupted the program and -1
+ * on errors. */
+static int read_input_until_readable(int const fd)
+{
+	fd_set fds;
+
+	while (1) {
+		read_input();
+
+		/* select() only leaves the ready descriptors in the set */
+		FD_ZERO(&fds);
+		FD_SET(0, &fds);
+		FD_SET(fd, &fds);
+		int const max_input_fd = input_fds(&fds);
+
+		TRACE_BEGIN("select");
+		int const ret = select(
+		  (fd > max_input_fd ? fd : max_input_fd) + 1,
+		  &fds, NULL, NULL, NULL);
+		TRACE_END("select");
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			LOG("select err: %s\n", strerror(errno));
+			return -1;
+		}
+		if (FD_ISSET(0, &fds)) {
+			LOG("user interrupted!\n");
+			return 1;
+		}
+		if (FD_ISSET(fd, &fds)) return 0;
+	}
+}
+
+/* Read input until some arrives, or for timeout_ns at most.
+ * Returns 0 then, 1 if the user interrupted the program and -1 on
+ * errors. */
+static int wait_for_input(uint64_t const timeout_ns)
+{
+	fd_set fds;
+	struct timeval timeout = {
+		.tv_sec  = timeout_ns / 1000000000,
+		.tv_usec = (timeout_ns % 1000000000) / 1000
+	};
+
+	FD_ZERO(&fds);
+	FD_SET(0, &fds);
+	int const max_fd = input_fds(&fds);
+
+	int const ret = select(max_fd + 1, &fds, NULL, NULL, &timeout);
+	if (ret < 0) {
+		if (errno == EINTR) return 0;
+		LOG("select err: %s\n", strerror(errno));
+		return -1;
+	}
+	if (FD_ISSET(0, &fds)) {
+		LOG("user interrupted!\n");
+		return 1;
+	}
+	if (ret > 0) read_input();
+	return 0;
 }
 
 int old_drm() {
 	struct egl_infos egl;
 	struct gbm_infos gbm;
-	struct drm_infos drm;
-	fd_set fds;
+	struct drm_infos drm = {0};
 	drmEventContext evctx = {
 	  .version = DRM_EVENT_CONTEXT_VERSION,
 	  .page_flip_handler = page_flip_handler,
 	};
 	struct gbm_bo *bo;
+	/* Queued for display, but not displayed yet */
+	struct gbm_bo *pending_bo = NULL;
+	/* The cursor, when shown by a display plane */
+	struct myy_layer *cursor_layer = NULL;
 	struct drm_fb *fb;
+	int waiting_for_flip = 0;
+	/* Signaled once the queued atomic commit is displayed */
+	int kms_fence_fd = -1;
 	uint32_t i = 0;
 	int ret;
+	/* Changed through the control socket */
+	unsigned int vsync = 1;
+	/* Input events counted when the last frame was started */
+	uint64_t input_seen = 0;
+	/* Frames started without new input */
+	unsigned int idle_frames = 0;
+#if defined(MYY_COUNT_ALLOCATIONS)
+	uint64_t frames = 0, frames_checked = 0, frames_allocating = 0;
+	struct ah_allocation_counts frame_start = ah_ThreadAllocationCounts();
+#endif
 
 	/* Prepare to read input from Evdev */
-	struct myy_evdev_data evdev_data;
-	ret = myy_init_input_devices(&evdev_data, 1);
-	if (!ret) {
+	n_input_devices =
+		myy_init_input_devices(input_devices, MYY_INPUT_MAX_DEVICES);
+	if (!n_input_devices) {
 		LOG("Meow ? Where's the mouse ?\n"
-		    "Mouse input device not found.\n"
+		    "No mouse, touchscreen or keyboard found.\n"
 		    "Check that a mouse is plugged and you have sufficent privileges\n");
+		ret = 0;
 		goto no_mouse;
 	}
 
@@ -81,9 +321,11 @@ int old_drm() {
 		goto program_end;
 	}
 
-	FD_ZERO(&fds);
-	FD_SET(0, &fds);
-	FD_SET(drm.fd, &fds);
+	/* Prefer atomic modesetting, with explicit fences */
+	init_drm_atomic(&drm);
+	/* Refresh the display when frames are ready, rather than the
+	   opposite */
+	drm_init_vrr(&drm);
 
 	/* Generate a Generic Buffer */
 	ret = init_gbm(&drm, &gbm);
@@ -99,23 +341,93 @@ int old_drm() {
 		goto program_end;
 	}
 
+	/* Measure the GPU time of myy_draw passes */
+	glhGpuTimerStart(egl.display);
+
+	if (!ah_FrameArenaInit(MYY_FRAME_ARENA_SIZE)) {
+		ret = -1;
+		goto program_end;
+	}
+
+	/* Serve shaders and textures from a single mapping */
+	if (!fh_OpenAssetPack(MYY_ASSET_PACK))
+		LOG("No asset pack. Loading assets from the filesystem.\n");
+
+	/* Load textures in the background from now on */
+	glhTextureStreamerStart(egl.display, egl.config, egl.context);
+
 	/* clear the color buffer */
 	glClearColor(0.5, 0.5, 0.5, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 	eglSwapBuffers(egl.display, egl.surface);
 	bo = gbm_surface_lock_front_buffer(gbm.surface);
 	fb = drm_fb_get_from_bo(bo, &drm);
+	if (fb == NULL) {
+		LOG("No framebuffer for the first frame\n");
+		if (bo) gbm_surface_release_buffer(gbm.surface, bo);
+		ret = -1;
+		goto program_end;
+	}
 
 	/* Save the current CRTC configuration */
 	drmModeCrtcPtr prev_crtc = drmModeGetCrtc(drm.fd, drm.crtc_id);
 	/* set mode: */
-	ret = drmModeSetCrtc(drm.fd, drm.crtc_id, fb->fb_id, 0, 0,
-	    &drm.connector_id, 1, drm.mode);
+	if (drm.atomic) {
+		ret = drm_atomic_commit(&drm, fb->fb_id, -1, NULL, 0, NULL);
+		if (ret && drm.vrr) {
+			LOG_WARN("Could not enable the variable refresh rate : %s\n",
+			         strerror(errno));
+			drm.vrr = 0;
+			ret = drm_atomic_commit(&drm, fb->fb_id, -1, NULL, 0, NULL);
+		}
+	}
+	else
+		ret = drmModeSetCrtc(drm.fd, drm.crtc_id, fb->fb_id, 0, 0,
+		    &drm.connector_id, 1, drm.mode);
 	if (ret) {
 		LOG("failed to set mode: %s\n", strerror(errno));
 		goto program_end;
 	}
 
+	/* Show the cursor with a cursor or overlay plane, so that moving it
+	   does not require drawing a new frame */
+	if (myy_compositor_init(&drm)) {
+		uint32_t cursor_width, cursor_height;
+		myy_compositor_cursor_size(&drm, &cursor_width, &cursor_height);
+
+		uint32_t * __restrict const pixels = (cursor_width * cursor_height
+		  <= MYY_CURSOR_MAX_PIXELS)
+		  ? malloc(cursor_width * cursor_height * sizeof(uint32_t))
+		  : NULL;
+		if (pixels && myy_cursor_image(pixels, cursor_width, cursor_height))
+			cursor_layer = myy_compositor_add_layer(
+			  &drm, gbm.dev, pixels, cursor_width, cursor_height);
+		free(pixels);
+
+		if (cursor_layer) {
+			int cursor_x, cursor_y;
+			myy_cursor_position(&cursor_x, &cursor_y);
+			myy_compositor_move_layer(cursor_layer, cursor_x, cursor_y);
+			myy_compositor_assign(&drm, fb->fb_id);
+		}
+	}
+
+	/* Touchscreens cover the whole screen */
+	myy_evdev_set_screen_size(
+	  input_devices, n_input_devices,
+	  drm.mode->hdisplay, drm.mode->vdisplay);
+
+	/* Used to predict when the frames will be seen */
+	refresh_us = (uint64_t) drm.mode->htotal * drm.mode->vtotal * 1000
+		/ (drm.mode->clock ? drm.mode->clock : 1);
+	if (refresh_us == 0) refresh_us = 16667;
+
+	/* Inspect and control the program while it runs */
+	myy_control_start(MYY_CONTROL_DEFAULT_SOCKET);
+	myy_control_set_mode(
+	  drm.mode->name, drm.mode->hdisplay, drm.mode->vdisplay,
+	  drm.mode->vrefresh);
+
 	/* Initialise our 'engine' */
 	myy_generate_new_state();
 	myy_init_drawing();
@@ -123,69 +435,237 @@ int old_drm() {
 	  gbm_bo_get_width(bo),
 	  gbm_bo_get_height(bo)
 	);
+	myy_set_hardware_cursor(cursor_layer && cursor_layer->plane_id);
 
 	while (1) {
 		struct gbm_bo *next_bo;
-		int waiting_for_flip = 1;
+		struct myy_control_command command;
+		unsigned int active = 0;
 
-		/* Draw ! */
-		myy_draw();
+		/* Apply the commands received through the control socket */
+		while (myy_control_next_command(&command)) {
+			active = 1;
+			switch (command.type) {
+			case MYY_CONTROL_SET_VSYNC:
+				vsync = command.value;
+				break;
+			case MYY_CONTROL_SET_PREDICTION:
+				myy_evdev_set_prediction(command.value);
+				break;
+			case MYY_CONTROL_REPLAY_INPUT:
+				myy_evdev_replay_start(
+				  command.data,
+				  command.size / sizeof(struct input_event),
+				  th_TraceNow() / 1000);
+				break;
+			}
+		}
+		myy_evdev_replay(input_devices, th_TraceNow() / 1000);
 
-		/* Show ! */
-		eglSwapBuffers(egl.display, egl.surface);
+		/* Nothing changes on screen without input. With a variable
+		   refresh rate, the display waits for the next commit anyway, so
+		   the next frame is only drawn, and shown at once, when input
+		   arrives. With a fixed refresh rate, the frames keep coming at
+		   the display pace for a while, then at MYY_IDLE_WAIT_NS
+		   intervals until input arrives. */
+		uint64_t const input = input_activity();
+		if (input != input_seen || active || myy_evdev_replaying() ||
+		    glhTextureStreamerPending())
+			idle_frames = 0;
+		else if (++idle_frames > (drm.vrr ? 0 : MYY_IDLE_FRAMES)) {
+			TRACE_BEGIN("wait_for_input");
+			ret = wait_for_input(MYY_IDLE_WAIT_NS);
+			TRACE_END("wait_for_input");
+			if (ret > 0) goto stop;
+			if (ret) goto program_end;
+		}
+		/* Including the input read while waiting, shown by this frame */
+		input_seen = input_activity();
+		TRACE_BEGIN("myy_evdev_flush_events");
+		myy_evdev_flush_events();
+		TRACE_END("myy_evdev_flush_events");
 
-		/* Wait until the next VBlank */
-		next_bo = gbm_surface_lock_front_buffer(gbm.surface);
-		fb = drm_fb_get_from_bo(next_bo, &drm);
+		/* Make the textures loaded in the background available */
+		TRACE_BEGIN("glhTextureStreamerUpload");
+		glhTextureStreamerUpload(
+		  MYY_TEXTURE_UPLOAD_BYTES_PER_FRAME,
+		  MYY_TEXTURE_UPLOAD_NS_PER_FRAME
+		);
+		TRACE_END("glhTextureStreamerUpload");
 
-		/*
-		 * Here you could also update drm plane layers if you want
-		 * hw composition
-		 */
+		/* Show the cursor where it should be when this frame is seen */
+		int cursor_x, cursor_y;
+		uint64_t const now_us = th_TraceNow() / 1000;
+		myy_evdev_predict_cursor(
+		  now_us, expected_scanout_us(now_us, waiting_for_flip),
+		  &cursor_x, &cursor_y);
+		myy_show_cursor_at(cursor_x, cursor_y);
 
-		ret = drmModePageFlip(
-		  drm.fd, drm.crtc_id, fb->fb_id,
-		  DRM_MODE_PAGE_FLIP_EVENT, &waiting_for_flip
-		);
-		if (ret) {
-			LOG("failed to queue page flip: %s\n", strerror(errno));
-			ret = -1;
-			goto program_end;
+		if (cursor_layer) {
+			myy_shown_cursor_position(&cursor_x, &cursor_y);
+			myy_compositor_move_layer(cursor_layer, cursor_x, cursor_y);
 		}
 
-		while (waiting_for_flip) {
+		/* When only the layers shown by planes changed, the last frame
+		   is shown again with the layers at their new positions */
+		next_bo = NULL;
+		int gpu_fence_fd = -1;
+		if (myy_needs_redraw()) {
+			/* Draw ! */
+			glhGpuTimerFrameBegin();
+			TRACE_BEGIN("myy_draw");
+			myy_draw();
+			TRACE_END("myy_draw");
 
-			/* Read input when waiting for Vblank
-			 * Given that waiting_for_flip is set to 1 before entering this
-			 * loop, this could be rewritten like this :
-			 *   do { ... } while (waiting_for_flip)
-			*/
-			myy_evdev_read_input(&evdev_data);
-			ret = select(drm.fd + 1, &fds, NULL, NULL, NULL);
-			if (ret < 0) {
-				LOG("select err: %s\n", strerror(errno));
-				goto program_end;
-			} else if (ret == 0) {
-				LOG("select timeout!\n");
+			/* Show ! */
+			EGLSyncKHR const gpu_fence =
+				drm.atomic ? egl_native_fence_insert(&egl) : EGL_NO_SYNC_KHR;
+			TRACE_BEGIN("eglSwapBuffers");
+			eglSwapBuffers(egl.display, egl.surface);
+			TRACE_END("eglSwapBuffers");
+			/* Signaled when the GPU is done with this frame */
+			gpu_fence_fd = egl_native_fence_export(&egl, gpu_fence);
+
+			TRACE_BEGIN("gbm_surface_lock_front_buffer");
+			next_bo = gbm_surface_lock_front_buffer(gbm.surface);
+			fb = drm_fb_get_from_bo(next_bo, &drm);
+			TRACE_END("gbm_surface_lock_front_buffer");
+			if (fb == NULL) {
+				LOG("No framebuffer for the new frame\n");
+				if (next_bo) gbm_surface_release_buffer(gbm.surface, next_bo);
+				if (gpu_fence_fd >= 0) close(gpu_fence_fd);
 				ret = -1;
 				goto program_end;
-			} else if (FD_ISSET(0, &fds)) {
-				LOG("user interrupted!\n");
-				break;
 			}
 
-			/* THIS is the the part that might set waiting_for_flip to 0 */
-			/* Now, it might be better to draw directly from inside the
-			 * handler, instead of polling here... */
-			drmHandleEvent(drm.fd, &evctx);
+			/* The kernel only keeps a few milliseconds of events from
+			   high rate mice (64 events for most mice, 2.7 ms at 8 kHz),
+			   and its buffers cannot be enlarged. Read them as soon as the
+			   GPU lets us, rather than after the next flip. */
+			read_input();
+		}
+
+		/* This frame was drawn while the previous one was waiting for
+		 * the vblank. Wait until the previous one is displayed before
+		 * queuing this one. */
+		while (waiting_for_flip) {
+			int const flip_fd = (kms_fence_fd >= 0) ? kms_fence_fd : drm.fd;
+			ret = read_input_until_readable(flip_fd);
+			if (ret) {
+				if (gpu_fence_fd >= 0) close(gpu_fence_fd);
+				if (ret > 0) goto stop;
+				goto program_end;
+			}
+
+			if (kms_fence_fd >= 0) {
+				close(kms_fence_fd);
+				kms_fence_fd = -1;
+				/* Signaled at the vblank */
+				flip_done(&waiting_for_flip, th_TraceNow() / 1000);
+			}
+			else {
+				TRACE_BEGIN("drmHandleEvent");
+				drmHandleEvent(drm.fd, &evctx);
+				TRACE_END("drmHandleEvent");
+			}
 		}
 
-		/* Prepare for the next draw */
-		/* release last buffer to render on again: */
-		gbm_surface_release_buffer(gbm.surface, bo);
-		bo = next_bo;
+		/* The buffer replaced by the previous flip can be drawn on again */
+		if (pending_bo) {
+			gbm_surface_release_buffer(gbm.surface, bo);
+			bo = pending_bo;
+			pending_bo = NULL;
+		}
+
+		TRACE_BEGIN("queue_flip");
+		flip_queued_at = th_TraceNow();
+		ret = queue_flip(
+		  &drm, fb->fb_id, vsync, gpu_fence_fd, &kms_fence_fd,
+		  &waiting_for_flip);
+		if (ret && !vsync) {
+			LOG_WARN("Immediate page flips unsupported. "
+			         "Waiting for the vertical blank.\n");
+			vsync = 1;
+			ret = queue_flip(
+			  &drm, fb->fb_id, vsync, gpu_fence_fd, &kms_fence_fd,
+			  &waiting_for_flip);
+		}
+		if (ret && cursor_layer && cursor_layer->plane_id) {
+			/* Draw the cursor with GL from now on */
+			LOG_WARN("Could not show the cursor plane : %s\n",
+			         strerror(errno));
+			myy_compositor_drop_planes();
+			myy_set_hardware_cursor(0);
+			ret = queue_flip(
+			  &drm, fb->fb_id, vsync, gpu_fence_fd, &kms_fence_fd,
+			  &waiting_for_flip);
+		}
+		TRACE_END("queue_flip");
+		/* The kernel keeps its own reference */
+		if (gpu_fence_fd >= 0) close(gpu_fence_fd);
+		if (ret) {
+			LOG("failed to queue page flip: %s\n", strerror(errno));
+			ret = -1;
+			goto program_end;
+		}
+		waiting_for_flip = 1;
+		pending_bo = next_bo;
+
+		ah_FrameArenaReset();
+		th_TraceExportIfRequested();
+
+		/* The statistics of this frame, dropped at the next flip */
+		struct glh_gpu_timer_results * __restrict const gpu_times =
+			ah_FrameAlloc(sizeof(*gpu_times));
+		struct myy_control_frame * __restrict const frame =
+			ah_FrameAlloc(sizeof(*frame));
+		if (gpu_times != NULL && frame != NULL) {
+			uint64_t input_events, input_resyncs, input_dropped_reports;
+			struct drm_fb_stats fb_stats;
+			input_counts(&input_events, &input_resyncs, &input_dropped_reports);
+			drm_fb_get_stats(&fb_stats);
+			glhGpuTimerResults(gpu_times);
+			*frame = (struct myy_control_frame) {
+				.time_ns       = th_TraceNow(),
+				.input_events  = input_events,
+				.input_resyncs = input_resyncs,
+				.input_dropped_reports = input_dropped_reports,
+				.fb_hits       = fb_stats.hits,
+				.fb_misses     = fb_stats.misses,
+				.fb_in_use     = fb_stats.in_use,
+				.fb_capacity   = fb_stats.capacity,
+				.vsync         = vsync,
+				.vrr           = drm.vrr,
+				.prediction    = myy_evdev_prediction(),
+				.gpu_ns        = gpu_times->total_ns
+			};
+			myy_control_publish_frame(frame);
+		}
+
+#if defined(MYY_COUNT_ALLOCATIONS)
+		struct ah_allocation_counts const frame_end =
+			ah_ThreadAllocationCounts();
+		if (++frames > MYY_ALLOCATION_WARMUP_FRAMES &&
+		    glhTextureStreamerPending() == 0)
+		{
+			uint64_t const allocations =
+				frame_end.allocations - frame_start.allocations;
+			uint64_t const frees = frame_end.frees - frame_start.frees;
+			frames_checked++;
+			if (allocations || frees) {
+				frames_allocating++;
+				fprintf(stderr,
+				  "[Allocations] Frame %llu : %llu allocations, %llu frees\n",
+				  (unsigned long long) frames,
+				  (unsigned long long) allocations,
+				  (unsigned long long) frees);
+			}
+		}
+		frame_start = frame_end;
+#endif
 	}
 
+stop:
 	/* Try to restore the previous CRTC */
 	drmModeSetCrtc(
 	  drm.fd, prev_crtc->crtc_id, prev_crtc->buffer_id,
@@ -194,7 +674,21 @@ int old_drm() {
 	);
 
 program_end:
-	myy_free_input_devices(&evdev_data, 1);
+	if (kms_fence_fd >= 0) close(kms_fence_fd);
+	myy_compositor_free();
+	free_drm_atomic(&drm);
+#if defined(MYY_COUNT_ALLOCATIONS)
+	fprintf(stderr,
+	  "[Allocations] %llu frames checked, %llu with heap allocations\n",
+	  (unsigned long long) frames_checked,
+	  (unsigned long long) frames_allocating);
+#endif
+	myy_control_stop();
+	glhGpuTimerStop();
+	glhTextureStreamerStop();
+	fh_CloseAssetPack();
+	ah_FrameArenaFree();
+	myy_free_input_devices(input_devices, n_input_devices);
 no_mouse:
 	return ret;
 }
@@ -211,5 +705,8 @@ no_mouse:
  */
 int main(int argc, char *argv[])
 {
+	lh_LogSetLevelFromEnvironment();
+	th_TraceStart(MYY_TRACE_DEFAULT_FILE);
+	th_TraceThreadName("render");
 	return old_drm();
 }
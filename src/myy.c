@@ -22,36 +22,93 @@
 */
 
 #include <helpers/gl_loaders.h>
+#include <helpers/texture_streamer.h>
+#include <helpers/gpu_timer.h>
+#include <helpers/file.h>
 #include <helpers/log.h>
+#include <helpers/pointer.h>
+#include <helpers/sprite_batch.h>
 #include <myy.h>
 
+#include <linux/input-event-codes.h>
+
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 // ------ GLSL Data
 enum glsl_programs { glsl_cursor_program, n_glsl_programs };
-enum glsl_textures { glsl_cursor_texture, n_glsl_textures };
-enum glsl_buffers  { glsl_cursor_buffer,  n_glsl_buffers  };
-enum glsl_cursor_program_attribs { glsl_cursor_attr_xyst };
+enum glsl_textures {
+	glsl_cursor_texture,
+	glsl_labels_texture,
+	n_glsl_textures
+};
+enum glsl_cursor_program_attribs {
+	glsl_cursor_attr_xyst,
+	glsl_cursor_attr_sprite
+};
 GLuint glsl_programs[n_glsl_programs] = {0};
 GLuint glsl_textures[n_glsl_textures] = {0};
-GLuint glsl_buffers[n_glsl_buffers]   = {0};
 
 enum glsl_cursor_program_uniforms { 
 	glsl_cursor_unif_tex,
+	glsl_cursor_unif_labels,
 	glsl_cursor_unif_norm,
-	glsl_cursor_unif_position,
+	glsl_cursor_unif_labels_cells,
 	n_glsl_cursor_uniforms
 };
 GLuint glsl_cursor_uniforms[n_glsl_cursor_uniforms] = {0};
 
+/* Every pointer and its label, drawn at once */
+static struct glh_sprite_batch cursors_batch;
+
 // ------ Cursor variables
-static struct mouse_cursor_position {	int x, y; } cursor = {200, 200};
+/* Every pointer on screen. The pointer 0 is the cursor, the others are
+   drawn with the same image. See myy_input_motion. */
+#define MYY_MAX_POINTERS 64
+static struct ph_pointers pointers;
+static _Alignas(32) uint8_t pointers_arrays[PH_POINTERS_SIZE(MYY_MAX_POINTERS)];
+/* Where the cursor is drawn. Ahead of the cursor with prediction. */
+static struct mouse_cursor_position {	int x, y; } shown_cursor = {200, 200};
+/* The pointers and their labels, written before each draw */
+static struct glh_sprite cursors_sprites[MYY_MAX_POINTERS * 2];
+/* When the cursor is shown by a display plane, it's not drawn here */
+static unsigned int hardware_cursor = 0;
+/* The screen content, besides the cursor, has to be drawn again */
+static unsigned int redraw = 1;
 
 struct screen_props { unsigned int width, height; }
 	screen_size = { 1920, 1080 };
+/* The last pixel is the last position reached */
+static struct ph_pointers_bounds screen_bounds = { 0, 0, 1919, 1079 };
 
 // ----- Code
 
+/* The store is created with the cursor, when first used, as input can
+   be read before the display is initialised */
+static struct ph_pointers * __restrict pointers_store()
+{
+	if (pointers.capacity == 0) {
+		ph_PointersInit(&pointers, MYY_MAX_POINTERS, pointers_arrays);
+		ph_PointersAdd(&pointers, 0, &screen_bounds, 200, 200);
+	}
+	return &pointers;
+}
+
+/* The index of the pointer `id`, added at the cursor position when
+   first seen. The cursor when the store is full. */
+static unsigned int pointer_index(unsigned int const id)
+{
+	struct ph_pointers * __restrict const store = pointers_store();
+	if (id < store->n && store->device[id] == id) return id;
+
+	int index = ph_PointersFind(store, id);
+	if (index < 0)
+		index = ph_PointersAdd(store, id, &screen_bounds, store->x[0], store->y[0]);
+	if (index < 0) index = 0;
+	return index;
+}
+
 void myy_generate_new_state() {}
 
 void myy_display_initialised
@@ -66,6 +123,13 @@ void myy_display_initialised
 		recenter_width  = -1,
 		recenter_height = -1;
 
+	screen_size.width  = width;
+	screen_size.height = height;
+	screen_bounds.max_x = width  ? width  - 1 : 0;
+	screen_bounds.max_y = height ? height - 1 : 0;
+	struct ph_pointers * __restrict const store = pointers_store();
+	ph_PointersSetBounds(store, 0, store->n, &screen_bounds);
+
 	/* This expects that the cursor program has been linked prior to this
 	   call ! */
 	GLuint cursor_program = glsl_programs[glsl_cursor_program];
@@ -76,13 +140,197 @@ void myy_display_initialised
 		inv_half_width, inv_half_height,
 		recenter_width, recenter_height
 	);
+
+	redraw = 1;
+}
+
+void myy_set_hardware_cursor(unsigned int const enabled) {
+	/* The software cursor has to be drawn or erased */
+	if (hardware_cursor != enabled) redraw = 1;
+	hardware_cursor = enabled;
+}
+
+unsigned int myy_needs_redraw() { return redraw || !hardware_cursor; }
+
+void myy_cursor_position(int * __restrict const x, int * __restrict const y)
+{
+	struct ph_pointers const * __restrict const store = pointers_store();
+	*x = store->x[0];
+	*y = store->y[0];
+}
+
+void myy_shown_cursor_position
+(int * __restrict const x, int * __restrict const y)
+{
+	*x = shown_cursor.x;
+	*y = shown_cursor.y;
+}
+
+static int clamp(int const value, int const min, int const max)
+{
+	return (value < min) ? min : (value < max ? value : max);
+}
+
+void myy_show_cursor_at(int const x, int const y)
+{
+	shown_cursor.x = clamp(x, screen_bounds.min_x, screen_bounds.max_x);
+	shown_cursor.y = clamp(y, screen_bounds.min_y, screen_bounds.max_y);
+}
+
+/* Convert a texture pixel to a premultiplied ARGB8888 pixel */
+static uint32_t premultiplied_argb
+(unsigned int const r, unsigned int const g, unsigned int const b,
+ unsigned int const a)
+{
+	return
+		(a << 24) |
+		((r * a / 255) << 16) |
+		((g * a / 255) << 8) |
+		(b * a / 255);
+}
+
+unsigned int myy_cursor_image
+(uint32_t * __restrict const pixels,
+ unsigned int const width,
+ unsigned int const height)
+{
+	struct myy_fh_map_handle const mapped =
+		fh_MapFileToMemory("textures/cursor.raw");
+	struct glh_raw_texture tex;
+	unsigned int converted = 0;
+
+	memset(pixels, 0, width * height * sizeof(uint32_t));
+
+	if (!mapped.ok ||
+	    !glhParseMyyRawTexture(mapped.address, mapped.length, &tex) ||
+	    tex.compressed || tex.format != GL_RGBA ||
+	    (tex.type != GL_UNSIGNED_BYTE &&
+	     tex.type != GL_UNSIGNED_SHORT_4_4_4_4))
+	{
+		LOG("The cursor texture cannot be shown by a display plane\n");
+		goto out;
+	}
+
+	struct glh_texture_level const * __restrict const level = tex.levels;
+	uint32_t const row_size = glhRawTextureRowSize(&tex, 0);
+	unsigned int const copied_width =
+		level->width < width ? level->width : width;
+	unsigned int const copied_height =
+		level->height < height ? level->height : height;
+
+	/* Textures rows go from the bottom to the top. Display planes read
+	   them from the top to the bottom. */
+	for (unsigned int y = 0; y < copied_height; y++) {
+		uint8_t const * __restrict const row =
+			(uint8_t const *) level->data +
+			(level->height - 1 - y) * row_size;
+		uint32_t * __restrict const out = pixels + y * width;
+
+		for (unsigned int x = 0; x < copied_width; x++) {
+			if (tex.type == GL_UNSIGNED_BYTE) {
+				uint8_t const * __restrict const rgba = row + x * 4;
+				out[x] = premultiplied_argb(rgba[0], rgba[1], rgba[2], rgba[3]);
+			}
+			else {
+				uint16_t rgba;
+				memcpy(&rgba, row + x * 2, sizeof(rgba));
+				/* 4 bits to 8 bits : 0xf becomes 0xff */
+				out[x] = premultiplied_argb(
+				  (rgba >> 12) * 17, ((rgba >> 8) & 0xf) * 17,
+				  ((rgba >> 4) & 0xf) * 17, (rgba & 0xf) * 17);
+			}
+		}
+	}
+	converted = 1;
+
+out:
+	fh_UnmapFileFromMemory(mapped);
+	return converted;
+}
+
+/* Labels : the pointer number, in white, on a coloured badge.
+   Each label is a cell of the labels atlas, as large as the cursor. */
+#define LABEL_SIZE 24
+#define LABELS_PER_ROW 8
+#define LABELS_ATLAS_SIZE (LABEL_SIZE * LABELS_PER_ROW)
+/* Below and right of the cursor tip */
+#define LABEL_OFFSET 14
+#define LABEL_HEIGHT 12
+#define DIGIT_SCALE 2
+
+/* 3x5 pixels digits, from the top row to the bottom one, 3 bits per
+   row, the leftmost pixel being the most significant bit */
+static uint16_t const digits_glyphs[10] = {
+	075557, 026227, 071747, 071717, 055711,
+	074717, 074757, 071111, 075757, 075717
+};
+
+/* ABGR, as stored little-endian RGBA */
+static uint32_t const labels_colors[8] = {
+	0xd03030e0, 0xd030a030, 0xd0e06030, 0xd0a030a0,
+	0xd000a0d0, 0xd03090e0, 0xd0a0a030, 0xd0606060
+};
+
+static void draw_label
+(uint32_t * __restrict const atlas,
+ unsigned int const number)
+{
+	unsigned int const left = (number % LABELS_PER_ROW) * LABEL_SIZE;
+	unsigned int const bottom = (number / LABELS_PER_ROW) * LABEL_SIZE;
+	unsigned int const n_digits = (number >= 10) ? 2 : 1;
+	unsigned int const text_width = n_digits * 4 * DIGIT_SCALE - DIGIT_SCALE;
+	unsigned int const text_left = (LABEL_SIZE - text_width) / 2;
+	uint32_t const color = labels_colors[number % 8];
+
+	/* The texture rows go from the bottom to the top : the label uses
+	   the top rows of its cell, y counting from the top */
+	for (unsigned int y = 0; y < LABEL_HEIGHT; y++) {
+		uint32_t * __restrict const row =
+			atlas + (bottom + LABEL_SIZE - 1 - y) * LABELS_ATLAS_SIZE + left;
+		for (unsigned int x = 0; x < LABEL_SIZE; x++) row[x] = color;
+
+		unsigned int const glyph_y = (y - 1) / DIGIT_SCALE;
+		if (y == 0 || glyph_y >= 5) continue;
+		for (unsigned int d = 0; d < n_digits; d++) {
+			unsigned int const digit =
+				(n_digits == 2 && d == 0) ? number / 10 : number % 10;
+			unsigned int const bits =
+				(digits_glyphs[digit] >> ((4 - glyph_y) * 3)) & 7;
+			for (unsigned int x = 0; x < 3 * DIGIT_SCALE; x++)
+				if (bits & (4 >> (x / DIGIT_SCALE)))
+					row[text_left + d * 4 * DIGIT_SCALE + x] = 0xffffffff;
+		}
+	}
+}
+
+static void init_labels_texture()
+{
+	uint32_t * __restrict const atlas =
+		calloc(LABELS_ATLAS_SIZE * LABELS_ATLAS_SIZE, sizeof(uint32_t));
+	if (atlas == NULL) {
+		LOG("Not enough memory for the pointers labels\n");
+		return;
+	}
+	for (unsigned int n = 0; n < LABELS_PER_ROW * LABELS_PER_ROW; n++)
+		draw_label(atlas, n);
+
+	glGenTextures(1, glsl_textures + glsl_labels_texture);
+	glBindTexture(GL_TEXTURE_2D, glsl_textures[glsl_labels_texture]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+	             LABELS_ATLAS_SIZE, LABELS_ATLAS_SIZE, 0,
+	             GL_RGBA, GL_UNSIGNED_BYTE, atlas);
+	free(atlas);
 }
 
 static void init_cursor_program() {
 	/* Link and use our cursor shader */
 	GLuint cursor_program = glhSetupAndUse(
     "shaders/cursor.vsh", "shaders/cursor.fsh",
-    1, "xyst"
+    2, "xyst\0sprite"
   );
 	glsl_programs[glsl_cursor_program] = cursor_program;
 
@@ -92,51 +340,92 @@ static void init_cursor_program() {
 	   cannot be set directly (GLSL 3.1 feature) */
 	glsl_cursor_uniforms[glsl_cursor_unif_tex] =
 		glGetUniformLocation(cursor_program, "sampler");
+	glsl_cursor_uniforms[glsl_cursor_unif_labels] =
+		glGetUniformLocation(cursor_program, "labels");
 	glsl_cursor_uniforms[glsl_cursor_unif_norm] =
 		glGetUniformLocation(cursor_program, "px_to_norm");
-	glsl_cursor_uniforms[glsl_cursor_unif_position] =
-		glGetUniformLocation(cursor_program, "cursor_pos");
+	glsl_cursor_uniforms[glsl_cursor_unif_labels_cells] =
+		glGetUniformLocation(cursor_program, "labels_cells");
+
+	glUniform3f(glsl_cursor_uniforms[glsl_cursor_unif_labels_cells],
+	            1.0f / LABELS_PER_ROW, 1.0f / LABELS_PER_ROW, LABELS_PER_ROW);
 
-	/* Upload and activate the cursor texture */
-	glhUploadMyyRawTextures(
+	/* Upload the cursor texture in the background. A transparent
+	   placeholder is used until it's available. */
+	glhStreamMyyRawTextures(
 		"textures/cursor.raw",
-		n_glsl_textures, glsl_textures
+		1, glsl_textures + glsl_cursor_texture
 	);
-	glhActiveTextures(glsl_textures, 1);
-
-	/* Store the cursor quad in the GPU memory */
-	glGenBuffers(n_glsl_buffers, glsl_buffers);
-	GLuint cursor_buffer = glsl_buffers[glsl_cursor_buffer];
-	/* Most buffers operations are done on the currently bound buffer */
-	glBindBuffer(GL_ARRAY_BUFFER, cursor_buffer);
+	init_labels_texture();
 
 	/* x, y are expressed in pixels.
 	 * s is the normalised coordinate of the texture. 0 : left - 1 : right
 	 * t is the normalised coordinate of the texture. 0 : down - 1 : up
 	 */
   float left = 0, right = 24, up = 0, down = -24;
-	float cursor_icon[16] = {
+	GLfloat const cursor_icon[GLH_SPRITE_CORNERS][4] = {
 	  /*  x     y  s  t */
-	  right,   up, 1, 1,
-	   left,   up, 0, 1,
-	   left, down, 0, 0,
-	  right, down, 1, 0
+	  { right,   up, 1, 1 },
+	  {  left,   up, 0, 1 },
+	  {  left, down, 0, 0 },
+	  { right, down, 1, 0 }
 	};
 
-	glBufferData(
-		GL_ARRAY_BUFFER, 16*sizeof(float), cursor_icon, GL_STATIC_DRAW
-	);
+	/* The cursors sprites are streamed to the GPU memory before each
+	   draw. MYY_SPRITE_BATCH chooses how they are drawn. */
+	enum glh_sprite_batch_method method = GLH_SPRITES_AUTO;
+	char const * __restrict const method_name = getenv("MYY_SPRITE_BATCH");
+	if (method_name != NULL && !glhSpriteBatchParseMethod(method_name, &method))
+		LOG_WARN("Invalid MYY_SPRITE_BATCH : %s\n", method_name);
+	if (!glhSpriteBatchInit(
+	      &cursors_batch, cursor_icon,
+	      glsl_cursor_attr_xyst, glsl_cursor_attr_sprite,
+	      MYY_MAX_POINTERS * 2, method))
+		LOG("Not enough memory to draw the pointers\n");
 }
 
 void myy_init_drawing() { init_cursor_program(); }
 
+/* Write the sprites of the pointers drawn : the cursor, where it should
+   be seen, the other pointers where they are, with their labels.
+   Returns the number of sprites. */
+static unsigned int write_cursors_sprites
+(struct ph_pointers const * __restrict const store,
+ unsigned int const first_pointer)
+{
+	struct glh_sprite * __restrict sprite = cursors_sprites;
+	float const height = screen_size.height;
+
+	for (unsigned int p = first_pointer; p < store->n; p++) {
+		float const x = p ? store->x[p] : shown_cursor.x;
+		float const y = height - (p ? store->y[p] : shown_cursor.y);
+
+		*sprite++ = (struct glh_sprite) { x, y, 0, 0 };
+		if (p == 0) continue;
+		*sprite++ = (struct glh_sprite) {
+			x + LABEL_OFFSET, y - LABEL_OFFSET,
+			p % (LABELS_PER_ROW * LABELS_PER_ROW), 1
+		};
+	}
+	return sprite - cursors_sprites;
+}
+
 void myy_draw() {
 
 	/* Clear the screen with a nice blueish color */
+	glhGpuTimerPassBegin("gpu clear (us)");
 	glClear( GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT );
+	glhGpuTimerPassEnd();
 	//            RED GREEN  BLUE ALPHA
 	glClearColor(0.2f, 0.5f, 0.7f, 1.0f);
 
+	redraw = 0;
+	/* The display plane showing the cursor is above this frame. The
+	   other pointers are still drawn. */
+	struct ph_pointers const * __restrict const store = pointers_store();
+	unsigned int const first_pointer = hardware_cursor ? 1 : 0;
+	if (first_pointer == store->n) return;
+
 	/** Note : Rebinding the same buffer, re-enabling the same vertex 
 	           attributes and resetting the texture sampler ID every time
 	           is redundant here, as we only have one GLSL program.
@@ -144,6 +433,8 @@ void myy_draw() {
 	           Still, ONLY ONE GLSL program is quite rare, though, so 
 	           we'll do it the common way.*/
 	
+	glhGpuTimerPassBegin("gpu cursor (us)");
+
 	/* Enable the cursor program */
 	GLuint cursor_program = glsl_programs[glsl_cursor_program];
 	glUseProgram(cursor_program);
@@ -154,37 +445,28 @@ void myy_draw() {
 	glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	
-	/* Enable the cursor texture. */
+	/* Enable the cursor texture and the labels atlas.
+	   The texture name changes once the streamed texture is uploaded,
+	   so the textures are rebound every frame. */
+	glhActiveTextures(glsl_textures, n_glsl_textures);
 	glUniform1i(glsl_cursor_uniforms[glsl_cursor_unif_tex],
               glsl_cursor_texture);
-	/* Set the current cursor position. This is ESSENTIAL */
-
-	glUniform2f(glsl_cursor_uniforms[glsl_cursor_unif_position], 
-							(float) cursor.x,
-              (float) screen_size.height - cursor.y);
-
-	/* -Get ready to send data.- */
- 	glEnableVertexAttribArray(glsl_cursor_attr_xyst);
-	/* When calling glVertexAttribPointer, if an ARRAY_BUFFER is bound,
-	   a copy the current GPU buffer adddress is made and glDrawArrays 
-	   will use this address as a base for glVertexAttribPointer
-	   offsets.
-	   Else, these "offsets" will be considered to be CPU addresses.
-	   Therefore, IT IS ESSENTIAL TO BIND THE BUFFER NOW ! */
-	glBindBuffer(GL_ARRAY_BUFFER, glsl_buffers[glsl_cursor_buffer]);
-	/* The 0 offset is relative to the currently bound buffer's memory.
-		Avoid using NULL instead of 0 as NULL is not assured to be 0. */
-	glVertexAttribPointer(
-    glsl_cursor_attr_xyst, 4, GL_FLOAT, GL_FALSE, 0, (uint8_t *) 0
-	);
-	/* Draw the cursor. This is it for the CPU part ! */
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	glUniform1i(glsl_cursor_uniforms[glsl_cursor_unif_labels],
+              glsl_labels_texture);
+
+	/* Draw every pointer and label at once. This is it for the CPU
+	   part ! */
+	glhSpriteBatchDraw(&cursors_batch, cursors_sprites,
+	                   write_cursors_sprites(store, first_pointer));
+
+	glhGpuTimerPassEnd();
 }
 
 void myy_cleanup_drawing() {
   glFinish();
   glDeleteProgram(glsl_programs[glsl_cursor_program]);
-  glDeleteBuffers(n_glsl_buffers, glsl_buffers);
+  glDeleteTextures(1, glsl_textures + glsl_labels_texture);
+  glhSpriteBatchFree(&cursors_batch);
 }
 
 /* Evdev will send ABSOLUTE movement offsets like -4, +2, +9, -1
@@ -198,34 +480,107 @@ void myy_cleanup_drawing() {
  * This is completely arbitrary though.
  * 
  * We also keep the cursor inside the screen by clamping :
- * - x between [0, width]
- * - y between [0, height]
+ * - x between [0, width - 1]
+ * - y between [0, height - 1]
  * 
  * Note that instead of int32 we could use uint32 and do a "% width", 
  * "% height" to have connected edges (i.e. sending the cursor outside
  * the left edge would teleport the cursor near the right edge, ...).
 */
 void myy_abs_mouse_move(int x, int y) {
-	unsigned int 
-		width  = screen_size.width,
-		height = screen_size.height;
-	
-	int32_t
-		current_x = cursor.x,
-		new_x = current_x + x;
+	struct ph_pointers * __restrict const store = pointers_store();
 
-	new_x = (new_x >= 0) ? new_x : 0;
-	new_x = (new_x < width ? new_x : width);
+	store->x[0] = clamp(store->x[0] + x, store->min_x[0], store->max_x[0]);
+	store->y[0] = clamp(store->y[0] + y, store->min_y[0], store->max_y[0]);
+	shown_cursor.x = store->x[0];
+	shown_cursor.y = store->y[0];
+}
 
-	int32_t
-		current_y = cursor.y,
-		new_y = current_y + y;
+/* The first contact moves the cursor */
+void myy_touch_frame
+(struct myy_touch_snapshot const * __restrict const snapshot)
+{
+	if (snapshot->n_points == 0) return;
+
+	struct ph_pointers * __restrict const store = pointers_store();
+	store->x[0] = clamp(snapshot->points[0].x, store->min_x[0], store->max_x[0]);
+	store->y[0] = clamp(snapshot->points[0].y, store->min_y[0], store->max_y[0]);
+	shown_cursor.x = store->x[0];
+	shown_cursor.y = store->y[0];
+}
 
-	new_y = (new_y >= 0) ? new_y : 0;
-	new_y = (new_y < height ? new_y : height);
+static struct ph_pointers_bounds pointer_bounds
+(struct ph_pointers const * __restrict const store,
+ unsigned int const p)
+{
+	struct ph_pointers_bounds const bounds = {
+		store->min_x[p], store->min_y[p], store->max_x[p], store->max_y[p]
+	};
+	return bounds;
+}
 
-	cursor.x = new_x;
-	cursor.y = new_y;
+/* Only the pointers move here. Local devices motions are applied one
+   after the other, as a pointer stops at the edges and the next motions
+   move it from there, and the touchscreens move the cursor to their
+   first contact. The motions added to the store by ph_PointersMove
+   since the last batch, such as the remote users ones, are then applied
+   to every pointer at once. */
+void myy_input_batch(struct myy_input_batch const * __restrict const batch)
+{
+	struct ph_pointers * __restrict const store = pointers_store();
+	/* The pointer moved by the last motions, kept out of the store until
+	   another pointer moves */
+	unsigned int p = 0, id = 0, moved = 0;
+	int32_t x = store->x[0], y = store->y[0];
+	struct ph_pointers_bounds bounds = pointer_bounds(store, 0);
+
+	for (unsigned int e = 0; e < batch->n_events; e++) {
+		struct myy_input_event const * __restrict const event =
+			batch->events + e;
+		switch (event->type) {
+		case myy_input_motion:
+			if (event->code != id) {
+				store->x[p] = x;
+				store->y[p] = y;
+				id = event->code;
+				p = pointer_index(id);
+				x = store->x[p];
+				y = store->y[p];
+				bounds = pointer_bounds(store, p);
+				/* The other pointers are drawn in the frame */
+				if (p) redraw = 1;
+			}
+			x = clamp(x + event->motion.dx, bounds.min_x, bounds.max_x);
+			y = clamp(y + event->motion.dy, bounds.min_y, bounds.max_y);
+			moved = 1;
+			break;
+		case myy_input_button: {
+			uint32_t const button = 1u << ((event->code - BTN_MOUSE) & 31);
+			unsigned int const b = pointer_index(event->button.pointer);
+			if (event->state) store->buttons[b] |= button;
+			else store->buttons[b] &= ~button;
+			break;
+		}
+		case myy_input_touch:
+			if (event->code != 0 || event->state == 0) break;
+			store->x[p] = x;
+			store->y[p] = y;
+			p = id = 0;
+			bounds = pointer_bounds(store, 0);
+			x = clamp(event->touch.x, bounds.min_x, bounds.max_x);
+			y = clamp(event->touch.y, bounds.min_y, bounds.max_y);
+			moved = 1;
+			break;
+		}
+	}
+	store->x[p] = x;
+	store->y[p] = y;
+	ph_PointersApply(store);
+
+	if (moved) {
+		shown_cursor.x = store->x[0];
+		shown_cursor.y = store->y[0];
+	}
 }
 
 /* Invoked when the mouse wheel is used, but this isn't useful here */
@@ -233,3 +588,8 @@ void myy_mouse_action(enum mouse_action_type action, int value) {
   // Doing a printf here would be of no use as we cannot see the
   // terminal until the application shutdown
 }
+
+/* Invoked for each key pressed, repeated or released. Nothing to type
+   into here. */
+void myy_key_action(struct myy_key_event const * __restrict const event) {
+}
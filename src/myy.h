@@ -32,10 +32,157 @@ void myy_draw();
 void myy_cleanup_drawing();
 void myy_generate_new_state();
 
+/* Whether the cursor is shown by a display plane, rather than drawn by
+   myy_draw */
+void myy_set_hardware_cursor(unsigned int const enabled);
+/* 0 when the last frame drawn can be shown again, the only change
+   being the cursor position */
+unsigned int myy_needs_redraw();
+/* Top-left corner of the cursor image, in pixels, from the top-left of
+   the screen */
+void myy_cursor_position(int * __restrict const x, int * __restrict const y);
+/* Where the cursor is drawn. Moved back to the cursor position by
+   myy_abs_mouse_move. */
+void myy_shown_cursor_position
+(int * __restrict const x, int * __restrict const y);
+/* Draw the cursor at a predicted position, kept inside the screen */
+void myy_show_cursor_at(int const x, int const y);
+/* Write the cursor image as width * height premultiplied ARGB8888
+   pixels, from the top-left corner.
+   Returns 0 if the cursor texture cannot be converted. */
+unsigned int myy_cursor_image
+(uint32_t * __restrict const pixels,
+ unsigned int const width,
+ unsigned int const height);
+
 /* Temporary changes */
-enum mouse_action_type { myy_mouse_wheel_action };
+enum mouse_action_type {
+	/* value : notches, positive when scrolling up or right */
+	myy_mouse_wheel_action,
+	myy_mouse_hwheel_action,
+	/* value : BTN_* code */
+	myy_mouse_button_pressed_action,
+	myy_mouse_button_released_action
+};
 void myy_mouse_action(enum mouse_action_type, int value);
 
 void myy_abs_mouse_move(int x, int y);
 
+/* Keyboards */
+enum myy_key_state {
+	myy_key_released,
+	myy_key_pressed,
+	/* Held long enough to be repeated */
+	myy_key_repeated
+};
+
+enum myy_key_modifier {
+	myy_key_mod_shift = 1,
+	myy_key_mod_ctrl  = 2,
+	myy_key_mod_alt   = 4,
+	myy_key_mod_logo  = 8
+};
+
+struct myy_key_event {
+	/* CLOCK_MONOTONIC */
+	uint64_t time_us;
+	/* Evdev KEY_* code, whatever the keymap */
+	uint16_t code;
+	enum myy_key_state state;
+	/* XKB keysym. 0 when unknown (built without xkbcommon). */
+	uint32_t keysym;
+	/* The character typed, in UTF-32. 0 when none. */
+	uint32_t utf32;
+	/* myy_key_mod_* active after this event */
+	uint32_t modifiers;
+};
+
+void myy_key_action(struct myy_key_event const * __restrict const event);
+
+/* Contacts on touchscreens */
+#define MYY_TOUCH_MAX_POINTS 16
+
+struct myy_touch_point {
+	/* Identifies the contact from its first to its last snapshot */
+	int32_t id;
+	/* Pixels, from the top-left of the screen */
+	int16_t x, y;
+};
+
+struct myy_touch_snapshot {
+	/* When the device reported it, CLOCK_MONOTONIC */
+	uint64_t time_us;
+	unsigned int n_points;
+	struct myy_touch_point points[MYY_TOUCH_MAX_POINTS];
+};
+
+/* Every contact of a touchscreen, sent each time one of them changed.
+   A contact missing from the snapshot was lifted. */
+void myy_touch_frame(struct myy_touch_snapshot const * __restrict const snapshot);
+
+/* Input batches.
+ *
+ * The input read during a frame is handed to myy_input_batch once,
+ * before the frame is drawn, as a packed array of 16 bytes events, in
+ * the order they were read. The callbacks above are only invoked by
+ * myy_input_dispatch, for applications handling the events one by
+ * one. */
+
+enum myy_input_event_type {
+	/* Accelerated relative motion, in pixels.
+	   code : the pointer moved. Every mouse moves the pointer 0, the
+	   cursor, unless each mouse has its own pointer (MYY_MULTI_POINTER). */
+	myy_input_motion,
+	/* Mouse button. code : BTN_*, state : 1 pressed, 0 released */
+	myy_input_button,
+	/* code : REL_WHEEL or REL_HWHEEL, value : in MYY_WHEEL_NOTCH
+	   fractions of notch */
+	myy_input_wheel,
+	/* code : KEY_*, state : enum myy_key_state */
+	myy_input_key,
+	/* One point of a touchscreen snapshot. The points of a snapshot
+	   follow each other. code : index of the point, state : points in
+	   the snapshot. A snapshot without points, every contact being
+	   lifted, is a single event with state 0. */
+	myy_input_touch
+};
+
+/* One wheel notch, as reported by REL_WHEEL_HI_RES */
+#define MYY_WHEEL_NOTCH 120
+
+struct myy_input_event {
+	/* Microseconds from the batch time_us. Negative when a device
+	   reported it before the first event of the batch. */
+	int32_t time_offset_us;
+	uint8_t type;
+	uint8_t state;
+	uint16_t code;
+	union {
+		struct { int32_t dx, dy; } motion;
+		/* pointer : the pointer of the mouse, as for the motions */
+		struct { uint32_t pointer; } button;
+		struct { int32_t value; uint32_t pointer; } wheel;
+		struct {
+			/* 0 without xkbcommon */
+			uint32_t keysym;
+			/* UTF-32 character, and myy_key_mod_* active after the key */
+			uint32_t utf32:24, modifiers:8;
+		} key;
+		struct { int32_t id; int16_t x, y; } touch;
+	};
+};
+
+struct myy_input_batch {
+	/* CLOCK_MONOTONIC time of the first event */
+	uint64_t time_us;
+	unsigned int n_events;
+	struct myy_input_event const * events;
+};
+
+void myy_input_batch(struct myy_input_batch const * __restrict const batch);
+
+/* Invoke the callbacks above for each event of the batch.
+   Wheel fractions are added up until they make a notch. */
+void myy_input_dispatch(struct myy_input_batch const * __restrict const batch);
+
 #endif 
@@ -0,0 +1,106 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_COMPOSITOR_H
+#define MYY_COMPOSITOR_H 1
+
+#include <myy_drm.h>
+
+/* Planes compositor.
+ *
+ * Layers are images with their own scanout buffer, stacked above the
+ * frames drawn by GL on the primary plane. When the display has free
+ * overlay or cursor planes, the layers are shown by these planes, and
+ * GL only has to draw the layers that did not fit. Moving a layer
+ * shown by a plane is then a matter of changing the plane position.
+ *
+ * The planes given to the layers are decided by test-only atomic
+ * commits, starting from the top layer. A layer drawn by GL is drawn
+ * into the primary plane, which is below every other plane, so all the
+ * layers below it are drawn by GL too.
+ *
+ * Requires atomic modesetting. */
+
+#define MYY_COMPOSITOR_MAX_PLANES 8
+#define MYY_COMPOSITOR_MAX_LAYERS 8
+
+struct myy_layer {
+	struct gbm_bo * bo;
+	uint32_t fb_id;
+	/* Top-left corner, in pixels, from the top-left of the screen */
+	int32_t x, y;
+	uint32_t width, height;
+	/* The plane showing the layer. 0 when it must be drawn with GL. */
+	uint32_t plane_id;
+};
+
+/* Find the overlay and cursor planes usable with the CRTC.
+ * Returns the number of planes found. */
+unsigned int myy_compositor_init
+(struct drm_infos const * __restrict const drm_infos);
+
+/* Destroy the layers and forget the planes */
+void myy_compositor_free();
+
+/* Size of the buffers cursor planes accept */
+void myy_compositor_cursor_size
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t * __restrict const width,
+ uint32_t * __restrict const height);
+
+/* Add a layer above the others, showing `pixels` : width * height
+ * premultiplied ARGB8888 pixels, from the top-left corner.
+ * The layer is drawn by GL until myy_compositor_assign is called.
+ * Returns NULL on failure. */
+struct myy_layer * myy_compositor_add_layer
+(struct drm_infos const * __restrict const drm_infos,
+ struct gbm_device * __restrict const gbm_device,
+ uint32_t const * __restrict const pixels,
+ uint32_t const width,
+ uint32_t const height);
+
+void myy_compositor_move_layer
+(struct myy_layer * __restrict const layer,
+ int32_t const x,
+ int32_t const y);
+
+/* Give the layers to the planes, using test-only commits with
+ * primary_fb_id on the primary plane.
+ * Returns the number of layers shown by planes. */
+unsigned int myy_compositor_assign
+(struct drm_infos * __restrict const drm_infos,
+ uint32_t const primary_fb_id);
+
+/* Draw every layer with GL. To use when a commit showing the layers
+ * failed. */
+void myy_compositor_drop_planes();
+
+/* Add the layers planes to an atomic request */
+void myy_compositor_add_planes
+(drmModeAtomicReq * __restrict const request,
+ struct drm_infos const * __restrict const drm_infos);
+
+/* Call after each successful commit including the planes */
+void myy_compositor_committed();
+
+#endif
@@ -0,0 +1,106 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_CONTROL_H
+#define MYY_CONTROL_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Control socket.
+ *
+ * A UNIX domain socket, served by its own thread, to inspect and
+ * control the program while it runs :
+ *   echo stats | socat - UNIX-CONNECT:/tmp/myy-control.sock
+ *
+ * One command per line. Send "help" for the list.
+ *
+ * The render thread only publishes its statistics once per frame,
+ * without locking, and picks the commands it has to apply from a
+ * lock-free queue (myy_control_next_command). It never waits for the
+ * control thread. */
+
+/* Frame times kept for the percentiles */
+#define MYY_CONTROL_FRAME_TIMES 256
+
+enum myy_control_command_type {
+	/* value : 1 to wait for the vertical blank, 0 to flip immediately */
+	MYY_CONTROL_SET_VSYNC,
+	/* value : the enum ph_predict_mode of the cursor prediction */
+	MYY_CONTROL_SET_PREDICTION,
+	/* data : struct input_event records allocated with malloc.
+	 *        See myy_evdev_replay_start. */
+	MYY_CONTROL_REPLAY_INPUT
+};
+
+struct myy_control_command {
+	enum myy_control_command_type type;
+	int value;
+	void * data;
+	size_t size;
+};
+
+/* Published by the render thread after each frame */
+struct myy_control_frame {
+	/* When the frame was shown (CLOCK_MONOTONIC) */
+	uint64_t time_ns;
+	/* Input events read since the start */
+	uint64_t input_events;
+	uint64_t input_resyncs;
+	/* Estimated. See struct myy_evdev_data. */
+	uint64_t input_dropped_reports;
+	/* See struct drm_fb_stats */
+	uint64_t fb_hits, fb_misses;
+	unsigned int fb_in_use, fb_capacity;
+	unsigned int vsync;
+	/* Variable refresh rate enabled */
+	unsigned int vrr;
+	/* enum ph_predict_mode */
+	unsigned int prediction;
+	/* GPU time of the last measured frame. 0 when unknown. */
+	uint64_t gpu_ns;
+};
+
+/* Listen on `default_path`, or $MYY_CONTROL_SOCKET when defined.
+ * Returns 1 if the control thread is running, 0 otherwise. */
+unsigned int myy_control_start(char const * __restrict const default_path);
+
+void myy_control_stop();
+
+/* The display mode, as shown in the statistics */
+void myy_control_set_mode
+(char const * __restrict const name,
+ unsigned int const width,
+ unsigned int const height,
+ unsigned int const refresh);
+
+/* Render thread only */
+void myy_control_publish_frame
+(struct myy_control_frame const * __restrict const frame);
+
+/* Render thread only. Returns 1 if a command was stored in `command`,
+ * 0 if there is no pending command. */
+unsigned int myy_control_next_command
+(struct myy_control_command * __restrict const command);
+
+#endif
@@ -30,11 +30,19 @@
 
 #include <current/opengl.h>
 
+/* Maximum number of format modifiers considered for the scanout
+ * buffers */
+#define MYY_DRM_MAX_MODIFIERS 64
+
 struct egl_infos {
 	EGLDisplay display;
 	EGLConfig config;
 	EGLContext context;
 	EGLSurface surface;
+	/* EGL_ANDROID_native_fence_sync. NULL when unsupported. */
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_native_fence_fd;
 };
 
 struct gbm_infos {
@@ -42,11 +50,45 @@ struct gbm_infos {
 	struct gbm_surface *surface;
 };
 
+/* Atomic modesetting properties IDs. 0 when unsupported. */
+struct drm_plane_properties {
+	uint32_t fb_id, crtc_id;
+	uint32_t src_x, src_y, src_w, src_h;
+	uint32_t crtc_x, crtc_y, crtc_w, crtc_h;
+	uint32_t in_fence_fd;
+};
+
+struct drm_crtc_properties {
+	uint32_t mode_id, active, out_fence_ptr;
+	/* Set by drm_init_vrr */
+	uint32_t vrr_enabled;
+};
+
+struct drm_connector_properties {
+	uint32_t crtc_id;
+};
+
 struct drm_infos {
 	int fd;
 	drmModeModeInfo *mode;
 	uint32_t crtc_id;
 	uint32_t connector_id;
+	/* The CRTC index in drmModeRes.crtcs, as used by possible_crtcs */
+	unsigned int crtc_index;
+	/* drmModeAddFB2WithModifiers is supported */
+	unsigned int fb_modifiers;
+	/* Set by init_drm_atomic */
+	unsigned int atomic;
+	unsigned int atomic_modeset_done;
+	uint32_t plane_id;
+	uint32_t mode_blob_id;
+	/* Rewound and refilled by each drm_atomic_request */
+	drmModeAtomicReq * request;
+	/* Variable refresh rate. Set by drm_init_vrr */
+	unsigned int vrr;
+	struct drm_plane_properties plane_props;
+	struct drm_crtc_properties crtc_props;
+	struct drm_connector_properties connector_props;
 };
 
 struct drm_fb {
@@ -58,6 +100,96 @@ struct drm_fb {
 int init_drm
 (struct drm_infos * const drm_infos);
 
+/* Use atomic modesetting, showing the framebuffers on the primary plane
+ * of the CRTC chosen by init_drm.
+ * Returns 0 on success, -1 if the driver only provides the legacy API,
+ * in which case drmModeSetCrtc and drmModePageFlip must be used. */
+int init_drm_atomic
+(struct drm_infos * __restrict const drm_infos);
+
+/* Free what init_drm_atomic allocated */
+void free_drm_atomic
+(struct drm_infos * __restrict const drm_infos);
+
+/* Enable the variable refresh rate (Adaptive-Sync, FreeSync) with the
+ * first atomic commit, when the connector reports "vrr_capable" and the
+ * CRTC has a "VRR_ENABLED" property. The display then refreshes when a
+ * new frame is committed, within the panel range, instead of at fixed
+ * intervals.
+ * Set MYY_DRM_VRR=0 to keep a fixed refresh rate.
+ * Must be called after init_drm_atomic.
+ * Returns 0 when enabled, -1 otherwise. */
+int drm_init_vrr
+(struct drm_infos * __restrict const drm_infos);
+
+/* Show fb_id on the primary plane. The first commit also sets the mode.
+ *
+ * in_fence_fd  : sync file the display waits for before reading fb_id.
+ *                -1 to rely on implicit synchronisation.
+ * out_fence_fd : receives a sync file signaled once fb_id is displayed,
+ *                meaning that the previously displayed buffer can be
+ *                reused. NULL if unneeded.
+ * flags        : DRM_MODE_ATOMIC_* and DRM_MODE_PAGE_FLIP_* flags
+ * user_data    : passed to the page flip handler, with
+ *                DRM_MODE_PAGE_FLIP_EVENT
+ *
+ * Returns 0 on success, -1 otherwise (errno is set) */
+int drm_atomic_commit
+(struct drm_infos * __restrict const drm_infos,
+ uint32_t const fb_id,
+ int const in_fence_fd,
+ int * __restrict const out_fence_fd,
+ uint32_t const flags,
+ void * const user_data);
+
+/* The same, in two steps, so that other planes can be added to the
+ * request before committing it. The request is allocated once by
+ * init_drm_atomic, and only valid until the next drm_atomic_request.
+ * Pass DRM_MODE_ATOMIC_TEST_ONLY to only check whether the
+ * driver would accept the request. */
+drmModeAtomicReq * drm_atomic_request
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const fb_id,
+ int const in_fence_fd,
+ int * __restrict const out_fence_fd);
+
+int drm_atomic_request_commit
+(struct drm_infos * __restrict const drm_infos,
+ drmModeAtomicReq * __restrict const request,
+ uint32_t flags,
+ void * const user_data);
+
+/* Show the whole fb_id at (x, y), with the same size, on the plane */
+void drm_atomic_add_plane
+(drmModeAtomicReq * __restrict const request,
+ struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id,
+ struct drm_plane_properties const * __restrict const plane,
+ uint32_t const fb_id,
+ int32_t const x, int32_t const y,
+ uint32_t const width, uint32_t const height);
+
+void drm_atomic_disable_plane
+(drmModeAtomicReq * __restrict const request,
+ uint32_t const plane_id,
+ struct drm_plane_properties const * __restrict const plane);
+
+/* Returns DRM_PLANE_TYPE_PRIMARY, _OVERLAY or _CURSOR, or -1 */
+int drm_plane_type
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id);
+
+/* Returns 1 if every property required to show a framebuffer on the
+ * plane was found, 0 otherwise */
+unsigned int drm_plane_find_properties
+(struct drm_infos const * __restrict const drm_infos,
+ uint32_t const plane_id,
+ struct drm_plane_properties * __restrict const plane);
+
+/* Create the scanout surface. With atomic modesetting, its layout is
+ * negotiated between the primary plane IN_FORMATS and the EGL
+ * renderable modifiers (EGL_EXT_image_dma_buf_import_modifiers).
+ * Set MYY_DRM_MODIFIERS=0 to leave the layout to the driver. */
 int init_gbm
 (struct drm_infos * __restrict const drm_infos,
  struct gbm_infos * __restrict const gbm_infos);
@@ -66,6 +198,23 @@ int add_gl_context
 (struct egl_infos * const egl_infos,
  struct gbm_infos * const gbm_infos);
 
+/* Look for EGL_ANDROID_native_fence_sync.
+ * Returns 1 if native fences can be exported, 0 otherwise. */
+unsigned int egl_init_native_fences
+(struct egl_infos * __restrict const egl_infos);
+
+/* Insert a fence after the commands issued so far.
+ * Returns EGL_NO_SYNC_KHR when native fences are unsupported. */
+EGLSyncKHR egl_native_fence_insert
+(struct egl_infos const * __restrict const egl_infos);
+
+/* Export `fence` as a sync file descriptor, and destroy it.
+ * The commands must have been flushed (eglSwapBuffers does it).
+ * Returns -1 if `fence` is EGL_NO_SYNC_KHR or on error. */
+int egl_native_fence_export
+(struct egl_infos const * __restrict const egl_infos,
+ EGLSyncKHR const fence);
+
 struct drm_fb * drm_fb_get_from_bo
 (struct gbm_bo * __restrict const bo, 
  struct drm_infos * __restrict const drm_infos);
@@ -74,4 +223,15 @@ void drm_fb_destroy_callback
 (struct gbm_bo * __restrict const bo,
  void * const data);
 
+struct drm_fb_stats {
+	/* drm_fb_get_from_bo calls reusing the framebuffer of a buffer */
+	uint64_t hits;
+	/* drm_fb_get_from_bo calls creating a new framebuffer */
+	uint64_t misses;
+	unsigned int in_use;
+	unsigned int capacity;
+};
+
+void drm_fb_get_stats(struct drm_fb_stats * __restrict const stats);
+
 #endif
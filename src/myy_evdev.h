@@ -26,21 +26,154 @@
 
 #include <libevdev/libevdev.h>
 
+#include <helpers/pointer.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <myy.h>
+
+/* Devices opened at most */
+#define MYY_INPUT_MAX_DEVICES 8
+
+/* Events queued at most. The batch is handed to the application early
+   when more events are read before the next myy_evdev_flush_events. */
+#define MYY_INPUT_BATCH_MAX_EVENTS 1024
+
+enum myy_input_device_type {
+	/* Relative motions and buttons */
+	MYY_INPUT_MOUSE,
+	/* Absolute positions of up to MYY_TOUCH_MAX_POINTS contacts */
+	MYY_INPUT_TOUCHSCREEN,
+	/* Keys, see myy_keyboard.h */
+	MYY_INPUT_KEYBOARD
+};
+
+struct myy_touch_contact {
+	/* -1 when nothing touches the screen in this slot */
+	int32_t tracking_id;
+	/* Device coordinates */
+	int32_t x, y;
+};
+
+struct myy_touch_state {
+	/* The slot updated by the next ABS_MT_* events.
+	   MYY_TOUCH_MAX_POINTS when its events are ignored. */
+	unsigned int slot;
+	/* 0 for single-touch devices, using contacts[0] */
+	unsigned int n_slots;
+	/* A contact changed since the last report */
+	unsigned int changed;
+	/* The last one receives the events of the ignored slots */
+	struct myy_touch_contact contacts[MYY_TOUCH_MAX_POINTS + 1];
+	/* Screen position : (device position - min) * scale, with scale in
+	   16.16 fixed point. See myy_evdev_set_screen_size. */
+	int32_t min_x, min_y;
+	uint32_t scale_x, scale_y;
+};
+
 struct myy_evdev_data {
 	/* The opened device */
 	struct libevdev *dev;
 	int fd;
+	enum myy_input_device_type type;
+	/* MYY_INPUT_MOUSE : the vertical and horizontal wheels report
+	   fractions of notches (REL_WHEEL_HI_RES, REL_HWHEEL_HI_RES) */
+	unsigned int hires_wheel, hires_hwheel;
+	/* MYY_INPUT_MOUSE : the pointer moved, see myy_input_motion */
+	uint16_t pointer;
+	/* Exclusive access : the console and other programs do not receive
+	   the device events. See myy_init_input_devices. */
+	unsigned int grabbed;
+	/* Events read since the device was opened */
+	uint64_t events;
+	/* Resynchronisations after the kernel dropped events (SYN_DROPPED) */
+	uint64_t resyncs;
+	/* Reports lost in the resynchronisations, estimated from the time
+	   elapsed since the last report read and the shortest interval
+	   between two reports */
+	uint64_t dropped_reports;
+	uint64_t last_report_us, report_interval_us;
+	/* Events are discarded until the next SYN_REPORT, after a
+	   SYN_DROPPED found in a recording */
+	unsigned int dropping;
+	/* MYY_INPUT_TOUCHSCREEN only */
+	struct myy_touch_state touch;
 };
 
+/* Open up to n_devices mice, touchscreens and keyboards.
+ * With MYY_INPUT_GRAB=1, the mice and touchscreens are grabbed. The
+ * keyboards never are, as the program is stopped from the terminal.
+ * With MYY_MULTI_POINTER=1, each mouse moves its own pointer, in the
+ * order they are found. Otherwise, they all move the cursor.
+ * Returns the number of devices opened. */
 unsigned int myy_init_input_devices
-(struct myy_evdev_data * const mouse,
+(struct myy_evdev_data * const devices,
  unsigned int const n_devices);
 
 unsigned int myy_free_input_devices
-(struct myy_evdev_data * const mouse,
+(struct myy_evdev_data * const devices,
  unsigned int const n_devices);
 
+/* Map the touchscreens surfaces to a width x height pixels screen, on
+ * which the cursor moves */
+void myy_evdev_set_screen_size
+(struct myy_evdev_data * const devices,
+ unsigned int const n_devices,
+ unsigned int const width,
+ unsigned int const height);
+
 unsigned int myy_evdev_read_input
-(struct myy_evdev_data const * const mouse);
+(struct myy_evdev_data * const mouse);
+
+/* Add an event to the next batch, timestamped time_us
+ * (CLOCK_MONOTONIC). Returns the event, to fill its type data. */
+struct myy_input_event * myy_evdev_queue_event
+(uint8_t const type,
+ uint16_t const code,
+ uint8_t const state,
+ uint64_t const time_us);
+
+/* Hand the events queued to myy_input_batch, once per frame.
+ * Returns the number of events handed. */
+unsigned int myy_evdev_flush_events();
+
+/* Relative motions are turned into pixels following this acceleration
+ * profile. myy_init_input_devices sets the profile described by
+ * MYY_POINTER_ACCEL (see ph_AccelParseConfig), or the adaptive one. */
+void myy_evdev_set_acceleration
+(struct ph_accel_config const * __restrict const config);
+
+/* Predict the cursor position from the recent reports.
+ * myy_init_input_devices sets the mode named by MYY_CURSOR_PREDICTION
+ * (see ph_PredictParseMode), or disables the prediction. */
+void myy_evdev_set_prediction(enum ph_predict_mode const mode);
+enum ph_predict_mode myy_evdev_prediction();
+
+/* The cursor position expected at scanout_us (CLOCK_MONOTONIC).
+ * The current position when the prediction is disabled. */
+void myy_evdev_predict_cursor
+(uint64_t const now_us,
+ uint64_t const scanout_us,
+ int * __restrict const x,
+ int * __restrict const y);
+
+/* Replay recorded events, as read from /dev/input/event* nodes, at
+ * their original pace. The replay starts at `now_us` (CLOCK_MONOTONIC)
+ * and takes ownership of `events`, allocated with malloc. */
+void myy_evdev_replay_start
+(struct input_event * __restrict const events,
+ size_t const n_events,
+ uint64_t const now_us);
+
+/* Dispatch the replayed events due at `now_us`, as if read from a
+ * mouse. They are counted as read by `mouse`.
+ * Returns the number of events dispatched. */
+unsigned int myy_evdev_replay
+(struct myy_evdev_data * const mouse,
+ uint64_t const now_us);
+
+/* Returns 1 while replayed events remain to be dispatched */
+unsigned int myy_evdev_replaying();
 
 #endif /* MYY_EVDEV */
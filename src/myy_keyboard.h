@@ -0,0 +1,69 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_KEYBOARD_H
+#define MYY_KEYBOARD_H 1
+
+#include <stdint.h>
+
+/* Keyboards.
+ *
+ * The keys read from every keyboard are queued for myy_input_batch, with
+ * the keysym and the character they type according to the keymap,
+ * when built with xkbcommon (MYY_XKBCOMMON). The keymap compiled from
+ * the XKB_DEFAULT_* names is cached in $XDG_CACHE_HOME, or ~/.cache,
+ * and loaded from there on the next starts, without resolving the
+ * rules and includes again.
+ *
+ * Held keys are repeated by a timerfd, armed on presses, rather than
+ * checked at each frame. The kernel own repeated events are ignored.
+ * MYY_KEY_REPEAT sets the delay and the rate : "delay_ms:per_second".
+ * A rate of 0 disables the repetition. */
+
+/* Default repetition */
+#define MYY_KEY_REPEAT_DELAY_MS 600
+#define MYY_KEY_REPEAT_RATE 25
+
+/* Load the keymap and prepare the repetition timer.
+ * Returns 0 if the keys cannot be handled. */
+unsigned int myy_keyboard_init();
+void myy_keyboard_free();
+
+/* A key event read from a keyboard : evdev KEY_* code, with the value
+ * 0 when released, 1 when pressed and 2 when repeated by the kernel,
+ * timestamped on CLOCK_MONOTONIC. */
+void myy_keyboard_key
+(uint16_t const code,
+ int32_t const value,
+ uint64_t const time_us);
+
+/* Readable when a held key must be repeated. -1 before init. */
+int myy_keyboard_repeat_fd();
+
+/* Send the repetitions due. Returns the number of events sent. */
+unsigned int myy_keyboard_repeat();
+
+/* Repetitions sent since init */
+uint64_t myy_keyboard_repeats();
+
+#endif
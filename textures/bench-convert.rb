@@ -0,0 +1,52 @@
+# Compare the Ruby converter speed with the native one (myy-texconv).
+#
+# Usage : ruby bench-convert.rb file.bmp [from] [to] [path/to/myy-texconv]
+#
+# from and to default to argb8888 and rgba4444, like convert.rb .
+# Without the myy-texconv path, only the Ruby converter is measured.
+
+require_relative 'myy-color'
+require 'json'
+require 'tmpdir'
+
+bmp_filename, from, to, texconv = ARGV
+from ||= "argb8888"
+to   ||= "rgba4444"
+
+if bmp_filename.nil?
+  abort "Usage : ruby #{$0} file.bmp [from] [to] [path/to/myy-texconv]"
+end
+
+Dir.mktmpdir do |dir|
+  ruby_raw = File.join(dir, "ruby.raw")
+  $stderr.reopen(File::NULL, "w") # convert_content is verbose
+
+  start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+  MyyColor::OpenGL.convert_bmp(bmp_filename: bmp_filename,
+                               raw_filename: ruby_raw,
+                               from: from, to: to)
+  ruby_seconds = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+
+  width, height = File.binread(ruby_raw, 8).unpack("I<2")
+  megapixels = width * height / 1e6
+  ruby_mps = megapixels / ruby_seconds
+  puts "%-8s %10.2f MP/s" % ["ruby", ruby_mps]
+
+  if texconv
+    native_raw = File.join(dir, "native.raw")
+    # Enough repetitions to run for a noticeable time
+    repetitions = [(50 / megapixels).ceil, 1].max
+    report = JSON.parse(
+      IO.popen([texconv, "--from", from, "--to", to,
+                "--bench", repetitions.to_s, bmp_filename, native_raw],
+               &:read))
+    report["kernels"].each do |kernel|
+      puts "%-8s %10.2f MP/s  x%.0f" %
+        [kernel["kernel"], kernel["megapixels_per_second"],
+         kernel["megapixels_per_second"] / ruby_mps]
+    end
+
+    identical = File.binread(ruby_raw) == File.binread(native_raw)
+    puts "Output identical to the Ruby one : #{identical}"
+  end
+end
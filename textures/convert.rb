@@ -5,3 +5,12 @@ MyyColor::OpenGL.convert_bmp(bmp_filename: "cursor.bmp",
                              from: :argb8888,
                              to: :rgba4444)
 
+
+# Compressed textures are generated the same way, with "to" set to
+# :etc1, :etc2_rgb, :etc2_rgba, :astc_4x4 or :astc_8x8 (astcenc required).
+# Add "mipmaps: true" to store the whole mipmaps chain.
+# MyyColor::OpenGL.convert_bmp(bmp_filename: "cursor.bmp",
+#                              raw_filename: "cursor-etc2.raw",
+#                              from: :argb8888,
+#                              to: :etc2_rgba,
+#                              mipmaps: true)
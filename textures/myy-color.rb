@@ -1,3 +1,5 @@
+require_relative 'myy-etc'
+
 module MyyColor
   class DecompInfo
     # right-shift operand (>>), and-mask operand (&), multiplication operand
@@ -100,9 +102,26 @@ module MyyColor
       rgba8888: "I<*",
       argb8888: "I<*"
     }
+    # Returns the BMP pixels as [r, g, b, a] arrays, rows after rows.
+    def self.decode_content(filename:, from:)
+      infile = File.open(filename, "rb")
+      infile.seek(@@header_offsets[:content_start_address_info])
+      start_address, bitmap_header_size, width, height =
+        infile.read(16).unpack("I<4")
+      infile.seek(start_address)
+      input_pixels = infile.read(width * height * (from.to_s.end_with?("8888") ? 4 : 2))
+                           .unpack(@@unpack_formats[from])
+      infile.close
+
+      {
+        pixels: input_pixels.map { |pixel| MyyColor.decode(pixel, encoding: from) },
+        metadata: {width: width, height: height}
+      }
+    end
+
     def self.convert_content(filename:, from:, to:)
       if MyyColor.handle_formats?(from, to)
-        if !File.exists?(filename)
+        if !File.exist?(filename)
           raise ArgumentError,
             "Are you sure about that file ? #{filename}"
         end
@@ -144,6 +163,56 @@ module MyyColor
     end
   end
 
+  module Mipmaps
+    # Every level down to 1x1, starting with the provided one.
+    # Each level is [pixels, width, height].
+    def self.chain(pixels, width, height)
+      levels = [[pixels, width, height]]
+      while width > 1 || height > 1
+        pixels, width, height = downscale(pixels, width, height)
+        levels << [pixels, width, height]
+      end
+      levels
+    end
+
+    # sRGB <-> linear light conversions. Averaging sRGB values directly
+    # darkens every level, and thin bright features fade away.
+    @@to_linear = (0..255).map do |c|
+      c /= 255.0
+      c <= 0.04045 ? c / 12.92 : ((c + 0.055) / 1.055) ** 2.4
+    end.freeze
+
+    def self.to_srgb(linear)
+      c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * linear ** (1 / 2.4) - 0.055
+      (c * 255).round.clamp(0, 255)
+    end
+
+    # 2x2 box filter, done in linear light and weighted by alpha, so
+    # that the colour of fully transparent pixels does not bleed.
+    # Odd borders reuse the last row/column.
+    def self.downscale(pixels, width, height)
+      new_width, new_height = [width / 2, 1].max, [height / 2, 1].max
+      new_pixels = []
+      new_height.times do |y|
+        new_width.times do |x|
+          sources = [[0, 0], [1, 0], [0, 1], [1, 1]].map do |dx, dy|
+            pixels[[y*2 + dy, height - 1].min * width + [x*2 + dx, width - 1].min]
+          end
+          alpha_sum = sources.sum { |p| p[3] }
+          weights =
+            if alpha_sum > 0 then sources.map { |p| p[3] / alpha_sum.to_f }
+            else [0.25] * 4
+            end
+          color = (0..2).map do |c|
+            to_srgb(sources.each_with_index.sum { |p, i| @@to_linear[p[c]] * weights[i] })
+          end
+          new_pixels << [*color, (alpha_sum + 2) / 4]
+        end
+      end
+      [new_pixels, new_width, new_height]
+    end
+  end
+
   module OpenGL
 
     module GL
@@ -152,6 +221,88 @@ module MyyColor
       UNSIGNED_SHORT_5_5_5_1 = 0x8034
       UNSIGNED_SHORT_4_4_4_4 = 0x8033
       TEXTURE_2D = 0x0DE1
+      NEAREST = 0x2600
+      LINEAR = 0x2601
+      NEAREST_MIPMAP_NEAREST = 0x2700
+      LINEAR_MIPMAP_NEAREST = 0x2701
+      NEAREST_MIPMAP_LINEAR = 0x2702
+      LINEAR_MIPMAP_LINEAR = 0x2703
+      ETC1_RGB8 = 0x8D64
+      COMPRESSED_RGB8_ETC2 = 0x9274
+      COMPRESSED_RGBA8_ETC2_EAC = 0x9278
+      COMPRESSED_RGBA_ASTC_4x4 = 0x93B0
+      COMPRESSED_RGBA_ASTC_8x8 = 0x93B7
+    end
+
+    # Stored in the upper bits of the alignment field.
+    # See struct myy_raw_texture_content
+    FLAG_COMPRESSED = 1 << 30
+    FLAG_LEVELS     = 1 << 31
+
+    @@compressed_formats = {
+      etc1:      {format: GL::ETC1_RGB8,
+                  encode: ->(px, w, h) { ETC.encode(px, w, h) }},
+      etc2_rgb:  {format: GL::COMPRESSED_RGB8_ETC2,
+                  encode: ->(px, w, h) { ETC.encode(px, w, h) }},
+      etc2_rgba: {format: GL::COMPRESSED_RGBA8_ETC2_EAC,
+                  encode: ->(px, w, h) { ETC.encode(px, w, h, alpha: true) }},
+      astc_4x4:  {format: GL::COMPRESSED_RGBA_ASTC_4x4, external: true,
+                  encode: ->(px, w, h) { ASTC.encode(px, w, h, block: "4x4") }},
+      astc_8x8:  {format: GL::COMPRESSED_RGBA_ASTC_8x8, external: true,
+                  encode: ->(px, w, h) { ASTC.encode(px, w, h, block: "8x8") }}
+    }
+
+    def self.compressed_format?(format)
+      @@compressed_formats.has_key?(format.to_sym)
+    end
+
+    # Write a myy raw texture with a levels header.
+    # levels : [[width, height, data], ...]
+    # min_filter, mag_filter : GL filters. nil lets the loader decide.
+    def self.write_levels(raw_filename, width, height, headers, flags, levels,
+                          min_filter: nil, mag_filter: nil)
+      target, format, type, alignment = headers
+      table_size = 8 + levels.length * 16
+      offset = table_size
+      table = [levels.length, (min_filter || 0) | ((mag_filter || 0) << 16)]
+      levels.each do |level_width, level_height, data|
+        table.push(level_width, level_height, data.bytesize, offset)
+        offset += (data.bytesize + 3) & ~3
+      end
+
+      File.open(raw_filename, "wb") do |out|
+        out.write([width, height, target, format, type,
+                   alignment | flags | FLAG_LEVELS].pack("I<*"))
+        out.write(table.pack("I<*"))
+        levels.each do |_, _, data|
+          out.write(data)
+          out.write("\0" * (((data.bytesize + 3) & ~3) - data.bytesize))
+        end
+      end
+    end
+
+    # Convert a BMP to a compressed texture, with its mipmaps if
+    # required.
+    def self.compress_bmp(bmp_filename:, raw_filename:, from:, to:,
+                          mipmaps: true, min_filter: nil, mag_filter: nil)
+      compression = @@compressed_formats[to.to_sym]
+      if compression[:external] && !ASTC.available?
+        raise ArgumentError, "#{to} requires astcenc in the PATH"
+      end
+
+      image = MyyColor::BMP.decode_content(filename: bmp_filename,
+                                           from: from.to_sym)
+      width, height = image[:metadata].values_at(:width, :height)
+      levels =
+        if mipmaps then Mipmaps.chain(image[:pixels], width, height)
+        else [[image[:pixels], width, height]]
+        end
+
+      write_levels(
+        raw_filename, width, height,
+        [GL::TEXTURE_2D, compression[:format], 0, 4], FLAG_COMPRESSED,
+        levels.map { |px, w, h| [w, h, compression[:encode].(px, w, h)] },
+        min_filter: min_filter, mag_filter: mag_filter)
     end
 
     @@formats = {
@@ -161,13 +312,41 @@ module MyyColor
       rgba4444: {headers: [GL::TEXTURE_2D, GL::RGBA,
                            GL::UNSIGNED_SHORT_4_4_4_4, 2],
                  unpack: "S<*", pack: "S<*"},
-      rgba8888: {headers: [GL::RGBA, GL::UNSIGNED_BYTE],
+      rgba8888: {headers: [GL::TEXTURE_2D, GL::RGBA, GL::UNSIGNED_BYTE, 4],
                  unpack: "I<*", pack: "I>*"},
-      argb8888: {headers: [GL::RGBA, GL::UNSIGNED_BYTE],
+      argb8888: {headers: [GL::TEXTURE_2D, GL::RGBA, GL::UNSIGNED_BYTE, 4],
                  unpack: "I<*", pack: "I>*"}
     }
 
-    def self.convert_bmp(bmp_filename:, raw_filename:, from:, to:)
+    # to can also be one of the compressed formats : etc1, etc2_rgb,
+    # etc2_rgba, astc_4x4 or astc_8x8.
+    # With mipmaps, every level down to 1x1 is precomputed with a
+    # gamma-correct filter and stored in the file.
+    # min_filter and mag_filter (GL::* values) are stored with the
+    # levels and override the loader defaults.
+    def self.convert_bmp(bmp_filename:, raw_filename:, from:, to:,
+                         mipmaps: false, min_filter: nil, mag_filter: nil)
+      if compressed_format?(to)
+        return compress_bmp(bmp_filename: bmp_filename,
+                            raw_filename: raw_filename,
+                            from: from, to: to, mipmaps: mipmaps,
+                            min_filter: min_filter, mag_filter: mag_filter)
+      end
+
+      output_format = @@formats[to.to_sym]
+      if mipmaps
+        image = MyyColor::BMP.decode_content(filename: bmp_filename,
+                                             from: from.to_sym)
+        width, height = image[:metadata].values_at(:width, :height)
+        levels = Mipmaps.chain(image[:pixels], width, height).map do |px, w, h|
+          encoded = px.map { |rgba| MyyColor.encode(rgba, encoding: to.to_sym) }
+          [w, h, encoded.pack(output_format[:pack])]
+        end
+        return write_levels(raw_filename, width, height,
+                            output_format[:headers], 0, levels,
+                            min_filter: min_filter, mag_filter: mag_filter)
+      end
+
       raw = MyyColor::BMP.convert_content(filename: bmp_filename,
                                           from: from.to_sym,
                                           to: to.to_sym)
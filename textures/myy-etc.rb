@@ -0,0 +1,217 @@
+module MyyColor
+  # Block compression encoders.
+  # Pixels are provided as arrays of [r, g, b, a] components, in the
+  # [0,255] range, rows after rows. Blocks are 4x4 pixels and stored as
+  # big-endian 64 bits words. Inside a block, pixels are indexed column
+  # by column (index = x*4 + y), like the decoders in
+  # src/helpers/texture_codecs.c expect.
+  module ETC
+    MODIFIERS = [
+      [ 2,   8,  -2,   -8],
+      [ 5,  17,  -5,  -17],
+      [ 9,  29,  -9,  -29],
+      [13,  42, -13,  -42],
+      [18,  60, -18,  -60],
+      [24,  80, -24,  -80],
+      [33, 106, -33, -106],
+      [47, 183, -47, -183]
+    ].freeze
+
+    EAC_MODIFIERS = [
+      [-3, -6,  -9, -15, 2, 5, 8, 14],
+      [-3, -7, -10, -13, 2, 6, 9, 12],
+      [-2, -5,  -8, -13, 1, 4, 7, 12],
+      [-2, -4,  -6, -13, 1, 3, 5, 12],
+      [-3, -6,  -8, -12, 2, 5, 7, 11],
+      [-3, -7,  -9, -11, 2, 6, 8, 10],
+      [-4, -7,  -8, -11, 3, 6, 7, 10],
+      [-3, -5,  -8, -11, 2, 4, 7, 10],
+      [-2, -6,  -8, -10, 1, 5, 7,  9],
+      [-2, -5,  -8, -10, 1, 4, 7,  9],
+      [-2, -4,  -8, -10, 1, 3, 7,  9],
+      [-2, -5,  -7, -10, 1, 4, 6,  9],
+      [-3, -4,  -7, -10, 2, 3, 6,  9],
+      [-1, -2,  -3, -10, 0, 1, 2,  9],
+      [-4, -6,  -8,  -9, 3, 5, 7,  8],
+      [-3, -5,  -7,  -9, 2, 4, 6,  8]
+    ].freeze
+
+    def self.clamp(value)
+      value < 0 ? 0 : (value > 255 ? 255 : value)
+    end
+
+    # Returns the 16 pixels of the block at (bx, by), indexed x*4 + y.
+    # Pixels outside the image repeat the border ones.
+    def self.block_pixels(pixels, width, height, bx, by)
+      (0...16).map do |i|
+        x = [bx + i / 4, width - 1].min
+        y = [by + i % 4, height - 1].min
+        pixels[y * width + x]
+      end
+    end
+
+    # Best table and indices for a sub-block of pixels sharing a base
+    # color. Returns [error, table, {pixel_index => modifier_index}]
+    def self.fit_subblock(block, members, base)
+      best = nil
+      MODIFIERS.each_with_index do |modifiers, table|
+        error = 0
+        indices = {}
+        members.each do |i|
+          pixel = block[i]
+          best_modifier, best_error = 0, nil
+          modifiers.each_with_index do |modifier, m|
+            e = (0..2).sum do |c|
+              d = clamp(base[c] + modifier) - pixel[c]
+              d * d
+            end
+            best_modifier, best_error = m, e if best_error.nil? || e < best_error
+          end
+          error += best_error
+          indices[i] = best_modifier
+        end
+        best = [error, table, indices] if best.nil? || error < best[0]
+      end
+      best
+    end
+
+    def self.average(block, members)
+      (0..2).map { |c| members.sum { |i| block[i][c] } / members.length.to_f }
+    end
+
+    def self.extend_4(c); (c << 4) | c; end
+    def self.extend_5(c); (c << 3) | (c >> 2); end
+
+    # Individual and differential modes. These are valid in both ETC1
+    # and ETC2 streams.
+    def self.encode_color_block(block)
+      best = nil
+      [0, 1].each do |flip|
+        subs = [[], []]
+        16.times do |i|
+          x, y = i / 4, i % 4
+          subs[(flip == 1 ? y : x) >= 2 ? 1 : 0] << i
+        end
+        averages = subs.map { |members| average(block, members) }
+
+        q5 = averages.map { |avg| avg.map { |c| (c * 31 / 255.0).round } }
+        deltas = (0..2).map { |c| q5[1][c] - q5[0][c] }
+        candidates = []
+        if deltas.all? { |d| d >= -4 && d <= 3 }
+          candidates << [1, q5, q5.map { |q| q.map { |c| extend_5(c) } }]
+        end
+        q4 = averages.map { |avg| avg.map { |c| (c * 15 / 255.0).round } }
+        candidates << [0, q4, q4.map { |q| q.map { |c| extend_4(c) } }]
+
+        candidates.each do |differential, quantized, bases|
+          fits = [0, 1].map { |s| fit_subblock(block, subs[s], bases[s]) }
+          error = fits[0][0] + fits[1][0]
+          if best.nil? || error < best[0]
+            best = [error, flip, differential, quantized, fits]
+          end
+        end
+      end
+
+      _, flip, differential, q, fits = best
+      high = 0
+      if differential == 1
+        3.times do |c|
+          high |= q[0][c] << (27 - c * 8)
+          high |= ((q[1][c] - q[0][c]) & 7) << (24 - c * 8)
+        end
+      else
+        3.times do |c|
+          high |= q[0][c] << (28 - c * 8)
+          high |= q[1][c] << (24 - c * 8)
+        end
+      end
+      high |= fits[0][1] << 5
+      high |= fits[1][1] << 2
+      high |= differential << 1
+      high |= flip
+
+      low = 0
+      fits.each do |_, _, indices|
+        indices.each do |i, m|
+          low |= (m >> 1) << (16 + i)
+          low |= (m & 1) << i
+        end
+      end
+      [high, low].pack("N2")
+    end
+
+    def self.encode_alpha_block(block)
+      alphas = block.map { |pixel| pixel[3] }
+      min, max = alphas.minmax
+      base = (min + max + 1) / 2
+      # Table 13 has a 0 modifier, for uniform blocks
+      best = min == max ? [0, 13, 1, [4] * 16] : nil
+      EAC_MODIFIERS.each_with_index do |modifiers, table|
+        break if min == max
+        (1..15).each do |multiplier|
+          error = 0
+          indices = alphas.map do |a|
+            m = (0..7).min_by { |i| (clamp(base + modifiers[i] * multiplier) - a).abs }
+            error += (clamp(base + modifiers[m] * multiplier) - a) ** 2
+            m
+          end
+          best = [error, table, multiplier, indices] if best.nil? || error < best[0]
+        end
+      end
+      _, table, multiplier, indices = best
+      word = (base << 56) | (multiplier << 52) | (table << 48)
+      indices.each_with_index { |m, i| word |= m << (45 - i * 3) }
+      [word >> 32, word & 0xffffffff].pack("N2")
+    end
+
+    def self.encode(pixels, width, height, alpha: false)
+      output = "".b
+      (0...height).step(4) do |by|
+        (0...width).step(4) do |bx|
+          block = block_pixels(pixels, width, height, bx, by)
+          output << encode_alpha_block(block) if alpha
+          output << encode_color_block(block)
+        end
+      end
+      output
+    end
+  end
+
+  # ASTC, through ARM astcenc when it's installed.
+  module ASTC
+    def self.encoder
+      ["astcenc", "astcenc-avx2", "astcenc-sse4.1", "astcenc-sse2",
+       "astcenc-neon"].find do |name|
+        ENV["PATH"].split(File::PATH_SEPARATOR).any? do |dir|
+          File.executable?(File.join(dir, name))
+        end
+      end
+    end
+
+    def self.available?
+      !encoder.nil?
+    end
+
+    # Uncompressed 32 bits TGA, top-left origin, so that astcenc reads
+    # the rows in the same order as we store them.
+    def self.write_tga(filename, pixels, width, height)
+      File.open(filename, "wb") do |out|
+        out.write([0, 0, 2, 0, 0, 0, 0, 0, width, height, 32, 0x28]
+                    .pack("CCCvvCvvvvCC"))
+        out.write(pixels.map { |r, g, b, a| [b, g, r, a] }.flatten.pack("C*"))
+      end
+    end
+
+    def self.encode(pixels, width, height, block: "4x4")
+      require 'tmpdir'
+      Dir.mktmpdir do |dir|
+        input, output = File.join(dir, "in.tga"), File.join(dir, "out.astc")
+        write_tga(input, pixels, width, height)
+        system(encoder, "-cl", input, output, block, "-medium",
+               out: File::NULL) or raise "#{encoder} failed"
+        # Skip the 16 bytes .astc header
+        File.binread(output)[16..]
+      end
+    end
+  end
+end
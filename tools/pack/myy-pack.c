@@ -0,0 +1,125 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Build an asset pack (see src/helpers/asset_pack.h).
+ *
+ * Usage : myy-pack output.pack file_or_directory...
+ *
+ * Directories are packed recursively. Assets are stored under the
+ * path given on the command line, so run myy-pack from the directory
+ * the program will be launched from :
+ *   myy-pack assets.pack shaders textures/cursor.raw */
+
+#include "pack_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define ERROR(...) fprintf(stderr, __VA_ARGS__)
+
+struct path_list {
+	char ** paths;
+	unsigned int n, allocated;
+};
+
+static int add_path
+(struct path_list * __restrict const list,
+ char const * __restrict path)
+{
+	if (list->n == list->allocated) {
+		unsigned int const allocated = list->allocated ? list->allocated * 2 : 64;
+		char ** const paths = realloc(list->paths, allocated * sizeof(char *));
+		if (paths == NULL) return -1;
+		list->paths = paths;
+		list->allocated = allocated;
+	}
+
+	/* Assets are looked up without the leading "./" */
+	while (path[0] == '.' && path[1] == '/') path += 2;
+	if ((list->paths[list->n] = strdup(path)) == NULL) return -1;
+	list->n++;
+	return 0;
+}
+
+static int add_tree
+(struct path_list * __restrict const list,
+ char const * __restrict const path)
+{
+	struct stat path_stats;
+	if (stat(path, &path_stats) != 0) {
+		ERROR("Could not stat %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (!S_ISDIR(path_stats.st_mode)) return add_path(list, path);
+
+	DIR * __restrict const dir = opendir(path);
+	if (dir == NULL) {
+		ERROR("Could not open %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	int ret = 0;
+	struct dirent const * __restrict entry;
+	while (ret == 0 && (entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') continue;
+		size_t const length = strlen(path) + strlen(entry->d_name) + 2;
+		char * __restrict const child = malloc(length);
+		if (child == NULL) { ret = -1; break; }
+		snprintf(child, length, "%s/%s", path, entry->d_name);
+		ret = add_tree(list, child);
+		free(child);
+	}
+	closedir(dir);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct path_list list = {0};
+	int ret = 0;
+
+	if (argc < 3) {
+		ERROR("Usage : %s output.pack file_or_directory...\n", argv[0]);
+		return 1;
+	}
+
+	for (int a = 2; a < argc && ret == 0; a++)
+		ret = add_tree(&list, argv[a]);
+
+	if (ret == 0) {
+		char const * const * const paths = (char const * const *) list.paths;
+		ret = pw_WriteAssetPack(argv[1], paths, paths, list.n);
+	}
+	if (ret == 0) printf("%s : %u assets\n", argv[1], list.n);
+
+	for (unsigned int p = 0; p < list.n; p++) free(list.paths[p]);
+	free(list.paths);
+	return ret ? 1 : 0;
+}
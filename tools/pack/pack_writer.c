@@ -0,0 +1,201 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pack_writer.h"
+
+#include <helpers/asset_pack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define ERROR(...) fprintf(stderr, __VA_ARGS__)
+
+struct pack_file {
+	char const * name;
+	char const * source;
+	uint64_t size;
+};
+
+static int by_name(void const * a, void const * b)
+{
+	return strcmp(
+		((struct pack_file const *) a)->name,
+		((struct pack_file const *) b)->name);
+}
+
+static uint64_t aligned(uint64_t const offset)
+{
+	return (offset + MYY_ASSET_PACK_ALIGNMENT - 1) &
+		~((uint64_t) MYY_ASSET_PACK_ALIGNMENT - 1);
+}
+
+static void put_le
+(uint8_t * __restrict const bytes,
+ uint64_t const value,
+ unsigned int const size)
+{
+	for (unsigned int b = 0; b < size; b++)
+		bytes[b] = value >> (b * 8);
+}
+
+static int write_zeroes
+(FILE * __restrict const pack,
+ uint64_t n)
+{
+	static uint8_t const zeroes[MYY_ASSET_PACK_ALIGNMENT];
+	while (n) {
+		size_t const chunk = n < sizeof(zeroes) ? n : sizeof(zeroes);
+		if (fwrite(zeroes, 1, chunk, pack) != chunk) return -1;
+		n -= chunk;
+	}
+	return 0;
+}
+
+static int copy_file
+(FILE * __restrict const pack,
+ struct pack_file const * __restrict const file)
+{
+	uint8_t buffer[65536];
+	uint64_t copied = 0;
+	FILE * __restrict const source = fopen(file->source, "rb");
+
+	if (source == NULL) {
+		ERROR("Could not open %s : %s\n", file->source, strerror(errno));
+		return -1;
+	}
+
+	size_t n_read;
+	while ((n_read = fread(buffer, 1, sizeof(buffer), source)) > 0) {
+		if (fwrite(buffer, 1, n_read, pack) != n_read) break;
+		copied += n_read;
+	}
+	fclose(source);
+
+	if (copied != file->size) {
+		ERROR("%s changed while being packed\n", file->source);
+		return -1;
+	}
+	return 0;
+}
+
+int pw_WriteAssetPack
+(char const * __restrict const pack_pathname,
+ char const * const * __restrict const names,
+ char const * const * __restrict const sources,
+ unsigned int const n)
+{
+	int ret = -1;
+	FILE * __restrict pack = NULL;
+	struct pack_file * __restrict const files =
+		calloc(n ? n : 1, sizeof(struct pack_file));
+	uint8_t * __restrict const toc = calloc(
+		1, sizeof(struct myy_asset_pack_header) +
+		   (size_t) n * sizeof(struct myy_asset_pack_entry));
+
+	if (files == NULL || toc == NULL) goto out;
+
+	uint64_t names_size = 0;
+	for (unsigned int f = 0; f < n; f++) {
+		FILE * __restrict const source = fopen(sources[f], "rb");
+		if (source == NULL || fseek(source, 0, SEEK_END) != 0) {
+			ERROR("Could not read %s : %s\n", sources[f], strerror(errno));
+			if (source) fclose(source);
+			goto out;
+		}
+		files[f].name   = names[f];
+		files[f].source = sources[f];
+		files[f].size   = ftell(source);
+		fclose(source);
+		names_size += strlen(names[f]) + 1;
+	}
+
+	qsort(files, n, sizeof(struct pack_file), by_name);
+	for (unsigned int f = 1; f < n; f++) {
+		if (strcmp(files[f-1].name, files[f].name) == 0) {
+			ERROR("%s is packed twice\n", files[f].name);
+			goto out;
+		}
+	}
+
+	/* Table of contents */
+	size_t const toc_size = sizeof(struct myy_asset_pack_header) +
+		(size_t) n * sizeof(struct myy_asset_pack_entry);
+	uint64_t const names_offset = toc_size;
+	uint64_t data_offset = aligned(names_offset + names_size);
+	uint32_t name_offset = 0;
+
+	for (unsigned int f = 0; f < n; f++) {
+		uint8_t * __restrict const entry = toc +
+			sizeof(struct myy_asset_pack_header) +
+			f * sizeof(struct myy_asset_pack_entry);
+		uint32_t const name_length = strlen(files[f].name);
+
+		put_le(entry+0,  data_offset, 8);
+		put_le(entry+8,  files[f].size, 8);
+		put_le(entry+16, name_offset, 4);
+		put_le(entry+20, name_length, 4);
+
+		name_offset += name_length + 1;
+		/* Keep at least one '\0' after each asset */
+		data_offset = aligned(data_offset + files[f].size + 1);
+	}
+
+	memcpy(toc, MYY_ASSET_PACK_MAGIC, 8);
+	put_le(toc+8,  n, 4);
+	put_le(toc+12, names_offset, 4);
+	put_le(toc+16, data_offset, 8);
+
+	pack = fopen(pack_pathname, "wb");
+	if (pack == NULL) {
+		ERROR("Could not create %s : %s\n", pack_pathname, strerror(errno));
+		goto out;
+	}
+
+	if (fwrite(toc, toc_size, 1, pack) != 1) goto write_error;
+	for (unsigned int f = 0; f < n; f++) {
+		if (fwrite(files[f].name, strlen(files[f].name) + 1, 1, pack) != 1)
+			goto write_error;
+	}
+	if (write_zeroes(pack, aligned(names_offset + names_size) -
+	                       (names_offset + names_size)))
+		goto write_error;
+
+	for (unsigned int f = 0; f < n; f++) {
+		if (copy_file(pack, files+f)) goto out;
+		if (write_zeroes(pack, aligned(files[f].size + 1) - files[f].size))
+			goto write_error;
+	}
+
+	ret = 0;
+	goto out;
+
+write_error:
+	ERROR("Could not write %s : %s\n", pack_pathname, strerror(errno));
+out:
+	if (pack && fclose(pack) != 0) ret = -1;
+	free(toc);
+	free(files);
+	return ret;
+}
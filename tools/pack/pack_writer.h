@@ -0,0 +1,48 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_TOOLS_PACK_WRITER_H
+#define MYY_TOOLS_PACK_WRITER_H 1
+
+/**
+ * Write an asset pack (see src/helpers/asset_pack.h) storing `n`
+ * files.
+ *
+ * PARAMS :
+ * @param pack_pathname Where to write the pack
+ * @param names   The names used to look the files up at runtime
+ *                (e.g. shaders/cursor.vsh). Must be unique.
+ * @param sources The files to read, on the filesystem.
+ *                Can be the same array as names.
+ * @param n       The number of files
+ *
+ * RETURNS :
+ * @return 0 on success, -1 on failure
+ */
+int pw_WriteAssetPack
+(char const * __restrict const pack_pathname,
+ char const * const * __restrict const names,
+ char const * const * __restrict const sources,
+ unsigned int const n);
+
+#endif
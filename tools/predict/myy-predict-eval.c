@@ -0,0 +1,256 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Score the cursor prediction modes against recorded input.
+ *
+ * Usage : myy-predict-eval [options] trace...
+ *   --refresh-hz HZ     Frames rate of the simulated display (60)
+ *   --latency-us US     Time between drawing a frame and seeing it
+ *                       (two refresh periods)
+ *   --accel PROFILE     Pointer acceleration, as MYY_POINTER_ACCEL
+ *
+ * Traces are raw struct input_event records, as read from
+ * /dev/input/event* nodes :
+ *   cat /dev/input/event3 > moves.trace
+ * These are the files accepted by the "replay" control command.
+ *
+ * Each trace is replayed through the pointer acceleration. At each
+ * simulated frame, the cursor position predicted for the time the frame
+ * is seen is compared to the position the pointer actually had then.
+ * The "off" mode shows the error caused by the latency alone. */
+
+#include <helpers/pointer.h>
+
+#include <linux/input.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ERROR(...) fprintf(stderr, __VA_ARGS__)
+
+#if !defined(input_event_sec)
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+struct report {
+	uint64_t time_us;
+	int32_t x, y;
+};
+
+struct reports {
+	struct report * reports;
+	size_t n, allocated;
+	/* SYN_DROPPED found in the trace */
+	size_t resyncs;
+};
+
+static int add_report
+(struct reports * __restrict const list,
+ uint64_t const time_us,
+ int32_t const x, int32_t const y)
+{
+	if (list->n == list->allocated) {
+		size_t const allocated = list->allocated ? list->allocated * 2 : 4096;
+		struct report * const reports =
+			realloc(list->reports, allocated * sizeof(struct report));
+		if (reports == NULL) return -1;
+		list->reports = reports;
+		list->allocated = allocated;
+	}
+	list->reports[list->n++] = (struct report) { time_us, x, y };
+	return 0;
+}
+
+/* Turn the relative motions of the trace into cursor positions.
+ * The cursor is not limited by screen edges.
+ * After a SYN_DROPPED, the incomplete report and the events up to the
+ * next SYN_REPORT are discarded, like the program does. */
+static int read_trace
+(char const * __restrict const path,
+ struct ph_accel_config const * __restrict const accel_config,
+ struct reports * __restrict const list)
+{
+	FILE * __restrict const file = fopen(path, "rb");
+	if (file == NULL) {
+		ERROR("Could not open %s : %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct ph_pointer accel;
+	struct input_event event;
+	int32_t dx = 0, dy = 0, x = 0, y = 0;
+	unsigned int dropping = 0;
+	int ret = 0;
+
+	ph_PointerInit(&accel, accel_config);
+	while (ret == 0 && fread(&event, sizeof(event), 1, file) == 1) {
+		if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+			dx = dy = 0;
+			dropping = 1;
+			list->resyncs++;
+		}
+		else if (dropping)
+			dropping = !(event.type == EV_SYN && event.code == SYN_REPORT);
+		else if (event.type == EV_REL && event.code == REL_X) dx += event.value;
+		else if (event.type == EV_REL && event.code == REL_Y) dy += event.value;
+		else if (event.type == EV_SYN && event.code == SYN_REPORT &&
+		         (dx || dy))
+		{
+			int32_t px, py;
+			uint64_t const time_us =
+				(uint64_t) event.input_event_sec * 1000000 +
+				event.input_event_usec;
+			ph_PointerMove(&accel, dx, dy, time_us, &px, &py);
+			x += px;
+			y += py;
+			dx = dy = 0;
+			ret = add_report(list, time_us, x, y);
+		}
+	}
+
+	fclose(file);
+	return ret;
+}
+
+static int compare_floats(void const * a, void const * b)
+{
+	float const fa = *(float const *) a, fb = *(float const *) b;
+	return (fa > fb) - (fa < fb);
+}
+
+/* Returns 0 on success, -1 when out of memory */
+static int evaluate
+(struct reports const * __restrict const list,
+ enum ph_predict_mode const mode,
+ uint64_t const period_us,
+ uint64_t const latency_us)
+{
+	struct report const * __restrict const reports = list->reports;
+	size_t const n = list->n;
+	struct ph_predictor predictor;
+
+	uint64_t const first_us = reports[0].time_us;
+	uint64_t const last_us  = reports[n-1].time_us;
+	size_t const n_frames = (last_us - first_us) / period_us + 1;
+	float * __restrict const errors = malloc(n_frames * sizeof(float));
+	if (errors == NULL) return -1;
+
+	size_t fed = 0, seen = 0, n_errors = 0;
+	double sum = 0;
+
+	ph_PredictorInit(&predictor, mode);
+	for (uint64_t frame_us = first_us; frame_us <= last_us;
+	     frame_us += period_us)
+	{
+		uint64_t const target_us = frame_us + latency_us;
+		float predicted_x, predicted_y;
+
+		/* The reports read before drawing the frame */
+		for (; fed < n && reports[fed].time_us <= frame_us; fed++)
+			ph_PredictorAddSample(
+			  &predictor, reports[fed].x, reports[fed].y,
+			  reports[fed].time_us);
+		if (!ph_PredictorPredict(
+		      &predictor, frame_us, target_us, &predicted_x, &predicted_y))
+			continue;
+
+		/* Where the pointer was when the frame was seen */
+		if (seen < fed) seen = fed - 1;
+		while (seen + 1 < n && reports[seen + 1].time_us <= target_us) seen++;
+
+		float const error_x = predicted_x - reports[seen].x;
+		float const error_y = predicted_y - reports[seen].y;
+		float const error = sqrtf(error_x * error_x + error_y * error_y);
+		errors[n_errors++] = error;
+		sum += error;
+	}
+
+	if (n_errors) {
+		qsort(errors, n_errors, sizeof(float), compare_floats);
+		printf("  %-8s mean %7.2f px  p50 %7.2f  p95 %7.2f  max %7.2f\n",
+		  ph_PredictModeName(mode), sum / n_errors,
+		  errors[n_errors / 2], errors[n_errors * 95 / 100],
+		  errors[n_errors - 1]);
+	}
+
+	free(errors);
+	return 0;
+}
+
+static void usage(char const * __restrict const program)
+{
+	ERROR("Usage : %s [--refresh-hz HZ] [--latency-us US] "
+	      "[--accel PROFILE] trace...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+	struct ph_accel_config accel_config;
+	double refresh_hz = 60;
+	long latency_us = -1;
+	int a = 1, ret = 0;
+
+	ph_AccelDefaultConfig(&accel_config);
+
+	for (; a < argc && strncmp(argv[a], "--", 2) == 0; a += 2) {
+		if (a + 1 >= argc) { usage(argv[0]); return 1; }
+		if (strcmp(argv[a], "--refresh-hz") == 0)
+			refresh_hz = atof(argv[a+1]);
+		else if (strcmp(argv[a], "--latency-us") == 0)
+			latency_us = atol(argv[a+1]);
+		else if (strcmp(argv[a], "--accel") == 0) {
+			if (!ph_AccelParseConfig(argv[a+1], &accel_config)) {
+				ERROR("Invalid acceleration profile : %s\n", argv[a+1]);
+				return 1;
+			}
+		}
+		else { usage(argv[0]); return 1; }
+	}
+	if (a == argc || refresh_hz <= 0) { usage(argv[0]); return 1; }
+
+	uint64_t const period_us = 1000000 / refresh_hz;
+	if (latency_us < 0) latency_us = 2 * period_us;
+
+	for (; a < argc && ret == 0; a++) {
+		struct reports list = {0};
+
+		ret = read_trace(argv[a], &accel_config, &list);
+		if (ret == 0 && list.n < 2)
+			ERROR("%s : not enough motion to evaluate\n", argv[a]);
+		else if (ret == 0) {
+			printf("%s : %zu reports, %zu resyncs, %.1f s, latency %ld us\n",
+			  argv[a], list.n, list.resyncs,
+			  (list.reports[list.n-1].time_us - list.reports[0].time_us) / 1e6,
+			  latency_us);
+			for (unsigned int m = 0; m < PH_PREDICT_MODES && ret == 0; m++)
+				ret = evaluate(&list, m, period_us, latency_us);
+		}
+		free(list.reports);
+	}
+
+	return ret ? 1 : 0;
+}
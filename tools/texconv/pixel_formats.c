@@ -0,0 +1,690 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "pixel_formats.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PF_HAVE_AVX2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* bits : number of bits used to store the component */
+#define PF_COMPONENT(shift, bits) { \
+	shift, \
+	(1 << (bits)) - 1, \
+	((bits) == 1) ? 255 : (1 << (8 - (bits))), \
+	((bits) == 1) ? 1 : 0, \
+	((bits) == 1) ? 8 : (8 - (bits)) \
+}
+
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_RGBA 0x1908
+#define GL_UNSIGNED_SHORT_4_4_4_4 0x8033
+#define GL_UNSIGNED_SHORT_5_5_5_1 0x8034
+#define GL_BGRA_EXT 0x80E1
+#define GL_UNSIGNED_SHORT_1_5_5_5_REV_EXT 0x8366
+
+/* Same order and headers as MyyColor.
+ * argb5551 and bgra8888 are not written by MyyColor::OpenGL. They use
+ * the GL_EXT_texture_format_BGRA8888 and GL_EXT_read_format_bgra
+ * enums that describe their layout. */
+static struct pf_format const formats[] = {
+	{
+		.name = "rgba4444", .bytes_per_pixel = 2,
+		.rgba = {
+			PF_COMPONENT(12, 4), PF_COMPONENT(8, 4),
+			PF_COMPONENT(4, 4), PF_COMPONENT(0, 4)
+		},
+		.gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_4_4_4_4,
+		.alignment = 2
+	},
+	{
+		.name = "rgba5551", .bytes_per_pixel = 2,
+		.rgba = {
+			PF_COMPONENT(11, 5), PF_COMPONENT(6, 5),
+			PF_COMPONENT(1, 5), PF_COMPONENT(0, 1)
+		},
+		.gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_5_5_5_1,
+		.alignment = 2
+	},
+	{
+		.name = "argb5551", .bytes_per_pixel = 2,
+		.rgba = {
+			PF_COMPONENT(10, 5), PF_COMPONENT(5, 5),
+			PF_COMPONENT(0, 5), PF_COMPONENT(15, 1)
+		},
+		.gl_format = GL_BGRA_EXT,
+		.gl_type = GL_UNSIGNED_SHORT_1_5_5_5_REV_EXT,
+		.alignment = 2
+	},
+	{
+		.name = "rgba8888", .bytes_per_pixel = 4,
+		.rgba = {
+			PF_COMPONENT(24, 8), PF_COMPONENT(16, 8),
+			PF_COMPONENT(8, 8), PF_COMPONENT(0, 8)
+		},
+		.gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE,
+		.alignment = 4
+	},
+	{
+		.name = "bgra8888", .bytes_per_pixel = 4,
+		.rgba = {
+			PF_COMPONENT(8, 8), PF_COMPONENT(16, 8),
+			PF_COMPONENT(24, 8), PF_COMPONENT(0, 8)
+		},
+		.gl_format = GL_BGRA_EXT, .gl_type = GL_UNSIGNED_BYTE,
+		.alignment = 4
+	},
+	{
+		/* Written as A, R, G, B bytes, with MyyColor headers */
+		.name = "argb8888", .bytes_per_pixel = 4,
+		.rgba = {
+			PF_COMPONENT(16, 8), PF_COMPONENT(8, 8),
+			PF_COMPONENT(0, 8), PF_COMPONENT(24, 8)
+		},
+		.gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE,
+		.alignment = 4
+	}
+};
+
+#define N_FORMATS (sizeof(formats) / sizeof(struct pf_format))
+
+struct pf_format const * pf_FormatByName
+(char const * __restrict const name)
+{
+	for (unsigned int f = 0; f < N_FORMATS; f++)
+		if (strcmp(formats[f].name, name) == 0) return formats+f;
+	return (struct pf_format const *) 0;
+}
+
+struct pf_format const * pf_Formats
+(unsigned int * __restrict const count)
+{
+	*count = N_FORMATS;
+	return formats;
+}
+
+/* ---- Scalar ---- */
+
+static inline uint32_t scalar_decode_pixel
+(struct pf_format const * __restrict const from,
+ uint32_t const value)
+{
+	uint32_t pixel = 0;
+	for (unsigned int c = 0; c < 4; c++) {
+		struct pf_component const * __restrict const comp =
+			from->rgba+c;
+		pixel |=
+			(((value >> comp->shift) & comp->mask) * comp->mult) << (c*8);
+	}
+	return pixel;
+}
+
+static inline uint32_t saturated_add_u8x4
+(uint32_t const a, uint32_t const b)
+{
+	uint32_t result = 0;
+	for (unsigned int c = 0; c < 32; c += 8) {
+		uint32_t sum = ((a >> c) & 0xff) + ((b >> c) & 0xff);
+		result |= (sum > 0xff ? 0xff : sum) << c;
+	}
+	return result;
+}
+
+static inline uint32_t scalar_encode_pixel
+(struct pf_format const * __restrict const to,
+ uint32_t const pixel)
+{
+	uint32_t value = 0;
+	for (unsigned int c = 0; c < 4; c++) {
+		struct pf_component const * __restrict const comp = to->rgba+c;
+		uint32_t const component = (pixel >> (c*8)) & 0xff;
+		value |=
+			((component + comp->div_bias) >> comp->div_shift) << comp->shift;
+	}
+	return value;
+}
+
+static void scalar_decode
+(struct pf_format const * __restrict const from,
+ void const * __restrict const src,
+ uint32_t * __restrict const dst,
+ size_t const n_pixels)
+{
+	uint8_t const * __restrict const bytes = (uint8_t const *) src;
+	if (from->bytes_per_pixel == 2) {
+		for (size_t p = 0; p < n_pixels; p++) {
+			uint32_t const value = bytes[p*2] | (bytes[p*2+1] << 8);
+			dst[p] = scalar_decode_pixel(from, value);
+		}
+	}
+	else {
+		for (size_t p = 0; p < n_pixels; p++) {
+			uint8_t const * __restrict const b = bytes + p*4;
+			uint32_t const value =
+				b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+			dst[p] = scalar_decode_pixel(from, value);
+		}
+	}
+}
+
+/* first_x : x coordinate of src[0], used to pick the dither offsets */
+static void scalar_encode_from
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither,
+ size_t const first_x)
+{
+	uint8_t * __restrict const bytes = (uint8_t *) dst;
+	for (size_t p = 0; p < n_pixels; p++) {
+		uint32_t pixel = src[p];
+		if (dither) pixel = saturated_add_u8x4(pixel, dither[(first_x+p)&3]);
+		uint32_t const value = scalar_encode_pixel(to, pixel);
+		if (to->bytes_per_pixel == 2) {
+			bytes[p*2]   = value;
+			bytes[p*2+1] = value >> 8;
+		}
+		else {
+			bytes[p*4]   = value >> 24;
+			bytes[p*4+1] = value >> 16;
+			bytes[p*4+2] = value >> 8;
+			bytes[p*4+3] = value;
+		}
+	}
+}
+
+static void scalar_encode
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither)
+{
+	scalar_encode_from(to, src, dst, n_pixels, dither, 0);
+}
+
+/* ---- SSE2 ----
+ * Components never exceed 255, and mult never exceeds 255, so the
+ * 16 bits multiplication of 32 bits lanes is exact. */
+
+#if defined(__SSE2__)
+
+struct sse2_component {
+	__m128i shift, mask, mult, bias, div_shift, position;
+};
+
+static inline void sse2_components
+(struct pf_format const * __restrict const format,
+ struct sse2_component * __restrict const components)
+{
+	for (unsigned int c = 0; c < 4; c++) {
+		struct pf_component const * __restrict const comp =
+			format->rgba+c;
+		components[c].shift     = _mm_cvtsi32_si128(comp->shift);
+		components[c].mask      = _mm_set1_epi32(comp->mask);
+		components[c].mult      = _mm_set1_epi32(comp->mult);
+		components[c].bias      = _mm_set1_epi32(comp->div_bias);
+		components[c].div_shift = _mm_cvtsi32_si128(comp->div_shift);
+		components[c].position  = _mm_cvtsi32_si128(c*8);
+	}
+}
+
+static inline __m128i sse2_decode4
+(struct sse2_component const * __restrict const comps,
+ __m128i const values)
+{
+	__m128i pixels = _mm_setzero_si128();
+	for (unsigned int c = 0; c < 4; c++) {
+		__m128i component = _mm_srl_epi32(values, comps[c].shift);
+		component = _mm_and_si128(component, comps[c].mask);
+		component = _mm_mullo_epi16(component, comps[c].mult);
+		pixels = _mm_or_si128(pixels,
+			_mm_sll_epi32(component, comps[c].position));
+	}
+	return pixels;
+}
+
+static inline __m128i sse2_encode4
+(struct sse2_component const * __restrict const comps,
+ __m128i const pixels)
+{
+	__m128i const byte_mask = _mm_set1_epi32(0xff);
+	__m128i values = _mm_setzero_si128();
+	for (unsigned int c = 0; c < 4; c++) {
+		__m128i component = _mm_srl_epi32(pixels, comps[c].position);
+		component = _mm_and_si128(component, byte_mask);
+		component = _mm_add_epi32(component, comps[c].bias);
+		component = _mm_srl_epi32(component, comps[c].div_shift);
+		values = _mm_or_si128(values,
+			_mm_sll_epi32(component, comps[c].shift));
+	}
+	return values;
+}
+
+static void sse2_decode
+(struct pf_format const * __restrict const from,
+ void const * __restrict const src,
+ uint32_t * __restrict const dst,
+ size_t const n_pixels)
+{
+	struct sse2_component comps[4];
+	sse2_components(from, comps);
+	uint8_t const * __restrict const bytes = (uint8_t const *) src;
+	__m128i const zero = _mm_setzero_si128();
+	size_t p = 0;
+
+	if (from->bytes_per_pixel == 2) {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m128i const values =
+				_mm_loadu_si128((__m128i const *) (bytes + p*2));
+			_mm_storeu_si128((__m128i *) (dst+p),
+				sse2_decode4(comps, _mm_unpacklo_epi16(values, zero)));
+			_mm_storeu_si128((__m128i *) (dst+p+4),
+				sse2_decode4(comps, _mm_unpackhi_epi16(values, zero)));
+		}
+	}
+	else {
+		for (; p + 4 <= n_pixels; p += 4) {
+			__m128i const values =
+				_mm_loadu_si128((__m128i const *) (bytes + p*4));
+			_mm_storeu_si128((__m128i *) (dst+p),
+				sse2_decode4(comps, values));
+		}
+	}
+
+	scalar_decode(from, bytes + p * from->bytes_per_pixel, dst+p,
+		n_pixels - p);
+}
+
+static inline __m128i sse2_bswap32(__m128i values)
+{
+	values = _mm_shufflelo_epi16(values, _MM_SHUFFLE(2,3,0,1));
+	values = _mm_shufflehi_epi16(values, _MM_SHUFFLE(2,3,0,1));
+	return _mm_or_si128(
+		_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8));
+}
+
+static void sse2_encode
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither)
+{
+	struct sse2_component comps[4];
+	sse2_components(to, comps);
+	uint8_t * __restrict const bytes = (uint8_t *) dst;
+	__m128i const offsets = dither
+		? _mm_loadu_si128((__m128i const *) dither)
+		: _mm_setzero_si128();
+	size_t p = 0;
+
+	if (to->bytes_per_pixel == 2) {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m128i low  = _mm_loadu_si128((__m128i const *) (src+p));
+			__m128i high = _mm_loadu_si128((__m128i const *) (src+p+4));
+			low  = sse2_encode4(comps, _mm_adds_epu8(low, offsets));
+			high = sse2_encode4(comps, _mm_adds_epu8(high, offsets));
+			/* packs_epi32 saturates signed values. Sign-extend the 16
+			 * bits values first to keep them intact. */
+			low  = _mm_srai_epi32(_mm_slli_epi32(low, 16), 16);
+			high = _mm_srai_epi32(_mm_slli_epi32(high, 16), 16);
+			_mm_storeu_si128((__m128i *) (bytes + p*2),
+				_mm_packs_epi32(low, high));
+		}
+	}
+	else {
+		for (; p + 4 <= n_pixels; p += 4) {
+			__m128i pixels = _mm_loadu_si128((__m128i const *) (src+p));
+			pixels = sse2_encode4(comps, _mm_adds_epu8(pixels, offsets));
+			_mm_storeu_si128((__m128i *) (bytes + p*4),
+				sse2_bswap32(pixels));
+		}
+	}
+
+	scalar_encode_from(to, src+p, bytes + p * to->bytes_per_pixel,
+		n_pixels - p, dither, p);
+}
+
+#endif
+
+/* ---- AVX2 ----
+ * Selected at runtime, with __builtin_cpu_supports. */
+
+#if defined(PF_HAVE_AVX2)
+
+#define PF_AVX2 __attribute__((target("avx2")))
+
+struct avx2_component {
+	__m128i shift, div_shift, position;
+	__m256i mask, mult, bias;
+};
+
+PF_AVX2 static inline void avx2_components
+(struct pf_format const * __restrict const format,
+ struct avx2_component * __restrict const components)
+{
+	for (unsigned int c = 0; c < 4; c++) {
+		struct pf_component const * __restrict const comp =
+			format->rgba+c;
+		components[c].shift     = _mm_cvtsi32_si128(comp->shift);
+		components[c].mask      = _mm256_set1_epi32(comp->mask);
+		components[c].mult      = _mm256_set1_epi32(comp->mult);
+		components[c].bias      = _mm256_set1_epi32(comp->div_bias);
+		components[c].div_shift = _mm_cvtsi32_si128(comp->div_shift);
+		components[c].position  = _mm_cvtsi32_si128(c*8);
+	}
+}
+
+PF_AVX2 static inline __m256i avx2_decode8
+(struct avx2_component const * __restrict const comps,
+ __m256i const values)
+{
+	__m256i pixels = _mm256_setzero_si256();
+	for (unsigned int c = 0; c < 4; c++) {
+		__m256i component = _mm256_srl_epi32(values, comps[c].shift);
+		component = _mm256_and_si256(component, comps[c].mask);
+		component = _mm256_mullo_epi16(component, comps[c].mult);
+		pixels = _mm256_or_si256(pixels,
+			_mm256_sll_epi32(component, comps[c].position));
+	}
+	return pixels;
+}
+
+PF_AVX2 static inline __m256i avx2_encode8
+(struct avx2_component const * __restrict const comps,
+ __m256i const pixels)
+{
+	__m256i const byte_mask = _mm256_set1_epi32(0xff);
+	__m256i values = _mm256_setzero_si256();
+	for (unsigned int c = 0; c < 4; c++) {
+		__m256i component = _mm256_srl_epi32(pixels, comps[c].position);
+		component = _mm256_and_si256(component, byte_mask);
+		component = _mm256_add_epi32(component, comps[c].bias);
+		component = _mm256_srl_epi32(component, comps[c].div_shift);
+		values = _mm256_or_si256(values,
+			_mm256_sll_epi32(component, comps[c].shift));
+	}
+	return values;
+}
+
+PF_AVX2 static void avx2_decode
+(struct pf_format const * __restrict const from,
+ void const * __restrict const src,
+ uint32_t * __restrict const dst,
+ size_t const n_pixels)
+{
+	struct avx2_component comps[4];
+	avx2_components(from, comps);
+	uint8_t const * __restrict const bytes = (uint8_t const *) src;
+	size_t p = 0;
+
+	if (from->bytes_per_pixel == 2) {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m256i const values = _mm256_cvtepu16_epi32(
+				_mm_loadu_si128((__m128i const *) (bytes + p*2)));
+			_mm256_storeu_si256((__m256i *) (dst+p),
+				avx2_decode8(comps, values));
+		}
+	}
+	else {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m256i const values =
+				_mm256_loadu_si256((__m256i const *) (bytes + p*4));
+			_mm256_storeu_si256((__m256i *) (dst+p),
+				avx2_decode8(comps, values));
+		}
+	}
+
+	scalar_decode(from, bytes + p * from->bytes_per_pixel, dst+p,
+		n_pixels - p);
+}
+
+PF_AVX2 static void avx2_encode
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither)
+{
+	struct avx2_component comps[4];
+	avx2_components(to, comps);
+	uint8_t * __restrict const bytes = (uint8_t *) dst;
+	__m256i const offsets = dither
+		? _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((__m128i const *) dither))
+		: _mm256_setzero_si256();
+	__m256i const bswap32 = _mm256_setr_epi8(
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t p = 0;
+
+	if (to->bytes_per_pixel == 2) {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m256i values = _mm256_loadu_si256((__m256i const *) (src+p));
+			values = avx2_encode8(comps, _mm256_adds_epu8(values, offsets));
+			/* packus works on each 128 bits lane. Gather both packed
+			 * halves in the lower lane. */
+			values = _mm256_packus_epi32(values, values);
+			values = _mm256_permute4x64_epi64(values, _MM_SHUFFLE(0,0,2,0));
+			_mm_storeu_si128((__m128i *) (bytes + p*2),
+				_mm256_castsi256_si128(values));
+		}
+	}
+	else {
+		for (; p + 8 <= n_pixels; p += 8) {
+			__m256i pixels = _mm256_loadu_si256((__m256i const *) (src+p));
+			pixels = avx2_encode8(comps, _mm256_adds_epu8(pixels, offsets));
+			_mm256_storeu_si256((__m256i *) (bytes + p*4),
+				_mm256_shuffle_epi8(pixels, bswap32));
+		}
+	}
+
+	scalar_encode_from(to, src+p, bytes + p * to->bytes_per_pixel,
+		n_pixels - p, dither, p);
+}
+
+#endif
+
+/* ---- NEON ---- */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+struct neon_component {
+	int32x4_t shift_right, div_shift_right, shift, position, position_right;
+	uint32x4_t mask, bias;
+	uint32_t mult;
+};
+
+static inline void neon_components
+(struct pf_format const * __restrict const format,
+ struct neon_component * __restrict const components)
+{
+	for (unsigned int c = 0; c < 4; c++) {
+		struct pf_component const * __restrict const comp =
+			format->rgba+c;
+		components[c].shift_right     = vdupq_n_s32(-comp->shift);
+		components[c].shift           = vdupq_n_s32(comp->shift);
+		components[c].div_shift_right = vdupq_n_s32(-comp->div_shift);
+		components[c].position        = vdupq_n_s32(c*8);
+		components[c].position_right  = vdupq_n_s32(-(int32_t) (c*8));
+		components[c].mask            = vdupq_n_u32(comp->mask);
+		components[c].bias            = vdupq_n_u32(comp->div_bias);
+		components[c].mult            = comp->mult;
+	}
+}
+
+static inline uint32x4_t neon_decode4
+(struct neon_component const * __restrict const comps,
+ uint32x4_t const values)
+{
+	uint32x4_t pixels = vdupq_n_u32(0);
+	for (unsigned int c = 0; c < 4; c++) {
+		uint32x4_t component = vshlq_u32(values, comps[c].shift_right);
+		component = vandq_u32(component, comps[c].mask);
+		component = vmulq_n_u32(component, comps[c].mult);
+		pixels = vorrq_u32(pixels, vshlq_u32(component, comps[c].position));
+	}
+	return pixels;
+}
+
+static inline uint32x4_t neon_encode4
+(struct neon_component const * __restrict const comps,
+ uint32x4_t const pixels)
+{
+	uint32x4_t const byte_mask = vdupq_n_u32(0xff);
+	uint32x4_t values = vdupq_n_u32(0);
+	for (unsigned int c = 0; c < 4; c++) {
+		uint32x4_t component =
+			vshlq_u32(pixels, comps[c].position_right);
+		component = vandq_u32(component, byte_mask);
+		component = vaddq_u32(component, comps[c].bias);
+		component = vshlq_u32(component, comps[c].div_shift_right);
+		values = vorrq_u32(values, vshlq_u32(component, comps[c].shift));
+	}
+	return values;
+}
+
+static void neon_decode
+(struct pf_format const * __restrict const from,
+ void const * __restrict const src,
+ uint32_t * __restrict const dst,
+ size_t const n_pixels)
+{
+	struct neon_component comps[4];
+	neon_components(from, comps);
+	uint8_t const * __restrict const bytes = (uint8_t const *) src;
+	size_t p = 0;
+
+	if (from->bytes_per_pixel == 2) {
+		for (; p + 4 <= n_pixels; p += 4) {
+			uint32x4_t const values = vmovl_u16(
+				vreinterpret_u16_u8(vld1_u8(bytes + p*2)));
+			vst1q_u32(dst+p, neon_decode4(comps, values));
+		}
+	}
+	else {
+		for (; p + 4 <= n_pixels; p += 4) {
+			uint32x4_t const values =
+				vreinterpretq_u32_u8(vld1q_u8(bytes + p*4));
+			vst1q_u32(dst+p, neon_decode4(comps, values));
+		}
+	}
+
+	scalar_decode(from, bytes + p * from->bytes_per_pixel, dst+p,
+		n_pixels - p);
+}
+
+static void neon_encode
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither)
+{
+	struct neon_component comps[4];
+	neon_components(to, comps);
+	uint8_t * __restrict const bytes = (uint8_t *) dst;
+	uint8x16_t const offsets = dither
+		? vreinterpretq_u8_u32(vld1q_u32(dither))
+		: vdupq_n_u8(0);
+	size_t p = 0;
+
+	for (; p + 4 <= n_pixels; p += 4) {
+		uint32x4_t const pixels = vreinterpretq_u32_u8(
+			vqaddq_u8(vreinterpretq_u8_u32(vld1q_u32(src+p)), offsets));
+		uint32x4_t const values = neon_encode4(comps, pixels);
+		if (to->bytes_per_pixel == 2)
+			vst1_u8(bytes + p*2, vreinterpret_u8_u16(vmovn_u32(values)));
+		else
+			vst1q_u8(bytes + p*4, vrev32q_u8(vreinterpretq_u8_u32(values)));
+	}
+
+	scalar_encode_from(to, src+p, bytes + p * to->bytes_per_pixel,
+		n_pixels - p, dither, p);
+}
+
+#endif
+
+static struct pf_kernels const kernels[] = {
+#if defined(PF_HAVE_AVX2)
+	{ .name = "avx2", .decode = avx2_decode, .encode = avx2_encode },
+#endif
+#if defined(__SSE2__)
+	{ .name = "sse2", .decode = sse2_decode, .encode = sse2_encode },
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	{ .name = "neon", .decode = neon_decode, .encode = neon_encode },
+#endif
+	{ .name = "scalar", .decode = scalar_decode, .encode = scalar_encode }
+};
+
+struct pf_kernels const * pf_Kernels
+(unsigned int * __restrict const count)
+{
+	unsigned int first = 0;
+#if defined(PF_HAVE_AVX2)
+	if (!__builtin_cpu_supports("avx2")) first = 1;
+#endif
+	*count = sizeof(kernels) / sizeof(struct pf_kernels) - first;
+	return kernels+first;
+}
+
+static uint8_t const bayer4x4[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 }
+};
+
+unsigned int pf_DitherRow
+(struct pf_format const * __restrict const to,
+ uint32_t const y,
+ uint32_t * __restrict const dither)
+{
+	unsigned int dithered = 0;
+	for (unsigned int x = 0; x < 4; x++) {
+		uint32_t offsets = 0;
+		for (unsigned int c = 0; c < 4; c++) {
+			uint32_t const mult = to->rgba[c].mult;
+			if (mult > 1 && mult < 255) {
+				offsets |= (bayer4x4[y&3][x] * mult / 16) << (c*8);
+				dithered = 1;
+			}
+		}
+		dither[x] = offsets;
+	}
+	return dithered;
+}
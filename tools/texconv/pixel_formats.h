@@ -0,0 +1,110 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MYY_TEXCONV_PIXEL_FORMATS_H
+#define MYY_TEXCONV_PIXEL_FORMATS_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Pixel formats handled by MyyColor (textures/myy-color.rb).
+ *
+ * A pixel is a 16 or 32 bits value. Each component is extracted with
+ * ((value >> shift) & mask) * mult and stored back with
+ * component / mult << shift, exactly like MyyColor::DecompInfo, so that
+ * the native converter output is identical to the Ruby one.
+ *
+ * Values are read little-endian. When written, 16 bits values stay
+ * little-endian and 32 bits values are written big-endian, like
+ * MyyColor::OpenGL does ("S<*" and "I>*").
+ *
+ * Between a decode and an encode, pixels are stored as "canonical"
+ * 32 bits words : R, G, B, A bytes, in that order, in memory. */
+
+struct pf_component {
+	uint8_t shift;
+	uint8_t mask;
+	uint8_t mult;
+	/* component / mult == (component + div_bias) >> div_shift
+	 * for every component in [0,255] */
+	uint8_t div_bias;
+	uint8_t div_shift;
+};
+
+struct pf_format {
+	char const * __restrict const name;
+	uint8_t bytes_per_pixel;
+	struct pf_component rgba[4];
+	/* struct myy_raw_texture_content headers */
+	uint32_t gl_format;
+	uint32_t gl_type;
+	uint32_t alignment;
+};
+
+/* Returns the format named `name` (e.g. "rgba4444"), or 0 */
+struct pf_format const * pf_FormatByName
+(char const * __restrict const name);
+
+/* Returns all the formats, and stores their number in `count` */
+struct pf_format const * pf_Formats
+(unsigned int * __restrict const count);
+
+typedef void (*pf_decode_fn)
+(struct pf_format const * __restrict const from,
+ void const * __restrict const src,
+ uint32_t * __restrict const dst,
+ size_t const n_pixels);
+
+/* `dither` holds 4 canonical words added, with unsigned saturation,
+ * to pixels whose x coordinate modulo 4 is 0, 1, 2 and 3.
+ * `dst` must be the start of a row (x = 0). `dither` can be 0. */
+typedef void (*pf_encode_fn)
+(struct pf_format const * __restrict const to,
+ uint32_t const * __restrict const src,
+ void * __restrict const dst,
+ size_t const n_pixels,
+ uint32_t const * __restrict const dither);
+
+struct pf_kernels {
+	char const * __restrict const name;
+	pf_decode_fn decode;
+	pf_encode_fn encode;
+};
+
+/* Returns the kernels usable on this CPU, fastest first, and stores
+ * their number in `count`. The last one is always the scalar one. */
+struct pf_kernels const * pf_Kernels
+(unsigned int * __restrict const count);
+
+/* Fill `dither` with the 4x4 ordered (Bayer) dithering offsets of the
+ * row `y`, for the `to` format.
+ * Components stored with 4 or 5 bits get offsets in [0, mult[, other
+ * components get none.
+ *
+ * @return 0 if `to` does not benefit from dithering, 1 otherwise */
+unsigned int pf_DitherRow
+(struct pf_format const * __restrict const to,
+ uint32_t const y,
+ uint32_t * __restrict const dither);
+
+#endif
@@ -0,0 +1,449 @@
+/*
+	Copyright (c) 2017 Miouyouyou <Myy>
+
+	Permission is hereby granted, free of charge, to any person obtaining
+	a copy of this software and associated documentation files
+	(the "Software"), to deal in the Software without restriction,
+	including without limitation the rights to use, copy, modify, merge,
+	publish, distribute, sublicense, and/or sell copies of the Software,
+	and to permit persons to whom the Software is furnished to do so,
+	subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be
+	included in all copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+	EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+	MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+	IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+	CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+	TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* Native replacement for MyyColor::OpenGL.convert_bmp
+ * (textures/myy-color.rb).
+ *
+ * Converts a BMP, or a PNG when built with libpng, to a myy raw
+ * texture (struct myy_raw_texture_content). For the formats handled by
+ * MyyColor, the output is byte for byte the one generated by the Ruby
+ * converter.
+ *
+ * Usage :
+ *   myy-texconv [--from format] [--to format] [--dither]
+ *               [--kernel name] [--bench repetitions]
+ *               input.bmp|input.png output.raw
+ *
+ * --from is the BMP pixels format and defaults to argb8888.
+ * PNG pixels are always read as RGBA8888.
+ * --to defaults to rgba4444.
+ * --dither applies 4x4 ordered dithering to 4 and 5 bits components.
+ * --bench converts the image `repetitions` times with every kernel
+ * available and reports the megapixels converted per second. */
+
+#include "pixel_formats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#if defined(MYY_TEXCONV_PNG)
+#include <png.h>
+#endif
+
+#define ERROR(...) fprintf(stderr, __VA_ARGS__)
+
+struct source_image {
+	uint32_t width, height;
+	/* Pixels as stored in the file, rows after rows, bottom row first */
+	uint8_t * __restrict data;
+	uint32_t stride;
+	/* 0 when data is already canonical (PNG) */
+	struct pf_format const * __restrict format;
+};
+
+static uint8_t * read_file
+(char const * __restrict const filename,
+ size_t * __restrict const size)
+{
+	uint8_t * __restrict data = NULL;
+	FILE * __restrict const file = fopen(filename, "rb");
+	if (file == NULL) {
+		ERROR("Could not open %s : %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) == 0) {
+		long const file_size = ftell(file);
+		rewind(file);
+		if (file_size > 0 && (data = malloc(file_size)) != NULL) {
+			if (fread(data, 1, file_size, file) == (size_t) file_size)
+				*size = file_size;
+			else {
+				ERROR("Could not read %s\n", filename);
+				free(data);
+				data = NULL;
+			}
+		}
+	}
+
+	fclose(file);
+	return data;
+}
+
+static inline uint32_t le32(uint8_t const * __restrict const bytes)
+{
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+		((uint32_t) bytes[3] << 24);
+}
+
+/* Like MyyColor::BMP, only the pixel data offset and the dimensions
+ * are read. The pixels are expected to be stored in `from` format.
+ * Rows padding is skipped, and top-down BMP are flipped, so that the
+ * rows are always stored bottom row first. */
+static int load_bmp
+(char const * __restrict const filename,
+ struct pf_format const * __restrict const from,
+ struct source_image * __restrict const image)
+{
+	size_t size = 0;
+	uint8_t * __restrict const file = read_file(filename, &size);
+	if (file == NULL) return -1;
+
+	if (size < 0x1e || file[0] != 'B' || file[1] != 'M') {
+		ERROR("%s is not a BMP file\n", filename);
+		goto invalid_bmp;
+	}
+
+	uint32_t const start = le32(file+0x0a);
+	int32_t const raw_height = (int32_t) le32(file+0x16);
+	uint32_t const width = le32(file+0x12);
+	uint32_t const height = raw_height < 0 ? -raw_height : raw_height;
+	uint32_t const bpp = file[0x1c] | (file[0x1d] << 8);
+	uint32_t const stride = ((width * bpp + 31) / 32) * 4;
+
+	if (bpp != from->bytes_per_pixel * 8u) {
+		ERROR("%s stores %u bits pixels. %s pixels use %u bits\n",
+			filename, bpp, from->name, from->bytes_per_pixel * 8u);
+		goto invalid_bmp;
+	}
+	if (start > size || (size - start) / stride < height) {
+		ERROR("%s is truncated\n", filename);
+		goto invalid_bmp;
+	}
+
+	uint8_t * __restrict const data = malloc((size_t) stride * height);
+	if (data == NULL) goto invalid_bmp;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint32_t const file_row = raw_height < 0 ? height - 1 - y : y;
+		memcpy(data + (size_t) y * stride,
+			file + start + (size_t) file_row * stride, stride);
+	}
+
+	free(file);
+	image->width  = width;
+	image->height = height;
+	image->data   = data;
+	image->stride = stride;
+	image->format = from;
+	return 0;
+
+invalid_bmp:
+	free(file);
+	return -1;
+}
+
+#if defined(MYY_TEXCONV_PNG)
+/* PNG rows are stored top row first. They are flipped to match the BMP
+ * rows order, so that both generate the same texture. */
+static int load_png
+(char const * __restrict const filename,
+ struct source_image * __restrict const image)
+{
+	png_image png;
+	memset(&png, 0, sizeof(png));
+	png.version = PNG_IMAGE_VERSION;
+
+	if (!png_image_begin_read_from_file(&png, filename)) {
+		ERROR("Could not read %s : %s\n", filename, png.message);
+		return -1;
+	}
+
+	png.format = PNG_FORMAT_RGBA;
+	uint32_t const stride = png.width * 4;
+	uint8_t * __restrict const data = malloc(PNG_IMAGE_SIZE(png));
+	if (data == NULL) {
+		png_image_free(&png);
+		return -1;
+	}
+
+	/* A negative row stride makes libpng store the rows bottom-up */
+	if (!png_image_finish_read(&png, NULL, data, -(png_int_32) stride, NULL)) {
+		ERROR("Could not decode %s : %s\n", filename, png.message);
+		free(data);
+		return -1;
+	}
+
+	image->width  = png.width;
+	image->height = png.height;
+	image->data   = data;
+	image->stride = stride;
+	image->format = NULL;
+	return 0;
+}
+#endif
+
+static unsigned int has_suffix
+(char const * __restrict const name,
+ char const * __restrict const suffix)
+{
+	size_t const name_length = strlen(name);
+	size_t const suffix_length = strlen(suffix);
+	return name_length >= suffix_length &&
+		strcasecmp(name + name_length - suffix_length, suffix) == 0;
+}
+
+/* Convert the whole image into `output`, which must be able to store
+ * width * height * to->bytes_per_pixel bytes.
+ * `row` must be able to store `width` canonical pixels. */
+static void convert_image
+(struct source_image const * __restrict const image,
+ struct pf_format const * __restrict const to,
+ struct pf_kernels const * __restrict const kernel,
+ unsigned int const dither,
+ uint32_t * __restrict const row,
+ uint8_t * __restrict const output)
+{
+	size_t const output_stride = (size_t) image->width * to->bytes_per_pixel;
+	uint32_t offsets[4];
+
+	for (uint32_t y = 0; y < image->height; y++) {
+		uint8_t const * __restrict const src =
+			image->data + (size_t) y * image->stride;
+		uint32_t const * __restrict pixels = (uint32_t const *) src;
+
+		if (image->format) {
+			kernel->decode(image->format, src, row, image->width);
+			pixels = row;
+		}
+
+		unsigned int const dithered = dither && pf_DitherRow(to, y, offsets);
+		kernel->encode(to, pixels, output + y * output_stride,
+			image->width, dithered ? offsets : NULL);
+	}
+}
+
+static int write_raw_texture
+(char const * __restrict const filename,
+ struct source_image const * __restrict const image,
+ struct pf_format const * __restrict const to,
+ uint8_t const * __restrict const data)
+{
+	/* struct myy_raw_texture_content, little-endian */
+	uint32_t const header[6] = {
+		image->width, image->height, 0x0DE1 /* GL_TEXTURE_2D */,
+		to->gl_format, to->gl_type, to->alignment
+	};
+	uint8_t header_bytes[sizeof(header)];
+	for (unsigned int i = 0; i < 6; i++) {
+		header_bytes[i*4]   = header[i];
+		header_bytes[i*4+1] = header[i] >> 8;
+		header_bytes[i*4+2] = header[i] >> 16;
+		header_bytes[i*4+3] = header[i] >> 24;
+	}
+
+	size_t const data_size =
+		(size_t) image->width * image->height * to->bytes_per_pixel;
+	FILE * __restrict const file = fopen(filename, "wb");
+	if (file == NULL) {
+		ERROR("Could not create %s : %s\n", filename, strerror(errno));
+		return -1;
+	}
+	int ret = 0;
+	if (fwrite(header_bytes, sizeof(header_bytes), 1, file) != 1 ||
+	    (data_size && fwrite(data, data_size, 1, file) != 1)) {
+		ERROR("Could not write %s : %s\n", filename, strerror(errno));
+		ret = -1;
+	}
+	if (fclose(file) != 0) ret = -1;
+	return ret;
+}
+
+static double now_seconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Every kernel output is compared to the scalar one before being
+ * timed, so that a faster but wrong kernel does not go unnoticed. */
+static int benchmark
+(struct source_image const * __restrict const image,
+ struct pf_format const * __restrict const to,
+ unsigned int const dither,
+ unsigned int const repetitions,
+ uint32_t * __restrict const row,
+ uint8_t * __restrict const output)
+{
+	unsigned int n_kernels;
+	struct pf_kernels const * __restrict const kernels = pf_Kernels(&n_kernels);
+	struct pf_kernels const * __restrict const scalar = kernels+n_kernels-1;
+	size_t const output_size =
+		(size_t) image->width * image->height * to->bytes_per_pixel;
+	double const megapixels =
+		(double) image->width * image->height * repetitions / 1e6;
+	int ret = 0;
+
+	uint8_t * __restrict const reference = malloc(output_size);
+	if (reference == NULL) return -1;
+	convert_image(image, to, scalar, dither, row, reference);
+
+	printf("{\"from\": \"%s\", \"to\": \"%s\", \"width\": %u, "
+		"\"height\": %u, \"repetitions\": %u, \"kernels\": [",
+		image->format ? image->format->name : "png", to->name,
+		image->width, image->height, repetitions);
+
+	for (unsigned int k = 0; k < n_kernels; k++) {
+		convert_image(image, to, kernels+k, dither, row, output);
+		unsigned int const identical =
+			memcmp(output, reference, output_size) == 0;
+		if (!identical) ret = -1;
+
+		double const start = now_seconds();
+		for (unsigned int r = 0; r < repetitions; r++)
+			convert_image(image, to, kernels+k, dither, row, output);
+		double const elapsed = now_seconds() - start;
+
+		printf("%s\n  {\"kernel\": \"%s\", \"seconds\": %.6f, "
+			"\"megapixels_per_second\": %.2f, \"matches_scalar\": %s}",
+			k ? "," : "", kernels[k].name, elapsed,
+			elapsed > 0 ? megapixels / elapsed : 0.0,
+			identical ? "true" : "false");
+	}
+	printf("\n]}\n");
+
+	free(reference);
+	return ret;
+}
+
+static void usage(char const * __restrict const program)
+{
+	unsigned int n_formats, n_kernels;
+	struct pf_format const * __restrict const formats = pf_Formats(&n_formats);
+	struct pf_kernels const * __restrict const kernels = pf_Kernels(&n_kernels);
+
+	ERROR("Usage : %s [--from format] [--to format] [--dither]\n"
+	      "          [--kernel name] [--bench repetitions]\n"
+	      "          input.bmp|input.png output.raw\n"
+	      "Formats :", program);
+	for (unsigned int f = 0; f < n_formats; f++)
+		ERROR(" %s", formats[f].name);
+	ERROR("\nKernels :");
+	for (unsigned int k = 0; k < n_kernels; k++)
+		ERROR(" %s", kernels[k].name);
+	ERROR("\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct pf_format const * __restrict from = pf_FormatByName("argb8888");
+	struct pf_format const * __restrict to = pf_FormatByName("rgba4444");
+	unsigned int n_kernels;
+	struct pf_kernels const * __restrict const kernels = pf_Kernels(&n_kernels);
+	struct pf_kernels const * __restrict kernel = kernels;
+	unsigned int dither = 0;
+	unsigned int bench_repetitions = 0;
+	char const * __restrict input = NULL;
+	char const * __restrict output = NULL;
+
+	for (int a = 1; a < argc; a++) {
+		char const * __restrict const arg = argv[a];
+		char const * __restrict const value = (a + 1 < argc) ? argv[a+1] : NULL;
+
+		if (strcmp(arg, "--dither") == 0) dither = 1;
+		else if (strcmp(arg, "--from") == 0 && value) {
+			from = pf_FormatByName(value);
+			if (from == NULL) goto unknown_value;
+			a++;
+		}
+		else if (strcmp(arg, "--to") == 0 && value) {
+			to = pf_FormatByName(value);
+			if (to == NULL) goto unknown_value;
+			a++;
+		}
+		else if (strcmp(arg, "--kernel") == 0 && value) {
+			kernel = NULL;
+			for (unsigned int k = 0; k < n_kernels; k++)
+				if (strcmp(kernels[k].name, value) == 0) kernel = kernels+k;
+			if (kernel == NULL) goto unknown_value;
+			a++;
+		}
+		else if (strcmp(arg, "--bench") == 0 && value) {
+			bench_repetitions = strtoul(value, NULL, 10);
+			if (bench_repetitions == 0) goto unknown_value;
+			a++;
+		}
+		else if (arg[0] == '-' && arg[1] == '-') {
+			usage(argv[0]);
+			return 1;
+		}
+		else if (input == NULL) input = arg;
+		else if (output == NULL) output = arg;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+		continue;
+
+unknown_value:
+		ERROR("Invalid value for %s : %s\n", arg, value);
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (input == NULL || (output == NULL && bench_repetitions == 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	struct source_image image;
+	int ret;
+	if (has_suffix(input, ".png")) {
+#if defined(MYY_TEXCONV_PNG)
+		ret = load_png(input, &image);
+#else
+		ERROR("PNG support was not compiled in (libpng not found)\n");
+		ret = -1;
+#endif
+	}
+	else ret = load_bmp(input, from, &image);
+	if (ret) return 1;
+
+	uint32_t * __restrict const row =
+		malloc((size_t) (image.width ? image.width : 1) * sizeof(uint32_t));
+	uint8_t * __restrict const converted = malloc(
+		(size_t) image.width * image.height * to->bytes_per_pixel + 1);
+
+	if (row && converted) {
+		if (bench_repetitions)
+			ret = benchmark(&image, to, dither, bench_repetitions, row,
+				converted);
+		if (output && ret == 0) {
+			convert_image(&image, to, kernel, dither, row, converted);
+			ret = write_raw_texture(output, &image, to, converted);
+		}
+	}
+	else {
+		ERROR("Not enough memory to convert %s\n", input);
+		ret = -1;
+	}
+
+	free(converted);
+	free(row);
+	free(image.data);
+	return ret ? 1 : 0;
+}